@@ -24,7 +24,9 @@ filename ("D3D12Sample_" .. _SUFFIX)
 targetdir "../bin"
 objdir "../build/Desktop_%{_SUFFIX}/%{cfg.platform}/%{cfg.buildcfg}"
 floatingpoint "Fast"
-files { "../src/*.h", "../src/*.cpp" }
+files {
+    "../src/*.h", "../src/*.cpp",
+    "../src/D3D12MAReplay/Replayer.h", "../src/D3D12MAReplay/Replayer.cpp" }
 flags { "NoPCH", "FatalWarnings" }
 characterset "Unicode"
 
@@ -48,3 +50,40 @@ buildoptions { "/MDd" }
 
 filter { "configurations:Release", "platforms:Windows-x64" }
 buildoptions { "/MD" }
+
+
+project "D3D12MAReplay"
+kind "ConsoleApp"
+language "C++"
+location "../build"
+filename ("D3D12MAReplay_" .. _SUFFIX)
+targetdir "../bin"
+objdir "../build/Desktop_%{_SUFFIX}/%{cfg.platform}/%{cfg.buildcfg}/D3D12MAReplay"
+floatingpoint "Fast"
+files {
+    "../src/D3D12MAReplay/*.h", "../src/D3D12MAReplay/*.cpp",
+    "../src/D3D12MemAlloc.h", "../src/D3D12MemAlloc.cpp",
+    "../src/SoftwareDevice.h", "../src/SoftwareDevice.cpp",
+    "../src/Common.h" }
+flags { "NoPCH", "FatalWarnings" }
+characterset "Unicode"
+
+filter "configurations:Debug"
+defines { "_DEBUG", "DEBUG" }
+flags { }
+targetsuffix ("_Debug_" .. _SUFFIX)
+
+filter "configurations:Release"
+defines { "NDEBUG" }
+optimize "On"
+flags { "LinkTimeOptimization" }
+targetsuffix ("_Release_" .. _SUFFIX)
+
+filter { "platforms:x64" }
+defines { "WIN32", "_CONSOLE", "PROFILE", "_WINDOWS", "_WIN32_WINNT=0x0601" }
+
+filter { "configurations:Debug", "platforms:x64" }
+buildoptions { "/MDd" }
+
+filter { "configurations:Release", "platforms:Windows-x64" }
+buildoptions { "/MD" }
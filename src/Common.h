@@ -46,6 +46,7 @@
 #include <cassert>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <cstdarg>
 
 typedef std::chrono::high_resolution_clock::time_point time_point;
@@ -0,0 +1,77 @@
+//
+// Copyright (c) 2019 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+/*
+Command line tool replaying a file recorded with ALLOCATOR_DESC::pRecordSettings.
+See "\page record_and_replay" in D3D12MemAlloc.h.
+*/
+
+#include "Replayer.h"
+
+static const char* const USAGE =
+    "Usage: D3D12MAReplay <TraceFile> [Options]\n"
+    "Options:\n"
+    "    --Tier <1|2>          Resource heap tier of the device. Default: as recorded.\n"
+    "    --BlockSize <Bytes>   ALLOCATOR_DESC::PreferredBlockSize. Default: as recorded.\n"
+    "    --Latency <Us>        Latency of creating heaps and resources on the device, in microseconds. Default: 0.\n"
+    "    --Timing              Keep time intervals between calls as recorded.\n";
+
+static bool ParseCommandLine(int argc, char** argv, ReplayConfig& outConfig)
+{
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--Tier") == 0 && i + 1 < argc)
+        {
+            outConfig.resourceHeapTier = (UINT)strtoul(argv[++i], NULL, 10);
+            if(outConfig.resourceHeapTier != 1 && outConfig.resourceHeapTier != 2)
+                return false;
+        }
+        else if(strcmp(argv[i], "--BlockSize") == 0 && i + 1 < argc)
+            outConfig.preferredBlockSize = strtoull(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "--Latency") == 0 && i + 1 < argc)
+            outConfig.latency = (UINT)strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "--Timing") == 0)
+            outConfig.timing = true;
+        else if(argv[i][0] != '-' && outConfig.filePath == nullptr)
+            outConfig.filePath = argv[i];
+        else
+            return false;
+    }
+    return outConfig.filePath != nullptr;
+}
+
+int main(int argc, char** argv)
+{
+    ReplayConfig config;
+    if(!ParseCommandLine(argc, argv, config))
+    {
+        printf("%s", USAGE);
+        return 2;
+    }
+
+    Replayer replayer(config);
+    const int result = replayer.Run();
+    if(result == 0)
+        replayer.PrintStats();
+    return result;
+}
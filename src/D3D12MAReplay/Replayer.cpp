@@ -0,0 +1,443 @@
+//
+// Copyright (c) 2019 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "Replayer.h"
+#include <thread>
+
+static const UINT TRACE_VERSION = 4;
+
+bool TraceReader::Load(const char* filePath)
+{
+    FILE* file = nullptr;
+#ifdef _MSC_VER
+    if(fopen_s(&file, filePath, "rb") != 0)
+        file = nullptr;
+#else
+    file = fopen(filePath, "rb");
+#endif
+    if(!file)
+        return false;
+    char buf[65536];
+    size_t readCount;
+    while((readCount = fread(buf, 1, sizeof(buf), file)) > 0)
+        m_Data.insert(m_Data.end(), buf, buf + readCount);
+    fclose(file);
+    m_Offset = 0;
+    return true;
+}
+
+Replayer::~Replayer()
+{
+    for(auto& it : m_Allocations)
+    {
+        it.second.resource.Release();
+        it.second.allocation->Release();
+    }
+    m_Allocations.clear();
+    if(m_Allocator)
+        m_Allocator->Release();
+}
+
+bool Replayer::Init()
+{
+    if(!m_Reader.Load(m_Config.filePath))
+    {
+        printf("ERROR: Cannot open file \"%s\".\n", m_Config.filePath);
+        return false;
+    }
+
+    char magic[8];
+    UINT32 version = 0, resourceHeapTier = 0, allocatorFlags = 0, nodeCount = 0;
+    UINT64 preferredBlockSize = 0;
+    if(!m_Reader.Read(magic) || memcmp(magic, "D3D12MAR", 8) != 0 ||
+        !m_Reader.Read(version) || !m_Reader.Read(resourceHeapTier) ||
+        !m_Reader.Read(allocatorFlags) || !m_Reader.Read(preferredBlockSize) || !m_Reader.Read(nodeCount))
+    {
+        printf("ERROR: Not a D3D12MA trace file.\n");
+        return false;
+    }
+    if(version != TRACE_VERSION)
+    {
+        printf("ERROR: Unsupported trace version %u.\n", version);
+        return false;
+    }
+
+    SoftwareDeviceDesc deviceDesc = {};
+    deviceDesc.ResourceHeapTier = (D3D12_RESOURCE_HEAP_TIER)(m_Config.resourceHeapTier ?
+        m_Config.resourceHeapTier : resourceHeapTier);
+    deviceDesc.NodeCount = nodeCount;
+    deviceDesc.CreateHeapLatency = m_Config.latency;
+    deviceDesc.CreatePlacedResourceLatency = m_Config.latency;
+    deviceDesc.CreateCommittedResourceLatency = m_Config.latency;
+    if(FAILED(CreateSoftwareDevice(deviceDesc, &m_Device)))
+    {
+        printf("ERROR: Cannot create software device with ResourceHeapTier = %u.\n", (UINT)deviceDesc.ResourceHeapTier);
+        return false;
+    }
+
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.Flags = (D3D12MA::ALLOCATOR_FLAGS)allocatorFlags;
+    allocatorDesc.pDevice = m_Device;
+    allocatorDesc.PreferredBlockSize = m_Config.preferredBlockSize ? m_Config.preferredBlockSize : preferredBlockSize;
+    if(FAILED(D3D12MA::CreateAllocator(&allocatorDesc, &m_Allocator)))
+    {
+        printf("ERROR: Cannot create allocator.\n");
+        return false;
+    }
+
+    m_ResourceHeapTier = (UINT)deviceDesc.ResourceHeapTier;
+    m_PreferredBlockSize = allocatorDesc.PreferredBlockSize;
+    m_NodeCount = nodeCount;
+    return true;
+}
+
+int Replayer::Run()
+{
+    if(!Init())
+        return 1;
+
+    m_StartTime = std::chrono::high_resolution_clock::now();
+    while(!m_Reader.IsEnd())
+    {
+        RecordHeader header;
+        if(!m_Reader.Read(header.type) || !m_Reader.Read(header.threadId) || !m_Reader.Read(header.time) ||
+            !m_Reader.Read(header.duration) || !m_Reader.Read(header.allocation))
+        {
+            printf("ERROR: Truncated record.\n");
+            return 1;
+        }
+
+        if(m_Config.timing)
+        {
+            std::this_thread::sleep_until(m_StartTime + std::chrono::nanoseconds(header.time));
+        }
+
+        bool success = false;
+        switch(header.type)
+        {
+        case RECORD_TYPE_CREATE_RESOURCE:
+            success = ReplayCreateResource(header);
+            break;
+        case RECORD_TYPE_RELEASE_ALLOCATION:
+            success = ReplayReleaseAllocation(header);
+            break;
+        case RECORD_TYPE_SET_ALLOCATION_NAME:
+            success = ReplaySetAllocationName(header);
+            break;
+        case RECORD_TYPE_ALLOCATE_BUFFER_RANGE:
+            success = ReplayAllocateBufferRange(header);
+            break;
+        case RECORD_TYPE_SET_CATEGORY_QUOTA:
+            success = ReplaySetCategoryQuota();
+            break;
+        default:
+            printf("ERROR: Unknown record type %u.\n", header.type);
+            break;
+        }
+        if(!success)
+            return 1;
+
+        ++m_RecordCount[header.type];
+        ++m_RecordCountPerThread[header.threadId];
+        m_RecordedDuration += header.duration;
+    }
+
+    return 0;
+}
+
+bool Replayer::ReadAllocationDesc(D3D12MA::ALLOCATION_DESC& outAllocDesc)
+{
+    UINT32 heapType, allocFlags, lifetime, creationNodeMask, visibleNodeMask, category;
+    if(!m_Reader.Read(heapType) || !m_Reader.Read(allocFlags) || !m_Reader.Read(lifetime) ||
+        !m_Reader.Read(creationNodeMask) || !m_Reader.Read(visibleNodeMask) || !m_Reader.Read(category))
+    {
+        return false;
+    }
+    outAllocDesc = {};
+    outAllocDesc.HeapType = (D3D12_HEAP_TYPE)heapType;
+    outAllocDesc.Flags = (D3D12MA::ALLOCATION_FLAGS)allocFlags;
+    outAllocDesc.Lifetime = (D3D12MA::ALLOCATION_LIFETIME)lifetime;
+    outAllocDesc.CreationNodeMask = creationNodeMask;
+    outAllocDesc.VisibleNodeMask = visibleNodeMask;
+    outAllocDesc.Category = category;
+    return true;
+}
+
+bool Replayer::ReplayCreateResource(const RecordHeader& header)
+{
+    INT32 recordedResult;
+    D3D12MA::ALLOCATION_DESC allocDesc;
+    UINT32 dimension, height, format, sampleCount, sampleQuality, layout, resourceFlags;
+    UINT16 depthOrArraySize, mipLevels;
+    UINT64 hash, alignment, width, size, sizeAlignment, recordedHeap, recordedOffset;
+    if(!m_Reader.Read(recordedResult) || !ReadAllocationDesc(allocDesc) ||
+        !m_Reader.Read(hash) || !m_Reader.Read(dimension) || !m_Reader.Read(alignment) ||
+        !m_Reader.Read(width) || !m_Reader.Read(height) || !m_Reader.Read(depthOrArraySize) ||
+        !m_Reader.Read(mipLevels) || !m_Reader.Read(format) || !m_Reader.Read(sampleCount) ||
+        !m_Reader.Read(sampleQuality) || !m_Reader.Read(layout) || !m_Reader.Read(resourceFlags) ||
+        !m_Reader.Read(size) || !m_Reader.Read(sizeAlignment) || !m_Reader.Read(recordedHeap) ||
+        !m_Reader.Read(recordedOffset))
+    {
+        printf("ERROR: Truncated CreateResource record.\n");
+        return false;
+    }
+    m_ResourceDescHashes.insert(hash);
+
+    D3D12_RESOURCE_DESC resourceDesc = {};
+    resourceDesc.Dimension = (D3D12_RESOURCE_DIMENSION)dimension;
+    resourceDesc.Alignment = alignment;
+    resourceDesc.Width = width;
+    resourceDesc.Height = height;
+    resourceDesc.DepthOrArraySize = depthOrArraySize;
+    resourceDesc.MipLevels = mipLevels;
+    resourceDesc.Format = (DXGI_FORMAT)format;
+    resourceDesc.SampleDesc.Count = sampleCount;
+    resourceDesc.SampleDesc.Quality = sampleQuality;
+    resourceDesc.Layout = (D3D12_TEXTURE_LAYOUT)layout;
+    resourceDesc.Flags = (D3D12_RESOURCE_FLAGS)resourceFlags;
+
+    D3D12_RESOURCE_STATES initialState;
+    switch(allocDesc.HeapType)
+    {
+    case D3D12_HEAP_TYPE_UPLOAD:
+        initialState = D3D12_RESOURCE_STATE_GENERIC_READ;
+        break;
+    case D3D12_HEAP_TYPE_READBACK:
+        initialState = D3D12_RESOURCE_STATE_COPY_DEST;
+        break;
+    default:
+        initialState = D3D12_RESOURCE_STATE_COMMON;
+        break;
+    }
+
+    ReplayedAllocation replayedAlloc = {};
+    const time_point beginTime = std::chrono::high_resolution_clock::now();
+    const HRESULT hr = m_Allocator->CreateResource(&allocDesc, &resourceDesc, initialState, NULL,
+        &replayedAlloc.allocation, IID_PPV_ARGS(&replayedAlloc.resource));
+    m_ReplayedDuration += std::chrono::high_resolution_clock::now() - beginTime;
+
+    if(SUCCEEDED(hr) != SUCCEEDED(recordedResult))
+        ++m_CreateResultMismatchCount;
+    if(FAILED(hr))
+        return true;
+
+    AddAllocation(header, recordedHeap, recordedOffset, replayedAlloc);
+    return true;
+}
+
+bool Replayer::ReplayAllocateBufferRange(const RecordHeader& header)
+{
+    INT32 recordedResult;
+    D3D12MA::ALLOCATION_DESC allocDesc;
+    UINT64 size, alignment, recordedHeap, recordedOffset;
+    if(!m_Reader.Read(recordedResult) || !ReadAllocationDesc(allocDesc) || !m_Reader.Read(size) ||
+        !m_Reader.Read(alignment) || !m_Reader.Read(recordedHeap) || !m_Reader.Read(recordedOffset))
+    {
+        printf("ERROR: Truncated AllocateBufferRange record.\n");
+        return false;
+    }
+
+    ReplayedAllocation replayedAlloc = {};
+    const time_point beginTime = std::chrono::high_resolution_clock::now();
+    const HRESULT hr = m_Allocator->AllocateBufferRange(&allocDesc, size, alignment, &replayedAlloc.allocation);
+    m_ReplayedDuration += std::chrono::high_resolution_clock::now() - beginTime;
+
+    if(SUCCEEDED(hr) != SUCCEEDED(recordedResult))
+        ++m_CreateResultMismatchCount;
+    if(FAILED(hr))
+        return true;
+
+    AddAllocation(header, recordedHeap, recordedOffset, replayedAlloc);
+    return true;
+}
+
+void Replayer::AddAllocation(const RecordHeader& header, UINT64 recordedHeap, UINT64 recordedOffset,
+    ReplayedAllocation& replayedAlloc)
+{
+    if(header.allocation == 0)
+    {
+        // Failed when recorded, so nothing can refer to it.
+        replayedAlloc.resource.Release();
+        replayedAlloc.allocation->Release();
+        return;
+    }
+
+    if(!RegisterPlacement(recordedHeap, recordedOffset, replayedAlloc.allocation))
+        ++m_PlacementMismatchCount;
+    replayedAlloc.recordedHeap = recordedHeap;
+
+    // Address of a released allocation can be reused by a new one, so an existing entry is stale.
+    auto it = m_Allocations.find(header.allocation);
+    if(it != m_Allocations.end())
+    {
+        ++m_UnknownAllocationCount;
+        UnregisterPlacement(it->second);
+        it->second.resource.Release();
+        it->second.allocation->Release();
+        m_Allocations.erase(it);
+    }
+    m_Allocations.emplace(header.allocation, std::move(replayedAlloc));
+}
+
+bool Replayer::ReplayReleaseAllocation(const RecordHeader& header)
+{
+    auto it = m_Allocations.find(header.allocation);
+    if(it == m_Allocations.end())
+    {
+        // E.g. allocation released internally by a failed CreateResource.
+        ++m_UnknownAllocationCount;
+        return true;
+    }
+
+    UnregisterPlacement(it->second);
+    const time_point beginTime = std::chrono::high_resolution_clock::now();
+    it->second.resource.Release();
+    it->second.allocation->Release();
+    m_ReplayedDuration += std::chrono::high_resolution_clock::now() - beginTime;
+    m_Allocations.erase(it);
+    return true;
+}
+
+bool Replayer::ReplaySetAllocationName(const RecordHeader& header)
+{
+    UINT32 charCount;
+    if(!m_Reader.Read(charCount))
+    {
+        printf("ERROR: Truncated SetName record.\n");
+        return false;
+    }
+    std::wstring name;
+    if(charCount != UINT32_MAX)
+    {
+        name.resize(charCount);
+        for(UINT32 i = 0; i < charCount; ++i)
+        {
+            UINT16 ch;
+            if(!m_Reader.Read(ch))
+            {
+                printf("ERROR: Truncated SetName record.\n");
+                return false;
+            }
+            name[i] = (wchar_t)ch;
+        }
+    }
+
+    auto it = m_Allocations.find(header.allocation);
+    if(it == m_Allocations.end())
+    {
+        ++m_UnknownAllocationCount;
+        return true;
+    }
+    const time_point beginTime = std::chrono::high_resolution_clock::now();
+    it->second.allocation->SetName(charCount != UINT32_MAX ? name.c_str() : NULL);
+    m_ReplayedDuration += std::chrono::high_resolution_clock::now() - beginTime;
+    return true;
+}
+
+bool Replayer::ReplaySetCategoryQuota()
+{
+    UINT32 category;
+    UINT64 maxBytes;
+    if(!m_Reader.Read(category) || !m_Reader.Read(maxBytes))
+    {
+        printf("ERROR: Truncated SetCategoryQuota record.\n");
+        return false;
+    }
+    if(category >= D3D12MA::ALLOCATION_CATEGORY_COUNT)
+    {
+        printf("ERROR: Invalid category %u.\n", category);
+        return false;
+    }
+    m_Allocator->SetCategoryQuota(category, maxBytes);
+    return true;
+}
+
+bool Replayer::RegisterPlacement(UINT64 recordedHeap, UINT64 recordedOffset, const D3D12MA::Allocation* allocation)
+{
+    ID3D12Heap* const replayedHeap = allocation->GetHeap();
+    if(recordedHeap == 0 || replayedHeap == NULL)
+    {
+        // Committed in one of them at least.
+        return recordedHeap == 0 && replayedHeap == NULL;
+    }
+
+    ++m_RecordedHeapAllocationCount[recordedHeap];
+    bool match = allocation->GetOffset() == recordedOffset;
+    auto recordedIt = m_RecordedToReplayedHeap.find(recordedHeap);
+    auto replayedIt = m_ReplayedToRecordedHeap.find(replayedHeap);
+    if(recordedIt == m_RecordedToReplayedHeap.end() && replayedIt == m_ReplayedToRecordedHeap.end())
+    {
+        m_RecordedToReplayedHeap[recordedHeap] = replayedHeap;
+        m_ReplayedToRecordedHeap[replayedHeap] = recordedHeap;
+    }
+    else if(recordedIt == m_RecordedToReplayedHeap.end() || recordedIt->second != replayedHeap)
+    {
+        match = false;
+    }
+    return match;
+}
+
+void Replayer::UnregisterPlacement(const ReplayedAllocation& replayedAlloc)
+{
+    if(replayedAlloc.recordedHeap == 0)
+        return;
+    auto countIt = m_RecordedHeapAllocationCount.find(replayedAlloc.recordedHeap);
+    if(countIt == m_RecordedHeapAllocationCount.end() || --countIt->second > 0)
+        return;
+    // Recorded heap became empty, so its address may later belong to a different heap.
+    m_RecordedHeapAllocationCount.erase(countIt);
+    auto recordedIt = m_RecordedToReplayedHeap.find(replayedAlloc.recordedHeap);
+    if(recordedIt != m_RecordedToReplayedHeap.end())
+    {
+        m_ReplayedToRecordedHeap.erase(recordedIt->second);
+        m_RecordedToReplayedHeap.erase(recordedIt);
+    }
+}
+
+void Replayer::PrintStats()
+{
+    SoftwareDeviceStats deviceStats = {};
+    GetSoftwareDeviceStats(m_Device, deviceStats);
+
+    printf("Trace: %s\n", m_Config.filePath);
+    printf("ResourceHeapTier: %u\n", m_ResourceHeapTier);
+    printf("PreferredBlockSize: %llu\n", m_PreferredBlockSize);
+    printf("NodeCount: %u\n", m_NodeCount);
+    printf("Threads: %zu\n", m_RecordCountPerThread.size());
+    printf("CreateResource calls: %zu\n", m_RecordCount[RECORD_TYPE_CREATE_RESOURCE]);
+    printf("Allocation::Release calls: %zu\n", m_RecordCount[RECORD_TYPE_RELEASE_ALLOCATION]);
+    printf("AllocateBufferRange calls: %zu\n", m_RecordCount[RECORD_TYPE_ALLOCATE_BUFFER_RANGE]);
+    printf("Allocation::SetName calls: %zu\n", m_RecordCount[RECORD_TYPE_SET_ALLOCATION_NAME]);
+    printf("SetCategoryQuota calls: %zu\n", m_RecordCount[RECORD_TYPE_SET_CATEGORY_QUOTA]);
+    printf("Distinct resource descs: %zu\n", m_ResourceDescHashes.size());
+    printf("Result mismatches: %zu\n", m_CreateResultMismatchCount);
+    printf("Placement mismatches: %zu\n", m_PlacementMismatchCount);
+    printf("Unknown allocations: %zu\n", m_UnknownAllocationCount);
+    printf("Recorded time in calls (ms): %.3f\n", (double)m_RecordedDuration * 1e-6);
+    printf("Replayed time in calls (ms): %.3f\n",
+        std::chrono::duration<double, std::milli>(m_ReplayedDuration).count());
+    printf("Heaps created: %llu\n", deviceStats.CreateHeapCount);
+    printf("Committed resources created: %llu\n", deviceStats.CreateCommittedResourceCount);
+    printf("Max device memory used (bytes): %llu\n", deviceStats.MaxUsedBytes);
+    printf("Device memory used at end (bytes): %llu\n", deviceStats.UsedBytes);
+}
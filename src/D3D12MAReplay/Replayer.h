@@ -0,0 +1,145 @@
+//
+// Copyright (c) 2019 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "../D3D12MemAlloc.h"
+#include "../SoftwareDevice.h"
+#include <unordered_map>
+#include <unordered_set>
+
+/*
+Replays a file recorded with ALLOCATOR_DESC::pRecordSettings on a fresh allocator
+created for a software stand-in device. Used by the D3D12MAReplay tool and by the tests.
+See "\page record_and_replay" in D3D12MemAlloc.h.
+*/
+
+enum RECORD_TYPE
+{
+    RECORD_TYPE_CREATE_RESOURCE = 1,
+    RECORD_TYPE_RELEASE_ALLOCATION = 2,
+    RECORD_TYPE_SET_ALLOCATION_NAME = 3,
+    RECORD_TYPE_ALLOCATE_BUFFER_RANGE = 4,
+    RECORD_TYPE_SET_CATEGORY_QUOTA = 5,
+    RECORD_TYPE_COUNT
+};
+
+struct ReplayConfig
+{
+    const char* filePath = nullptr;
+    UINT resourceHeapTier = 0; // 0 = as recorded.
+    UINT64 preferredBlockSize = 0; // 0 = as recorded.
+    UINT latency = 0;
+    bool timing = false;
+};
+
+// Sequential reader of the whole trace file loaded to memory.
+class TraceReader
+{
+public:
+    bool Load(const char* filePath);
+    bool IsEnd() const { return m_Offset == m_Data.size(); }
+    // Returns false if there are not enough bytes left.
+    template<typename T> bool Read(T& outValue)
+    {
+        if(m_Data.size() - m_Offset < sizeof(T))
+            return false;
+        memcpy(&outValue, m_Data.data() + m_Offset, sizeof(T));
+        m_Offset += sizeof(T);
+        return true;
+    }
+
+private:
+    std::vector<char> m_Data;
+    size_t m_Offset = 0;
+};
+
+struct RecordHeader
+{
+    UINT32 type;
+    UINT32 threadId;
+    UINT64 time;
+    UINT64 duration;
+    UINT64 allocation;
+};
+
+struct ReplayedAllocation
+{
+    D3D12MA::Allocation* allocation;
+    CComPtr<ID3D12Resource> resource;
+    UINT64 recordedHeap;
+};
+
+class Replayer
+{
+public:
+    Replayer(const ReplayConfig& config) : m_Config(config) { }
+    ~Replayer();
+    // Returns 0 on success.
+    int Run();
+    void PrintStats();
+
+    size_t GetCreateResultMismatchCount() const { return m_CreateResultMismatchCount; }
+    size_t GetPlacementMismatchCount() const { return m_PlacementMismatchCount; }
+
+private:
+    const ReplayConfig m_Config;
+    TraceReader m_Reader;
+    CComPtr<ID3D12Device> m_Device;
+    D3D12MA::Allocator* m_Allocator = nullptr;
+    UINT m_ResourceHeapTier = 0;
+    UINT64 m_PreferredBlockSize = 0;
+    UINT m_NodeCount = 0;
+    time_point m_StartTime;
+
+    // Keys are addresses of allocations and heaps from the trace.
+    std::unordered_map<UINT64, ReplayedAllocation> m_Allocations;
+    // Recorded heap <-> replayed heap, while any allocation lives in it.
+    std::unordered_map<UINT64, ID3D12Heap*> m_RecordedToReplayedHeap;
+    std::unordered_map<ID3D12Heap*, UINT64> m_ReplayedToRecordedHeap;
+    std::unordered_map<UINT64, size_t> m_RecordedHeapAllocationCount;
+    std::unordered_set<UINT64> m_ResourceDescHashes;
+
+    std::unordered_map<UINT32, size_t> m_RecordCountPerThread;
+    size_t m_RecordCount[RECORD_TYPE_COUNT] = {};
+    size_t m_CreateResultMismatchCount = 0;
+    size_t m_PlacementMismatchCount = 0;
+    size_t m_UnknownAllocationCount = 0;
+    UINT64 m_RecordedDuration = 0; // ns
+    duration m_ReplayedDuration = duration::zero();
+
+    bool Init();
+    // Reads the part of ALLOCATION_DESC common to CreateResource and AllocateBufferRange records.
+    bool ReadAllocationDesc(D3D12MA::ALLOCATION_DESC& outAllocDesc);
+    bool ReplayCreateResource(const RecordHeader& header);
+    bool ReplayAllocateBufferRange(const RecordHeader& header);
+    // Registers the replayed allocation under the recorded address and checks its placement.
+    void AddAllocation(const RecordHeader& header, UINT64 recordedHeap, UINT64 recordedOffset,
+        ReplayedAllocation& replayedAlloc);
+    bool ReplayReleaseAllocation(const RecordHeader& header);
+    bool ReplaySetAllocationName(const RecordHeader& header);
+    bool ReplaySetCategoryQuota();
+    // Returns false if placement of the replayed allocation doesn't match the recorded one.
+    bool RegisterPlacement(UINT64 recordedHeap, UINT64 recordedOffset, const D3D12MA::Allocation* allocation);
+    void UnregisterPlacement(const ReplayedAllocation& replayedAlloc);
+};
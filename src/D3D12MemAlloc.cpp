@@ -26,7 +26,15 @@
 #include <atomic>
 #include <algorithm>
 #include <cstdlib>
-#include <malloc.h> // for _aligned_malloc, _aligned_free
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <chrono>
+#ifdef _WIN32
+    #include <malloc.h> // for _aligned_malloc, _aligned_free
+#else
+    #include <shared_mutex>
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -86,6 +94,71 @@
    #define D3D12MA_DEFAULT_BLOCK_SIZE (256ull * 1024 * 1024)
 #endif
 
+#ifndef D3D12MA_SINGLE_THREADED
+    /*
+    Set this to 1 if every allocator and all objects created from it are used from only
+    one thread at a time, like with ALLOCATOR_FLAG_SINGLETHREADED. Internal mutexes are then
+    never locked and the code locking them is compiled out, instead of being skipped at runtime.
+    */
+    #define D3D12MA_SINGLE_THREADED (0)
+#endif
+
+#ifndef D3D12MA_RECORDING_ENABLED
+    /*
+    Set this to 1 to enable recording of calls to the library to a file,
+    requested with ALLOCATOR_DESC::pRecordSettings.
+    It adds a dependency on file I/O of the C runtime.
+    */
+    #define D3D12MA_RECORDING_ENABLED (0)
+#endif
+
+#ifndef D3D12MA_LOCK_STATS
+    /*
+    Set this to 1 to count acquisitions of internal mutexes and time spent waiting
+    for them and holding them, returned by Allocator::GetLockStats.
+    It makes every lock slower.
+    */
+    #define D3D12MA_LOCK_STATS (0)
+#endif
+
+#ifndef D3D12MA_LATENCY_HISTOGRAMS
+    /*
+    Set this to 1 to measure durations of calls to the library and to ID3D12Device,
+    returned by Allocator::GetLatencyStats.
+    */
+    #define D3D12MA_LATENCY_HISTOGRAMS (0)
+#endif
+
+#ifndef D3D12MA_TRACE_EVENTS
+    /*
+    Set this to 1 to record begin and end of operations of the library, waits for its
+    internal mutexes and calls to ID3D12Device in memory, returned in Chrome trace-event
+    format by Allocator::BuildTraceString.
+    */
+    #define D3D12MA_TRACE_EVENTS (0)
+#endif
+
+#ifndef D3D12MA_USE_SMALL_RESOURCE_PLACEMENT_ALIGNMENT
+    /*
+    Set this to 0 to disable placing small textures with D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT
+    in Allocator::CreateResource, so every resource uses the alignment reported for its desc as given.
+    */
+    #define D3D12MA_USE_SMALL_RESOURCE_PLACEMENT_ALIGNMENT (1)
+#endif
+
+#ifndef D3D12MA_CREATE_NOT_ZEROED_AVAILABLE
+    /*
+    1 if Direct3D 12 headers declare D3D12_HEAP_FLAG_CREATE_NOT_ZEROED and
+    D3D12_FEATURE_D3D12_OPTIONS7, used by ALLOCATOR_FLAG_CREATE_NOT_ZEROED_HEAPS.
+    When 0, the flag is ignored.
+    */
+    #ifdef __ID3D12Device8_INTERFACE_DEFINED__
+        #define D3D12MA_CREATE_NOT_ZEROED_AVAILABLE (1)
+    #else
+        #define D3D12MA_CREATE_NOT_ZEROED_AVAILABLE (0)
+    #endif
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -94,6 +167,31 @@
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
+#if D3D12MA_RECORDING_ENABLED
+    #include <cstdio>
+    #ifndef _WIN32
+        #include <thread>
+        #include <functional>
+    #endif
+#endif
+
+#if D3D12MA_LATENCY_HISTOGRAMS
+    #ifndef _WIN32
+        #include <thread>
+        #include <functional>
+    #endif
+#endif
+
+#if D3D12MA_TRACE_EVENTS
+    #include <cstdio>
+    #ifndef _WIN32
+        #include <thread>
+        #include <functional>
+    #endif
+#endif
+
+// Internal mutexes are locked with a try first, to measure waiting for them.
+#define D3D12MA_INSTRUMENTED_MUTEXES (D3D12MA_LOCK_STATS || D3D12MA_TRACE_EVENTS)
 
 namespace D3D12MA
 {
@@ -101,6 +199,7 @@ namespace D3D12MA
 ////////////////////////////////////////////////////////////////////////////////
 // Private globals - CPU memory allocation
 
+#ifdef _WIN32
 static void* DefaultAllocate(size_t Size, size_t Alignment, void* /*pUserData*/)
 {
     return _aligned_malloc(Size, Alignment);
@@ -109,6 +208,19 @@ static void DefaultFree(void* pMemory, void* /*pUserData*/)
 {
     return _aligned_free(pMemory);
 }
+#else
+static void* DefaultAllocate(size_t Size, size_t Alignment, void* /*pUserData*/)
+{
+    // aligned_alloc requires size to be a multiple of alignment. Some platforms
+    // also reject alignment smaller than pointer size.
+    const size_t alignment = Alignment < sizeof(void*) ? sizeof(void*) : Alignment;
+    return aligned_alloc(alignment, (Size + alignment - 1) / alignment * alignment);
+}
+static void DefaultFree(void* pMemory, void* /*pUserData*/)
+{
+    free(pMemory);
+}
+#endif
 
 static void* Malloc(const ALLOCATION_CALLBACKS& allocs, size_t size, size_t alignment)
 {
@@ -122,12 +234,12 @@ static void Free(const ALLOCATION_CALLBACKS& allocs, void* memory)
 template<typename T>
 static T* Allocate(const ALLOCATION_CALLBACKS& allocs)
 {
-    return (T*)Malloc(allocs, sizeof(T), __alignof(T));
+    return (T*)Malloc(allocs, sizeof(T), alignof(T));
 }
 template<typename T>
 static T* AllocateArray(const ALLOCATION_CALLBACKS& allocs, size_t count)
 {
-    return (T*)Malloc(allocs, sizeof(T) * count, __alignof(T));
+    return (T*)Malloc(allocs, sizeof(T) * count, alignof(T));
 }
 
 #define D3D12MA_NEW(allocs, type) new(D3D12MA::Allocate<type>(allocs))(type)
@@ -155,11 +267,11 @@ static void D3D12MA_DELETE_ARRAY(const ALLOCATION_CALLBACKS& allocs, T* memory,
     }
 }
 
-static void SetupAllocationCallbacks(ALLOCATION_CALLBACKS& outAllocs, const ALLOCATOR_DESC& allocatorDesc)
+static void SetupAllocationCallbacks(ALLOCATION_CALLBACKS& outAllocs, const ALLOCATION_CALLBACKS* allocationCallbacks)
 {
-    if(allocatorDesc.pAllocationCallbacks)
+    if(allocationCallbacks)
     {
-        outAllocs = *allocatorDesc.pAllocationCallbacks;
+        outAllocs = *allocationCallbacks;
         D3D12MA_ASSERT(outAllocs.pAllocate != NULL && outAllocs.pFree != NULL);
     }
     else
@@ -201,17 +313,21 @@ static inline void D3D12MA_SWAP(T& a, T& b)
     public:
         void Lock() { m_Mutex.lock(); }
         void Unlock() { m_Mutex.unlock(); }
+#if D3D12MA_INSTRUMENTED_MUTEXES
+        bool TryLock() { return m_Mutex.try_lock(); }
+#endif
     private:
         std::mutex m_Mutex;
     };
     #define D3D12MA_MUTEX Mutex
 #endif
 
-#if !defined(_WIN32) || !defined(WINVER) || WINVER < 0x0600
+#if defined(_WIN32) && (!defined(WINVER) || WINVER < 0x0600)
     #error Required at least WinAPI version supporting: client = Windows Vista, server = Windows Server 2008.
 #endif
 
 #ifndef D3D12MA_RW_MUTEX
+#ifdef _WIN32
     class RWMutex
     {
     public:
@@ -220,9 +336,29 @@ static inline void D3D12MA_SWAP(T& a, T& b)
         void UnlockRead() { ReleaseSRWLockShared(&m_Lock); }
         void LockWrite() { AcquireSRWLockExclusive(&m_Lock); }
         void UnlockWrite() { ReleaseSRWLockExclusive(&m_Lock); }
+#if D3D12MA_INSTRUMENTED_MUTEXES
+        bool TryLockRead() { return TryAcquireSRWLockShared(&m_Lock) != FALSE; }
+        bool TryLockWrite() { return TryAcquireSRWLockExclusive(&m_Lock) != FALSE; }
+#endif
     private:
         SRWLOCK m_Lock;
     };
+#else
+    class RWMutex
+    {
+    public:
+        void LockRead() { m_Mutex.lock_shared(); }
+        void UnlockRead() { m_Mutex.unlock_shared(); }
+        void LockWrite() { m_Mutex.lock(); }
+        void UnlockWrite() { m_Mutex.unlock(); }
+#if D3D12MA_INSTRUMENTED_MUTEXES
+        bool TryLockRead() { return m_Mutex.try_lock_shared(); }
+        bool TryLockWrite() { return m_Mutex.try_lock(); }
+#endif
+    private:
+        std::shared_mutex m_Mutex;
+    };
+#endif
     #define D3D12MA_RW_MUTEX RWMutex
 #endif
 
@@ -238,6 +374,16 @@ If providing your own implementation, you need to implement a subset of std::ato
     #define D3D12MA_ATOMIC_UINT32 std::atomic<UINT>
 #endif
 
+/*
+Same for 64-bit counters, which additionally need:
+
+- UINT64 operator++()
+- UINT64 operator+=(UINT64 arg)
+*/
+#ifndef D3D12MA_ATOMIC_UINT64
+    #define D3D12MA_ATOMIC_UINT64 std::atomic<UINT64>
+#endif
+
 // Aligns given value up to nearest multiply of align value. For example: AlignUp(11, 8) = 16.
 // Use types like UINT, uint64_t as T.
 template <typename T>
@@ -324,27 +470,322 @@ static inline bool StrIsEmpty(const char* pStr)
     return pStr == NULL || *pStr == '\0';
 }
 
+// Current time in nanoseconds, from arbitrary starting point.
+static inline UINT64 GetTimeNanoseconds()
+{
+    return (UINT64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#if D3D12MA_LATENCY_HISTOGRAMS || D3D12MA_TRACE_EVENTS || D3D12MA_RECORDING_ENABLED
+// ID of the calling thread. On other platforms than Windows, threads are numbered from 1
+// in the order they first call this function, so the number is unique in the process.
+static inline UINT GetCurrentThreadIdNumber()
+{
+#ifdef _WIN32
+    return GetCurrentThreadId();
+#else
+    static std::atomic<UINT> nextThreadNumber(1);
+    static thread_local const UINT threadNumber = nextThreadNumber.fetch_add(1, std::memory_order_relaxed);
+    return threadNumber;
+#endif
+}
+#endif
+
+#if D3D12MA_TRACE_EVENTS
+
+// Events recorded internally, in addition to those of TIMED_OPERATION.
+enum TRACE_EVENT
+{
+    // Waiting for an internal mutex locked by another thread.
+    TRACE_EVENT_LOCK_WAIT = TIMED_OPERATION_COUNT,
+    TRACE_EVENT_COUNT
+};
+
+template<typename T>
+class Vector;
+
+/*
+Thread that recorded trace events, created for the calling thread when it first records one.
+When the thread exits, it releases its buffers in all TraceEvents objects.
+*/
+class TraceEventsThread
+{
+public:
+    static TraceEventsThread& GetCurrent();
+    ~TraceEventsThread();
+
+    // Unique in the process and never reused, unlike IDs of threads given by the system.
+    UINT GetNumber() const { return m_Number; }
+    // Slot of this thread in the TraceEvents object it last recorded to, UINT_MAX if it was another one.
+    UINT GetCachedSlot(UINT64 traceEventsId) const { return m_CachedTraceEventsId == traceEventsId ? m_CachedSlot : UINT_MAX; }
+    void SetCachedSlot(UINT64 traceEventsId, UINT slot) { m_CachedTraceEventsId = traceEventsId; m_CachedSlot = slot; }
+
+private:
+    UINT m_Number;
+    UINT64 m_CachedTraceEventsId;
+    UINT m_CachedSlot;
+
+    TraceEventsThread();
+
+    D3D12MA_CLASS_NO_COPY(TraceEventsThread)
+};
+
+/*
+Records events with begin and end time into ring buffers, one per thread, so that
+recording doesn't take any lock. When a ring buffer is full, its oldest events are
+overwritten. BuildJson collects events from all buffers. A thread that exits gives its
+buffer up to the next new thread, keeping its events until BuildJson returns them.
+*/
+class TraceEvents
+{
+public:
+    TraceEvents(const ALLOCATION_CALLBACKS& allocationCallbacks);
+    ~TraceEvents();
+
+    // eventType is TIMED_OPERATION or TRACE_EVENT. Times come from GetTimeNanoseconds.
+    void Add(UINT eventType, UINT64 beginTime, UINT64 endTime);
+    // Removes all recorded events and returns them as null-terminated JSON string,
+    // allocated with allocation callbacks.
+    char* BuildJson();
+
+    // Called when a thread exits. Releases its buffers in all existing TraceEvents objects.
+    static void ReleaseThread(UINT threadNumber);
+
+private:
+    static const UINT MAX_THREAD_COUNT = 64;
+    static const UINT EVENTS_PER_THREAD = 4096;
+    // Limit of events kept from exited threads until BuildJson is called.
+    static const UINT MAX_EXITED_THREAD_EVENT_COUNT = MAX_THREAD_COUNT * EVENTS_PER_THREAD;
+
+    struct Event
+    {
+        UINT64 BeginTime;
+        UINT64 Duration;
+        UINT Type;
+    };
+    struct ThreadBuffer
+    {
+        UINT ThreadId;
+        // Number of events ever added. Incremented only by the owning thread.
+        std::atomic<UINT64> WriteCount;
+        // Number of events already returned by BuildJson. Accessed only under m_BuildMutex.
+        UINT64 ReadCount;
+        Event Events[EVENTS_PER_THREAD];
+    };
+    struct ExitedThreadEvent
+    {
+        Event EventData;
+        UINT ThreadId;
+    };
+    // All existing TraceEvents objects, linked through m_PrevInstance, m_NextInstance.
+    struct InstanceList
+    {
+        D3D12MA_MUTEX ListMutex;
+        TraceEvents* First = NULL;
+        UINT64 NextId = 1;
+    };
+
+    const ALLOCATION_CALLBACKS& m_AllocationCallbacks;
+    const UINT64 m_StartTime;
+    // Unique in the process, so threads can cache their slot without keeping a pointer to this object.
+    UINT64 m_Id;
+    // TraceEventsThread::GetNumber of the thread that owns each slot. Zero means the slot is free.
+    // Buffers stay allocated when their thread exits, for the next thread to take the slot.
+    std::atomic<UINT> m_ThreadNumbers[MAX_THREAD_COUNT];
+    std::atomic<ThreadBuffer*> m_ThreadBuffers[MAX_THREAD_COUNT];
+    // Events lost because there were too many threads.
+    std::atomic<UINT64> m_DroppedCount;
+    // Guards ReadCount of all buffers, ThreadId of buffers that are reused and m_ExitedThreadEvents.
+    D3D12MA_MUTEX m_BuildMutex;
+    // Events not returned by BuildJson yet, of threads that exited.
+    Vector<ExitedThreadEvent>* m_ExitedThreadEvents;
+    // Guarded by the mutex of GetInstanceList.
+    TraceEvents* m_PrevInstance;
+    TraceEvents* m_NextInstance;
+
+    static InstanceList& GetInstanceList();
+    // Returns null if all slots are taken by other threads.
+    ThreadBuffer* GetCurrentThreadBuffer();
+    void ReleaseThreadBuffer(UINT threadNumber);
+    void AppendEventJson(Vector<char>& inoutJson, bool& inoutFirstEvent, const Event& event, UINT threadId) const;
+
+    D3D12MA_CLASS_NO_COPY(TraceEvents)
+};
+
+#endif // #if D3D12MA_TRACE_EVENTS
+
+#if D3D12MA_LOCK_STATS
+
+// Counters of usage of a single mutex. Updated concurrently by all threads that lock it.
+class LockCounters
+{
+public:
+    // Call after the mutex has been locked.
+    void OnLocked(UINT64 lockBeginTime, UINT64 lockedTime, bool contended)
+    {
+        ++m_AcquireCount;
+        if(contended)
+        {
+            ++m_ContendedCount;
+            m_WaitTimeTotal += lockedTime - lockBeginTime;
+            UpdateMax(m_WaitTimeMax, lockedTime - lockBeginTime);
+        }
+    }
+    // Call before the mutex is unlocked.
+    void OnUnlocking(UINT64 lockedTime)
+    {
+        const UINT64 holdTime = GetTimeNanoseconds() - lockedTime;
+        m_HoldTimeTotal += holdTime;
+        UpdateMax(m_HoldTimeMax, holdTime);
+    }
+
+    void Get(LockStatInfo& outInfo) const
+    {
+        outInfo.AcquireCount = m_AcquireCount.load();
+        outInfo.ContendedCount = m_ContendedCount.load();
+        outInfo.WaitTimeTotal = m_WaitTimeTotal.load();
+        outInfo.WaitTimeMax = m_WaitTimeMax.load();
+        outInfo.HoldTimeTotal = m_HoldTimeTotal.load();
+        outInfo.HoldTimeMax = m_HoldTimeMax.load();
+    }
+
+private:
+    std::atomic<UINT64> m_AcquireCount{0};
+    std::atomic<UINT64> m_ContendedCount{0};
+    std::atomic<UINT64> m_WaitTimeTotal{0};
+    std::atomic<UINT64> m_WaitTimeMax{0};
+    std::atomic<UINT64> m_HoldTimeTotal{0};
+    std::atomic<UINT64> m_HoldTimeMax{0};
+
+    static void UpdateMax(std::atomic<UINT64>& max, UINT64 value)
+    {
+        UINT64 prevMax = max.load();
+        while(value > prevMax && !max.compare_exchange_weak(prevMax, value)) { }
+    }
+};
+
+#endif // #if D3D12MA_LOCK_STATS
+
+#if D3D12MA_INSTRUMENTED_MUTEXES
+
+// Mutex that measures its usage, updated by MutexLock, MutexLockRead, MutexLockWrite.
+template<typename MutexT>
+struct InstrumentedMutex
+{
+    MutexT Mutex;
+#if D3D12MA_LOCK_STATS
+    LockCounters Counters;
+#endif
+#if D3D12MA_TRACE_EVENTS
+    // Receives an event for every wait for this mutex. Can be null.
+    TraceEvents* pTraceEvents = NULL;
+#endif
+
+    // Call after the mutex has been locked. Returns the time it has been locked.
+    UINT64 OnLocked(UINT64 lockBeginTime, bool contended)
+    {
+        const UINT64 lockedTime = GetTimeNanoseconds();
+#if D3D12MA_LOCK_STATS
+        Counters.OnLocked(lockBeginTime, lockedTime, contended);
+#endif
+#if D3D12MA_TRACE_EVENTS
+        if(contended && pTraceEvents != NULL)
+        {
+            pTraceEvents->Add(TRACE_EVENT_LOCK_WAIT, lockBeginTime, lockedTime);
+        }
+#endif
+        return lockedTime;
+    }
+    // Call before the mutex is unlocked.
+    void OnUnlocking(UINT64 lockedTime)
+    {
+#if D3D12MA_LOCK_STATS
+        Counters.OnUnlocking(lockedTime);
+#else
+        (void)lockedTime;
+#endif
+    }
+};
+
+typedef InstrumentedMutex<D3D12MA_MUTEX> InternalMutex;
+typedef InstrumentedMutex<D3D12MA_RW_MUTEX> InternalRWMutex;
+
+#else
+
+typedef D3D12MA_MUTEX InternalMutex;
+typedef D3D12MA_RW_MUTEX InternalRWMutex;
+
+#endif // #if D3D12MA_INSTRUMENTED_MUTEXES
+
+#if D3D12MA_SINGLE_THREADED
+
+// Locks that do nothing, so that no code is generated for them.
+struct MutexLock
+{
+public:
+    MutexLock(InternalMutex& /*mutex*/, bool /*useMutex*/ = true) { }
+
+    D3D12MA_CLASS_NO_COPY(MutexLock)
+};
+
+struct MutexLockRead
+{
+public:
+    MutexLockRead(InternalRWMutex& /*mutex*/, bool /*useMutex*/) { }
+
+    D3D12MA_CLASS_NO_COPY(MutexLockRead)
+};
+
+struct MutexLockWrite
+{
+public:
+    MutexLockWrite(InternalRWMutex& /*mutex*/, bool /*useMutex*/) { }
+
+    D3D12MA_CLASS_NO_COPY(MutexLockWrite)
+};
+
+#else
+
 // Helper RAII class to lock a mutex in constructor and unlock it in destructor (at the end of scope).
 struct MutexLock
 {
 public:
-    MutexLock(D3D12MA_MUTEX& mutex, bool useMutex = true) :
+    MutexLock(InternalMutex& mutex, bool useMutex = true) :
         m_pMutex(useMutex ? &mutex : NULL)
     {
         if(m_pMutex)
         {
+#if D3D12MA_INSTRUMENTED_MUTEXES
+            const UINT64 lockBeginTime = GetTimeNanoseconds();
+            const bool contended = !m_pMutex->Mutex.TryLock();
+            if(contended)
+            {
+                m_pMutex->Mutex.Lock();
+            }
+            m_LockedTime = m_pMutex->OnLocked(lockBeginTime, contended);
+#else
             m_pMutex->Lock();
+#endif
         }
     }
     ~MutexLock()
     {
         if(m_pMutex)
         {
+#if D3D12MA_INSTRUMENTED_MUTEXES
+            m_pMutex->OnUnlocking(m_LockedTime);
+            m_pMutex->Mutex.Unlock();
+#else
             m_pMutex->Unlock();
+#endif
         }
     }
 private:
-    D3D12MA_MUTEX* m_pMutex;
+    InternalMutex* m_pMutex;
+#if D3D12MA_INSTRUMENTED_MUTEXES
+    UINT64 m_LockedTime;
+#endif
 
     D3D12MA_CLASS_NO_COPY(MutexLock)
 };
@@ -353,23 +794,41 @@ private:
 struct MutexLockRead
 {
 public:
-    MutexLockRead(D3D12MA_RW_MUTEX& mutex, bool useMutex) :
+    MutexLockRead(InternalRWMutex& mutex, bool useMutex) :
         m_pMutex(useMutex ? &mutex : NULL)
     {
         if(m_pMutex)
         {
+#if D3D12MA_INSTRUMENTED_MUTEXES
+            const UINT64 lockBeginTime = GetTimeNanoseconds();
+            const bool contended = !m_pMutex->Mutex.TryLockRead();
+            if(contended)
+            {
+                m_pMutex->Mutex.LockRead();
+            }
+            m_LockedTime = m_pMutex->OnLocked(lockBeginTime, contended);
+#else
             m_pMutex->LockRead();
+#endif
         }
     }
     ~MutexLockRead()
     {
         if(m_pMutex)
         {
+#if D3D12MA_INSTRUMENTED_MUTEXES
+            m_pMutex->OnUnlocking(m_LockedTime);
+            m_pMutex->Mutex.UnlockRead();
+#else
             m_pMutex->UnlockRead();
+#endif
         }
     }
 private:
-    D3D12MA_RW_MUTEX* m_pMutex;
+    InternalRWMutex* m_pMutex;
+#if D3D12MA_INSTRUMENTED_MUTEXES
+    UINT64 m_LockedTime;
+#endif
 
     D3D12MA_CLASS_NO_COPY(MutexLockRead)
 };
@@ -378,29 +837,49 @@ private:
 struct MutexLockWrite
 {
 public:
-    MutexLockWrite(D3D12MA_RW_MUTEX& mutex, bool useMutex) :
+    MutexLockWrite(InternalRWMutex& mutex, bool useMutex) :
         m_pMutex(useMutex ? &mutex : NULL)
     {
         if(m_pMutex)
         {
+#if D3D12MA_INSTRUMENTED_MUTEXES
+            const UINT64 lockBeginTime = GetTimeNanoseconds();
+            const bool contended = !m_pMutex->Mutex.TryLockWrite();
+            if(contended)
+            {
+                m_pMutex->Mutex.LockWrite();
+            }
+            m_LockedTime = m_pMutex->OnLocked(lockBeginTime, contended);
+#else
             m_pMutex->LockWrite();
+#endif
         }
     }
     ~MutexLockWrite()
     {
         if(m_pMutex)
         {
+#if D3D12MA_INSTRUMENTED_MUTEXES
+            m_pMutex->OnUnlocking(m_LockedTime);
+            m_pMutex->Mutex.UnlockWrite();
+#else
             m_pMutex->UnlockWrite();
+#endif
         }
     }
 private:
-    D3D12MA_RW_MUTEX* m_pMutex;
+    InternalRWMutex* m_pMutex;
+#if D3D12MA_INSTRUMENTED_MUTEXES
+    UINT64 m_LockedTime;
+#endif
 
     D3D12MA_CLASS_NO_COPY(MutexLockWrite)
 };
 
+#endif // #if D3D12MA_SINGLE_THREADED
+
 #if D3D12MA_DEBUG_GLOBAL_MUTEX
-    static D3D12MA_MUTEX g_DebugGlobalMutex;
+    static InternalMutex g_DebugGlobalMutex;
     #define D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK MutexLock debugGlobalMutexLock(g_DebugGlobalMutex, true);
 #else
     #define D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
@@ -458,15 +937,8 @@ IterT BinaryFindSorted(const IterT& beg, const IterT& end, const KeyT& value, co
     return end;
 }
 
-struct PointerLess
-{
-    bool operator()(const void* lhs, const void* rhs) const
-    {
-        return lhs < rhs;
-    }
-};
-
-static const UINT HEAP_TYPE_COUNT = 3;
+// HEAP_TYPE_COUNT from the header: DEFAULT, UPLOAD, READBACK, and CUSTOM used for
+// ALLOCATION_FLAG_CPU_ACCESSIBLE on UMA.
 
 static UINT HeapTypeToIndex(D3D12_HEAP_TYPE type)
 {
@@ -475,6 +947,7 @@ static UINT HeapTypeToIndex(D3D12_HEAP_TYPE type)
     case D3D12_HEAP_TYPE_DEFAULT:  return 0;
     case D3D12_HEAP_TYPE_UPLOAD:   return 1;
     case D3D12_HEAP_TYPE_READBACK: return 2;
+    case D3D12_HEAP_TYPE_CUSTOM:   return 3;
     default: D3D12MA_ASSERT(0); return UINT_MAX;
     }
 }
@@ -1323,7 +1796,8 @@ struct Suballocation
 {
     UINT64 offset;
     UINT64 size;
-    Allocation* allocation;
+    // Allocation object, or user data of an allocation made in a VirtualBlock.
+    void* userData;
     SuballocationType type;
 };
 
@@ -1375,9 +1849,11 @@ in a single ID3D12Heap memory block.
 class BlockMetadata
 {
 public:
-    BlockMetadata(const ALLOCATION_CALLBACKS* allocationCallbacks);
+    BlockMetadata(const ALLOCATION_CALLBACKS* allocationCallbacks, bool isVirtual);
     virtual ~BlockMetadata() { }
     virtual void Init(UINT64 size) { m_Size = size; }
+    // Frees all allocations. Returns to the state right after Init.
+    virtual void Clear() = 0;
 
     // Validates all data structures inside this object. If not valid, returns false.
     virtual bool Validate() const = 0;
@@ -1387,41 +1863,62 @@ public:
     virtual UINT64 GetUnusedRangeSizeMax() const = 0;
     // Returns true if this block is empty - contains only single free suballocation.
     virtual bool IsEmpty() const = 0;
+    // True if this block doesn't represent a real heap and allocations carry user data rather than Allocation objects.
+    bool IsVirtual() const { return m_IsVirtual; }
+
+    // Returns size and user data of the allocation at given offset.
+    virtual void GetAllocationInfo(UINT64 offset, VIRTUAL_ALLOCATION_INFO& outInfo) const = 0;
+    // Changes user data of the allocation at given offset.
+    virtual void SetAllocationUserData(UINT64 offset, void* userData) = 0;
+    // Adds statistics of this block to given structure. It must be initialized with InitStatInfo beforehand.
+    virtual void AddStatInfo(StatInfo& inoutInfo) const = 0;
 
     // Tries to find a place for suballocation with given parameters inside this block.
+    // strategy is one of ALLOCATION_FLAG_STRATEGY_*, or 0 for the default.
     // If succeeded, fills pAllocationRequest and returns true.
     // If failed, returns false.
     virtual bool CreateAllocationRequest(
         UINT64 allocSize,
         UINT64 allocAlignment,
+        UINT strategy,
         AllocationRequest* pAllocationRequest) = 0;
 
     // Makes actual allocation based on request. Request must already be checked and valid.
+    // userData is the Allocation object, or user data of a virtual allocation.
     virtual void Alloc(
         const AllocationRequest& request,
         UINT64 allocSize,
-        Allocation* Allocation) = 0;
+        void* userData) = 0;
 
     // Frees suballocation assigned to given memory region.
     virtual void Free(const Allocation* allocation) = 0;
     virtual void FreeAtOffset(UINT64 offset) = 0;
+    // Frees multiple suballocations in a single pass over the block.
+    // Allocations must belong to this block and be sorted by offset, ascending.
+    virtual void FreeMultiple(const Allocation* const* pAllocations, size_t allocationCount) = 0;
 
 protected:
     const ALLOCATION_CALLBACKS* GetAllocs() const { return m_pAllocationCallbacks; }
+    // Virtual blocks don't use D3D12MA_DEBUG_MARGIN, as it is meant for debugging of GPU memory.
+    UINT64 GetDebugMargin() const { return IsVirtual() ? 0 : D3D12MA_DEBUG_MARGIN; }
+    // Virtual blocks may count in units as small as a single descriptor, so every free range is registered.
+    UINT64 GetMinFreeSizeToRegister() const { return IsVirtual() ? 1 : MIN_FREE_SUBALLOCATION_SIZE_TO_REGISTER; }
 
 private:
     UINT64 m_Size;
+    bool m_IsVirtual;
     const ALLOCATION_CALLBACKS* m_pAllocationCallbacks;
 
     D3D12MA_CLASS_NO_COPY(BlockMetadata);
 };
 
-class BlockMetadata_Generic : public BlockMetadata
+class BlockMetadata_Generic final : public BlockMetadata
 {
 public:
-    BlockMetadata_Generic(const ALLOCATION_CALLBACKS* allocationCallbacks);
+    BlockMetadata_Generic(const ALLOCATION_CALLBACKS* allocationCallbacks, bool isVirtual);
     virtual ~BlockMetadata_Generic();
     virtual void Init(UINT64 size);
+    virtual void Clear();
 
     virtual bool Validate() const;
     virtual size_t GetAllocationCount() const { return m_Suballocations.size() - m_FreeCount; }
@@ -1429,18 +1926,24 @@ public:
     virtual UINT64 GetUnusedRangeSizeMax() const;
     virtual bool IsEmpty() const;
 
+    virtual void GetAllocationInfo(UINT64 offset, VIRTUAL_ALLOCATION_INFO& outInfo) const;
+    virtual void SetAllocationUserData(UINT64 offset, void* userData);
+    virtual void AddStatInfo(StatInfo& inoutInfo) const;
+
     virtual bool CreateAllocationRequest(
         UINT64 allocSize,
         UINT64 allocAlignment,
+        UINT strategy,
         AllocationRequest* pAllocationRequest);
 
     virtual void Alloc(
         const AllocationRequest& request,
         UINT64 allocSize,
-        Allocation* hAllocation);
+        void* userData);
 
     virtual void Free(const Allocation* allocation);
     virtual void FreeAtOffset(UINT64 offset);
+    virtual void FreeMultiple(const Allocation* const* pAllocations, size_t allocationCount);
 
 private:
     UINT m_FreeCount;
@@ -1477,6 +1980,14 @@ private:
     D3D12MA_CLASS_NO_COPY(BlockMetadata_Generic)
 };
 
+/*
+Metadata algorithm used by DeviceMemoryBlock and VirtualBlock, chosen at compile time.
+They call it through this type rather than through BlockMetadata, so calls made on every
+allocation and free are not virtual and can be inlined. Another algorithm derived from
+BlockMetadata and marked final can be plugged in by changing this typedef.
+*/
+typedef BlockMetadata_Generic BlockMetadataAlgorithm;
+
 ////////////////////////////////////////////////////////////////////////////////
 // Private class DeviceMemoryBlock definition
 
@@ -1489,7 +2000,7 @@ Thread-safety: This class must be externally synchronized.
 class DeviceMemoryBlock
 {
 public:
-    BlockMetadata* m_pMetadata;
+    BlockMetadataAlgorithm* m_pMetadata;
 
     DeviceMemoryBlock();
 
@@ -1504,6 +2015,8 @@ public:
         BlockVector* blockVector,
         D3D12_HEAP_TYPE newHeapType,
         ID3D12Heap* newHeap,
+        ID3D12Resource* newBuffer,
+        void* newMappedData,
         UINT64 newSize,
         UINT id);
     // Always call before destruction.
@@ -1511,8 +2024,20 @@ public:
 
     BlockVector* GetBlockVector() const { return m_BlockVector; }
     ID3D12Heap* GetHeap() const { return m_Heap; }
+    // Buffer spanning the whole heap, if the block is used for buffer suballocation. Otherwise null.
+    ID3D12Resource* GetBuffer() const { return m_Buffer; }
+    // Persistently mapped pointer to the beginning of GetBuffer(), if mappable. Otherwise null.
+    void* GetMappedData() const { return m_MappedData; }
     D3D12_HEAP_TYPE GetHeapType() const { return m_HeapType; }
     UINT GetId() const { return m_Id; }
+    // Lifetime of allocations in this block. Changes only when the block is empty.
+    ALLOCATION_LIFETIME GetLifetime() const { return m_Lifetime; }
+    void SetLifetime(ALLOCATION_LIFETIME lifetime) { m_Lifetime = lifetime; }
+
+    // Call when the block becomes empty and is kept for reuse.
+    void SetEmptySince(UINT frameIndex, UINT64 time) { m_EmptySinceFrameIndex = frameIndex; m_EmptySinceTime = time; }
+    UINT GetEmptySinceFrameIndex() const { return m_EmptySinceFrameIndex; }
+    UINT64 GetEmptySinceTime() const { return m_EmptySinceTime; }
 
     // Validates all data structures inside this object. If not valid, returns false.
     bool Validate() const;
@@ -1521,11 +2046,72 @@ private:
     BlockVector* m_BlockVector;
     D3D12_HEAP_TYPE m_HeapType;
     UINT m_Id;
+    ALLOCATION_LIFETIME m_Lifetime;
     ID3D12Heap* m_Heap;
+    ID3D12Resource* m_Buffer;
+    void* m_MappedData;
+    // Frame index and time in nanoseconds when it last became empty. Valid only while empty.
+    UINT m_EmptySinceFrameIndex;
+    UINT64 m_EmptySinceTime;
 
     D3D12MA_CLASS_NO_COPY(DeviceMemoryBlock)
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// Private class BlockSizePolicy definition
+
+// Smallest block size chosen by BlockSizePolicy, also a multiple of MSAA placement alignment.
+static const UINT64 ADAPTIVE_MIN_BLOCK_SIZE = 4ull * 1024 * 1024;
+
+/*
+Chooses sizes of new blocks of a BlockVector and the size above which resources
+are better created as committed, from a running histogram of requested sizes.
+Used when the allocator is created with ALLOCATOR_FLAG_ADAPTIVE_BLOCK_SIZE.
+
+The histogram has one bucket per power of two and is halved periodically, so old
+requests gradually stop counting. It is updated with relaxed atomics from any thread
+without a lock, so concurrent updates may occasionally be lost, which is fine for a heuristic.
+*/
+class BlockSizePolicy
+{
+public:
+    // Blocks up to this many times larger than preferred block size can be created.
+    static const UINT64 MAX_BLOCK_SIZE_FACTOR = 4;
+
+    BlockSizePolicy(UINT64 preferredBlockSize);
+
+    UINT64 GetMaxBlockSize() const { return m_PreferredBlockSize * MAX_BLOCK_SIZE_FACTOR; }
+    // Requests larger than this are better created as committed resources.
+    UINT64 GetCommittedThreshold() const { return m_CommittedThreshold.load(std::memory_order_relaxed); }
+
+    // Call for every request that may end up in the block vector, also if it is then made committed.
+    void AddRequest(UINT64 size);
+    /*
+    Returns size for a new block that must fit allocation of given size.
+    existingBlocksSize is sum of sizes of existing blocks, existingAllocatedSize sum of the allocated parts of them.
+    */
+    UINT64 CalcNewBlockSize(UINT64 size, UINT64 existingBlocksSize, UINT64 existingAllocatedSize) const;
+
+private:
+    static const UINT BUCKET_COUNT = 64;
+    // Every this many requests, the histogram is halved.
+    static const UINT DECAY_PERIOD = 1024;
+    // Every this many requests, committed threshold is recalculated.
+    static const UINT UPDATE_PERIOD = 64;
+    // Block should fit this many allocations of typical size.
+    static const UINT64 ALLOCATIONS_PER_BLOCK = 16;
+
+    const UINT64 m_PreferredBlockSize;
+    // Bucket i counts sizes in range [2^i, 2^(i+1)).
+    std::atomic<UINT> m_BucketCounts[BUCKET_COUNT];
+    std::atomic<UINT> m_RequestCount;
+    std::atomic<UINT64> m_CommittedThreshold;
+
+    // Block size that fits ALLOCATIONS_PER_BLOCK allocations of the 90th percentile of requested sizes.
+    UINT64 CalcTypicalBlockSize() const;
+    UINT64 ClampBlockSize(UINT64 blockSize) const;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // Private class BlockVector definition
 
@@ -1543,16 +2129,37 @@ public:
         AllocatorPimpl* hAllocator,
         D3D12_HEAP_TYPE heapType,
         D3D12_HEAP_FLAGS heapFlags,
+        bool msaa,
+        UINT creationNodeMask,
+        UINT visibleNodeMask,
         UINT64 preferredBlockSize,
         size_t minBlockCount,
         size_t maxBlockCount,
-        bool explicitBlockSize);
+        bool explicitBlockSize,
+        bool bufferSuballocation,
+        bool adaptiveBlockSize);
     ~BlockVector();
 
     HRESULT CreateMinBlocks();
 
     UINT GetHeapType() const { return m_HeapType; }
     UINT64 GetPreferredBlockSize() const { return m_PreferredBlockSize; }
+    UINT64 GetHeapAlignment() const;
+    // Parameters of the heap of a block of given size, also used as the key in the heap cache.
+    D3D12_HEAP_DESC CalcHeapDesc(UINT64 size) const;
+    // Resources larger than this are better created as committed.
+    UINT64 GetCommittedThreshold() const
+    {
+        return m_AdaptiveBlockSize ? m_BlockSizePolicy.GetCommittedThreshold() : m_PreferredBlockSize / 2;
+    }
+    // Call for every request for this block vector, before deciding whether to make it committed.
+    void AddRequestSize(UINT64 size)
+    {
+        if(m_AdaptiveBlockSize)
+        {
+            m_BlockSizePolicy.AddRequest(size);
+        }
+    }
 
     bool IsEmpty() const { return m_Blocks.empty(); }
 
@@ -1565,28 +2172,49 @@ public:
 
     void Free(
         Allocation* hAllocation);
+    // Frees multiple allocations under a single lock.
+    // Allocations must belong to this block vector and be sorted by block, then by offset.
+    void Free(
+        size_t allocationCount,
+        Allocation** pAllocations);
 
-private:
-    static UINT64 HeapFlagsToAlignment(D3D12_HEAP_FLAGS flags);
+    // Releases empty blocks kept for longer than allowed by the retention policy. Returns their number.
+    UINT Trim(UINT currentFrameIndex, UINT64 currentTime);
+    // Adds number and total size of empty blocks kept for reuse.
+    void AddEmptyBlockStats(UINT& inoutCount, UINT64& inoutBytes);
 
+#if D3D12MA_LOCK_STATS
+    void GetLockStats(PoolLockStats& outStats) const;
+#endif
+
+private:
     AllocatorPimpl* const m_hAllocator;
     const D3D12_HEAP_TYPE m_HeapType;
     const D3D12_HEAP_FLAGS m_HeapFlags;
+    // Heaps are created with alignment required by multisampled resources.
+    const bool m_Msaa;
+    const UINT m_CreationNodeMask;
+    const UINT m_VisibleNodeMask;
     const UINT64 m_PreferredBlockSize;
     const size_t m_MinBlockCount;
     const size_t m_MaxBlockCount;
     const bool m_ExplicitBlockSize;
-    /* There can be at most one allocation that is completely empty - a
-    hysteresis to avoid pessimistic case of alternating creation and destruction
-    of a VkDeviceMemory. */
-    bool m_HasEmptyBlock;
-    D3D12MA_RW_MUTEX m_Mutex;
+    // Every block has one buffer spanning the whole heap and allocations are ranges of it.
+    const bool m_BufferSuballocation;
+    // Block sizes are chosen by m_BlockSizePolicy, not only from m_PreferredBlockSize.
+    const bool m_AdaptiveBlockSize;
+    BlockSizePolicy m_BlockSizePolicy;
+    InternalRWMutex m_Mutex;
     // Incrementally sorted by sumFreeSize, ascending.
     Vector<DeviceMemoryBlock*> m_Blocks;
-    UINT m_NextBlockId;
 
     UINT64 CalcMaxBlockSize() const;
 
+    /* Decides whether pBlock, which has just become empty, is kept for reuse - a
+    hysteresis to avoid pessimistic case of alternating creation and destruction
+    of an ID3D12Heap. If so, remembers when it became empty. */
+    bool KeepEmptyBlock(DeviceMemoryBlock* pBlock);
+
     // Finds and removes given block from vector.
     void Remove(DeviceMemoryBlock* pBlock);
 
@@ -1600,1341 +2228,4379 @@ private:
         const ALLOCATION_DESC& createInfo,
         Allocation** pAllocation);
 
+    // Fails if the block is not empty and holds allocations of another lifetime.
     HRESULT AllocateFromBlock(
         DeviceMemoryBlock* pBlock,
         UINT64 size,
         UINT64 alignment,
         ALLOCATION_FLAGS allocFlags,
+        ALLOCATION_LIFETIME lifetime,
+        Allocation** pAllocation);
+    // Searches existing blocks in the order and with the metadata strategy given by allocFlags.
+    HRESULT AllocateFromExistingBlocks(
+        UINT64 size,
+        UINT64 alignment,
+        ALLOCATION_FLAGS allocFlags,
+        ALLOCATION_LIFETIME lifetime,
         Allocation** pAllocation);
 
     HRESULT CreateBlock(UINT64 blockSize, size_t* pNewBlockIndex);
     HRESULT CreateD3d12Heap(ID3D12Heap*& outHeap, UINT64 size) const;
+    HRESULT CreateD3d12Buffer(ID3D12Resource*& outBuffer, void*& outMappedData, ID3D12Heap* heap, UINT64 size) const;
 };
 
-////////////////////////////////////////////////////////////////////////////////
-// Private class AllocatorPimpl definition
+#if D3D12MA_RECORDING_ENABLED
 
-static const UINT DEFAULT_POOL_MAX_COUNT = 9;
+////////////////////////////////////////////////////////////////////////////////
+// Private class Recorder
 
-class AllocatorPimpl
+/*
+Writes calls to the library into a binary file. Format is described in
+"\page record_and_replay" in D3D12MemAlloc.h.
+*/
+class Recorder
 {
 public:
-    AllocatorPimpl(const ALLOCATION_CALLBACKS& allocationCallbacks, const ALLOCATOR_DESC& desc);
-    HRESULT Init();
-    ~AllocatorPimpl();
-
-    ID3D12Device* GetDevice() const { return m_Device; }
-    // Shortcut for "Allocation Callbacks", because this function is called so often.
-    const ALLOCATION_CALLBACKS& GetAllocs() const { return m_AllocationCallbacks; }
-    const D3D12_FEATURE_DATA_D3D12_OPTIONS& GetD3D12Options() const { return m_D3D12Options; }
-    bool SupportsResourceHeapTier2() const { return m_D3D12Options.ResourceHeapTier >= D3D12_RESOURCE_HEAP_TIER_2; }
-    bool UseMutex() const { return m_UseMutex; }
+    Recorder();
+    HRESULT Init(const RECORD_SETTINGS& settings, UINT resourceHeapTier, UINT allocatorFlags, UINT64 preferredBlockSize,
+        UINT nodeCount);
+    ~Recorder();
+
+    // Time since the recorder was created, in nanoseconds.
+    UINT64 GetTime() const;
+
+    void RecordCreateResource(
+        UINT64 beginTime,
+        const ALLOCATION_DESC& allocDesc,
+        const D3D12_RESOURCE_DESC& resourceDesc,
+        const D3D12_RESOURCE_ALLOCATION_INFO& resAllocInfo,
+        HRESULT result,
+        const Allocation* allocation);
+    void RecordAllocateBufferRange(
+        UINT64 beginTime,
+        const ALLOCATION_DESC& allocDesc,
+        UINT64 size,
+        UINT64 alignment,
+        HRESULT result,
+        const Allocation* allocation);
+    void RecordReleaseAllocation(UINT64 beginTime, UINT64 endTime, const Allocation* allocation);
+    void RecordSetAllocationName(UINT64 beginTime, const Allocation* allocation, LPCWSTR name);
+    void RecordSetCategoryQuota(UINT category, UINT64 maxBytes);
 
-    HRESULT CreateResource(
-        const ALLOCATION_DESC* pAllocDesc,
-        const D3D12_RESOURCE_DESC* pResourceDesc,
-        D3D12_RESOURCE_STATES InitialResourceState,
-        const D3D12_CLEAR_VALUE *pOptimizedClearValue,
-        Allocation** ppAllocation,
-        REFIID riidResource,
-        void** ppvResource);
+private:
+    enum RECORD_TYPE
+    {
+        RECORD_TYPE_CREATE_RESOURCE = 1,
+        RECORD_TYPE_RELEASE_ALLOCATION = 2,
+        RECORD_TYPE_SET_ALLOCATION_NAME = 3,
+        RECORD_TYPE_ALLOCATE_BUFFER_RANGE = 4,
+        RECORD_TYPE_SET_CATEGORY_QUOTA = 5,
+    };
 
-    // Unregisters allocation from the collection of dedicated allocations.
-    // Allocation object must be deleted externally afterwards.
-    void FreeCommittedMemory(Allocation* allocation);
-    // Unregisters allocation from the collection of placed allocations.
-    // Allocation object must be deleted externally afterwards.
-    void FreePlacedMemory(Allocation* allocation);
+    static const UINT VERSION = 4;
 
-private:
-    friend class Allocator;
+    // Fixed-size record is serialized here first, so it can be written with a single call.
+    class RecordBuffer
+    {
+    public:
+        template<typename T> void Write(T value)
+        {
+            D3D12MA_ASSERT(m_Size + sizeof(T) <= sizeof(m_Data));
+            memcpy(m_Data + m_Size, &value, sizeof(T));
+            m_Size += sizeof(T);
+        }
+        const char* GetData() const { return m_Data; }
+        size_t GetSize() const { return m_Size; }
+    private:
+        char m_Data[192];
+        size_t m_Size = 0;
+    };
 
-    /*
-    Heuristics that decides whether a resource should better be placed in its own,
-    dedicated allocation (committed resource rather than placed resource).
-    */
-    static bool PrefersCommittedAllocation(const D3D12_RESOURCE_DESC& resourceDesc);
+    FILE* m_File;
+    bool m_FlushAfterCall;
+    std::chrono::steady_clock::time_point m_StartTime;
+    InternalMutex m_FileMutex;
 
-    bool m_UseMutex;
-    ID3D12Device* m_Device;
-    UINT64 m_PreferredBlockSize;
-    ALLOCATION_CALLBACKS m_AllocationCallbacks;
+    static UINT64 CalcResourceDescHash(const RecordBuffer& resourceDescData);
+    void WriteRecordHeader(RecordBuffer& buf, RECORD_TYPE type, UINT64 beginTime, UINT64 endTime, const Allocation* allocation);
+    static void WriteAllocationDesc(RecordBuffer& buf, const ALLOCATION_DESC& allocDesc);
+    // Must be called with m_FileMutex locked.
+    void Flush();
+};
 
-    D3D12_FEATURE_DATA_D3D12_OPTIONS m_D3D12Options;
+Recorder::Recorder() :
+    m_File(NULL),
+    m_FlushAfterCall(false),
+    m_StartTime(std::chrono::steady_clock::now())
+{
+}
 
-    typedef Vector<Allocation*> AllocationVectorType;
-    AllocationVectorType* m_pCommittedAllocations[HEAP_TYPE_COUNT];
-    D3D12MA_RW_MUTEX m_CommittedAllocationsMutex[HEAP_TYPE_COUNT];
+HRESULT Recorder::Init(const RECORD_SETTINGS& settings, UINT resourceHeapTier, UINT allocatorFlags, UINT64 preferredBlockSize,
+    UINT nodeCount)
+{
+    if(settings.pFilePath == NULL)
+    {
+        return E_INVALIDARG;
+    }
+    m_FlushAfterCall = (settings.Flags & RECORD_FLAG_FLUSH_AFTER_CALL) != 0;
 
-    // Default pools.
-    BlockVector* m_BlockVectors[DEFAULT_POOL_MAX_COUNT];
+#ifdef _MSC_VER
+    if(fopen_s(&m_File, settings.pFilePath, "wb") != 0)
+    {
+        m_File = NULL;
+    }
+#else
+    m_File = fopen(settings.pFilePath, "wb");
+#endif
+    if(m_File == NULL)
+    {
+        return E_FAIL;
+    }
 
-    // Allocates and registers new committed resource with implicit heap, as dedicated allocation.
-    // Creates and returns Allocation objects.
-    HRESULT AllocateCommittedMemory(
-        const ALLOCATION_DESC* pAllocDesc,
-        const D3D12_RESOURCE_DESC* pResourceDesc,
-        const D3D12_RESOURCE_ALLOCATION_INFO& resAllocInfo,
-        D3D12_RESOURCE_STATES InitialResourceState,
-        const D3D12_CLEAR_VALUE *pOptimizedClearValue,
-        Allocation** ppAllocation,
-        REFIID riidResource,
-        void** ppvResource);
+    const char magic[8] = { 'D', '3', 'D', '1', '2', 'M', 'A', 'R' };
+    RecordBuffer buf;
+    for(size_t i = 0; i < 8; ++i)
+    {
+        buf.Write(magic[i]);
+    }
+    buf.Write<UINT32>(VERSION);
+    buf.Write<UINT32>(resourceHeapTier);
+    buf.Write<UINT32>(allocatorFlags);
+    buf.Write<UINT64>(preferredBlockSize);
+    buf.Write<UINT32>(nodeCount);
+    fwrite(buf.GetData(), 1, buf.GetSize(), m_File);
+    Flush();
+    return S_OK;
+}
 
-    /*
-    If SupportsResourceHeapTier2():
-        0: D3D12_HEAP_TYPE_DEFAULT
-        1: D3D12_HEAP_TYPE_UPLOAD
-        2: D3D12_HEAP_TYPE_READBACK
-    else:
-        0: D3D12_HEAP_TYPE_DEFAULT + buffer
-        1: D3D12_HEAP_TYPE_DEFAULT + texture
-        2: D3D12_HEAP_TYPE_DEFAULT + texture RT or DS
-        3: D3D12_HEAP_TYPE_UPLOAD + buffer
-        4: D3D12_HEAP_TYPE_UPLOAD + texture
-        5: D3D12_HEAP_TYPE_UPLOAD + texture RT or DS
-        6: D3D12_HEAP_TYPE_READBACK + buffer
-        7: D3D12_HEAP_TYPE_READBACK + texture
-        8: D3D12_HEAP_TYPE_READBACK + texture RT or DS
-    */
-    UINT CalcDefaultPoolCount() const;
-    UINT CalcDefaultPoolIndex(const ALLOCATION_DESC& allocDesc, const D3D12_RESOURCE_DESC& resourceDesc) const;
-    void CalcDefaultPoolParams(D3D12_HEAP_TYPE& outHeapType, D3D12_HEAP_FLAGS& outHeapFlags, UINT index) const;
-};
+Recorder::~Recorder()
+{
+    if(m_File != NULL)
+    {
+        fclose(m_File);
+    }
+}
 
-////////////////////////////////////////////////////////////////////////////////
-// Private class BlockMetadata implementation
+UINT64 Recorder::GetTime() const
+{
+    return (UINT64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - m_StartTime).count();
+}
 
-BlockMetadata::BlockMetadata(const ALLOCATION_CALLBACKS* allocationCallbacks) :
-    m_Size(0),
-    m_pAllocationCallbacks(allocationCallbacks)
+void Recorder::RecordCreateResource(
+    UINT64 beginTime,
+    const ALLOCATION_DESC& allocDesc,
+    const D3D12_RESOURCE_DESC& resourceDesc,
+    const D3D12_RESOURCE_ALLOCATION_INFO& resAllocInfo,
+    HRESULT result,
+    const Allocation* allocation)
 {
-    D3D12MA_ASSERT(allocationCallbacks);
+    const UINT64 endTime = GetTime();
+
+    RecordBuffer descData;
+    descData.Write<UINT32>(resourceDesc.Dimension);
+    descData.Write<UINT64>(resourceDesc.Alignment);
+    descData.Write<UINT64>(resourceDesc.Width);
+    descData.Write<UINT32>(resourceDesc.Height);
+    descData.Write<UINT16>(resourceDesc.DepthOrArraySize);
+    descData.Write<UINT16>(resourceDesc.MipLevels);
+    descData.Write<UINT32>(resourceDesc.Format);
+    descData.Write<UINT32>(resourceDesc.SampleDesc.Count);
+    descData.Write<UINT32>(resourceDesc.SampleDesc.Quality);
+    descData.Write<UINT32>(resourceDesc.Layout);
+    descData.Write<UINT32>(resourceDesc.Flags);
+
+    RecordBuffer buf;
+    WriteRecordHeader(buf, RECORD_TYPE_CREATE_RESOURCE, beginTime, endTime, allocation);
+    buf.Write<INT32>(result);
+    WriteAllocationDesc(buf, allocDesc);
+    buf.Write<UINT64>(CalcResourceDescHash(descData));
+    for(size_t i = 0; i < descData.GetSize(); ++i)
+    {
+        buf.Write(descData.GetData()[i]);
+    }
+    buf.Write<UINT64>(resAllocInfo.SizeInBytes);
+    buf.Write<UINT64>(resAllocInfo.Alignment);
+    buf.Write<UINT64>(allocation != NULL ? (UINT64)(uintptr_t)allocation->GetHeap() : 0);
+    buf.Write<UINT64>(allocation != NULL ? allocation->GetOffset() : 0);
+
+    MutexLock lock(m_FileMutex);
+    fwrite(buf.GetData(), 1, buf.GetSize(), m_File);
+    Flush();
 }
 
-////////////////////////////////////////////////////////////////////////////////
-// Private class BlockMetadata_Generic implementation
+void Recorder::RecordAllocateBufferRange(
+    UINT64 beginTime,
+    const ALLOCATION_DESC& allocDesc,
+    UINT64 size,
+    UINT64 alignment,
+    HRESULT result,
+    const Allocation* allocation)
+{
+    const UINT64 endTime = GetTime();
+
+    RecordBuffer buf;
+    WriteRecordHeader(buf, RECORD_TYPE_ALLOCATE_BUFFER_RANGE, beginTime, endTime, allocation);
+    buf.Write<INT32>(result);
+    WriteAllocationDesc(buf, allocDesc);
+    buf.Write<UINT64>(size);
+    buf.Write<UINT64>(alignment);
+    buf.Write<UINT64>(allocation != NULL ? (UINT64)(uintptr_t)allocation->GetHeap() : 0);
+    buf.Write<UINT64>(allocation != NULL ? allocation->GetOffset() : 0);
+
+    MutexLock lock(m_FileMutex);
+    fwrite(buf.GetData(), 1, buf.GetSize(), m_File);
+    Flush();
+}
 
-BlockMetadata_Generic::BlockMetadata_Generic(const ALLOCATION_CALLBACKS* allocationCallbacks) :
-    BlockMetadata(allocationCallbacks),
-    m_FreeCount(0),
-    m_SumFreeSize(0),
-    m_Suballocations(*allocationCallbacks),
-    m_FreeSuballocationsBySize(*allocationCallbacks)
+void Recorder::RecordReleaseAllocation(UINT64 beginTime, UINT64 endTime, const Allocation* allocation)
 {
-    D3D12MA_ASSERT(allocationCallbacks);
+    RecordBuffer buf;
+    WriteRecordHeader(buf, RECORD_TYPE_RELEASE_ALLOCATION, beginTime, endTime, allocation);
+
+    MutexLock lock(m_FileMutex);
+    fwrite(buf.GetData(), 1, buf.GetSize(), m_File);
+    Flush();
 }
 
-BlockMetadata_Generic::~BlockMetadata_Generic()
+void Recorder::RecordSetAllocationName(UINT64 beginTime, const Allocation* allocation, LPCWSTR name)
 {
+    const UINT64 endTime = GetTime();
+    const size_t charCount = name != NULL ? wcslen(name) : 0;
+
+    RecordBuffer buf;
+    WriteRecordHeader(buf, RECORD_TYPE_SET_ALLOCATION_NAME, beginTime, endTime, allocation);
+    buf.Write<UINT32>(name != NULL ? (UINT32)charCount : UINT32_MAX);
+
+    MutexLock lock(m_FileMutex);
+    fwrite(buf.GetData(), 1, buf.GetSize(), m_File);
+    // wchar_t is not 16-bit everywhere, so characters are converted in chunks.
+    UINT16 chars[64];
+    for(size_t charIndex = 0; charIndex < charCount; )
+    {
+        const size_t chunkSize = D3D12MA_MIN<size_t>(charCount - charIndex, sizeof(chars) / sizeof(chars[0]));
+        for(size_t i = 0; i < chunkSize; ++i)
+        {
+            chars[i] = (UINT16)name[charIndex + i];
+        }
+        fwrite(chars, sizeof(UINT16), chunkSize, m_File);
+        charIndex += chunkSize;
+    }
+    Flush();
 }
 
-void BlockMetadata_Generic::Init(UINT64 size)
+UINT64 Recorder::CalcResourceDescHash(const RecordBuffer& resourceDescData)
 {
-    BlockMetadata::Init(size);
+    // FNV-1a
+    UINT64 hash = 14695981039346656037ull;
+    for(size_t i = 0; i < resourceDescData.GetSize(); ++i)
+    {
+        hash = (hash ^ (UINT8)resourceDescData.GetData()[i]) * 1099511628211ull;
+    }
+    return hash;
+}
 
-    m_FreeCount = 1;
-    m_SumFreeSize = size;
+void Recorder::RecordSetCategoryQuota(UINT category, UINT64 maxBytes)
+{
+    const UINT64 time = GetTime();
 
-    Suballocation suballoc = {};
-    suballoc.offset = 0;
-    suballoc.size = size;
-    suballoc.type = SUBALLOCATION_TYPE_FREE;
-    suballoc.allocation = NULL;
+    RecordBuffer buf;
+    WriteRecordHeader(buf, RECORD_TYPE_SET_CATEGORY_QUOTA, time, time, NULL);
+    buf.Write<UINT32>(category);
+    buf.Write<UINT64>(maxBytes);
 
-    D3D12MA_ASSERT(size > MIN_FREE_SUBALLOCATION_SIZE_TO_REGISTER);
-    m_Suballocations.push_back(suballoc);
-    SuballocationList::iterator suballocItem = m_Suballocations.end();
-    --suballocItem;
-    m_FreeSuballocationsBySize.push_back(suballocItem);
+    MutexLock lock(m_FileMutex);
+    fwrite(buf.GetData(), 1, buf.GetSize(), m_File);
+    Flush();
 }
 
-bool BlockMetadata_Generic::Validate() const
+void Recorder::WriteRecordHeader(RecordBuffer& buf, RECORD_TYPE type, UINT64 beginTime, UINT64 endTime, const Allocation* allocation)
 {
-    D3D12MA_VALIDATE(!m_Suballocations.empty());
+    buf.Write<UINT32>(type);
+    buf.Write<UINT32>(GetCurrentThreadIdNumber());
+    buf.Write<UINT64>(beginTime);
+    buf.Write<UINT64>(endTime - beginTime);
+    buf.Write<UINT64>((UINT64)(uintptr_t)allocation);
+}
 
-    // Expected offset of new suballocation as calculated from previous ones.
-    UINT64 calculatedOffset = 0;
-    // Expected number of free suballocations as calculated from traversing their list.
-    UINT calculatedFreeCount = 0;
-    // Expected sum size of free suballocations as calculated from traversing their list.
-    UINT64 calculatedSumFreeSize = 0;
-    // Expected number of free suballocations that should be registered in
-    // m_FreeSuballocationsBySize calculated from traversing their list.
-    size_t freeSuballocationsToRegister = 0;
-    // True if previous visited suballocation was free.
-    bool prevFree = false;
+void Recorder::WriteAllocationDesc(RecordBuffer& buf, const ALLOCATION_DESC& allocDesc)
+{
+    buf.Write<UINT32>(allocDesc.HeapType);
+    buf.Write<UINT32>(allocDesc.Flags);
+    buf.Write<UINT32>(allocDesc.Lifetime);
+    buf.Write<UINT32>(allocDesc.CreationNodeMask);
+    buf.Write<UINT32>(allocDesc.VisibleNodeMask);
+    buf.Write<UINT32>(allocDesc.Category);
+}
 
-    for(SuballocationList::const_iterator suballocItem = m_Suballocations.cbegin();
-        suballocItem != m_Suballocations.cend();
-        ++suballocItem)
+void Recorder::Flush()
+{
+    if(m_FlushAfterCall)
     {
-        const Suballocation& subAlloc = *suballocItem;
+        fflush(m_File);
+    }
+}
 
-        // Actual offset of this suballocation doesn't match expected one.
-        D3D12MA_VALIDATE(subAlloc.offset == calculatedOffset);
+#endif // #if D3D12MA_RECORDING_ENABLED
 
-        const bool currFree = (subAlloc.type == SUBALLOCATION_TYPE_FREE);
-        // Two adjacent free suballocations are invalid. They should be merged.
-        D3D12MA_VALIDATE(!prevFree || !currFree);
+#if D3D12MA_LATENCY_HISTOGRAMS
 
-        D3D12MA_VALIDATE(currFree == (subAlloc.allocation == NULL));
+////////////////////////////////////////////////////////////////////////////////
+// Private class LatencyHistogram
 
-        if(currFree)
-        {
-            calculatedSumFreeSize += subAlloc.size;
-            ++calculatedFreeCount;
-            if(subAlloc.size >= MIN_FREE_SUBALLOCATION_SIZE_TO_REGISTER)
-            {
-                ++freeSuballocationsToRegister;
-            }
+/*
+Counts of durations in nanoseconds, in buckets of logarithmic scale with linear
+subdivision, like HDR histogram with 3 significant bits: values 0..7 have their
+own buckets, then every power of two is split into 8 buckets.
+Can be updated concurrently.
+*/
+class LatencyHistogram
+{
+public:
+    static const UINT SUB_BUCKET_BITS = 3;
+    static const UINT SUB_BUCKET_COUNT = 1u << SUB_BUCKET_BITS;
+    static const UINT BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
 
-            // Margin required between allocations - every free space must be at least that large.
-            D3D12MA_VALIDATE(subAlloc.size >= D3D12MA_DEBUG_MARGIN);
-        }
-        else
-        {
-            D3D12MA_VALIDATE(subAlloc.allocation->GetOffset() == subAlloc.offset);
-            D3D12MA_VALIDATE(subAlloc.allocation->GetSize() == subAlloc.size);
+    LatencyHistogram();
 
-            // Margin required between allocations - previous allocation must be free.
-            D3D12MA_VALIDATE(D3D12MA_DEBUG_MARGIN == 0 || prevFree);
-        }
+    void Add(UINT64 duration);
+    // Adds counts of this histogram to given arrays.
+    void AddTo(UINT64* pBucketCounts, UINT64& inoutTotal, UINT64& inoutMax) const;
 
-        calculatedOffset += subAlloc.size;
-        prevFree = currFree;
-    }
+    static UINT ValueToBucket(UINT64 value);
+    // Largest value that falls into given bucket.
+    static UINT64 BucketToMaxValue(UINT bucket);
 
-    // Number of free suballocations registered in m_FreeSuballocationsBySize doesn't
-    // match expected one.
-    D3D12MA_VALIDATE(m_FreeSuballocationsBySize.size() == freeSuballocationsToRegister);
+private:
+    std::atomic<UINT64> m_BucketCounts[BUCKET_COUNT];
+    std::atomic<UINT64> m_Total;
+    std::atomic<UINT64> m_Max;
+};
 
-    UINT64 lastSize = 0;
-    for(size_t i = 0; i < m_FreeSuballocationsBySize.size(); ++i)
+LatencyHistogram::LatencyHistogram()
+{
+    for(UINT i = 0; i < BUCKET_COUNT; ++i)
     {
-        SuballocationList::iterator suballocItem = m_FreeSuballocationsBySize[i];
-
-        // Only free suballocations can be registered in m_FreeSuballocationsBySize.
-        D3D12MA_VALIDATE(suballocItem->type == SUBALLOCATION_TYPE_FREE);
-        // They must be sorted by size ascending.
-        D3D12MA_VALIDATE(suballocItem->size >= lastSize);
-
-        lastSize = suballocItem->size;
+        m_BucketCounts[i].store(0);
     }
+    m_Total.store(0);
+    m_Max.store(0);
+}
 
-    // Check if totals match calculacted values.
-    D3D12MA_VALIDATE(ValidateFreeSuballocationList());
-    D3D12MA_VALIDATE(calculatedOffset == GetSize());
-    D3D12MA_VALIDATE(calculatedSumFreeSize == m_SumFreeSize);
-    D3D12MA_VALIDATE(calculatedFreeCount == m_FreeCount);
+void LatencyHistogram::Add(UINT64 duration)
+{
+    m_BucketCounts[ValueToBucket(duration)].fetch_add(1, std::memory_order_relaxed);
+    m_Total.fetch_add(duration, std::memory_order_relaxed);
+    UINT64 prevMax = m_Max.load(std::memory_order_relaxed);
+    while(duration > prevMax && !m_Max.compare_exchange_weak(prevMax, duration, std::memory_order_relaxed)) { }
+}
 
-    return true;
+void LatencyHistogram::AddTo(UINT64* pBucketCounts, UINT64& inoutTotal, UINT64& inoutMax) const
+{
+    for(UINT i = 0; i < BUCKET_COUNT; ++i)
+    {
+        pBucketCounts[i] += m_BucketCounts[i].load(std::memory_order_relaxed);
+    }
+    inoutTotal += m_Total.load(std::memory_order_relaxed);
+    inoutMax = D3D12MA_MAX(inoutMax, m_Max.load(std::memory_order_relaxed));
 }
 
-UINT64 BlockMetadata_Generic::GetUnusedRangeSizeMax() const
+UINT LatencyHistogram::ValueToBucket(UINT64 value)
 {
-    if(!m_FreeSuballocationsBySize.empty())
+    if(value < SUB_BUCKET_COUNT)
     {
-        return m_FreeSuballocationsBySize.back()->size;
+        return (UINT)value;
     }
-    else
+    UINT highestBit = 0;
+    for(UINT64 v = value; v >>= 1; )
     {
-        return 0;
+        ++highestBit;
     }
+    const UINT shift = highestBit - SUB_BUCKET_BITS;
+    return (shift + 1) * SUB_BUCKET_COUNT + (UINT)((value >> shift) & (SUB_BUCKET_COUNT - 1));
 }
 
-bool BlockMetadata_Generic::IsEmpty() const
+UINT64 LatencyHistogram::BucketToMaxValue(UINT bucket)
 {
-    return (m_Suballocations.size() == 1) && (m_FreeCount == 1);
+    if(bucket < SUB_BUCKET_COUNT)
+    {
+        return bucket;
+    }
+    const UINT shift = bucket / SUB_BUCKET_COUNT - 1;
+    const UINT64 minValue = (UINT64)(SUB_BUCKET_COUNT + bucket % SUB_BUCKET_COUNT) << shift;
+    return minValue + ((1ull << shift) - 1);
 }
 
-bool BlockMetadata_Generic::CreateAllocationRequest(
-    UINT64 allocSize,
-    UINT64 allocAlignment,
-    AllocationRequest* pAllocationRequest)
+////////////////////////////////////////////////////////////////////////////////
+// Private class LatencyHistograms
+
+/*
+One LatencyHistogram per TIMED_OPERATION, in several copies (shards). Every thread
+adds to the shard selected by its ID, so that threads don't fight for the same
+cache lines. Shards are merged when queried.
+*/
+class LatencyHistograms
 {
-    D3D12MA_ASSERT(allocSize > 0);
-    D3D12MA_ASSERT(pAllocationRequest != NULL);
-    D3D12MA_HEAVY_ASSERT(Validate());
+public:
+    void Add(TIMED_OPERATION operation, UINT64 duration)
+    {
+        m_Shards[GetCurrentShardIndex()].Histograms[operation].Add(duration);
+    }
+    void Calculate(TIMED_OPERATION operation, LatencyStats& outStats) const;
 
-    // There is not enough total free space in this block to fullfill the request: Early return.
-    if(m_SumFreeSize < allocSize + 2 * D3D12MA_DEBUG_MARGIN)
+private:
+    static const UINT SHARD_COUNT = 8;
+
+    struct alignas(64) Shard
     {
-        return false;
+        LatencyHistogram Histograms[TIMED_OPERATION_COUNT];
+    };
+    Shard m_Shards[SHARD_COUNT];
+
+    static UINT GetCurrentShardIndex();
+};
+
+void LatencyHistograms::Calculate(TIMED_OPERATION operation, LatencyStats& outStats) const
+{
+    UINT64 bucketCounts[LatencyHistogram::BUCKET_COUNT] = {};
+    UINT64 total = 0, max = 0;
+    for(UINT i = 0; i < SHARD_COUNT; ++i)
+    {
+        m_Shards[i].Histograms[operation].AddTo(bucketCounts, total, max);
     }
 
-    // New algorithm, efficiently searching freeSuballocationsBySize.
-    const size_t freeSuballocCount = m_FreeSuballocationsBySize.size();
-    if(freeSuballocCount > 0)
+    memset(&outStats, 0, sizeof(outStats));
+    for(UINT i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i)
     {
-        // Find first free suballocation with size not less than allocSize + 2 * D3D12MA_DEBUG_MARGIN.
-        SuballocationList::iterator* const it = BinaryFindFirstNotLess(
-            m_FreeSuballocationsBySize.data(),
-            m_FreeSuballocationsBySize.data() + freeSuballocCount,
-            allocSize + 2 * D3D12MA_DEBUG_MARGIN,
-            SuballocationItemSizeLess());
-        size_t index = it - m_FreeSuballocationsBySize.data();
-        for(; index < freeSuballocCount; ++index)
+        outStats.Count += bucketCounts[i];
+    }
+    outStats.TimeTotal = total;
+    outStats.TimeMax = max;
+
+    // Percentile is the upper end of the bucket holding the value of that rank, but not more than the maximum.
+    const double percentiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    UINT64* const outTimes[] = { &outStats.TimeP50, &outStats.TimeP90, &outStats.TimeP99, &outStats.TimeP999 };
+    for(size_t percentileIndex = 0; percentileIndex < sizeof(percentiles) / sizeof(percentiles[0]); ++percentileIndex)
+    {
+        if(outStats.Count == 0)
         {
-            if(CheckAllocation(
-                allocSize,
-                allocAlignment,
-                m_FreeSuballocationsBySize[index],
-                &pAllocationRequest->offset,
-                &pAllocationRequest->sumFreeSize,
-                &pAllocationRequest->sumItemSize))
+            break;
+        }
+        const UINT64 rank = D3D12MA_MAX<UINT64>((UINT64)(percentiles[percentileIndex] * (double)outStats.Count + 0.5), 1);
+        UINT64 cumulativeCount = 0;
+        for(UINT i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i)
+        {
+            cumulativeCount += bucketCounts[i];
+            if(cumulativeCount >= rank)
             {
-                pAllocationRequest->item = m_FreeSuballocationsBySize[index];
-                return true;
+                *outTimes[percentileIndex] = D3D12MA_MIN(LatencyHistogram::BucketToMaxValue(i), max);
+                break;
             }
         }
     }
-
-    return false;
 }
 
-void BlockMetadata_Generic::Alloc(
-    const AllocationRequest& request,
-    UINT64 allocSize,
-    Allocation* allocation)
+UINT LatencyHistograms::GetCurrentShardIndex()
 {
-    D3D12MA_ASSERT(request.item != m_Suballocations.end());
-    Suballocation& suballoc = *request.item;
-    // Given suballocation is a free block.
-    D3D12MA_ASSERT(suballoc.type == SUBALLOCATION_TYPE_FREE);
-    // Given offset is inside this suballocation.
-    D3D12MA_ASSERT(request.offset >= suballoc.offset);
-    const UINT64 paddingBegin = request.offset - suballoc.offset;
-    D3D12MA_ASSERT(suballoc.size >= paddingBegin + allocSize);
-    const UINT64 paddingEnd = suballoc.size - paddingBegin - allocSize;
-
-    // Unregister this free suballocation from m_FreeSuballocationsBySize and update
-    // it to become used.
-    UnregisterFreeSuballocation(request.item);
+    const UINT threadId = GetCurrentThreadIdNumber();
+    // Thread IDs on Windows are multiples of 4.
+    return (threadId ^ (threadId >> 2) ^ (threadId >> 5)) % SHARD_COUNT;
+}
 
-    suballoc.offset = request.offset;
-    suballoc.size = allocSize;
-    suballoc.type = SUBALLOCATION_TYPE_ALLOCATION;
-    suballoc.allocation = allocation;
+#endif // #if D3D12MA_LATENCY_HISTOGRAMS
 
-    // If there are any free bytes remaining at the end, insert new free suballocation after current one.
-    if(paddingEnd)
-    {
-        Suballocation paddingSuballoc = {};
-        paddingSuballoc.offset = request.offset + allocSize;
-        paddingSuballoc.size = paddingEnd;
-        paddingSuballoc.type = SUBALLOCATION_TYPE_FREE;
-        SuballocationList::iterator next = request.item;
-        ++next;
-        const SuballocationList::iterator paddingEndItem =
-            m_Suballocations.insert(next, paddingSuballoc);
-        RegisterFreeSuballocation(paddingEndItem);
-    }
+#if D3D12MA_TRACE_EVENTS
 
-    // If there are any free bytes remaining at the beginning, insert new free suballocation before current one.
-    if(paddingBegin)
-    {
-        Suballocation paddingSuballoc = {};
-        paddingSuballoc.offset = request.offset - paddingBegin;
-        paddingSuballoc.size = paddingBegin;
-        paddingSuballoc.type = SUBALLOCATION_TYPE_FREE;
-        const SuballocationList::iterator paddingBeginItem =
-            m_Suballocations.insert(request.item, paddingSuballoc);
-        RegisterFreeSuballocation(paddingBeginItem);
-    }
+////////////////////////////////////////////////////////////////////////////////
+// Private class TraceEvents implementation
+
+static const char* const TRACE_EVENT_NAMES[] = {
+    "Allocator::CreateResource",
+    "Allocation::Release",
+    "ID3D12Device::GetResourceAllocationInfo",
+    "ID3D12Device::CreateHeap",
+    "ID3D12Device::CreatePlacedResource",
+    "ID3D12Device::CreateCommittedResource",
+    "Find free range",
+    "Wait for lock",
+};
+static_assert(sizeof(TRACE_EVENT_NAMES) / sizeof(TRACE_EVENT_NAMES[0]) == TRACE_EVENT_COUNT,
+    "TRACE_EVENT_NAMES out of sync with TIMED_OPERATION and TRACE_EVENT.");
 
-    // Update totals.
-    m_FreeCount = m_FreeCount - 1;
-    if(paddingBegin > 0)
-    {
-        ++m_FreeCount;
-    }
-    if(paddingEnd > 0)
-    {
-        ++m_FreeCount;
-    }
-    m_SumFreeSize -= allocSize;
+TraceEventsThread& TraceEventsThread::GetCurrent()
+{
+    static thread_local TraceEventsThread thread;
+    return thread;
 }
 
-void BlockMetadata_Generic::Free(const Allocation* allocation)
+TraceEventsThread::TraceEventsThread() :
+    m_CachedTraceEventsId(0),
+    m_CachedSlot(UINT_MAX)
 {
-    for(SuballocationList::iterator suballocItem = m_Suballocations.begin();
-        suballocItem != m_Suballocations.end();
-        ++suballocItem)
-    {
-        Suballocation& suballoc = *suballocItem;
-        if(suballoc.allocation == allocation)
-        {
-            FreeSuballocation(suballocItem);
-            D3D12MA_HEAVY_ASSERT(Validate());
-            return;
-        }
-    }
-    D3D12MA_ASSERT(0 && "Not found!");
+    // Zero marks a free slot, so numbering starts from 1.
+    static std::atomic<UINT> nextNumber(1);
+    m_Number = nextNumber.fetch_add(1, std::memory_order_relaxed);
 }
 
-void BlockMetadata_Generic::FreeAtOffset(UINT64 offset)
+TraceEventsThread::~TraceEventsThread()
 {
-    for(SuballocationList::iterator suballocItem = m_Suballocations.begin();
-        suballocItem != m_Suballocations.end();
-        ++suballocItem)
-    {
-        Suballocation& suballoc = *suballocItem;
-        if(suballoc.offset == offset)
-        {
-            FreeSuballocation(suballocItem);
-            return;
-        }
-    }
-    D3D12MA_ASSERT(0 && "Not found!");
+    TraceEvents::ReleaseThread(m_Number);
 }
 
-bool BlockMetadata_Generic::ValidateFreeSuballocationList() const
+TraceEvents::TraceEvents(const ALLOCATION_CALLBACKS& allocationCallbacks) :
+    m_AllocationCallbacks(allocationCallbacks),
+    m_StartTime(GetTimeNanoseconds()),
+    m_ExitedThreadEvents(D3D12MA_NEW(allocationCallbacks, Vector<ExitedThreadEvent>)(allocationCallbacks)),
+    m_PrevInstance(NULL),
+    m_NextInstance(NULL)
 {
-    UINT64 lastSize = 0;
-    for(size_t i = 0, count = m_FreeSuballocationsBySize.size(); i < count; ++i)
+    for(UINT i = 0; i < MAX_THREAD_COUNT; ++i)
     {
-        const SuballocationList::iterator it = m_FreeSuballocationsBySize[i];
+        m_ThreadNumbers[i].store(0);
+        m_ThreadBuffers[i].store(NULL);
+    }
+    m_DroppedCount.store(0);
 
-        D3D12MA_VALIDATE(it->type == SUBALLOCATION_TYPE_FREE);
-        D3D12MA_VALIDATE(it->size >= MIN_FREE_SUBALLOCATION_SIZE_TO_REGISTER);
-        D3D12MA_VALIDATE(it->size >= lastSize);
-        lastSize = it->size;
+    InstanceList& instanceList = GetInstanceList();
+    instanceList.ListMutex.Lock();
+    m_Id = instanceList.NextId++;
+    m_NextInstance = instanceList.First;
+    if(m_NextInstance != NULL)
+    {
+        m_NextInstance->m_PrevInstance = this;
     }
-    return true;
+    instanceList.First = this;
+    instanceList.ListMutex.Unlock();
 }
 
-bool BlockMetadata_Generic::CheckAllocation(
-    UINT64 allocSize,
-    UINT64 allocAlignment,
-    SuballocationList::const_iterator suballocItem,
-    UINT64* pOffset,
-    UINT64* pSumFreeSize,
-    UINT64* pSumItemSize) const
+TraceEvents::~TraceEvents()
 {
-    D3D12MA_ASSERT(allocSize > 0);
-    D3D12MA_ASSERT(suballocItem != m_Suballocations.cend());
-    D3D12MA_ASSERT(pOffset != NULL);
-
-    *pSumFreeSize = 0;
-    *pSumItemSize = 0;
-
-    const Suballocation& suballoc = *suballocItem;
-    D3D12MA_ASSERT(suballoc.type == SUBALLOCATION_TYPE_FREE);
-
-    *pSumFreeSize = suballoc.size;
-
-    // Size of this suballocation is too small for this request: Early return.
-    if(suballoc.size < allocSize)
+    InstanceList& instanceList = GetInstanceList();
+    instanceList.ListMutex.Lock();
+    if(m_PrevInstance != NULL)
     {
-        return false;
+        m_PrevInstance->m_NextInstance = m_NextInstance;
     }
-
-    // Start from offset equal to beginning of this suballocation.
-    *pOffset = suballoc.offset;
-
-    // Apply D3D12MA_DEBUG_MARGIN at the beginning.
-    if(D3D12MA_DEBUG_MARGIN > 0)
+    else
+    {
+        instanceList.First = m_NextInstance;
+    }
+    if(m_NextInstance != NULL)
     {
-        *pOffset += D3D12MA_DEBUG_MARGIN;
+        m_NextInstance->m_PrevInstance = m_PrevInstance;
     }
+    instanceList.ListMutex.Unlock();
 
-    // Apply alignment.
-    *pOffset = AlignUp(*pOffset, allocAlignment);
+    D3D12MA_DELETE(m_AllocationCallbacks, m_ExitedThreadEvents);
 
-    // Calculate padding at the beginning based on current offset.
-    const UINT64 paddingBegin = *pOffset - suballoc.offset;
+    for(UINT i = 0; i < MAX_THREAD_COUNT; ++i)
+    {
+        D3D12MA_DELETE(m_AllocationCallbacks, m_ThreadBuffers[i].load());
+    }
+}
 
-    // Calculate required margin at the end.
-    const UINT64 requiredEndMargin = D3D12MA_DEBUG_MARGIN;
+TraceEvents::InstanceList& TraceEvents::GetInstanceList()
+{
+    static InstanceList instanceList;
+    return instanceList;
+}
 
-    // Fail if requested size plus margin before and after is bigger than size of this suballocation.
-    if(paddingBegin + allocSize + requiredEndMargin > suballoc.size)
+void TraceEvents::ReleaseThread(UINT threadNumber)
+{
+    // Not MutexLock, because these mutexes are not instrumented.
+    InstanceList& instanceList = GetInstanceList();
+    instanceList.ListMutex.Lock();
+    for(TraceEvents* traceEvents = instanceList.First; traceEvents != NULL; traceEvents = traceEvents->m_NextInstance)
     {
-        return false;
+        traceEvents->ReleaseThreadBuffer(threadNumber);
     }
-
-    // All tests passed: Success. pOffset is already filled.
-    return true;
+    instanceList.ListMutex.Unlock();
 }
 
-void BlockMetadata_Generic::MergeFreeWithNext(SuballocationList::iterator item)
+void TraceEvents::ReleaseThreadBuffer(UINT threadNumber)
 {
-    D3D12MA_ASSERT(item != m_Suballocations.end());
-    D3D12MA_ASSERT(item->type == SUBALLOCATION_TYPE_FREE);
+    for(UINT slot = 0; slot < MAX_THREAD_COUNT; ++slot)
+    {
+        if(m_ThreadNumbers[slot].load(std::memory_order_relaxed) != threadNumber)
+        {
+            continue;
+        }
 
-    SuballocationList::iterator nextItem = item;
-    ++nextItem;
-    D3D12MA_ASSERT(nextItem != m_Suballocations.end());
-    D3D12MA_ASSERT(nextItem->type == SUBALLOCATION_TYPE_FREE);
+        // The thread is exiting, so no event is being written to its buffer.
+        ThreadBuffer* const threadBuffer = m_ThreadBuffers[slot].load(std::memory_order_acquire);
+        m_BuildMutex.Lock();
+        const UINT64 writeCount = threadBuffer->WriteCount.load(std::memory_order_relaxed);
+        const UINT64 beginIndex = D3D12MA_MAX(threadBuffer->ReadCount,
+            writeCount > EVENTS_PER_THREAD ? writeCount - EVENTS_PER_THREAD : 0);
+        UINT64 droppedCount = beginIndex - threadBuffer->ReadCount;
+        for(UINT64 index = beginIndex; index < writeCount; ++index)
+        {
+            if(m_ExitedThreadEvents->size() < MAX_EXITED_THREAD_EVENT_COUNT)
+            {
+                ExitedThreadEvent exitedThreadEvent = {};
+                exitedThreadEvent.EventData = threadBuffer->Events[index % EVENTS_PER_THREAD];
+                exitedThreadEvent.ThreadId = threadBuffer->ThreadId;
+                m_ExitedThreadEvents->push_back(exitedThreadEvent);
+            }
+            else
+            {
+                ++droppedCount;
+            }
+        }
+        threadBuffer->WriteCount.store(0, std::memory_order_relaxed);
+        threadBuffer->ReadCount = 0;
+        m_BuildMutex.Unlock();
+        m_DroppedCount.fetch_add(droppedCount, std::memory_order_relaxed);
 
-    item->size += nextItem->size;
-    --m_FreeCount;
-    m_Suballocations.erase(nextItem);
+        m_ThreadNumbers[slot].store(0, std::memory_order_release);
+        return;
+    }
 }
 
-SuballocationList::iterator BlockMetadata_Generic::FreeSuballocation(SuballocationList::iterator suballocItem)
+void TraceEvents::Add(UINT eventType, UINT64 beginTime, UINT64 endTime)
 {
-    // Change this suballocation to be marked as free.
-    Suballocation& suballoc = *suballocItem;
-    suballoc.type = SUBALLOCATION_TYPE_FREE;
-    suballoc.allocation = NULL;
-
-    // Update totals.
-    ++m_FreeCount;
-    m_SumFreeSize += suballoc.size;
+    ThreadBuffer* const threadBuffer = GetCurrentThreadBuffer();
+    if(threadBuffer == NULL)
+    {
+        m_DroppedCount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
 
-    // Merge with previous and/or next suballocation if it's also free.
-    bool mergeWithNext = false;
-    bool mergeWithPrev = false;
+    // Only this thread writes to this buffer, so no atomic increment is needed.
+    const UINT64 index = threadBuffer->WriteCount.load(std::memory_order_relaxed);
+    Event& event = threadBuffer->Events[index % EVENTS_PER_THREAD];
+    event.BeginTime = beginTime;
+    event.Duration = endTime - beginTime;
+    event.Type = eventType;
+    threadBuffer->WriteCount.store(index + 1, std::memory_order_release);
+}
 
-    SuballocationList::iterator nextItem = suballocItem;
-    ++nextItem;
-    if((nextItem != m_Suballocations.end()) && (nextItem->type == SUBALLOCATION_TYPE_FREE))
+TraceEvents::ThreadBuffer* TraceEvents::GetCurrentThreadBuffer()
+{
+    TraceEventsThread& thread = TraceEventsThread::GetCurrent();
+    const UINT cachedSlot = thread.GetCachedSlot(m_Id);
+    if(cachedSlot != UINT_MAX)
     {
-        mergeWithNext = true;
+        return m_ThreadBuffers[cachedSlot].load(std::memory_order_acquire);
     }
 
-    SuballocationList::iterator prevItem = suballocItem;
-    if(suballocItem != m_Suballocations.begin())
+    // The thread may have taken its slot before recording to another TraceEvents object.
+    const UINT threadNumber = thread.GetNumber();
+    for(UINT slot = 0; slot < MAX_THREAD_COUNT; ++slot)
     {
-        --prevItem;
-        if(prevItem->type == SUBALLOCATION_TYPE_FREE)
+        if(m_ThreadNumbers[slot].load(std::memory_order_acquire) == threadNumber)
         {
-            mergeWithPrev = true;
+            thread.SetCachedSlot(m_Id, slot);
+            return m_ThreadBuffers[slot].load(std::memory_order_acquire);
         }
     }
 
-    if(mergeWithNext)
+    const UINT firstSlot = threadNumber % MAX_THREAD_COUNT;
+    for(UINT i = 0; i < MAX_THREAD_COUNT; ++i)
     {
-        UnregisterFreeSuballocation(nextItem);
-        MergeFreeWithNext(suballocItem);
-    }
+        const UINT slot = (firstSlot + i) % MAX_THREAD_COUNT;
+        UINT slotThreadNumber = m_ThreadNumbers[slot].load(std::memory_order_acquire);
+        if(slotThreadNumber != 0 ||
+            !m_ThreadNumbers[slot].compare_exchange_strong(slotThreadNumber, threadNumber, std::memory_order_acq_rel))
+        {
+            continue;
+        }
 
-    if(mergeWithPrev)
-    {
-        UnregisterFreeSuballocation(prevItem);
-        MergeFreeWithNext(prevItem);
-        RegisterFreeSuballocation(prevItem);
-        return prevItem;
+        ThreadBuffer* threadBuffer = m_ThreadBuffers[slot].load(std::memory_order_acquire);
+        if(threadBuffer == NULL)
+        {
+            threadBuffer = D3D12MA_NEW(m_AllocationCallbacks, ThreadBuffer)();
+            threadBuffer->ThreadId = GetCurrentThreadIdNumber();
+            threadBuffer->WriteCount.store(0);
+            threadBuffer->ReadCount = 0;
+            m_ThreadBuffers[slot].store(threadBuffer, std::memory_order_release);
+        }
+        else
+        {
+            // Buffer left by a thread that exited. BuildJson may be reading it.
+            m_BuildMutex.Lock();
+            threadBuffer->ThreadId = GetCurrentThreadIdNumber();
+            m_BuildMutex.Unlock();
+        }
+        thread.SetCachedSlot(m_Id, slot);
+        return threadBuffer;
     }
-    else
+    return NULL;
+}
+
+static void AppendString(Vector<char>& inoutStr, const char* pStr)
+{
+    for(; *pStr != '\0'; ++pStr)
     {
-        RegisterFreeSuballocation(suballocItem);
-        return suballocItem;
+        inoutStr.push_back(*pStr);
     }
 }
 
-void BlockMetadata_Generic::RegisterFreeSuballocation(SuballocationList::iterator item)
+char* TraceEvents::BuildJson()
 {
-    D3D12MA_ASSERT(item->type == SUBALLOCATION_TYPE_FREE);
-    D3D12MA_ASSERT(item->size > 0);
+    // Not MutexLock, because this mutex is not instrumented.
+    m_BuildMutex.Lock();
 
-    // You may want to enable this validation at the beginning or at the end of
-    // this function, depending on what do you want to check.
-    D3D12MA_HEAVY_ASSERT(ValidateFreeSuballocationList());
+    Vector<char> json(m_AllocationCallbacks);
+    Vector<Event> events(m_AllocationCallbacks);
+    UINT64 droppedCount = m_DroppedCount.exchange(0);
+    char buf[256];
+    bool firstEvent = true;
 
-    if(item->size >= MIN_FREE_SUBALLOCATION_SIZE_TO_REGISTER)
+    AppendString(json, "{\"traceEvents\":[");
+    for(size_t i = 0; i < m_ExitedThreadEvents->size(); ++i)
     {
-        if(m_FreeSuballocationsBySize.empty())
+        const ExitedThreadEvent& exitedThreadEvent = (*m_ExitedThreadEvents)[i];
+        AppendEventJson(json, firstEvent, exitedThreadEvent.EventData, exitedThreadEvent.ThreadId);
+    }
+    m_ExitedThreadEvents->clear();
+    for(UINT slot = 0; slot < MAX_THREAD_COUNT; ++slot)
+    {
+        ThreadBuffer* const threadBuffer = m_ThreadBuffers[slot].load(std::memory_order_acquire);
+        if(threadBuffer == NULL)
         {
-            m_FreeSuballocationsBySize.push_back(item);
+            continue;
         }
-        else
+
+        // The owning thread keeps writing meanwhile. Copy the events, then skip those that
+        // could have been overwritten during the copy.
+        const UINT64 writeCount = threadBuffer->WriteCount.load(std::memory_order_acquire);
+        const UINT64 copyBeginIndex = D3D12MA_MAX(threadBuffer->ReadCount,
+            writeCount > EVENTS_PER_THREAD ? writeCount - EVENTS_PER_THREAD : 0);
+        events.resize((size_t)(writeCount - copyBeginIndex));
+        for(UINT64 index = copyBeginIndex; index < writeCount; ++index)
         {
-            m_FreeSuballocationsBySize.InsertSorted(item, SuballocationItemSizeLess());
+            events[(size_t)(index - copyBeginIndex)] = threadBuffer->Events[index % EVENTS_PER_THREAD];
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // Event of index writeCountAfterCopy may be being written, over the one EVENTS_PER_THREAD before.
+        const UINT64 writeCountAfterCopy = threadBuffer->WriteCount.load(std::memory_order_relaxed);
+        const UINT64 beginIndex = D3D12MA_MAX(copyBeginIndex,
+            writeCountAfterCopy >= EVENTS_PER_THREAD ? writeCountAfterCopy - EVENTS_PER_THREAD + 1 : 0);
+        droppedCount += D3D12MA_MIN(beginIndex, writeCount) - threadBuffer->ReadCount;
+        threadBuffer->ReadCount = writeCount;
+
+        for(UINT64 index = beginIndex; index < writeCount; ++index)
+        {
+            AppendEventJson(json, firstEvent, events[(size_t)(index - copyBeginIndex)], threadBuffer->ThreadId);
         }
     }
+    snprintf(buf, sizeof(buf), "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"droppedEventCount\":\"%llu\"}}",
+        (unsigned long long)droppedCount);
+    AppendString(json, buf);
+    m_BuildMutex.Unlock();
+
+    char* const result = D3D12MA_NEW_ARRAY(m_AllocationCallbacks, char, json.size() + 1);
+    memcpy(result, json.data(), json.size());
+    result[json.size()] = '\0';
+    return result;
+}
 
-    //D3D12MA_HEAVY_ASSERT(ValidateFreeSuballocationList());
+void TraceEvents::AppendEventJson(Vector<char>& inoutJson, bool& inoutFirstEvent, const Event& event, UINT threadId) const
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+        "%s\n{\"name\":\"%s\",\"cat\":\"D3D12MA\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+        inoutFirstEvent ? "" : ",",
+        TRACE_EVENT_NAMES[event.Type],
+        threadId,
+        (double)(event.BeginTime - m_StartTime) * 1e-3,
+        (double)event.Duration * 1e-3);
+    AppendString(inoutJson, buf);
+    inoutFirstEvent = false;
 }
 
+#endif // #if D3D12MA_TRACE_EVENTS
 
-void BlockMetadata_Generic::UnregisterFreeSuballocation(SuballocationList::iterator item)
+#if D3D12MA_LATENCY_HISTOGRAMS || D3D12MA_TRACE_EVENTS
+
+// Measures time from its construction to destruction and adds it to latency histograms
+// and trace events of given allocator.
+class ScopedOperationTimer
 {
-    D3D12MA_ASSERT(item->type == SUBALLOCATION_TYPE_FREE);
+public:
+    ScopedOperationTimer(AllocatorPimpl* allocator, UINT operation) :
+        m_Allocator(allocator),
+        m_Operation(operation),
+        m_BeginTime(GetTimeNanoseconds())
+    {
+    }
+    ~ScopedOperationTimer();
+
+private:
+    AllocatorPimpl* const m_Allocator;
+    // TIMED_OPERATION, or TRACE_EVENT when only traced.
+    const UINT m_Operation;
+    const UINT64 m_BeginTime;
+
+    D3D12MA_CLASS_NO_COPY(ScopedOperationTimer)
+};
+
+#define D3D12MA_TIME_SCOPE_CONCAT2(a, b) a##b
+#define D3D12MA_TIME_SCOPE_CONCAT(a, b) D3D12MA_TIME_SCOPE_CONCAT2(a, b)
+// Measures duration of the rest of the current scope. Name of the variable is unique, so scopes can be nested.
+#define D3D12MA_TIME_SCOPE(allocator, operation) \
+    ScopedOperationTimer D3D12MA_TIME_SCOPE_CONCAT(operationTimer, __LINE__)((allocator), (operation));
+
+#else
+
+#define D3D12MA_TIME_SCOPE(allocator, operation)
+
+#endif // #if D3D12MA_LATENCY_HISTOGRAMS || D3D12MA_TRACE_EVENTS
+
+////////////////////////////////////////////////////////////////////////////////
+// Private class HeapCache definition
+
+/*
+Heaps of destroyed memory blocks, kept for reuse by any BlockVector that needs
+a heap of the same type, flags, size and alignment. Heaps that were put in it earliest are
+released when it exceeds its maximum size. Used when ALLOCATOR_DESC::HeapCacheMaxBytes
+is not 0.
+
+Synchronized internally with a mutex.
+*/
+class HeapCache
+{
+public:
+    HeapCache(const ALLOCATION_CALLBACKS& allocationCallbacks, bool useMutex, UINT64 maxBytes);
+    ~HeapCache();
+
+#if D3D12MA_TRACE_EVENTS
+    void SetTraceEvents(TraceEvents* traceEvents) { m_Mutex.pTraceEvents = traceEvents; }
+#endif
+
+    // Removes a heap matching the description from the cache and returns it. Returns null if there is none.
+    ID3D12Heap* Take(const D3D12_HEAP_DESC& desc);
+    // Takes ownership of the heap. Releases it immediately if it doesn't fit in the cache.
+    void Put(const D3D12_HEAP_DESC& desc, ID3D12Heap* heap);
+    // Releases all heaps in the cache.
+    void Clear();
+    void GetStats(UINT& outCount, UINT64& outBytes);
+
+private:
+    struct Item
+    {
+        ID3D12Heap* heap;
+        D3D12_HEAP_TYPE heapType;
+        D3D12_HEAP_FLAGS heapFlags;
+        UINT64 size;
+        UINT64 alignment;
+        UINT creationNodeMask;
+        UINT visibleNodeMask;
+    };
+
+    const bool m_UseMutex;
+    const UINT64 m_MaxBytes;
+    InternalMutex m_Mutex;
+    // Ordered from the earliest put.
+    Vector<Item> m_Items;
+    UINT64 m_Bytes;
+
+    D3D12MA_CLASS_NO_COPY(HeapCache)
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Private class NameTable definition
+
+/*
+Names of allocations. Every distinct name is stored once, with a reference count, so
+naming an allocation with a name that is already in use only looks it up, without
+allocating memory. A narrow name is converted from UTF-8 when it is first added and
+later looked up in its narrow form, so it is not converted again.
+*/
+class NameTable
+{
+public:
+    NameTable(const ALLOCATION_CALLBACKS& allocationCallbacks, bool useMutex);
+    ~NameTable();
+
+#if D3D12MA_TRACE_EVENTS
+    void SetTraceEvents(TraceEvents* traceEvents) { m_Mutex.pTraceEvents = traceEvents; }
+#endif
+
+    // Returns the stored copy of the name and increments its reference count. name cannot be null.
+    LPCWSTR Acquire(LPCWSTR name);
+    LPCWSTR Acquire(LPCSTR name);
+    // Decrements reference count of a string returned by Acquire. Frees it when it drops to zero.
+    void Release(LPCWSTR name);
+
+private:
+    // Followed in memory by the name as a null-terminated wide string,
+    // then by the narrow name it was added as, if narrowKey.
+    struct Entry
+    {
+        Entry* pNext;
+        size_t hash;
+        // Size of the key - the wide or the narrow name - in bytes, without terminating null.
+        size_t keySize;
+        UINT refCount;
+        bool narrowKey;
+    };
+
+    static const size_t INITIAL_BUCKET_COUNT = 64;
+
+    const ALLOCATION_CALLBACKS& m_AllocationCallbacks;
+    const bool m_UseMutex;
+    InternalMutex m_Mutex;
+    // Count is a power of 2.
+    Vector<Entry*> m_Buckets;
+    size_t m_EntryCount;
+
+    static wchar_t* GetName(Entry* entry) { return (wchar_t*)(entry + 1); }
+    static const void* GetKey(const Entry* entry);
+
+    LPCWSTR Acquire(const void* key, size_t keySize, size_t hash, bool narrowKey);
+    // Doubles the number of buckets.
+    void Grow();
+
+    D3D12MA_CLASS_NO_COPY(NameTable)
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Private class CommittedAllocationList definition
+
+/*
+Committed allocations of one heap type, in order of creation. The list is intrusive:
+its links are in Allocation::m_Committed, so adding and removing an allocation take
+constant time and allocate nothing.
+*/
+class CommittedAllocationList
+{
+public:
+    CommittedAllocationList() : m_Front(NULL), m_Back(NULL), m_Count(0) { }
+
+    bool IsEmpty() const { return m_Count == 0; }
+    size_t GetCount() const { return m_Count; }
+    // For iteration: for(a = list.GetFront(); a != NULL; a = CommittedAllocationList::GetNext(a))
+    Allocation* GetFront() const { return m_Front; }
+    static Allocation* GetNext(const Allocation* allocation) { return allocation->m_Committed.next; }
+
+    void PushBack(Allocation* allocation)
+    {
+        allocation->m_Committed.prev = m_Back;
+        allocation->m_Committed.next = NULL;
+        if(m_Back != NULL)
+        {
+            m_Back->m_Committed.next = allocation;
+        }
+        else
+        {
+            m_Front = allocation;
+        }
+        m_Back = allocation;
+        ++m_Count;
+    }
+    void Remove(Allocation* allocation)
+    {
+        D3D12MA_ASSERT(m_Count > 0);
+        if(allocation->m_Committed.prev != NULL)
+        {
+            allocation->m_Committed.prev->m_Committed.next = allocation->m_Committed.next;
+        }
+        else
+        {
+            D3D12MA_ASSERT(m_Front == allocation);
+            m_Front = allocation->m_Committed.next;
+        }
+        if(allocation->m_Committed.next != NULL)
+        {
+            allocation->m_Committed.next->m_Committed.prev = allocation->m_Committed.prev;
+        }
+        else
+        {
+            D3D12MA_ASSERT(m_Back == allocation);
+            m_Back = allocation->m_Committed.prev;
+        }
+        allocation->m_Committed.prev = NULL;
+        allocation->m_Committed.next = NULL;
+        --m_Count;
+    }
+
+    // Walks the whole list. If not valid, returns false.
+    bool Validate() const
+    {
+        size_t count = 0;
+        const Allocation* prev = NULL;
+        for(const Allocation* allocation = m_Front; allocation != NULL; allocation = GetNext(allocation))
+        {
+            D3D12MA_VALIDATE(allocation->m_Type == Allocation::TYPE_COMMITTED);
+            D3D12MA_VALIDATE(allocation->m_Committed.prev == prev);
+            prev = allocation;
+            ++count;
+        }
+        D3D12MA_VALIDATE(m_Back == prev);
+        D3D12MA_VALIDATE(m_Count == count);
+        return true;
+    }
+
+private:
+    Allocation* m_Front;
+    Allocation* m_Back;
+    size_t m_Count;
+
+    D3D12MA_CLASS_NO_COPY(CommittedAllocationList)
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Private class NodePools definition
+
+/*
+Default pools, pools of buffer ranges and lists of committed allocations of one
+combination of creation node mask and visible node mask. Heaps are never shared
+between two of them.
+*/
+class NodePools
+{
+public:
+    NodePools(AllocatorPimpl* hAllocator, UINT creationNodeMask, UINT visibleNodeMask, bool adaptiveBlockSize);
+    ~NodePools();
+
+    UINT GetCreationNodeMask() const { return m_CreationNodeMask; }
+    UINT GetVisibleNodeMask() const { return m_VisibleNodeMask; }
+    // Null for pools of CUSTOM heaps, unless they are used on UMA.
+    BlockVector* GetDefaultPool(UINT index) const { return m_BlockVectors[index]; }
+    BlockVector* GetBufferRangePool(UINT heapTypeIndex) const { return m_BufferBlockVectors[heapTypeIndex]; }
+
+    void AddCommittedAllocation(UINT heapTypeIndex, Allocation* allocation);
+    // Takes the lock of the list once for all of them.
+    void RemoveCommittedAllocations(UINT heapTypeIndex, size_t count, Allocation* const* ppAllocations);
+
+    UINT Trim(UINT currentFrameIndex, UINT64 currentTime);
+    void AddEmptyBlockStats(UINT& inoutCount, UINT64& inoutBytes);
+#if D3D12MA_LOCK_STATS
+    void GetLockStats(LockStats& outStats) const;
+#endif
+
+private:
+    AllocatorPimpl* const m_hAllocator;
+    const UINT m_CreationNodeMask;
+    const UINT m_VisibleNodeMask;
+
+    CommittedAllocationList m_CommittedAllocations[HEAP_TYPE_COUNT];
+    InternalRWMutex m_CommittedAllocationsMutex[HEAP_TYPE_COUNT];
+
+    // Default pools.
+    BlockVector* m_BlockVectors[DEFAULT_POOL_MAX_COUNT];
+    // Pools of large buffers used for AllocateBufferRange, one per heap type.
+    BlockVector* m_BufferBlockVectors[HEAP_TYPE_COUNT];
+
+    D3D12MA_CLASS_NO_COPY(NodePools)
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Private class AllocatorPimpl definition
+
+class AllocatorPimpl
+{
+public:
+    AllocatorPimpl(const ALLOCATION_CALLBACKS& allocationCallbacks, const ALLOCATOR_DESC& desc);
+    HRESULT Init(const ALLOCATOR_DESC& desc);
+    ~AllocatorPimpl();
+
+    ID3D12Device* GetDevice() const { return m_Device; }
+    // Shortcut for "Allocation Callbacks", because this function is called so often.
+    const ALLOCATION_CALLBACKS& GetAllocs() const { return m_AllocationCallbacks; }
+    NameTable& GetNameTable() { return m_NameTable; }
+    const D3D12_FEATURE_DATA_D3D12_OPTIONS& GetD3D12Options() const { return m_D3D12Options; }
+    bool SupportsResourceHeapTier2() const { return m_D3D12Options.ResourceHeapTier >= D3D12_RESOURCE_HEAP_TIER_2; }
+    BOOL IsUMA() const { return m_D3D12Architecture.UMA; }
+    BOOL IsCacheCoherentUMA() const { return m_D3D12Architecture.CacheCoherentUMA; }
+    // Properties of heaps of given type created by the library. CUSTOM means CPU-accessible memory in L0.
+    D3D12_HEAP_PROPERTIES CalcHeapProperties(D3D12_HEAP_TYPE heapType, UINT creationNodeMask, UINT visibleNodeMask) const;
+    // Added to flags of every heap and committed resource created by the library.
+    D3D12_HEAP_FLAGS GetExtraHeapFlags() const { return m_ExtraHeapFlags; }
+    bool UseMutex() const { return m_UseMutex; }
+    // Returns ID for a new block, unique among all blocks of this allocator.
+    UINT GenerateBlockId();
+    const EMPTY_BLOCK_RETENTION& GetEmptyBlockRetention() const { return m_EmptyBlockRetention; }
+    // False if ALLOCATOR_DESC::pEmptyBlockRetention was not provided, so the default is used.
+    bool HasEmptyBlockRetention() const { return m_HasEmptyBlockRetention; }
+    UINT GetCurrentFrameIndex() const { return m_CurrentFrameIndex.load(); }
+#if D3D12MA_RECORDING_ENABLED
+    // Null if recording was not requested.
+    Recorder* GetRecorder() const { return m_Recorder; }
+#endif
+#if D3D12MA_LATENCY_HISTOGRAMS
+    LatencyHistograms* GetLatencyHistograms() const { return m_LatencyHistograms; }
+#endif
+#if D3D12MA_TRACE_EVENTS
+    TraceEvents* GetTraceEvents() const { return m_TraceEvents; }
+#endif
+
+    HRESULT CreateResource(
+        const ALLOCATION_DESC* pAllocDesc,
+        const D3D12_RESOURCE_DESC* pResourceDesc,
+        D3D12_RESOURCE_STATES InitialResourceState,
+        const D3D12_CLEAR_VALUE *pOptimizedClearValue,
+        Allocation** ppAllocation,
+        REFIID riidResource,
+        void** ppvResource);
+
+    HRESULT AllocateBufferRange(
+        const ALLOCATION_DESC* pAllocDesc,
+        UINT64 size,
+        UINT64 alignment,
+        Allocation** ppAllocation);
+
+    // Unregisters allocation from the collection of dedicated allocations.
+    // Allocation object must be deleted externally afterwards.
+    void FreeCommittedMemory(Allocation* allocation);
+    // Unregisters allocation from the collection of placed allocations.
+    // Allocation object must be deleted externally afterwards.
+    void FreePlacedMemory(Allocation* allocation);
+
+    // Takes a heap from the heap cache or creates a new one.
+    HRESULT CreateHeap(const D3D12_HEAP_DESC& desc, ID3D12Heap*& outHeap);
+    // Puts the heap in the heap cache or releases it.
+    void ReleaseHeap(const D3D12_HEAP_DESC& desc, ID3D12Heap* heap);
+
+    // Update heap churn counters and call ALLOCATOR_DESC::pDeviceMemoryCallbacks, if provided.
+    void NotifyHeapCreated(const DeviceMemoryBlock& block);
+    void NotifyHeapDestroyed(const DeviceMemoryBlock& block);
+    // For committed or placed allocation.
+    void NotifyAllocationCreated(Allocation* allocation);
+    void NotifyAllocationFreed(Allocation* allocation);
+
+    // Frees multiple allocations, grouping them to take every lock only once.
+    // Allocation objects are deleted.
+    void FreeAllocations(UINT count, Allocation** ppAllocations);
+
+    void SetCurrentFrameIndex(UINT frameIndex);
+    void Trim();
+    void GetHeapChurnStats(HeapChurnStats& outStats);
+    void GetSmallAlignmentStats(SmallAlignmentStats& outStats) const;
+    void SetCategoryQuota(UINT category, UINT64 maxBytes);
+    void GetCategoryStats(UINT category, CategoryStats& outStats) const;
+
+#if D3D12MA_LOCK_STATS
+    void GetLockStats(LockStats& outStats) const;
+    // pLockStats null: returns the number of NodePools in inoutCount.
+    void GetAllLockStats(UINT& inoutCount, LockStats* pLockStats);
+#endif
+
+private:
+    friend class Allocator;
+    friend class NodePools;
+
+    /*
+    Heuristics that decides whether a resource should better be placed in its own,
+    dedicated allocation (committed resource rather than placed resource).
+    */
+    static bool PrefersCommittedAllocation(const D3D12_RESOURCE_DESC& resourceDesc);
+
+    /*
+    Queries size and alignment of the resource from the device. If the resource can be
+    placed with small alignment, sets inOutResourceDesc.Alignment to it.
+    */
+    D3D12_RESOURCE_ALLOCATION_INFO GetResourceAllocationInfo(D3D12_RESOURCE_DESC& inOutResourceDesc);
+
+    /*
+    Validates heap type, flags and node masks requested by the user. Returns the desc with
+    the heap type the allocation is really made in, which is D3D12_HEAP_TYPE_CUSTOM for
+    ALLOCATION_FLAG_CPU_ACCESSIBLE, and with zero node masks replaced by actual ones.
+    */
+    HRESULT CalcFinalAllocDesc(const ALLOCATION_DESC& allocDesc, ALLOCATION_DESC& outAllocDesc) const;
+    /*
+    Adds size to the total of the category before an allocation is made, unless it would
+    exceed the quota - then returns false. An allocation created successfully keeps the
+    reservation until it is freed. Otherwise it must be returned with ReleaseCategoryBytes.
+    */
+    bool ReserveCategoryBytes(UINT category, UINT64 size);
+    void ReleaseCategoryBytes(UINT category, UINT64 size);
+    // Returns pools of given, already validated node masks. Creates them on first use.
+    NodePools* GetNodePools(UINT creationNodeMask, UINT visibleNodeMask);
+
+    bool m_UseMutex;
+    ID3D12Device* m_Device;
+    UINT64 m_PreferredBlockSize;
+    ALLOCATION_CALLBACKS m_AllocationCallbacks;
+    // Zeros if not provided.
+    DEVICE_MEMORY_CALLBACKS m_DeviceMemoryCallbacks;
+    D3D12MA_ATOMIC_UINT32 m_NextBlockId;
+    EMPTY_BLOCK_RETENTION m_EmptyBlockRetention;
+    bool m_HasEmptyBlockRetention;
+    D3D12MA_ATOMIC_UINT32 m_CurrentFrameIndex;
+
+    // Counters returned in HeapChurnStats.
+    D3D12MA_ATOMIC_UINT64 m_HeapCreatedCount;
+    D3D12MA_ATOMIC_UINT64 m_HeapCreatedBytes;
+    D3D12MA_ATOMIC_UINT64 m_HeapDestroyedCount;
+    D3D12MA_ATOMIC_UINT64 m_HeapDestroyedBytes;
+    D3D12MA_ATOMIC_UINT64 m_HeapTrimmedCount;
+    D3D12MA_ATOMIC_UINT64 m_HeapReusedCount;
+
+    // Counters returned in SmallAlignmentStats.
+    D3D12MA_ATOMIC_UINT32 m_SmallAlignmentCount;
+    std::atomic<UINT64> m_SmallAlignmentBytes;
+    std::atomic<UINT64> m_SmallAlignmentSavedBytes;
+
+    // Totals returned in CategoryStats, and quotas set with SetCategoryQuota.
+    std::atomic<UINT64> m_CategoryAllocationCounts[ALLOCATION_CATEGORY_COUNT];
+    std::atomic<UINT64> m_CategoryAllocationBytes[ALLOCATION_CATEGORY_COUNT];
+    std::atomic<UINT64> m_CategoryQuotas[ALLOCATION_CATEGORY_COUNT];
+
+    D3D12_FEATURE_DATA_D3D12_OPTIONS m_D3D12Options;
+    D3D12_FEATURE_DATA_ARCHITECTURE m_D3D12Architecture;
+    // ALLOCATOR_FLAG_USE_UMA_CUSTOM_HEAPS was used and the device is UMA.
+    bool m_UseUmaCustomHeaps;
+    D3D12_HEAP_FLAGS m_ExtraHeapFlags;
+    HeapCache m_HeapCache;
+    NameTable m_NameTable;
+
+    // Returned by ID3D12Device::GetNodeCount.
+    UINT m_NodeCount;
+    bool m_AdaptiveBlockSize;
+    // Pools of node 0, visible only to it. Created in Init.
+    NodePools* m_DefaultNodePools;
+    // Pools of other combinations of node masks, created on first use.
+    Vector<NodePools*> m_OtherNodePools;
+    InternalRWMutex m_OtherNodePoolsMutex;
+
+#if D3D12MA_RECORDING_ENABLED
+    Recorder* m_Recorder;
+#endif
+#if D3D12MA_LATENCY_HISTOGRAMS
+    LatencyHistograms* m_LatencyHistograms;
+#endif
+#if D3D12MA_TRACE_EVENTS
+    TraceEvents* m_TraceEvents;
+#endif
+
+    HRESULT CreateResourceInternal(
+        const ALLOCATION_DESC* pAllocDesc,
+        const D3D12_RESOURCE_DESC* pResourceDesc,
+        const D3D12_RESOURCE_ALLOCATION_INFO& resAllocInfo,
+        D3D12_RESOURCE_STATES InitialResourceState,
+        const D3D12_CLEAR_VALUE *pOptimizedClearValue,
+        Allocation** ppAllocation,
+        REFIID riidResource,
+        void** ppvResource);
+
+    HRESULT AllocateBufferRangeInternal(
+        const ALLOCATION_DESC* pAllocDesc,
+        UINT64 size,
+        UINT64 alignment,
+        Allocation** ppAllocation);
+
+    // Allocates and registers new committed resource with implicit heap, as dedicated allocation.
+    // Creates and returns Allocation objects.
+    HRESULT AllocateCommittedMemory(
+        NodePools* nodePools,
+        const ALLOCATION_DESC* pAllocDesc,
+        const D3D12_RESOURCE_DESC* pResourceDesc,
+        const D3D12_RESOURCE_ALLOCATION_INFO& resAllocInfo,
+        D3D12_RESOURCE_STATES InitialResourceState,
+        const D3D12_CLEAR_VALUE *pOptimizedClearValue,
+        Allocation** ppAllocation,
+        REFIID riidResource,
+        void** ppvResource);
+
+    /*
+    If SupportsResourceHeapTier2():
+        0: D3D12_HEAP_TYPE_DEFAULT
+        1: D3D12_HEAP_TYPE_UPLOAD
+        2: D3D12_HEAP_TYPE_READBACK
+        3: D3D12_HEAP_TYPE_CUSTOM
+        4: D3D12_HEAP_TYPE_DEFAULT + MSAA
+    else:
+        0: D3D12_HEAP_TYPE_DEFAULT + buffer
+        1: D3D12_HEAP_TYPE_DEFAULT + texture
+        2: D3D12_HEAP_TYPE_DEFAULT + texture RT or DS
+        3: D3D12_HEAP_TYPE_UPLOAD + buffer
+        4: D3D12_HEAP_TYPE_UPLOAD + texture
+        5: D3D12_HEAP_TYPE_UPLOAD + texture RT or DS
+        6: D3D12_HEAP_TYPE_READBACK + buffer
+        7: D3D12_HEAP_TYPE_READBACK + texture
+        8: D3D12_HEAP_TYPE_READBACK + texture RT or DS
+        9: D3D12_HEAP_TYPE_CUSTOM + buffer
+        10: D3D12_HEAP_TYPE_CUSTOM + texture
+        11: D3D12_HEAP_TYPE_CUSTOM + texture RT or DS
+        12: D3D12_HEAP_TYPE_DEFAULT + texture RT or DS + MSAA
+    Only multisampled resources, which are always RT or DS textures in DEFAULT heap,
+    go to the MSAA pool, the last one. Only its heaps have MSAA alignment.
+    Pools of CUSTOM heaps are null unless m_UseUmaCustomHeaps.
+    */
+    UINT CalcDefaultPoolCount() const;
+    UINT CalcDefaultPoolIndex(const ALLOCATION_DESC& allocDesc, const D3D12_RESOURCE_DESC& resourceDesc) const;
+    void CalcDefaultPoolParams(D3D12_HEAP_TYPE& outHeapType, D3D12_HEAP_FLAGS& outHeapFlags, bool& outMsaa, UINT index) const;
+};
+
+#if D3D12MA_LATENCY_HISTOGRAMS || D3D12MA_TRACE_EVENTS
+ScopedOperationTimer::~ScopedOperationTimer()
+{
+    const UINT64 endTime = GetTimeNanoseconds();
+#if D3D12MA_LATENCY_HISTOGRAMS
+    if(m_Operation < TIMED_OPERATION_COUNT)
+    {
+        m_Allocator->GetLatencyHistograms()->Add((TIMED_OPERATION)m_Operation, endTime - m_BeginTime);
+    }
+#endif
+#if D3D12MA_TRACE_EVENTS
+    m_Allocator->GetTraceEvents()->Add(m_Operation, m_BeginTime, endTime);
+#endif
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Private globals - statistics
+
+static void InitStatInfo(StatInfo& outInfo)
+{
+    memset(&outInfo, 0, sizeof(outInfo));
+    outInfo.AllocationSizeMin = UINT64_MAX;
+    outInfo.UnusedRangeSizeMin = UINT64_MAX;
+}
+
+// Calculates averages and fixes minimums of a structure filled with AddStatInfo.
+static void PostprocessStatInfo(StatInfo& inoutInfo)
+{
+    inoutInfo.AllocationSizeAvg = inoutInfo.AllocationCount ?
+        inoutInfo.UsedBytes / inoutInfo.AllocationCount : 0;
+    inoutInfo.UnusedRangeSizeAvg = inoutInfo.UnusedRangeCount ?
+        inoutInfo.UnusedBytes / inoutInfo.UnusedRangeCount : 0;
+    if(inoutInfo.AllocationCount == 0)
+    {
+        inoutInfo.AllocationSizeMin = 0;
+    }
+    if(inoutInfo.UnusedRangeCount == 0)
+    {
+        inoutInfo.UnusedRangeSizeMin = 0;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private class BlockMetadata implementation
+
+BlockMetadata::BlockMetadata(const ALLOCATION_CALLBACKS* allocationCallbacks, bool isVirtual) :
+    m_Size(0),
+    m_IsVirtual(isVirtual),
+    m_pAllocationCallbacks(allocationCallbacks)
+{
+    D3D12MA_ASSERT(allocationCallbacks);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private class BlockMetadata_Generic implementation
+
+BlockMetadata_Generic::BlockMetadata_Generic(const ALLOCATION_CALLBACKS* allocationCallbacks, bool isVirtual) :
+    BlockMetadata(allocationCallbacks, isVirtual),
+    m_FreeCount(0),
+    m_SumFreeSize(0),
+    m_Suballocations(*allocationCallbacks),
+    m_FreeSuballocationsBySize(*allocationCallbacks)
+{
+    D3D12MA_ASSERT(allocationCallbacks);
+}
+
+BlockMetadata_Generic::~BlockMetadata_Generic()
+{
+}
+
+void BlockMetadata_Generic::Init(UINT64 size)
+{
+    BlockMetadata::Init(size);
+
+    m_FreeCount = 1;
+    m_SumFreeSize = size;
+
+    Suballocation suballoc = {};
+    suballoc.offset = 0;
+    suballoc.size = size;
+    suballoc.type = SUBALLOCATION_TYPE_FREE;
+    suballoc.userData = NULL;
+
+    D3D12MA_ASSERT(IsVirtual() || size > MIN_FREE_SUBALLOCATION_SIZE_TO_REGISTER);
+    m_Suballocations.push_back(suballoc);
+    SuballocationList::iterator suballocItem = m_Suballocations.end();
+    --suballocItem;
+    m_FreeSuballocationsBySize.push_back(suballocItem);
+}
+
+void BlockMetadata_Generic::Clear()
+{
+    m_Suballocations.Clear();
+    m_FreeSuballocationsBySize.clear();
+    Init(GetSize());
+}
+
+bool BlockMetadata_Generic::Validate() const
+{
+    D3D12MA_VALIDATE(!m_Suballocations.empty());
+
+    // Expected offset of new suballocation as calculated from previous ones.
+    UINT64 calculatedOffset = 0;
+    // Expected number of free suballocations as calculated from traversing their list.
+    UINT calculatedFreeCount = 0;
+    // Expected sum size of free suballocations as calculated from traversing their list.
+    UINT64 calculatedSumFreeSize = 0;
+    // Expected number of free suballocations that should be registered in
+    // m_FreeSuballocationsBySize calculated from traversing their list.
+    size_t freeSuballocationsToRegister = 0;
+    // True if previous visited suballocation was free.
+    bool prevFree = false;
+
+    for(SuballocationList::const_iterator suballocItem = m_Suballocations.cbegin();
+        suballocItem != m_Suballocations.cend();
+        ++suballocItem)
+    {
+        const Suballocation& subAlloc = *suballocItem;
+
+        // Actual offset of this suballocation doesn't match expected one.
+        D3D12MA_VALIDATE(subAlloc.offset == calculatedOffset);
+
+        const bool currFree = (subAlloc.type == SUBALLOCATION_TYPE_FREE);
+        // Two adjacent free suballocations are invalid. They should be merged.
+        D3D12MA_VALIDATE(!prevFree || !currFree);
+
+        if(!IsVirtual())
+        {
+            D3D12MA_VALIDATE(currFree == (subAlloc.userData == NULL));
+        }
+
+        if(currFree)
+        {
+            calculatedSumFreeSize += subAlloc.size;
+            ++calculatedFreeCount;
+            if(subAlloc.size >= GetMinFreeSizeToRegister())
+            {
+                ++freeSuballocationsToRegister;
+            }
+
+            // Margin required between allocations - every free space must be at least that large.
+            D3D12MA_VALIDATE(subAlloc.size >= GetDebugMargin());
+        }
+        else
+        {
+            if(!IsVirtual())
+            {
+                const Allocation* const alloc = (const Allocation*)subAlloc.userData;
+                D3D12MA_VALIDATE(alloc->GetOffset() == subAlloc.offset);
+                D3D12MA_VALIDATE(alloc->GetSize() == subAlloc.size);
+            }
+
+            // Margin required between allocations - previous allocation must be free.
+            D3D12MA_VALIDATE(GetDebugMargin() == 0 || prevFree);
+        }
+
+        calculatedOffset += subAlloc.size;
+        prevFree = currFree;
+    }
+
+    // Number of free suballocations registered in m_FreeSuballocationsBySize doesn't
+    // match expected one.
+    D3D12MA_VALIDATE(m_FreeSuballocationsBySize.size() == freeSuballocationsToRegister);
+
+    UINT64 lastSize = 0;
+    for(size_t i = 0; i < m_FreeSuballocationsBySize.size(); ++i)
+    {
+        SuballocationList::iterator suballocItem = m_FreeSuballocationsBySize[i];
+
+        // Only free suballocations can be registered in m_FreeSuballocationsBySize.
+        D3D12MA_VALIDATE(suballocItem->type == SUBALLOCATION_TYPE_FREE);
+        // They must be sorted by size ascending.
+        D3D12MA_VALIDATE(suballocItem->size >= lastSize);
+
+        lastSize = suballocItem->size;
+    }
+
+    // Check if totals match calculacted values.
+    D3D12MA_VALIDATE(ValidateFreeSuballocationList());
+    D3D12MA_VALIDATE(calculatedOffset == GetSize());
+    D3D12MA_VALIDATE(calculatedSumFreeSize == m_SumFreeSize);
+    D3D12MA_VALIDATE(calculatedFreeCount == m_FreeCount);
+
+    return true;
+}
+
+UINT64 BlockMetadata_Generic::GetUnusedRangeSizeMax() const
+{
+    if(!m_FreeSuballocationsBySize.empty())
+    {
+        return m_FreeSuballocationsBySize.back()->size;
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+bool BlockMetadata_Generic::IsEmpty() const
+{
+    return (m_Suballocations.size() == 1) && (m_FreeCount == 1);
+}
+
+void BlockMetadata_Generic::GetAllocationInfo(UINT64 offset, VIRTUAL_ALLOCATION_INFO& outInfo) const
+{
+    for(SuballocationList::const_iterator suballocItem = m_Suballocations.cbegin();
+        suballocItem != m_Suballocations.cend();
+        ++suballocItem)
+    {
+        const Suballocation& suballoc = *suballocItem;
+        if(suballoc.offset == offset)
+        {
+            D3D12MA_ASSERT(suballoc.type == SUBALLOCATION_TYPE_ALLOCATION);
+            outInfo.Size = suballoc.size;
+            outInfo.pUserData = suballoc.userData;
+            return;
+        }
+    }
+    D3D12MA_ASSERT(0 && "Not found!");
+}
+
+void BlockMetadata_Generic::SetAllocationUserData(UINT64 offset, void* userData)
+{
+    for(SuballocationList::iterator suballocItem = m_Suballocations.begin();
+        suballocItem != m_Suballocations.end();
+        ++suballocItem)
+    {
+        Suballocation& suballoc = *suballocItem;
+        if(suballoc.offset == offset)
+        {
+            D3D12MA_ASSERT(suballoc.type == SUBALLOCATION_TYPE_ALLOCATION);
+            suballoc.userData = userData;
+            return;
+        }
+    }
+    D3D12MA_ASSERT(0 && "Not found!");
+}
+
+void BlockMetadata_Generic::AddStatInfo(StatInfo& inoutInfo) const
+{
+    inoutInfo.BlockCount++;
+    inoutInfo.AllocationCount += (UINT)m_Suballocations.size() - m_FreeCount;
+    inoutInfo.UnusedRangeCount += m_FreeCount;
+    inoutInfo.UsedBytes += GetSize() - m_SumFreeSize;
+    inoutInfo.UnusedBytes += m_SumFreeSize;
+
+    for(SuballocationList::const_iterator suballocItem = m_Suballocations.cbegin();
+        suballocItem != m_Suballocations.cend();
+        ++suballocItem)
+    {
+        const Suballocation& suballoc = *suballocItem;
+        if(suballoc.type == SUBALLOCATION_TYPE_FREE)
+        {
+            inoutInfo.UnusedRangeSizeMin = D3D12MA_MIN(inoutInfo.UnusedRangeSizeMin, suballoc.size);
+            inoutInfo.UnusedRangeSizeMax = D3D12MA_MAX(inoutInfo.UnusedRangeSizeMax, suballoc.size);
+        }
+        else
+        {
+            inoutInfo.AllocationSizeMin = D3D12MA_MIN(inoutInfo.AllocationSizeMin, suballoc.size);
+            inoutInfo.AllocationSizeMax = D3D12MA_MAX(inoutInfo.AllocationSizeMax, suballoc.size);
+        }
+    }
+}
+
+bool BlockMetadata_Generic::CreateAllocationRequest(
+    UINT64 allocSize,
+    UINT64 allocAlignment,
+    UINT strategy,
+    AllocationRequest* pAllocationRequest)
+{
+    D3D12MA_ASSERT(allocSize > 0);
+    D3D12MA_ASSERT(pAllocationRequest != NULL);
+    D3D12MA_HEAVY_ASSERT(Validate());
+
+    // There is not enough total free space in this block to fullfill the request: Early return.
+    if(m_SumFreeSize < allocSize + 2 * GetDebugMargin())
+    {
+        return false;
+    }
+
+    const size_t freeSuballocCount = m_FreeSuballocationsBySize.size();
+    if(freeSuballocCount == 0)
+    {
+        return false;
+    }
+
+    if(strategy == ALLOCATION_FLAG_STRATEGY_MIN_TIME)
+    {
+        // Only the largest free suballocation, which is the one most likely to fit.
+        SuballocationList::iterator const item = m_FreeSuballocationsBySize.back();
+        if(CheckAllocation(
+            allocSize,
+            allocAlignment,
+            item,
+            &pAllocationRequest->offset,
+            &pAllocationRequest->sumFreeSize,
+            &pAllocationRequest->sumItemSize))
+        {
+            pAllocationRequest->item = item;
+            return true;
+        }
+    }
+    else if(strategy == ALLOCATION_FLAG_STRATEGY_MIN_FRAGMENTATION)
+    {
+        // Free suballocations from the largest down, so the remaining free space is largest.
+        for(size_t index = freeSuballocCount; index--; )
+        {
+            if(m_FreeSuballocationsBySize[index]->size < allocSize + 2 * GetDebugMargin())
+            {
+                break;
+            }
+            if(CheckAllocation(
+                allocSize,
+                allocAlignment,
+                m_FreeSuballocationsBySize[index],
+                &pAllocationRequest->offset,
+                &pAllocationRequest->sumFreeSize,
+                &pAllocationRequest->sumItemSize))
+            {
+                pAllocationRequest->item = m_FreeSuballocationsBySize[index];
+                return true;
+            }
+        }
+    }
+    else
+    {
+        D3D12MA_ASSERT(strategy == 0 || strategy == ALLOCATION_FLAG_STRATEGY_MIN_MEMORY);
+        // Find first free suballocation with size not less than allocSize + 2 * GetDebugMargin().
+        SuballocationList::iterator* const it = BinaryFindFirstNotLess(
+            m_FreeSuballocationsBySize.data(),
+            m_FreeSuballocationsBySize.data() + freeSuballocCount,
+            allocSize + 2 * GetDebugMargin(),
+            SuballocationItemSizeLess());
+        size_t index = it - m_FreeSuballocationsBySize.data();
+        for(; index < freeSuballocCount; ++index)
+        {
+            if(CheckAllocation(
+                allocSize,
+                allocAlignment,
+                m_FreeSuballocationsBySize[index],
+                &pAllocationRequest->offset,
+                &pAllocationRequest->sumFreeSize,
+                &pAllocationRequest->sumItemSize))
+            {
+                pAllocationRequest->item = m_FreeSuballocationsBySize[index];
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void BlockMetadata_Generic::Alloc(
+    const AllocationRequest& request,
+    UINT64 allocSize,
+    void* userData)
+{
+    D3D12MA_ASSERT(request.item != m_Suballocations.end());
+    Suballocation& suballoc = *request.item;
+    // Given suballocation is a free block.
+    D3D12MA_ASSERT(suballoc.type == SUBALLOCATION_TYPE_FREE);
+    // Given offset is inside this suballocation.
+    D3D12MA_ASSERT(request.offset >= suballoc.offset);
+    const UINT64 paddingBegin = request.offset - suballoc.offset;
+    D3D12MA_ASSERT(suballoc.size >= paddingBegin + allocSize);
+    const UINT64 paddingEnd = suballoc.size - paddingBegin - allocSize;
+
+    // Unregister this free suballocation from m_FreeSuballocationsBySize and update
+    // it to become used.
+    UnregisterFreeSuballocation(request.item);
+
+    suballoc.offset = request.offset;
+    suballoc.size = allocSize;
+    suballoc.type = SUBALLOCATION_TYPE_ALLOCATION;
+    suballoc.userData = userData;
+
+    // If there are any free bytes remaining at the end, insert new free suballocation after current one.
+    if(paddingEnd)
+    {
+        Suballocation paddingSuballoc = {};
+        paddingSuballoc.offset = request.offset + allocSize;
+        paddingSuballoc.size = paddingEnd;
+        paddingSuballoc.type = SUBALLOCATION_TYPE_FREE;
+        SuballocationList::iterator next = request.item;
+        ++next;
+        const SuballocationList::iterator paddingEndItem =
+            m_Suballocations.insert(next, paddingSuballoc);
+        RegisterFreeSuballocation(paddingEndItem);
+    }
+
+    // If there are any free bytes remaining at the beginning, insert new free suballocation before current one.
+    if(paddingBegin)
+    {
+        Suballocation paddingSuballoc = {};
+        paddingSuballoc.offset = request.offset - paddingBegin;
+        paddingSuballoc.size = paddingBegin;
+        paddingSuballoc.type = SUBALLOCATION_TYPE_FREE;
+        const SuballocationList::iterator paddingBeginItem =
+            m_Suballocations.insert(request.item, paddingSuballoc);
+        RegisterFreeSuballocation(paddingBeginItem);
+    }
+
+    // Update totals.
+    m_FreeCount = m_FreeCount - 1;
+    if(paddingBegin > 0)
+    {
+        ++m_FreeCount;
+    }
+    if(paddingEnd > 0)
+    {
+        ++m_FreeCount;
+    }
+    m_SumFreeSize -= allocSize;
+}
+
+void BlockMetadata_Generic::Free(const Allocation* allocation)
+{
+    for(SuballocationList::iterator suballocItem = m_Suballocations.begin();
+        suballocItem != m_Suballocations.end();
+        ++suballocItem)
+    {
+        Suballocation& suballoc = *suballocItem;
+        if(suballoc.userData == allocation)
+        {
+            FreeSuballocation(suballocItem);
+            D3D12MA_HEAVY_ASSERT(Validate());
+            return;
+        }
+    }
+    D3D12MA_ASSERT(0 && "Not found!");
+}
+
+void BlockMetadata_Generic::FreeAtOffset(UINT64 offset)
+{
+    for(SuballocationList::iterator suballocItem = m_Suballocations.begin();
+        suballocItem != m_Suballocations.end();
+        ++suballocItem)
+    {
+        Suballocation& suballoc = *suballocItem;
+        if(suballoc.offset == offset)
+        {
+            FreeSuballocation(suballocItem);
+            return;
+        }
+    }
+    D3D12MA_ASSERT(0 && "Not found!");
+}
+
+void BlockMetadata_Generic::FreeMultiple(const Allocation* const* pAllocations, size_t allocationCount)
+{
+    // Single pass over the list, up to the last freed suballocation: mark matching
+    // suballocations as free and merge every free suballocation into the previous one
+    // if that one is also free. Only the free ranges touched by the batch are updated in
+    // m_FreeSuballocationsBySize: a merged range is unregistered before it grows and
+    // registered again once it can't grow any more.
+    size_t allocIndex = 0;
+    SuballocationList::iterator prevItem = m_Suballocations.end();
+    SuballocationList::iterator unregisteredItem = m_Suballocations.end();
+    for(SuballocationList::iterator suballocItem = m_Suballocations.begin();
+        suballocItem != m_Suballocations.end(); )
+    {
+        Suballocation& suballoc = *suballocItem;
+        bool freed = false;
+        if(allocIndex < allocationCount && suballoc.userData == pAllocations[allocIndex])
+        {
+            D3D12MA_ASSERT(suballoc.type == SUBALLOCATION_TYPE_ALLOCATION);
+            suballoc.type = SUBALLOCATION_TYPE_FREE;
+            suballoc.userData = NULL;
+            ++m_FreeCount;
+            m_SumFreeSize += suballoc.size;
+            ++allocIndex;
+            freed = true;
+        }
+
+        if(suballoc.type == SUBALLOCATION_TYPE_FREE &&
+            prevItem != m_Suballocations.end() &&
+            prevItem->type == SUBALLOCATION_TYPE_FREE)
+        {
+            // Two free neighbours are only possible next to a suballocation freed now.
+            if(prevItem != unregisteredItem)
+            {
+                UnregisterFreeSuballocation(prevItem);
+                unregisteredItem = prevItem;
+            }
+            if(!freed)
+            {
+                UnregisterFreeSuballocation(suballocItem);
+            }
+            prevItem->size += suballoc.size;
+            --m_FreeCount;
+            SuballocationList::iterator itemToErase = suballocItem;
+            ++suballocItem;
+            m_Suballocations.erase(itemToErase);
+        }
+        else
+        {
+            if(unregisteredItem != m_Suballocations.end())
+            {
+                RegisterFreeSuballocation(unregisteredItem);
+                unregisteredItem = m_Suballocations.end();
+            }
+            if(freed)
+            {
+                unregisteredItem = suballocItem;
+            }
+            else if(allocIndex == allocationCount)
+            {
+                break;
+            }
+            prevItem = suballocItem;
+            ++suballocItem;
+        }
+    }
+    if(unregisteredItem != m_Suballocations.end())
+    {
+        RegisterFreeSuballocation(unregisteredItem);
+    }
+    D3D12MA_ASSERT(allocIndex == allocationCount && "Not all allocations found!");
+
+    D3D12MA_HEAVY_ASSERT(Validate());
+}
+
+bool BlockMetadata_Generic::ValidateFreeSuballocationList() const
+{
+    UINT64 lastSize = 0;
+    for(size_t i = 0, count = m_FreeSuballocationsBySize.size(); i < count; ++i)
+    {
+        const SuballocationList::iterator it = m_FreeSuballocationsBySize[i];
+
+        D3D12MA_VALIDATE(it->type == SUBALLOCATION_TYPE_FREE);
+        D3D12MA_VALIDATE(it->size >= GetMinFreeSizeToRegister());
+        D3D12MA_VALIDATE(it->size >= lastSize);
+        lastSize = it->size;
+    }
+    return true;
+}
+
+bool BlockMetadata_Generic::CheckAllocation(
+    UINT64 allocSize,
+    UINT64 allocAlignment,
+    SuballocationList::const_iterator suballocItem,
+    UINT64* pOffset,
+    UINT64* pSumFreeSize,
+    UINT64* pSumItemSize) const
+{
+    D3D12MA_ASSERT(allocSize > 0);
+    D3D12MA_ASSERT(suballocItem != m_Suballocations.cend());
+    D3D12MA_ASSERT(pOffset != NULL);
+
+    *pSumFreeSize = 0;
+    *pSumItemSize = 0;
+
+    const Suballocation& suballoc = *suballocItem;
+    D3D12MA_ASSERT(suballoc.type == SUBALLOCATION_TYPE_FREE);
+
+    *pSumFreeSize = suballoc.size;
+
+    // Size of this suballocation is too small for this request: Early return.
+    if(suballoc.size < allocSize)
+    {
+        return false;
+    }
+
+    // Start from offset equal to beginning of this suballocation.
+    *pOffset = suballoc.offset;
+
+    // Apply debug margin at the beginning.
+    if(GetDebugMargin() > 0)
+    {
+        *pOffset += GetDebugMargin();
+    }
+
+    // Apply alignment.
+    *pOffset = AlignUp(*pOffset, allocAlignment);
+
+    // Calculate padding at the beginning based on current offset.
+    const UINT64 paddingBegin = *pOffset - suballoc.offset;
+
+    // Calculate required margin at the end.
+    const UINT64 requiredEndMargin = GetDebugMargin();
+
+    // Fail if requested size plus margin before and after is bigger than size of this suballocation.
+    if(paddingBegin + allocSize + requiredEndMargin > suballoc.size)
+    {
+        return false;
+    }
+
+    // All tests passed: Success. pOffset is already filled.
+    return true;
+}
+
+void BlockMetadata_Generic::MergeFreeWithNext(SuballocationList::iterator item)
+{
+    D3D12MA_ASSERT(item != m_Suballocations.end());
+    D3D12MA_ASSERT(item->type == SUBALLOCATION_TYPE_FREE);
+
+    SuballocationList::iterator nextItem = item;
+    ++nextItem;
+    D3D12MA_ASSERT(nextItem != m_Suballocations.end());
+    D3D12MA_ASSERT(nextItem->type == SUBALLOCATION_TYPE_FREE);
+
+    item->size += nextItem->size;
+    --m_FreeCount;
+    m_Suballocations.erase(nextItem);
+}
+
+SuballocationList::iterator BlockMetadata_Generic::FreeSuballocation(SuballocationList::iterator suballocItem)
+{
+    // Change this suballocation to be marked as free.
+    Suballocation& suballoc = *suballocItem;
+    suballoc.type = SUBALLOCATION_TYPE_FREE;
+    suballoc.userData = NULL;
+
+    // Update totals.
+    ++m_FreeCount;
+    m_SumFreeSize += suballoc.size;
+
+    // Merge with previous and/or next suballocation if it's also free.
+    bool mergeWithNext = false;
+    bool mergeWithPrev = false;
+
+    SuballocationList::iterator nextItem = suballocItem;
+    ++nextItem;
+    if((nextItem != m_Suballocations.end()) && (nextItem->type == SUBALLOCATION_TYPE_FREE))
+    {
+        mergeWithNext = true;
+    }
+
+    SuballocationList::iterator prevItem = suballocItem;
+    if(suballocItem != m_Suballocations.begin())
+    {
+        --prevItem;
+        if(prevItem->type == SUBALLOCATION_TYPE_FREE)
+        {
+            mergeWithPrev = true;
+        }
+    }
+
+    if(mergeWithNext)
+    {
+        UnregisterFreeSuballocation(nextItem);
+        MergeFreeWithNext(suballocItem);
+    }
+
+    if(mergeWithPrev)
+    {
+        UnregisterFreeSuballocation(prevItem);
+        MergeFreeWithNext(prevItem);
+        RegisterFreeSuballocation(prevItem);
+        return prevItem;
+    }
+    else
+    {
+        RegisterFreeSuballocation(suballocItem);
+        return suballocItem;
+    }
+}
+
+void BlockMetadata_Generic::RegisterFreeSuballocation(SuballocationList::iterator item)
+{
+    D3D12MA_ASSERT(item->type == SUBALLOCATION_TYPE_FREE);
+    D3D12MA_ASSERT(item->size > 0);
+
+    // You may want to enable this validation at the beginning or at the end of
+    // this function, depending on what do you want to check.
+    D3D12MA_HEAVY_ASSERT(ValidateFreeSuballocationList());
+
+    if(item->size >= GetMinFreeSizeToRegister())
+    {
+        if(m_FreeSuballocationsBySize.empty())
+        {
+            m_FreeSuballocationsBySize.push_back(item);
+        }
+        else
+        {
+            m_FreeSuballocationsBySize.InsertSorted(item, SuballocationItemSizeLess());
+        }
+    }
+
+    //D3D12MA_HEAVY_ASSERT(ValidateFreeSuballocationList());
+}
+
+
+void BlockMetadata_Generic::UnregisterFreeSuballocation(SuballocationList::iterator item)
+{
+    D3D12MA_ASSERT(item->type == SUBALLOCATION_TYPE_FREE);
     D3D12MA_ASSERT(item->size > 0);
 
-    // You may want to enable this validation at the beginning or at the end of
-    // this function, depending on what do you want to check.
-    D3D12MA_HEAVY_ASSERT(ValidateFreeSuballocationList());
+    // You may want to enable this validation at the beginning or at the end of
+    // this function, depending on what do you want to check.
+    D3D12MA_HEAVY_ASSERT(ValidateFreeSuballocationList());
+
+    if(item->size >= GetMinFreeSizeToRegister())
+    {
+        SuballocationList::iterator* const it = BinaryFindFirstNotLess(
+            m_FreeSuballocationsBySize.data(),
+            m_FreeSuballocationsBySize.data() + m_FreeSuballocationsBySize.size(),
+            item,
+            SuballocationItemSizeLess());
+        for(size_t index = it - m_FreeSuballocationsBySize.data();
+            index < m_FreeSuballocationsBySize.size();
+            ++index)
+        {
+            if(m_FreeSuballocationsBySize[index] == item)
+            {
+                m_FreeSuballocationsBySize.remove(index);
+                return;
+            }
+            D3D12MA_ASSERT((m_FreeSuballocationsBySize[index]->size == item->size) && "Not found.");
+        }
+        D3D12MA_ASSERT(0 && "Not found.");
+    }
+
+    //D3D12MA_HEAVY_ASSERT(ValidateFreeSuballocationList());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private class DeviceMemoryBlock implementation
+
+DeviceMemoryBlock::DeviceMemoryBlock() :
+    m_pMetadata(NULL),
+    m_BlockVector(NULL),
+    m_HeapType(D3D12_HEAP_TYPE_CUSTOM),
+    m_Id(0),
+    m_Lifetime(ALLOCATION_LIFETIME_DEFAULT),
+    m_Heap(NULL),
+    m_Buffer(NULL),
+    m_MappedData(NULL),
+    m_EmptySinceFrameIndex(0),
+    m_EmptySinceTime(0)
+{
+}
+
+void DeviceMemoryBlock::Init(
+    AllocatorPimpl* allocator,
+    BlockVector* blockVector,
+    D3D12_HEAP_TYPE newHeapType,
+    ID3D12Heap* newHeap,
+    ID3D12Resource* newBuffer,
+    void* newMappedData,
+    UINT64 newSize,
+    UINT id)
+{
+    D3D12MA_ASSERT(m_Heap == NULL);
+
+    m_BlockVector = blockVector;
+    m_HeapType = newHeapType;
+    m_Id = id;
+    m_Heap = newHeap;
+    m_Buffer = newBuffer;
+    m_MappedData = newMappedData;
+
+    const ALLOCATION_CALLBACKS& allocs = allocator->GetAllocs();
+
+    m_pMetadata = D3D12MA_NEW(allocs, BlockMetadataAlgorithm)(&allocs, false);
+    m_pMetadata->Init(newSize);
+}
+
+void DeviceMemoryBlock::Destroy(AllocatorPimpl* allocator)
+{
+    // THIS IS THE MOST IMPORTANT ASSERT IN THE ENTIRE LIBRARY!
+    // Hitting it means you have some memory leak - unreleased Allocation objects.
+    D3D12MA_ASSERT(m_pMetadata->IsEmpty() && "Some allocations were not freed before destruction of this memory block!");
+
+    allocator->NotifyHeapDestroyed(*this);
+
+    // Buffer must be released before the heap it is placed in. Unmapping is not required.
+    if(m_Buffer != NULL)
+    {
+        m_Buffer->Release();
+        m_Buffer = NULL;
+        m_MappedData = NULL;
+    }
+
+    D3D12MA_ASSERT(m_Heap != NULL);
+    allocator->ReleaseHeap(m_BlockVector->CalcHeapDesc(m_pMetadata->GetSize()), m_Heap);
+    m_Heap = NULL;
+
+    D3D12MA_DELETE(allocator->GetAllocs(), m_pMetadata);
+    m_pMetadata = NULL;
+}
+
+bool DeviceMemoryBlock::Validate() const
+{
+    D3D12MA_VALIDATE(m_Heap && m_pMetadata && m_pMetadata->GetSize() != 0);
+    return m_pMetadata->Validate();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private class BlockSizePolicy implementation
+
+BlockSizePolicy::BlockSizePolicy(UINT64 preferredBlockSize) :
+    m_PreferredBlockSize(preferredBlockSize)
+{
+    for(UINT i = 0; i < BUCKET_COUNT; ++i)
+    {
+        m_BucketCounts[i].store(0);
+    }
+    m_RequestCount.store(0);
+    // Same as without this policy, until enough requests are seen.
+    m_CommittedThreshold.store(preferredBlockSize / 2);
+}
+
+void BlockSizePolicy::AddRequest(UINT64 size)
+{
+    UINT bucket = 0;
+    for(UINT64 v = size; v >>= 1; )
+    {
+        ++bucket;
+    }
+    m_BucketCounts[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    const UINT requestCount = m_RequestCount.fetch_add(1, std::memory_order_relaxed) + 1;
+    if(requestCount % DECAY_PERIOD == 0)
+    {
+        for(UINT i = 0; i < BUCKET_COUNT; ++i)
+        {
+            m_BucketCounts[i].store(m_BucketCounts[i].load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+        }
+    }
+    if(requestCount % UPDATE_PERIOD == 0)
+    {
+        m_CommittedThreshold.store(CalcTypicalBlockSize() / 2, std::memory_order_relaxed);
+    }
+}
+
+UINT64 BlockSizePolicy::CalcNewBlockSize(UINT64 size, UINT64 existingBlocksSize, UINT64 existingAllocatedSize) const
+{
+    UINT64 blockSize = CalcTypicalBlockSize();
+    // Existing blocks are well used, so the workload grows. Grow geometrically to need few heaps.
+    if(existingBlocksSize > 0 && existingAllocatedSize >= existingBlocksSize / 4 * 3)
+    {
+        blockSize = D3D12MA_MAX(blockSize, (UINT64)NextPow2((uint64_t)existingBlocksSize) / 2);
+    }
+    blockSize = D3D12MA_MAX(blockSize, (UINT64)NextPow2((uint64_t)size));
+    return ClampBlockSize(blockSize);
+}
+
+UINT64 BlockSizePolicy::CalcTypicalBlockSize() const
+{
+    UINT bucketCounts[BUCKET_COUNT];
+    UINT64 totalCount = 0;
+    for(UINT i = 0; i < BUCKET_COUNT; ++i)
+    {
+        bucketCounts[i] = m_BucketCounts[i].load(std::memory_order_relaxed);
+        totalCount += bucketCounts[i];
+    }
+    if(totalCount == 0)
+    {
+        return m_PreferredBlockSize;
+    }
+
+    const UINT64 rank = (totalCount * 9 + 9) / 10;
+    UINT64 cumulativeCount = 0;
+    UINT bucket = 0;
+    for(; bucket < BUCKET_COUNT - 1; ++bucket)
+    {
+        cumulativeCount += bucketCounts[bucket];
+        if(cumulativeCount >= rank)
+        {
+            break;
+        }
+    }
+    // Sizes this large need the largest block anyway. Avoids overflow.
+    if(bucket >= 40)
+    {
+        return GetMaxBlockSize();
+    }
+    // Upper end of the bucket.
+    return ClampBlockSize((2ull << bucket) * ALLOCATIONS_PER_BLOCK);
+}
+
+UINT64 BlockSizePolicy::ClampBlockSize(UINT64 blockSize) const
+{
+    return D3D12MA_MIN(D3D12MA_MAX(blockSize, ADAPTIVE_MIN_BLOCK_SIZE), GetMaxBlockSize());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private class BlockVector implementation
+
+BlockVector::BlockVector(
+    AllocatorPimpl* hAllocator,
+    D3D12_HEAP_TYPE heapType,
+    D3D12_HEAP_FLAGS heapFlags,
+    bool msaa,
+    UINT creationNodeMask,
+    UINT visibleNodeMask,
+    UINT64 preferredBlockSize,
+    size_t minBlockCount,
+    size_t maxBlockCount,
+    bool explicitBlockSize,
+    bool bufferSuballocation,
+    bool adaptiveBlockSize) :
+    m_hAllocator(hAllocator),
+    m_HeapType(heapType),
+    m_HeapFlags(heapFlags),
+    m_Msaa(msaa),
+    m_CreationNodeMask(creationNodeMask),
+    m_VisibleNodeMask(visibleNodeMask),
+    m_PreferredBlockSize(preferredBlockSize),
+    m_MinBlockCount(minBlockCount),
+    m_MaxBlockCount(maxBlockCount),
+    m_ExplicitBlockSize(explicitBlockSize),
+    m_BufferSuballocation(bufferSuballocation),
+    m_AdaptiveBlockSize(adaptiveBlockSize && !explicitBlockSize),
+    m_BlockSizePolicy(preferredBlockSize),
+    m_Blocks(hAllocator->GetAllocs())
+{
+#if D3D12MA_TRACE_EVENTS
+    m_Mutex.pTraceEvents = hAllocator->GetTraceEvents();
+#endif
+}
+
+BlockVector::~BlockVector()
+{
+    for(size_t i = m_Blocks.size(); i--; )
+    {
+        m_Blocks[i]->Destroy(m_hAllocator);
+        D3D12MA_DELETE(m_hAllocator->GetAllocs(), m_Blocks[i]);
+    }
+}
+
+HRESULT BlockVector::CreateMinBlocks()
+{
+    for(size_t i = 0; i < m_MinBlockCount; ++i)
+    {
+        HRESULT hr = CreateBlock(m_PreferredBlockSize, NULL);
+        if(FAILED(hr))
+        {
+            return hr;
+        }
+    }
+    return S_OK;
+}
+
+HRESULT BlockVector::Allocate(
+    UINT64 size,
+    UINT64 alignment,
+    const ALLOCATION_DESC& createInfo,
+    size_t allocationCount,
+    Allocation** pAllocations)
+{
+    size_t allocIndex;
+    HRESULT hr = S_OK;
+
+    {
+        MutexLockWrite lock(m_Mutex, m_hAllocator->UseMutex());
+        for(allocIndex = 0; allocIndex < allocationCount; ++allocIndex)
+        {
+            hr = AllocatePage(
+                size,
+                alignment,
+                createInfo,
+                pAllocations + allocIndex);
+            if(FAILED(hr))
+            {
+                break;
+            }
+        }
+    }
+
+    if(FAILED(hr))
+    {
+        // Free all already created allocations.
+        while(allocIndex--)
+        {
+            Free(pAllocations[allocIndex]);
+        }
+        memset(pAllocations, 0, sizeof(Allocation*) * allocationCount);
+    }
+
+    return hr;
+}
+
+HRESULT BlockVector::AllocatePage(
+    UINT64 size,
+    UINT64 alignment,
+    const ALLOCATION_DESC& createInfo,
+    Allocation** pAllocation)
+{
+    // Early reject: requested allocation size is larger that maximum block size for this block vector.
+    const UINT64 maxBlockSize = m_AdaptiveBlockSize ? m_BlockSizePolicy.GetMaxBlockSize() : m_PreferredBlockSize;
+    if(size + 2 * D3D12MA_DEBUG_MARGIN > maxBlockSize)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    const bool canCreateNewBlock =
+        ((createInfo.Flags & ALLOCATION_FLAG_NEVER_ALLOCATE) == 0) &&
+        (m_Blocks.size() < m_MaxBlockCount);
+
+    if(canCreateNewBlock)
+    {
+        // 1. Search existing allocations. Try to allocate without making other allocations lost.
+        ALLOCATION_FLAGS allocFlagsCopy = createInfo.Flags;
+
+        {
+            HRESULT hr = AllocateFromExistingBlocks(size, alignment, allocFlagsCopy, createInfo.Lifetime, pAllocation);
+            if(SUCCEEDED(hr))
+            {
+                return hr;
+            }
+        }
+
+        // 2. Try to create new block.
+        if(canCreateNewBlock)
+        {
+            // Calculate optimal size for new block.
+            UINT64 newBlockSize = m_PreferredBlockSize;
+            UINT newBlockSizeShift = 0;
+            const UINT NEW_BLOCK_SIZE_SHIFT_MAX = 3;
+
+            if(m_AdaptiveBlockSize)
+            {
+                UINT64 existingBlocksSize = 0, existingAllocatedSize = 0;
+                for(size_t blockIndex = 0; blockIndex < m_Blocks.size(); ++blockIndex)
+                {
+                    const BlockMetadataAlgorithm* const pMetadata = m_Blocks[blockIndex]->m_pMetadata;
+                    existingBlocksSize += pMetadata->GetSize();
+                    existingAllocatedSize += pMetadata->GetSize() - pMetadata->GetSumFreeSize();
+                }
+                newBlockSize = m_BlockSizePolicy.CalcNewBlockSize(
+                    size + 2 * D3D12MA_DEBUG_MARGIN, existingBlocksSize, existingAllocatedSize);
+            }
+            else if(!m_ExplicitBlockSize)
+            {
+                // Allocate 1/8, 1/4, 1/2 as first blocks.
+                const UINT64 maxExistingBlockSize = CalcMaxBlockSize();
+                for(UINT i = 0; i < NEW_BLOCK_SIZE_SHIFT_MAX; ++i)
+                {
+                    const UINT64 smallerNewBlockSize = newBlockSize / 2;
+                    if(smallerNewBlockSize > maxExistingBlockSize && smallerNewBlockSize >= size * 2)
+                    {
+                        newBlockSize = smallerNewBlockSize;
+                        ++newBlockSizeShift;
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+            }
+
+            size_t newBlockIndex = 0;
+            HRESULT hr = CreateBlock(newBlockSize, &newBlockIndex);
+            // Allocation of this size failed? Try 1/2, 1/4, 1/8 of it.
+            if(!m_ExplicitBlockSize)
+            {
+                while(FAILED(hr) && newBlockSizeShift < NEW_BLOCK_SIZE_SHIFT_MAX)
+                {
+                    const UINT64 smallerNewBlockSize = newBlockSize / 2;
+                    if(smallerNewBlockSize >= size)
+                    {
+                        newBlockSize = smallerNewBlockSize;
+                        ++newBlockSizeShift;
+                        hr = CreateBlock(newBlockSize, &newBlockIndex);
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+            }
+
+            if(SUCCEEDED(hr))
+            {
+                DeviceMemoryBlock* const pBlock = m_Blocks[newBlockIndex];
+                D3D12MA_ASSERT(pBlock->m_pMetadata->GetSize() >= size);
+
+                hr = AllocateFromBlock(
+                    pBlock,
+                    size,
+                    alignment,
+                    allocFlagsCopy,
+                    createInfo.Lifetime,
+                    pAllocation);
+                if(SUCCEEDED(hr))
+                {
+                    return hr;
+                }
+                else
+                {
+                    // Allocation from new block failed, possibly due to D3D12MA_DEBUG_MARGIN or alignment.
+                    return E_OUTOFMEMORY;
+                }
+            }
+        }
+    }
+
+    return E_OUTOFMEMORY;
+}
+
+void BlockVector::Free(Allocation* hAllocation)
+{
+    DeviceMemoryBlock* pBlockToDelete = NULL;
+
+    // Scope for lock.
+    {
+        MutexLockWrite lock(m_Mutex, m_hAllocator->UseMutex());
+
+        DeviceMemoryBlock* pBlock = hAllocation->GetBlock();
+
+        pBlock->m_pMetadata->Free(hAllocation);
+        D3D12MA_HEAVY_ASSERT(pBlock->Validate());
+
+        // pBlock became empty after this deallocation.
+        if(pBlock->m_pMetadata->IsEmpty())
+        {
+            if(!KeepEmptyBlock(pBlock))
+            {
+                pBlockToDelete = pBlock;
+                Remove(pBlock);
+            }
+        }
+        // pBlock didn't become empty, but we may have another empty block - free that one.
+        // (This is optional, heuristics. Not done when empty blocks are kept by a retention policy.)
+        else if(!m_hAllocator->HasEmptyBlockRetention())
+        {
+            DeviceMemoryBlock* pLastBlock = m_Blocks.back();
+            if(pLastBlock->m_pMetadata->IsEmpty() && m_Blocks.size() > m_MinBlockCount)
+            {
+                pBlockToDelete = pLastBlock;
+                m_Blocks.pop_back();
+            }
+        }
+
+        IncrementallySortBlocks();
+    }
+
+    // Destruction of a free Allocation. Deferred until this point, outside of mutex
+    // lock, for performance reason.
+    if(pBlockToDelete != NULL)
+    {
+        pBlockToDelete->Destroy(m_hAllocator);
+        D3D12MA_DELETE(m_hAllocator->GetAllocs(), pBlockToDelete);
+    }
+}
+
+void BlockVector::Free(size_t allocationCount, Allocation** pAllocations)
+{
+    Vector<DeviceMemoryBlock*> blocksToDelete(m_hAllocator->GetAllocs());
+
+    // Scope for lock.
+    {
+        MutexLockWrite lock(m_Mutex, m_hAllocator->UseMutex());
+
+        bool anyBlockNotEmpty = false;
+        size_t allocIndex = 0;
+        while(allocIndex < allocationCount)
+        {
+            DeviceMemoryBlock* const pBlock = pAllocations[allocIndex]->GetBlock();
+            D3D12MA_ASSERT(pBlock->GetBlockVector() == this);
+
+            // Find range of allocations that belong to this block.
+            size_t allocEndIndex = allocIndex + 1;
+            while(allocEndIndex < allocationCount && pAllocations[allocEndIndex]->GetBlock() == pBlock)
+            {
+                ++allocEndIndex;
+            }
+
+            pBlock->m_pMetadata->FreeMultiple(pAllocations + allocIndex, allocEndIndex - allocIndex);
+            D3D12MA_HEAVY_ASSERT(pBlock->Validate());
+
+            // pBlock became empty after this deallocation.
+            if(pBlock->m_pMetadata->IsEmpty())
+            {
+                if(!KeepEmptyBlock(pBlock))
+                {
+                    blocksToDelete.push_back(pBlock);
+                    Remove(pBlock);
+                }
+            }
+            else
+            {
+                anyBlockNotEmpty = true;
+            }
+
+            allocIndex = allocEndIndex;
+        }
+
+        // Same heuristics as in single Free, applied once: some block didn't become empty,
+        // but we may have another empty block - free that one.
+        if(anyBlockNotEmpty && !m_hAllocator->HasEmptyBlockRetention())
+        {
+            DeviceMemoryBlock* pLastBlock = m_Blocks.back();
+            if(pLastBlock->m_pMetadata->IsEmpty() && m_Blocks.size() > m_MinBlockCount)
+            {
+                blocksToDelete.push_back(pLastBlock);
+                m_Blocks.pop_back();
+            }
+        }
+
+        IncrementallySortBlocks();
+    }
+
+    // Destruction of free blocks. Deferred until this point, outside of mutex
+    // lock, for performance reason.
+    for(size_t i = blocksToDelete.size(); i--; )
+    {
+        blocksToDelete[i]->Destroy(m_hAllocator);
+        D3D12MA_DELETE(m_hAllocator->GetAllocs(), blocksToDelete[i]);
+    }
+}
+
+UINT BlockVector::Trim(UINT currentFrameIndex, UINT64 currentTime)
+{
+    const EMPTY_BLOCK_RETENTION& retention = m_hAllocator->GetEmptyBlockRetention();
+    Vector<DeviceMemoryBlock*> blocksToDelete(m_hAllocator->GetAllocs());
+
+    // Scope for lock.
+    {
+        MutexLockWrite lock(m_Mutex, m_hAllocator->UseMutex());
+
+        for(size_t blockIndex = m_Blocks.size(); blockIndex-- && m_Blocks.size() > m_MinBlockCount; )
+        {
+            DeviceMemoryBlock* const pBlock = m_Blocks[blockIndex];
+            if(!pBlock->m_pMetadata->IsEmpty())
+            {
+                continue;
+            }
+            // Without any limit of disuse, all empty blocks are released.
+            const bool release =
+                (retention.FrameCount == 0 && retention.Milliseconds == 0) ||
+                (retention.FrameCount != 0 &&
+                    currentFrameIndex - pBlock->GetEmptySinceFrameIndex() >= retention.FrameCount) ||
+                (retention.Milliseconds != 0 &&
+                    currentTime - pBlock->GetEmptySinceTime() >= (UINT64)retention.Milliseconds * 1000000);
+            if(release)
+            {
+                blocksToDelete.push_back(pBlock);
+                m_Blocks.remove(blockIndex);
+            }
+        }
+    }
+
+    // Destruction of free blocks. Deferred until this point, outside of mutex
+    // lock, for performance reason.
+    for(size_t i = blocksToDelete.size(); i--; )
+    {
+        blocksToDelete[i]->Destroy(m_hAllocator);
+        D3D12MA_DELETE(m_hAllocator->GetAllocs(), blocksToDelete[i]);
+    }
+    return (UINT)blocksToDelete.size();
+}
+
+void BlockVector::AddEmptyBlockStats(UINT& inoutCount, UINT64& inoutBytes)
+{
+    MutexLockRead lock(m_Mutex, m_hAllocator->UseMutex());
+    for(size_t blockIndex = 0; blockIndex < m_Blocks.size(); ++blockIndex)
+    {
+        if(m_Blocks[blockIndex]->m_pMetadata->IsEmpty())
+        {
+            ++inoutCount;
+            inoutBytes += m_Blocks[blockIndex]->m_pMetadata->GetSize();
+        }
+    }
+}
+
+#if D3D12MA_LOCK_STATS
+void BlockVector::GetLockStats(PoolLockStats& outStats) const
+{
+    outStats.HeapType = m_HeapType;
+    outStats.HeapFlags = m_HeapFlags;
+    outStats.Msaa = m_Msaa ? TRUE : FALSE;
+    m_Mutex.Counters.Get(outStats.Lock);
+}
+#endif
+
+UINT64 BlockVector::GetHeapAlignment() const
+{
+    /*
+    Documentation of D3D12_HEAP_DESC structure says:
+
+    - D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT   defined as 64KB.
+    - D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT   defined as 4MB. An
+      application must decide whether the heap will contain multi-sample
+      anti-aliasing (MSAA), in which case, the application must choose [this flag].
+
+    https://docs.microsoft.com/en-us/windows/desktop/api/d3d12/ns-d3d12-d3d12_heap_desc
+
+    Multisampled resources have block vectors of their own, so other heaps don't
+    need the larger alignment.
+    */
+    return m_Msaa ?
+        D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT : D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+}
+
+UINT64 BlockVector::CalcMaxBlockSize() const
+{
+    UINT64 result = 0;
+    for(size_t i = m_Blocks.size(); i--; )
+    {
+        result = D3D12MA_MAX(result, m_Blocks[i]->m_pMetadata->GetSize());
+        if(result >= m_PreferredBlockSize)
+        {
+            break;
+        }
+    }
+    return result;
+}
+
+bool BlockVector::KeepEmptyBlock(DeviceMemoryBlock* pBlock)
+{
+    bool keep = m_Blocks.size() <= m_MinBlockCount;
+    if(!keep)
+    {
+        const EMPTY_BLOCK_RETENTION& retention = m_hAllocator->GetEmptyBlockRetention();
+        UINT otherEmptyBlockCount = 0;
+        UINT64 otherEmptyBlockBytes = 0;
+        for(size_t blockIndex = 0; blockIndex < m_Blocks.size(); ++blockIndex)
+        {
+            const DeviceMemoryBlock* const pOtherBlock = m_Blocks[blockIndex];
+            if(pOtherBlock != pBlock && pOtherBlock->m_pMetadata->IsEmpty())
+            {
+                ++otherEmptyBlockCount;
+                otherEmptyBlockBytes += pOtherBlock->m_pMetadata->GetSize();
+            }
+        }
+        keep = otherEmptyBlockCount < retention.MaxBlockCount &&
+            (retention.MaxBytes == 0 || otherEmptyBlockBytes + pBlock->m_pMetadata->GetSize() <= retention.MaxBytes);
+    }
+    if(keep)
+    {
+        pBlock->SetEmptySince(m_hAllocator->GetCurrentFrameIndex(), GetTimeNanoseconds());
+    }
+    return keep;
+}
+
+void BlockVector::Remove(DeviceMemoryBlock* pBlock)
+{
+    for(UINT blockIndex = 0; blockIndex < m_Blocks.size(); ++blockIndex)
+    {
+        if(m_Blocks[blockIndex] == pBlock)
+        {
+            m_Blocks.remove(blockIndex);
+            return;
+        }
+    }
+    D3D12MA_ASSERT(0);
+}
+
+void BlockVector::IncrementallySortBlocks()
+{
+    // Bubble sort only until first swap.
+    for(size_t i = 1; i < m_Blocks.size(); ++i)
+    {
+        if(m_Blocks[i - 1]->m_pMetadata->GetSumFreeSize() > m_Blocks[i]->m_pMetadata->GetSumFreeSize())
+        {
+            D3D12MA_SWAP(m_Blocks[i - 1], m_Blocks[i]);
+            return;
+        }
+    }
+}
+
+HRESULT BlockVector::AllocateFromExistingBlocks(
+    UINT64 size,
+    UINT64 alignment,
+    ALLOCATION_FLAGS allocFlags,
+    ALLOCATION_LIFETIME lifetime,
+    Allocation** pAllocation)
+{
+    const UINT strategy = allocFlags & ALLOCATION_FLAG_STRATEGY_MASK;
+    if(strategy == ALLOCATION_FLAG_STRATEGY_MIN_TIME)
+    {
+        // First block whose largest free range is big enough - skip the others without searching them.
+        for(size_t blockIndex = 0; blockIndex < m_Blocks.size(); ++blockIndex)
+        {
+            DeviceMemoryBlock* const pCurrBlock = m_Blocks[blockIndex];
+            D3D12MA_ASSERT(pCurrBlock);
+            if(pCurrBlock->m_pMetadata->GetUnusedRangeSizeMax() >= size + 2 * D3D12MA_DEBUG_MARGIN &&
+                SUCCEEDED(AllocateFromBlock(pCurrBlock, size, alignment, allocFlags, lifetime, pAllocation)))
+            {
+                return S_OK;
+            }
+        }
+    }
+    else if(strategy == ALLOCATION_FLAG_STRATEGY_MIN_FRAGMENTATION)
+    {
+        // Backward order in m_Blocks - prefer blocks with largest amount of free space.
+        for(size_t blockIndex = m_Blocks.size(); blockIndex--; )
+        {
+            DeviceMemoryBlock* const pCurrBlock = m_Blocks[blockIndex];
+            D3D12MA_ASSERT(pCurrBlock);
+            if(SUCCEEDED(AllocateFromBlock(pCurrBlock, size, alignment, allocFlags, lifetime, pAllocation)))
+            {
+                return S_OK;
+            }
+        }
+    }
+    else
+    {
+        // Forward order in m_Blocks - prefer blocks with smallest amount of free space.
+        for(size_t blockIndex = 0; blockIndex < m_Blocks.size(); ++blockIndex)
+        {
+            DeviceMemoryBlock* const pCurrBlock = m_Blocks[blockIndex];
+            D3D12MA_ASSERT(pCurrBlock);
+            if(SUCCEEDED(AllocateFromBlock(pCurrBlock, size, alignment, allocFlags, lifetime, pAllocation)))
+            {
+                return S_OK;
+            }
+        }
+    }
+    return E_OUTOFMEMORY;
+}
+
+HRESULT BlockVector::AllocateFromBlock(
+    DeviceMemoryBlock* pBlock,
+    UINT64 size,
+    UINT64 alignment,
+    ALLOCATION_FLAGS allocFlags,
+    ALLOCATION_LIFETIME lifetime,
+    Allocation** pAllocation)
+{
+    // Allocations of different lifetimes don't share blocks, so that blocks of short-lived ones can become empty.
+    if(pBlock->GetLifetime() != lifetime && !pBlock->m_pMetadata->IsEmpty())
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    AllocationRequest currRequest = {};
+    bool found;
+    {
+        D3D12MA_TIME_SCOPE(m_hAllocator, TIMED_OPERATION_FIND_FREE_RANGE)
+        found = pBlock->m_pMetadata->CreateAllocationRequest(
+            size,
+            alignment,
+            allocFlags & ALLOCATION_FLAG_STRATEGY_MASK,
+            &currRequest);
+    }
+    if(found)
+    {
+        *pAllocation = D3D12MA_NEW(m_hAllocator->GetAllocs(), Allocation)();
+        pBlock->m_pMetadata->Alloc(currRequest, size, *pAllocation);
+        pBlock->SetLifetime(lifetime);
+        (*pAllocation)->InitPlaced(
+            m_hAllocator,
+            size,
+            currRequest.offset,
+            alignment,
+            pBlock);
+        D3D12MA_HEAVY_ASSERT(pBlock->Validate());
+        return S_OK;
+    }
+    return E_OUTOFMEMORY;
+}
+
+HRESULT BlockVector::CreateBlock(UINT64 blockSize, size_t* pNewBlockIndex)
+{
+    ID3D12Heap* heap = NULL;
+    HRESULT hr = CreateD3d12Heap(heap, blockSize);
+    if(FAILED(hr))
+    {
+        return hr;
+    }
+
+    ID3D12Resource* buffer = NULL;
+    void* mappedData = NULL;
+    if(m_BufferSuballocation)
+    {
+        hr = CreateD3d12Buffer(buffer, mappedData, heap, blockSize);
+        if(FAILED(hr))
+        {
+            m_hAllocator->ReleaseHeap(CalcHeapDesc(blockSize), heap);
+            return hr;
+        }
+    }
+
+    DeviceMemoryBlock* const pBlock = D3D12MA_NEW(m_hAllocator->GetAllocs(), DeviceMemoryBlock)();
+    pBlock->Init(
+        m_hAllocator,
+        this,
+        m_HeapType,
+        heap,
+        buffer,
+        mappedData,
+        blockSize,
+        m_hAllocator->GenerateBlockId());
+
+    m_Blocks.push_back(pBlock);
+    m_hAllocator->NotifyHeapCreated(*pBlock);
+    if(pNewBlockIndex != NULL)
+    {
+        *pNewBlockIndex = m_Blocks.size() - 1;
+    }
+
+    return hr;
+}
+
+D3D12_HEAP_DESC BlockVector::CalcHeapDesc(UINT64 size) const
+{
+    D3D12_HEAP_DESC heapDesc = {};
+    heapDesc.SizeInBytes = size;
+    heapDesc.Properties = m_hAllocator->CalcHeapProperties(m_HeapType, m_CreationNodeMask, m_VisibleNodeMask);
+    heapDesc.Alignment = GetHeapAlignment();
+    heapDesc.Flags = m_HeapFlags | m_hAllocator->GetExtraHeapFlags();
+    return heapDesc;
+}
+
+HRESULT BlockVector::CreateD3d12Heap(ID3D12Heap*& outHeap, UINT64 size) const
+{
+    return m_hAllocator->CreateHeap(CalcHeapDesc(size), outHeap);
+}
+
+HRESULT BlockVector::CreateD3d12Buffer(ID3D12Resource*& outBuffer, void*& outMappedData, ID3D12Heap* heap, UINT64 size) const
+{
+    D3D12_RESOURCE_DESC resourceDesc = {};
+    resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    resourceDesc.Alignment = 0;
+    resourceDesc.Width = size;
+    resourceDesc.Height = 1;
+    resourceDesc.DepthOrArraySize = 1;
+    resourceDesc.MipLevels = 1;
+    resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+    resourceDesc.SampleDesc.Count = 1;
+    resourceDesc.SampleDesc.Quality = 0;
+    resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+    // Buffers in UPLOAD and READBACK heaps must stay in their required state for
+    // their whole lifetime. Buffers in DEFAULT and CUSTOM heap are promoted from COMMON implicitly.
+    D3D12_RESOURCE_STATES initialState = D3D12_RESOURCE_STATE_COMMON;
+    switch(m_HeapType)
+    {
+    case D3D12_HEAP_TYPE_DEFAULT:
+    case D3D12_HEAP_TYPE_CUSTOM:
+        resourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+        break;
+    case D3D12_HEAP_TYPE_UPLOAD:
+        initialState = D3D12_RESOURCE_STATE_GENERIC_READ;
+        break;
+    case D3D12_HEAP_TYPE_READBACK:
+        initialState = D3D12_RESOURCE_STATE_COPY_DEST;
+        break;
+    default:
+        D3D12MA_ASSERT(0);
+    }
+
+    outMappedData = NULL;
+    HRESULT hr;
+    {
+        D3D12MA_TIME_SCOPE(m_hAllocator, TIMED_OPERATION_CREATE_PLACED_RESOURCE)
+        hr = m_hAllocator->GetDevice()->CreatePlacedResource(
+            heap,
+            0, // HeapOffset
+            &resourceDesc,
+            initialState,
+            NULL, // pOptimizedClearValue
+            IID_PPV_ARGS(&outBuffer));
+    }
+    if(SUCCEEDED(hr) && m_HeapType != D3D12_HEAP_TYPE_DEFAULT)
+    {
+        // Keep the buffer persistently mapped. Nothing is read on the CPU side at this point.
+        const D3D12_RANGE readRange = {0, 0};
+        hr = outBuffer->Map(0, m_HeapType == D3D12_HEAP_TYPE_UPLOAD ? &readRange : NULL, &outMappedData);
+        if(FAILED(hr))
+        {
+            outBuffer->Release();
+            outBuffer = NULL;
+        }
+    }
+    return hr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private class HeapCache implementation
+
+HeapCache::HeapCache(const ALLOCATION_CALLBACKS& allocationCallbacks, bool useMutex, UINT64 maxBytes) :
+    m_UseMutex(useMutex),
+    m_MaxBytes(maxBytes),
+    m_Items(allocationCallbacks),
+    m_Bytes(0)
+{
+}
+
+HeapCache::~HeapCache()
+{
+    for(size_t i = m_Items.size(); i--; )
+    {
+        m_Items[i].heap->Release();
+    }
+}
+
+ID3D12Heap* HeapCache::Take(const D3D12_HEAP_DESC& desc)
+{
+    if(m_MaxBytes == 0)
+    {
+        return NULL;
+    }
+
+    MutexLock lock(m_Mutex, m_UseMutex);
+    // Search from the most recently put.
+    for(size_t i = m_Items.size(); i--; )
+    {
+        const Item& item = m_Items[i];
+        if(item.heapType == desc.Properties.Type &&
+            item.heapFlags == desc.Flags &&
+            item.size == desc.SizeInBytes &&
+            item.alignment == desc.Alignment &&
+            item.creationNodeMask == desc.Properties.CreationNodeMask &&
+            item.visibleNodeMask == desc.Properties.VisibleNodeMask)
+        {
+            ID3D12Heap* const heap = item.heap;
+            m_Bytes -= item.size;
+            m_Items.remove(i);
+            return heap;
+        }
+    }
+    return NULL;
+}
+
+void HeapCache::Put(const D3D12_HEAP_DESC& desc, ID3D12Heap* heap)
+{
+    if(desc.SizeInBytes > m_MaxBytes)
+    {
+        heap->Release();
+        return;
+    }
+
+    MutexLock lock(m_Mutex, m_UseMutex);
+    while(m_Bytes + desc.SizeInBytes > m_MaxBytes)
+    {
+        m_Items[0].heap->Release();
+        m_Bytes -= m_Items[0].size;
+        m_Items.remove(0);
+    }
+    const Item item = { heap, desc.Properties.Type, desc.Flags, desc.SizeInBytes, desc.Alignment,
+        desc.Properties.CreationNodeMask, desc.Properties.VisibleNodeMask };
+    m_Items.push_back(item);
+    m_Bytes += desc.SizeInBytes;
+}
+
+void HeapCache::Clear()
+{
+    MutexLock lock(m_Mutex, m_UseMutex);
+    for(size_t i = m_Items.size(); i--; )
+    {
+        m_Items[i].heap->Release();
+    }
+    m_Items.clear();
+    m_Bytes = 0;
+}
+
+void HeapCache::GetStats(UINT& outCount, UINT64& outBytes)
+{
+    MutexLock lock(m_Mutex, m_UseMutex);
+    outCount = (UINT)m_Items.size();
+    outBytes = m_Bytes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private class NameTable implementation
+
+// FNV-1a of the code units of a null-terminated string. Also returns its length.
+template<typename CharT>
+static size_t HashString(const CharT* str, size_t& outLength)
+{
+    UINT64 hash = 14695981039346656037ull;
+    size_t length = 0;
+    for(; str[length] != 0; ++length)
+    {
+        hash = (hash ^ (UINT64)str[length]) * 1099511628211ull;
+    }
+    outLength = length;
+    return (size_t)hash;
+}
+
+/*
+Converts UTF-8 to UTF-16 where wchar_t is 16-bit, or to UTF-32 otherwise. Invalid sequences
+become U+FFFD. Returns the number of wide characters. Pass null dst to only count them.
+*/
+static size_t ConvertUtf8ToWide(const char* src, size_t srcLength, wchar_t* dst)
+{
+    size_t dstLength = 0;
+    size_t i = 0;
+    while(i < srcLength)
+    {
+        const UINT lead = (UINT8)src[i];
+        UINT codePoint;
+        size_t seqLength;
+        if(lead < 0x80) { codePoint = lead; seqLength = 1; }
+        else if((lead & 0xE0) == 0xC0) { codePoint = lead & 0x1F; seqLength = 2; }
+        else if((lead & 0xF0) == 0xE0) { codePoint = lead & 0x0F; seqLength = 3; }
+        else if((lead & 0xF8) == 0xF0) { codePoint = lead & 0x07; seqLength = 4; }
+        else { codePoint = 0xFFFD; seqLength = 1; }
+
+        size_t j = 1;
+        for(; j < seqLength && i + j < srcLength && ((UINT8)src[i + j] & 0xC0) == 0x80; ++j)
+        {
+            codePoint = (codePoint << 6) | ((UINT8)src[i + j] & 0x3F);
+        }
+        if(j < seqLength || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF))
+        {
+            codePoint = 0xFFFD;
+        }
+        i += j;
+
+        if(sizeof(wchar_t) == 2 && codePoint >= 0x10000)
+        {
+            if(dst != NULL)
+            {
+                dst[dstLength] = (wchar_t)(0xD800 + ((codePoint - 0x10000) >> 10));
+                dst[dstLength + 1] = (wchar_t)(0xDC00 + ((codePoint - 0x10000) & 0x3FF));
+            }
+            dstLength += 2;
+        }
+        else
+        {
+            if(dst != NULL)
+            {
+                dst[dstLength] = (wchar_t)codePoint;
+            }
+            ++dstLength;
+        }
+    }
+    return dstLength;
+}
+
+NameTable::NameTable(const ALLOCATION_CALLBACKS& allocationCallbacks, bool useMutex) :
+    m_AllocationCallbacks(allocationCallbacks),
+    m_UseMutex(useMutex),
+    m_Buckets(allocationCallbacks),
+    m_EntryCount(0)
+{
+    m_Buckets.resize(INITIAL_BUCKET_COUNT);
+    memset(m_Buckets.data(), 0, m_Buckets.size() * sizeof(Entry*));
+}
+
+NameTable::~NameTable()
+{
+    for(size_t i = 0; i < m_Buckets.size(); ++i)
+    {
+        for(Entry* entry = m_Buckets[i]; entry != NULL; )
+        {
+            Entry* const next = entry->pNext;
+            Free(m_AllocationCallbacks, entry);
+            entry = next;
+        }
+    }
+}
+
+LPCWSTR NameTable::Acquire(LPCWSTR name)
+{
+    size_t length;
+    const size_t hash = HashString(name, length);
+    return Acquire(name, length * sizeof(wchar_t), hash, false);
+}
+
+LPCWSTR NameTable::Acquire(LPCSTR name)
+{
+    size_t length;
+    const size_t hash = HashString(name, length);
+    return Acquire(name, length, hash, true);
+}
+
+void NameTable::Release(LPCWSTR name)
+{
+    Entry* const entry = (Entry*)name - 1;
+
+    MutexLock lock(m_Mutex, m_UseMutex);
+    D3D12MA_ASSERT(entry->refCount > 0);
+    if(--entry->refCount == 0)
+    {
+        Entry** ppEntry = &m_Buckets[entry->hash & (m_Buckets.size() - 1)];
+        while(*ppEntry != entry)
+        {
+            ppEntry = &(*ppEntry)->pNext;
+        }
+        *ppEntry = entry->pNext;
+        --m_EntryCount;
+        Free(m_AllocationCallbacks, entry);
+    }
+}
+
+const void* NameTable::GetKey(const Entry* entry)
+{
+    const wchar_t* const name = (const wchar_t*)(entry + 1);
+    return entry->narrowKey ? (const void*)(name + wcslen(name) + 1) : name;
+}
+
+LPCWSTR NameTable::Acquire(const void* key, size_t keySize, size_t hash, bool narrowKey)
+{
+    MutexLock lock(m_Mutex, m_UseMutex);
+
+    for(Entry* entry = m_Buckets[hash & (m_Buckets.size() - 1)]; entry != NULL; entry = entry->pNext)
+    {
+        if(entry->hash == hash &&
+            entry->keySize == keySize &&
+            entry->narrowKey == narrowKey &&
+            memcmp(GetKey(entry), key, keySize) == 0)
+        {
+            ++entry->refCount;
+            return GetName(entry);
+        }
+    }
+
+    const size_t nameLength = narrowKey ?
+        ConvertUtf8ToWide((const char*)key, keySize, NULL) : keySize / sizeof(wchar_t);
+    const size_t entrySize = sizeof(Entry) + (nameLength + 1) * sizeof(wchar_t) + (narrowKey ? keySize + 1 : 0);
+    Entry* const entry = (Entry*)Malloc(m_AllocationCallbacks, entrySize, alignof(Entry));
+    entry->hash = hash;
+    entry->keySize = keySize;
+    entry->refCount = 1;
+    entry->narrowKey = narrowKey;
+    wchar_t* const name = GetName(entry);
+    if(narrowKey)
+    {
+        ConvertUtf8ToWide((const char*)key, keySize, name);
+        memcpy(name + nameLength + 1, key, keySize);
+        ((char*)(name + nameLength + 1))[keySize] = 0;
+    }
+    else
+    {
+        memcpy(name, key, keySize);
+    }
+    name[nameLength] = 0;
+
+    Entry** const ppBucket = &m_Buckets[hash & (m_Buckets.size() - 1)];
+    entry->pNext = *ppBucket;
+    *ppBucket = entry;
+    if(++m_EntryCount > m_Buckets.size())
+    {
+        Grow();
+    }
+    return name;
+}
+
+void NameTable::Grow()
+{
+    Entry* allEntries = NULL;
+    for(size_t i = 0; i < m_Buckets.size(); ++i)
+    {
+        for(Entry* entry = m_Buckets[i]; entry != NULL; )
+        {
+            Entry* const next = entry->pNext;
+            entry->pNext = allEntries;
+            allEntries = entry;
+            entry = next;
+        }
+    }
+
+    m_Buckets.resize(m_Buckets.size() * 2);
+    memset(m_Buckets.data(), 0, m_Buckets.size() * sizeof(Entry*));
+    const size_t mask = m_Buckets.size() - 1;
+    while(allEntries != NULL)
+    {
+        Entry* const entry = allEntries;
+        allEntries = entry->pNext;
+        entry->pNext = m_Buckets[entry->hash & mask];
+        m_Buckets[entry->hash & mask] = entry;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private class NodePools implementation
+
+NodePools::NodePools(AllocatorPimpl* hAllocator, UINT creationNodeMask, UINT visibleNodeMask, bool adaptiveBlockSize) :
+    m_hAllocator(hAllocator),
+    m_CreationNodeMask(creationNodeMask),
+    m_VisibleNodeMask(visibleNodeMask)
+{
+    memset(m_BlockVectors, 0, sizeof(m_BlockVectors));
+    memset(m_BufferBlockVectors, 0, sizeof(m_BufferBlockVectors));
+
+#if D3D12MA_TRACE_EVENTS
+    for(UINT heapTypeIndex = 0; heapTypeIndex < HEAP_TYPE_COUNT; ++heapTypeIndex)
+    {
+        m_CommittedAllocationsMutex[heapTypeIndex].pTraceEvents = hAllocator->GetTraceEvents();
+    }
+#endif
+
+    const UINT defaultPoolCount = hAllocator->CalcDefaultPoolCount();
+    for(UINT i = 0; i < defaultPoolCount; ++i)
+    {
+        D3D12_HEAP_TYPE heapType;
+        D3D12_HEAP_FLAGS heapFlags;
+        bool msaa;
+        hAllocator->CalcDefaultPoolParams(heapType, heapFlags, msaa, i);
+        if(heapType == D3D12_HEAP_TYPE_CUSTOM && !hAllocator->m_UseUmaCustomHeaps)
+        {
+            continue;
+        }
+
+        m_BlockVectors[i] = D3D12MA_NEW(hAllocator->GetAllocs(), BlockVector)(
+            hAllocator, // hAllocator
+            heapType, // heapType
+            heapFlags, // heapFlags
+            msaa, // msaa
+            creationNodeMask, // creationNodeMask
+            visibleNodeMask, // visibleNodeMask
+            hAllocator->m_PreferredBlockSize,
+            0, // minBlockCount
+            SIZE_MAX, // maxBlockCount
+            false, // explicitBlockSize
+            false, // bufferSuballocation
+            adaptiveBlockSize); // adaptiveBlockSize
+        // No need to call m_pBlockVectors[i]->CreateMinBlocks here, becase minBlockCount is 0.
+    }
+
+    const D3D12_HEAP_TYPE bufferHeapTypes[HEAP_TYPE_COUNT] = {
+        D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_TYPE_UPLOAD, D3D12_HEAP_TYPE_READBACK, D3D12_HEAP_TYPE_CUSTOM };
+    for(UINT i = 0; i < HEAP_TYPE_COUNT; ++i)
+    {
+        D3D12MA_ASSERT(HeapTypeToIndex(bufferHeapTypes[i]) == i);
+        if(bufferHeapTypes[i] == D3D12_HEAP_TYPE_CUSTOM && !hAllocator->m_UseUmaCustomHeaps)
+        {
+            continue;
+        }
+        m_BufferBlockVectors[i] = D3D12MA_NEW(hAllocator->GetAllocs(), BlockVector)(
+            hAllocator, // hAllocator
+            bufferHeapTypes[i], // heapType
+            D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES | D3D12_HEAP_FLAG_DENY_NON_RT_DS_TEXTURES, // heapFlags
+            false, // msaa
+            creationNodeMask, // creationNodeMask
+            visibleNodeMask, // visibleNodeMask
+            hAllocator->m_PreferredBlockSize,
+            0, // minBlockCount
+            SIZE_MAX, // maxBlockCount
+            false, // explicitBlockSize
+            true, // bufferSuballocation
+            adaptiveBlockSize); // adaptiveBlockSize
+    }
+}
+
+NodePools::~NodePools()
+{
+    for(UINT i = HEAP_TYPE_COUNT; i--; )
+    {
+        D3D12MA_DELETE(m_hAllocator->GetAllocs(), m_BufferBlockVectors[i]);
+    }
+
+    for(UINT i = DEFAULT_POOL_MAX_COUNT; i--; )
+    {
+        D3D12MA_DELETE(m_hAllocator->GetAllocs(), m_BlockVectors[i]);
+    }
+
+    for(UINT i = HEAP_TYPE_COUNT; i--; )
+    {
+        if(!m_CommittedAllocations[i].IsEmpty())
+        {
+            D3D12MA_ASSERT(0 && "Unfreed committed allocations found.");
+        }
+    }
+}
+
+void NodePools::AddCommittedAllocation(UINT heapTypeIndex, Allocation* allocation)
+{
+    MutexLockWrite lock(m_CommittedAllocationsMutex[heapTypeIndex], m_hAllocator->UseMutex());
+    m_CommittedAllocations[heapTypeIndex].PushBack(allocation);
+    D3D12MA_HEAVY_ASSERT(m_CommittedAllocations[heapTypeIndex].Validate());
+}
+
+void NodePools::RemoveCommittedAllocations(UINT heapTypeIndex, size_t count, Allocation* const* ppAllocations)
+{
+    MutexLockWrite lock(m_CommittedAllocationsMutex[heapTypeIndex], m_hAllocator->UseMutex());
+    for(size_t i = 0; i < count; ++i)
+    {
+        m_CommittedAllocations[heapTypeIndex].Remove(ppAllocations[i]);
+    }
+    D3D12MA_HEAVY_ASSERT(m_CommittedAllocations[heapTypeIndex].Validate());
+}
+
+UINT NodePools::Trim(UINT currentFrameIndex, UINT64 currentTime)
+{
+    UINT trimmedCount = 0;
+    for(UINT i = 0; i < DEFAULT_POOL_MAX_COUNT; ++i)
+    {
+        if(m_BlockVectors[i] != NULL)
+        {
+            trimmedCount += m_BlockVectors[i]->Trim(currentFrameIndex, currentTime);
+        }
+    }
+    for(UINT i = 0; i < HEAP_TYPE_COUNT; ++i)
+    {
+        if(m_BufferBlockVectors[i] != NULL)
+        {
+            trimmedCount += m_BufferBlockVectors[i]->Trim(currentFrameIndex, currentTime);
+        }
+    }
+    return trimmedCount;
+}
+
+void NodePools::AddEmptyBlockStats(UINT& inoutCount, UINT64& inoutBytes)
+{
+    for(UINT i = 0; i < DEFAULT_POOL_MAX_COUNT; ++i)
+    {
+        if(m_BlockVectors[i] != NULL)
+        {
+            m_BlockVectors[i]->AddEmptyBlockStats(inoutCount, inoutBytes);
+        }
+    }
+    for(UINT i = 0; i < HEAP_TYPE_COUNT; ++i)
+    {
+        if(m_BufferBlockVectors[i] != NULL)
+        {
+            m_BufferBlockVectors[i]->AddEmptyBlockStats(inoutCount, inoutBytes);
+        }
+    }
+}
+
+#if D3D12MA_LOCK_STATS
+void NodePools::GetLockStats(LockStats& outStats) const
+{
+    memset(&outStats, 0, sizeof(outStats));
+    outStats.CreationNodeMask = m_CreationNodeMask;
+    outStats.VisibleNodeMask = m_VisibleNodeMask;
+    outStats.DefaultPoolCount = m_hAllocator->CalcDefaultPoolCount();
+    for(UINT i = 0; i < outStats.DefaultPoolCount; ++i)
+    {
+        if(m_BlockVectors[i] != NULL)
+        {
+            m_BlockVectors[i]->GetLockStats(outStats.DefaultPools[i]);
+        }
+    }
+    for(UINT i = 0; i < HEAP_TYPE_COUNT; ++i)
+    {
+        if(m_BufferBlockVectors[i] != NULL)
+        {
+            m_BufferBlockVectors[i]->GetLockStats(outStats.BufferRangePools[i]);
+        }
+        m_CommittedAllocationsMutex[i].Counters.Get(outStats.CommittedAllocations[i]);
+    }
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Private class AllocatorPimpl implementation
+
+AllocatorPimpl::AllocatorPimpl(const ALLOCATION_CALLBACKS& allocationCallbacks, const ALLOCATOR_DESC& desc) :
+    m_UseMutex((desc.Flags & ALLOCATOR_FLAG_SINGLETHREADED) == 0),
+    m_Device(desc.pDevice),
+    m_PreferredBlockSize(desc.PreferredBlockSize != 0 ? desc.PreferredBlockSize : D3D12MA_DEFAULT_BLOCK_SIZE),
+    m_AllocationCallbacks(allocationCallbacks),
+    m_NextBlockId(0),
+    m_HasEmptyBlockRetention(desc.pEmptyBlockRetention != NULL),
+    m_CurrentFrameIndex(0),
+    m_HeapCreatedCount(0),
+    m_HeapCreatedBytes(0),
+    m_HeapDestroyedCount(0),
+    m_HeapDestroyedBytes(0),
+    m_HeapTrimmedCount(0),
+    m_HeapReusedCount(0),
+    m_SmallAlignmentCount(0),
+    m_SmallAlignmentBytes(0),
+    m_SmallAlignmentSavedBytes(0),
+    m_UseUmaCustomHeaps(false),
+    m_ExtraHeapFlags(D3D12_HEAP_FLAG_NONE),
+    // A recycled heap keeps contents of its previous resources, so it is given only to
+    // allocators that don't need zeroed memory.
+    m_HeapCache(m_AllocationCallbacks, (desc.Flags & ALLOCATOR_FLAG_SINGLETHREADED) == 0,
+        (desc.Flags & ALLOCATOR_FLAG_CREATE_NOT_ZEROED_HEAPS) != 0 ? desc.HeapCacheMaxBytes : 0),
+    m_NameTable(m_AllocationCallbacks, (desc.Flags & ALLOCATOR_FLAG_SINGLETHREADED) == 0),
+    m_NodeCount(1),
+    m_AdaptiveBlockSize((desc.Flags & ALLOCATOR_FLAG_ADAPTIVE_BLOCK_SIZE) != 0),
+    m_DefaultNodePools(NULL),
+    m_OtherNodePools(m_AllocationCallbacks)
+{
+    // desc.pAllocationCallbacks intentionally ignored here, preprocessed by CreateAllocator.
+    memset(&m_D3D12Options, 0, sizeof(m_D3D12Options));
+    memset(&m_D3D12Architecture, 0, sizeof(m_D3D12Architecture));
+
+    for(UINT i = 0; i < ALLOCATION_CATEGORY_COUNT; ++i)
+    {
+        m_CategoryAllocationCounts[i].store(0);
+        m_CategoryAllocationBytes[i].store(0);
+        m_CategoryQuotas[i].store(0);
+    }
+
+    if(desc.pDeviceMemoryCallbacks != NULL)
+    {
+        m_DeviceMemoryCallbacks = *desc.pDeviceMemoryCallbacks;
+    }
+    else
+    {
+        memset(&m_DeviceMemoryCallbacks, 0, sizeof(m_DeviceMemoryCallbacks));
+    }
+
+    if(desc.pEmptyBlockRetention != NULL)
+    {
+        m_EmptyBlockRetention = *desc.pEmptyBlockRetention;
+    }
+    else
+    {
+        // At most one empty block per pool, until Trim.
+        memset(&m_EmptyBlockRetention, 0, sizeof(m_EmptyBlockRetention));
+        m_EmptyBlockRetention.MaxBlockCount = 1;
+    }
+
+#if D3D12MA_RECORDING_ENABLED
+    m_Recorder = NULL;
+#endif
+#if D3D12MA_LATENCY_HISTOGRAMS
+    m_LatencyHistograms = D3D12MA_NEW(GetAllocs(), LatencyHistograms)();
+#endif
+#if D3D12MA_TRACE_EVENTS
+    m_TraceEvents = D3D12MA_NEW(GetAllocs(), TraceEvents)(GetAllocs());
+    m_HeapCache.SetTraceEvents(m_TraceEvents);
+    m_NameTable.SetTraceEvents(m_TraceEvents);
+    m_OtherNodePoolsMutex.pTraceEvents = m_TraceEvents;
+#endif
+}
+
+HRESULT AllocatorPimpl::Init(const ALLOCATOR_DESC& desc)
+{
+#if !D3D12MA_RECORDING_ENABLED
+    if(desc.pRecordSettings != NULL)
+    {
+        D3D12MA_ASSERT(0 && "ALLOCATOR_DESC::pRecordSettings used, but not supported due to D3D12MA_RECORDING_ENABLED not defined to 1.");
+        return E_NOTIMPL;
+    }
+#endif
+
+    HRESULT hr = m_Device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &m_D3D12Options, sizeof(m_D3D12Options));
+    if(FAILED(hr))
+    {
+        return hr;
+    }
 
-    if(item->size >= MIN_FREE_SUBALLOCATION_SIZE_TO_REGISTER)
+    m_D3D12Architecture.NodeIndex = 0;
+    hr = m_Device->CheckFeatureSupport(D3D12_FEATURE_ARCHITECTURE, &m_D3D12Architecture, sizeof(m_D3D12Architecture));
+    if(FAILED(hr))
     {
-        SuballocationList::iterator* const it = BinaryFindFirstNotLess(
-            m_FreeSuballocationsBySize.data(),
-            m_FreeSuballocationsBySize.data() + m_FreeSuballocationsBySize.size(),
-            item,
-            SuballocationItemSizeLess());
-        for(size_t index = it - m_FreeSuballocationsBySize.data();
-            index < m_FreeSuballocationsBySize.size();
-            ++index)
+        return hr;
+    }
+    m_UseUmaCustomHeaps = (desc.Flags & ALLOCATOR_FLAG_USE_UMA_CUSTOM_HEAPS) != 0 && m_D3D12Architecture.UMA;
+
+#if D3D12MA_CREATE_NOT_ZEROED_AVAILABLE
+    if((desc.Flags & ALLOCATOR_FLAG_CREATE_NOT_ZEROED_HEAPS) != 0)
+    {
+        // Runtimes that know D3D12_FEATURE_D3D12_OPTIONS7 also support D3D12_HEAP_FLAG_CREATE_NOT_ZEROED.
+        D3D12_FEATURE_DATA_D3D12_OPTIONS7 options7 = {};
+        if(SUCCEEDED(m_Device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS7, &options7, sizeof(options7))))
         {
-            if(m_FreeSuballocationsBySize[index] == item)
-            {
-                m_FreeSuballocationsBySize.remove(index);
-                return;
-            }
-            D3D12MA_ASSERT((m_FreeSuballocationsBySize[index]->size == item->size) && "Not found.");
+            m_ExtraHeapFlags |= D3D12_HEAP_FLAG_CREATE_NOT_ZEROED;
         }
-        D3D12MA_ASSERT(0 && "Not found.");
     }
+#endif
 
-    //D3D12MA_HEAVY_ASSERT(ValidateFreeSuballocationList());
-}
+    m_NodeCount = D3D12MA_MAX(m_Device->GetNodeCount(), 1u);
 
-////////////////////////////////////////////////////////////////////////////////
-// Private class DeviceMemoryBlock implementation
+#if D3D12MA_RECORDING_ENABLED
+    if(desc.pRecordSettings != NULL)
+    {
+        m_Recorder = D3D12MA_NEW(GetAllocs(), Recorder)();
+        hr = m_Recorder->Init(*desc.pRecordSettings, m_D3D12Options.ResourceHeapTier, desc.Flags, m_PreferredBlockSize,
+            m_NodeCount);
+        if(FAILED(hr))
+        {
+            return hr;
+        }
+    }
+#endif
 
-DeviceMemoryBlock::DeviceMemoryBlock() :
-    m_pMetadata(NULL),
-    m_BlockVector(NULL),
-    m_HeapType(D3D12_HEAP_TYPE_CUSTOM),
-    m_Id(0),
-    m_Heap(NULL)
-{
+    m_DefaultNodePools = D3D12MA_NEW(GetAllocs(), NodePools)(this, 1, 1, m_AdaptiveBlockSize);
+
+    return S_OK;
 }
 
-void DeviceMemoryBlock::Init(
-    AllocatorPimpl* allocator,
-    BlockVector* blockVector,
-    D3D12_HEAP_TYPE newHeapType,
-    ID3D12Heap* newHeap,
-    UINT64 newSize,
-    UINT id)
+AllocatorPimpl::~AllocatorPimpl()
 {
-    D3D12MA_ASSERT(m_Heap == NULL);
+#if D3D12MA_RECORDING_ENABLED
+    D3D12MA_DELETE(GetAllocs(), m_Recorder);
+#endif
+#if D3D12MA_LATENCY_HISTOGRAMS
+    D3D12MA_DELETE(GetAllocs(), m_LatencyHistograms);
+#endif
 
-    m_BlockVector = blockVector;
-    m_HeapType = newHeapType;
-    m_Id = id;
-    m_Heap = newHeap;
+    for(size_t i = m_OtherNodePools.size(); i--; )
+    {
+        D3D12MA_DELETE(GetAllocs(), m_OtherNodePools[i]);
+    }
+    D3D12MA_DELETE(GetAllocs(), m_DefaultNodePools);
 
-    const ALLOCATION_CALLBACKS& allocs = allocator->GetAllocs();
+    // After the pools, because their destroyed blocks put heaps in it.
+    m_HeapCache.Clear();
 
-    m_pMetadata = D3D12MA_NEW(allocs, BlockMetadata_Generic)(&allocs);
-    m_pMetadata->Init(newSize);
+#if D3D12MA_TRACE_EVENTS
+    // Last, because mutexes of the pools point to it.
+    D3D12MA_DELETE(GetAllocs(), m_TraceEvents);
+#endif
 }
 
-void DeviceMemoryBlock::Destroy(AllocatorPimpl* allocator)
+HRESULT AllocatorPimpl::CreateResource(
+    const ALLOCATION_DESC* pAllocDesc,
+    const D3D12_RESOURCE_DESC* pResourceDesc,
+    D3D12_RESOURCE_STATES InitialResourceState,
+    const D3D12_CLEAR_VALUE *pOptimizedClearValue,
+    Allocation** ppAllocation,
+    REFIID riidResource,
+    void** ppvResource)
 {
-    // THIS IS THE MOST IMPORTANT ASSERT IN THE ENTIRE LIBRARY!
-    // Hitting it means you have some memory leak - unreleased Allocation objects.
-    D3D12MA_ASSERT(m_pMetadata->IsEmpty() && "Some allocations were not freed before destruction of this memory block!");
+    ALLOCATION_DESC finalAllocDesc;
+    HRESULT hr = CalcFinalAllocDesc(*pAllocDesc, finalAllocDesc);
+    if(FAILED(hr))
+    {
+        return hr;
+    }
+    // MSAA alignment is used only in DEFAULT heap.
+    if(finalAllocDesc.HeapType == D3D12_HEAP_TYPE_CUSTOM && pResourceDesc->SampleDesc.Count > 1)
+    {
+        return E_INVALIDARG;
+    }
 
-    D3D12MA_ASSERT(m_Heap != NULL);
-    m_Heap->Release();
-    m_Heap = NULL;
+#if D3D12MA_RECORDING_ENABLED
+    const UINT64 recordBeginTime = m_Recorder != NULL ? m_Recorder->GetTime() : 0;
+#endif
 
-    D3D12MA_DELETE(allocator->GetAllocs(), m_pMetadata);
-    m_pMetadata = NULL;
-}
+    D3D12MA_TIME_SCOPE(this, TIMED_OPERATION_CREATE_RESOURCE)
 
-bool DeviceMemoryBlock::Validate() const
-{
-    D3D12MA_VALIDATE(m_Heap && m_pMetadata && m_pMetadata->GetSize() != 0);
-    return m_pMetadata->Validate();
-}
+    *ppvResource = NULL;
 
-////////////////////////////////////////////////////////////////////////////////
-// Private class BlockVector implementation
+    D3D12_RESOURCE_DESC finalResourceDesc = *pResourceDesc;
+    D3D12_RESOURCE_ALLOCATION_INFO resAllocInfo = GetResourceAllocationInfo(finalResourceDesc);
+    resAllocInfo.Alignment = D3D12MA_MAX<UINT64>(resAllocInfo.Alignment, D3D12MA_DEBUG_ALIGNMENT);
+    D3D12MA_ASSERT(IsPow2(resAllocInfo.Alignment));
+    D3D12MA_ASSERT(resAllocInfo.SizeInBytes > 0);
 
-BlockVector::BlockVector(
-    AllocatorPimpl* hAllocator,
-    D3D12_HEAP_TYPE heapType,
-    D3D12_HEAP_FLAGS heapFlags,
-    UINT64 preferredBlockSize,
-    size_t minBlockCount,
-    size_t maxBlockCount,
-    bool explicitBlockSize) :
-    m_hAllocator(hAllocator),
-    m_HeapType(heapType),
-    m_HeapFlags(heapFlags),
-    m_PreferredBlockSize(preferredBlockSize),
-    m_MinBlockCount(minBlockCount),
-    m_MaxBlockCount(maxBlockCount),
-    m_ExplicitBlockSize(explicitBlockSize),
-    m_HasEmptyBlock(false),
-    m_Blocks(hAllocator->GetAllocs()),
-    m_NextBlockId(0)
-{
-}
+    if(!ReserveCategoryBytes(finalAllocDesc.Category, resAllocInfo.SizeInBytes))
+    {
+        hr = E_OUTOFMEMORY;
+    }
+    else
+    {
+        hr = CreateResourceInternal(
+            &finalAllocDesc,
+            &finalResourceDesc,
+            resAllocInfo,
+            InitialResourceState,
+            pOptimizedClearValue,
+            ppAllocation,
+            riidResource,
+            ppvResource);
+        if(FAILED(hr))
+        {
+            ReleaseCategoryBytes(finalAllocDesc.Category, resAllocInfo.SizeInBytes);
+        }
+    }
 
-BlockVector::~BlockVector()
-{
-    for(size_t i = m_Blocks.size(); i--; )
+#if D3D12MA_RECORDING_ENABLED
+    if(m_Recorder != NULL)
     {
-        m_Blocks[i]->Destroy(m_hAllocator);
-        D3D12MA_DELETE(m_hAllocator->GetAllocs(), m_Blocks[i]);
+        m_Recorder->RecordCreateResource(recordBeginTime, *pAllocDesc, *pResourceDesc, resAllocInfo, hr,
+            SUCCEEDED(hr) ? *ppAllocation : NULL);
     }
+#endif
+
+    return hr;
 }
 
-HRESULT BlockVector::CreateMinBlocks()
+HRESULT AllocatorPimpl::CreateResourceInternal(
+    const ALLOCATION_DESC* pAllocDesc,
+    const D3D12_RESOURCE_DESC* pResourceDesc,
+    const D3D12_RESOURCE_ALLOCATION_INFO& resAllocInfo,
+    D3D12_RESOURCE_STATES InitialResourceState,
+    const D3D12_CLEAR_VALUE *pOptimizedClearValue,
+    Allocation** ppAllocation,
+    REFIID riidResource,
+    void** ppvResource)
 {
-    for(size_t i = 0; i < m_MinBlockCount; ++i)
+    ALLOCATION_DESC finalAllocDesc = *pAllocDesc;
+
+    NodePools* const nodePools = GetNodePools(pAllocDesc->CreationNodeMask, pAllocDesc->VisibleNodeMask);
+    const UINT defaultPoolIndex = CalcDefaultPoolIndex(*pAllocDesc, *pResourceDesc);
+    BlockVector* blockVector = nodePools->GetDefaultPool(defaultPoolIndex);
+    D3D12MA_ASSERT(blockVector);
+
+    blockVector->AddRequestSize(resAllocInfo.SizeInBytes);
+    bool preferCommittedMemory =
+        D3D12MA_DEBUG_ALWAYS_COMMITTED ||
+        PrefersCommittedAllocation(*pResourceDesc) ||
+        // Heuristics: Allocate committed memory if requested size if greater than half of (typical) block size.
+        resAllocInfo.SizeInBytes > blockVector->GetCommittedThreshold();
+    if(preferCommittedMemory &&
+        (finalAllocDesc.Flags & ALLOCATION_FLAG_NEVER_ALLOCATE) == 0)
     {
-        HRESULT hr = CreateBlock(m_PreferredBlockSize, NULL);
-        if(FAILED(hr))
+        finalAllocDesc.Flags |= ALLOCATION_FLAG_COMMITTED;
+    }
+
+    if((finalAllocDesc.Flags & ALLOCATION_FLAG_COMMITTED) != 0)
+    {
+        return AllocateCommittedMemory(
+            nodePools,
+            &finalAllocDesc,
+            pResourceDesc,
+            resAllocInfo,
+            InitialResourceState,
+            pOptimizedClearValue,
+            ppAllocation,
+            riidResource,
+            ppvResource);
+    }
+    else
+    {
+        HRESULT hr = blockVector->Allocate(
+            resAllocInfo.SizeInBytes,
+            resAllocInfo.Alignment,
+            finalAllocDesc,
+            1,
+            (Allocation**)ppAllocation);
+        if(SUCCEEDED(hr))
         {
-            return hr;
+            (*ppAllocation)->m_Placed.smallAlignment =
+                pResourceDesc->Alignment == D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+            (*ppAllocation)->m_Category = finalAllocDesc.Category;
+            {
+                D3D12MA_TIME_SCOPE(this, TIMED_OPERATION_CREATE_PLACED_RESOURCE)
+                hr = m_Device->CreatePlacedResource(
+                    (*ppAllocation)->GetBlock()->GetHeap(),
+                    (*ppAllocation)->GetOffset(),
+                    pResourceDesc,
+                    InitialResourceState,
+                    pOptimizedClearValue,
+                    riidResource,
+                    ppvResource);
+            }
+            if(SUCCEEDED(hr))
+            {
+                NotifyAllocationCreated(*ppAllocation);
+                return hr;
+            }
+            else
+            {
+                // Not reported as created yet, so it is freed without notifying anyone.
+                FreePlacedMemory(*ppAllocation);
+                D3D12MA_DELETE(GetAllocs(), *ppAllocation);
+                *ppAllocation = NULL;
+                return hr;
+            }
         }
+
+        return AllocateCommittedMemory(
+            nodePools,
+            &finalAllocDesc,
+            pResourceDesc,
+            resAllocInfo,
+            InitialResourceState,
+            pOptimizedClearValue,
+            ppAllocation,
+            riidResource,
+            ppvResource);
     }
-    return S_OK;
 }
 
-HRESULT BlockVector::Allocate(
+HRESULT AllocatorPimpl::AllocateBufferRange(
+    const ALLOCATION_DESC* pAllocDesc,
     UINT64 size,
     UINT64 alignment,
-    const ALLOCATION_DESC& createInfo,
-    size_t allocationCount,
-    Allocation** pAllocations)
+    Allocation** ppAllocation)
 {
-    size_t allocIndex;
-    HRESULT hr = S_OK;
+#if D3D12MA_RECORDING_ENABLED
+    const UINT64 recordBeginTime = m_Recorder != NULL ? m_Recorder->GetTime() : 0;
+#endif
 
+    const HRESULT hr = AllocateBufferRangeInternal(pAllocDesc, size, alignment, ppAllocation);
+
+#if D3D12MA_RECORDING_ENABLED
+    if(m_Recorder != NULL)
     {
-        MutexLockWrite lock(m_Mutex, m_hAllocator->UseMutex());
-        for(allocIndex = 0; allocIndex < allocationCount; ++allocIndex)
-        {
-            hr = AllocatePage(
-                size,
-                alignment,
-                createInfo,
-                pAllocations + allocIndex);
-            if(FAILED(hr))
-            {
-                break;
-            }
-        }
+        m_Recorder->RecordAllocateBufferRange(recordBeginTime, *pAllocDesc, size, alignment, hr,
+            SUCCEEDED(hr) ? *ppAllocation : NULL);
+    }
+#endif
+
+    return hr;
+}
+
+HRESULT AllocatorPimpl::AllocateBufferRangeInternal(
+    const ALLOCATION_DESC* pAllocDesc,
+    UINT64 size,
+    UINT64 alignment,
+    Allocation** ppAllocation)
+{
+    ALLOCATION_DESC finalAllocDesc;
+    HRESULT hr = CalcFinalAllocDesc(*pAllocDesc, finalAllocDesc);
+    if(FAILED(hr))
+    {
+        return hr;
+    }
+    // Range of a shared buffer cannot have its own implicit heap.
+    if((finalAllocDesc.Flags & ALLOCATION_FLAG_COMMITTED) != 0)
+    {
+        return E_INVALIDARG;
+    }
+    if(size == 0 || !IsPow2(alignment))
+    {
+        return E_INVALIDARG;
+    }
+
+    if(alignment == 0)
+    {
+        alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
     }
+    alignment = D3D12MA_MAX<UINT64>(alignment, D3D12MA_DEBUG_ALIGNMENT);
 
-    if(FAILED(hr))
+    if(!ReserveCategoryBytes(finalAllocDesc.Category, size))
     {
-        // Free all already created allocations.
-        while(allocIndex--)
-        {
-            Free(pAllocations[allocIndex]);
-        }
-        memset(pAllocations, 0, sizeof(Allocation*) * allocationCount);
+        return E_OUTOFMEMORY;
     }
 
+    BlockVector* const blockVector = GetNodePools(finalAllocDesc.CreationNodeMask, finalAllocDesc.VisibleNodeMask)->
+        GetBufferRangePool(HeapTypeToIndex(finalAllocDesc.HeapType));
+    D3D12MA_ASSERT(blockVector);
+    blockVector->AddRequestSize(size);
+    hr = blockVector->Allocate(size, alignment, finalAllocDesc, 1, ppAllocation);
+    if(SUCCEEDED(hr))
+    {
+        (*ppAllocation)->m_Category = finalAllocDesc.Category;
+        NotifyAllocationCreated(*ppAllocation);
+    }
+    else
+    {
+        ReleaseCategoryBytes(finalAllocDesc.Category, size);
+    }
     return hr;
 }
 
-HRESULT BlockVector::AllocatePage(
-    UINT64 size,
-    UINT64 alignment,
-    const ALLOCATION_DESC& createInfo,
-    Allocation** pAllocation)
+HRESULT AllocatorPimpl::CalcFinalAllocDesc(const ALLOCATION_DESC& allocDesc, ALLOCATION_DESC& outAllocDesc) const
 {
-    // Early reject: requested allocation size is larger that maximum block size for this block vector.
-    if(size + 2 * D3D12MA_DEBUG_MARGIN > m_PreferredBlockSize)
+    if(allocDesc.HeapType != D3D12_HEAP_TYPE_DEFAULT &&
+        allocDesc.HeapType != D3D12_HEAP_TYPE_UPLOAD &&
+        allocDesc.HeapType != D3D12_HEAP_TYPE_READBACK)
     {
-        return E_OUTOFMEMORY;
+        return E_INVALIDARG;
     }
 
-    const bool canCreateNewBlock =
-        ((createInfo.Flags & ALLOCATION_FLAG_NEVER_ALLOCATE) == 0) &&
-        (m_Blocks.size() < m_MaxBlockCount);
-
-    if(canCreateNewBlock)
+    const UINT strategy = allocDesc.Flags & ALLOCATION_FLAG_STRATEGY_MASK;
+    if(strategy != 0 && !IsPow2(strategy))
     {
-        // 1. Search existing allocations. Try to allocate without making other allocations lost.
-        ALLOCATION_FLAGS allocFlagsCopy = createInfo.Flags;
+        return E_INVALIDARG;
+    }
+    if((UINT)allocDesc.Lifetime >= ALLOCATION_LIFETIME_COUNT ||
+        allocDesc.Category >= ALLOCATION_CATEGORY_COUNT)
+    {
+        return E_INVALIDARG;
+    }
 
+    outAllocDesc = allocDesc;
+    if((allocDesc.Flags & ALLOCATION_FLAG_CPU_ACCESSIBLE) != 0)
+    {
+        if(allocDesc.HeapType != D3D12_HEAP_TYPE_DEFAULT)
         {
-            {
-                // Forward order in m_Blocks - prefer blocks with smallest amount of free space.
-                for(size_t blockIndex = 0; blockIndex < m_Blocks.size(); ++blockIndex )
-                {
-                    DeviceMemoryBlock* const pCurrBlock = m_Blocks[blockIndex];
-                    D3D12MA_ASSERT(pCurrBlock);
-                    HRESULT hr = AllocateFromBlock(
-                        pCurrBlock,
-                        size,
-                        alignment,
-                        allocFlagsCopy,
-                        pAllocation);
-                    if(SUCCEEDED(hr))
-                    {
-                        return hr;
-                    }
-                }
-            }
+            return E_INVALIDARG;
         }
-
-        // 2. Try to create new block.
-        if(canCreateNewBlock)
+        // Not an error of the caller, who can fall back to a staging copy.
+        if(!m_UseUmaCustomHeaps)
         {
-            // Calculate optimal size for new block.
-            UINT64 newBlockSize = m_PreferredBlockSize;
-            UINT newBlockSizeShift = 0;
-            const UINT NEW_BLOCK_SIZE_SHIFT_MAX = 3;
-
-            if(!m_ExplicitBlockSize)
-            {
-                // Allocate 1/8, 1/4, 1/2 as first blocks.
-                const UINT64 maxExistingBlockSize = CalcMaxBlockSize();
-                for(UINT i = 0; i < NEW_BLOCK_SIZE_SHIFT_MAX; ++i)
-                {
-                    const UINT64 smallerNewBlockSize = newBlockSize / 2;
-                    if(smallerNewBlockSize > maxExistingBlockSize && smallerNewBlockSize >= size * 2)
-                    {
-                        newBlockSize = smallerNewBlockSize;
-                        ++newBlockSizeShift;
-                    }
-                    else
-                    {
-                        break;
-                    }
-                }
-            }
-
-            size_t newBlockIndex = 0;
-            HRESULT hr = CreateBlock(newBlockSize, &newBlockIndex);
-            // Allocation of this size failed? Try 1/2, 1/4, 1/8 of m_PreferredBlockSize.
-            if(!m_ExplicitBlockSize)
-            {
-                while(FAILED(hr) && newBlockSizeShift < NEW_BLOCK_SIZE_SHIFT_MAX)
-                {
-                    const UINT64 smallerNewBlockSize = newBlockSize / 2;
-                    if(smallerNewBlockSize >= size)
-                    {
-                        newBlockSize = smallerNewBlockSize;
-                        ++newBlockSizeShift;
-                        hr = CreateBlock(newBlockSize, &newBlockIndex);
-                    }
-                    else
-                    {
-                        break;
-                    }
-                }
-            }
-
-            if(SUCCEEDED(hr))
-            {
-                DeviceMemoryBlock* const pBlock = m_Blocks[newBlockIndex];
-                D3D12MA_ASSERT(pBlock->m_pMetadata->GetSize() >= size);
-
-                hr = AllocateFromBlock(
-                    pBlock,
-                    size,
-                    alignment,
-                    allocFlagsCopy,
-                    pAllocation);
-                if(SUCCEEDED(hr))
-                {
-                    return hr;
-                }
-                else
-                {
-                    // Allocation from new block failed, possibly due to D3D12MA_DEBUG_MARGIN or alignment.
-                    return E_OUTOFMEMORY;
-                }
-            }
+            return E_NOTIMPL;
         }
+        outAllocDesc.HeapType = D3D12_HEAP_TYPE_CUSTOM;
     }
 
-    return E_OUTOFMEMORY;
+    // One node out of m_NodeCount, visible to itself and possibly others.
+    const UINT allNodesMask = m_NodeCount < 32 ? (1u << m_NodeCount) - 1 : UINT_MAX;
+    if(outAllocDesc.CreationNodeMask == 0)
+    {
+        outAllocDesc.CreationNodeMask = 1;
+    }
+    if(outAllocDesc.VisibleNodeMask == 0)
+    {
+        outAllocDesc.VisibleNodeMask = outAllocDesc.CreationNodeMask;
+    }
+    if(!IsPow2(outAllocDesc.CreationNodeMask) ||
+        (outAllocDesc.CreationNodeMask & ~allNodesMask) != 0 ||
+        (outAllocDesc.VisibleNodeMask & ~allNodesMask) != 0 ||
+        (outAllocDesc.VisibleNodeMask & outAllocDesc.CreationNodeMask) == 0)
+    {
+        return E_INVALIDARG;
+    }
+    return S_OK;
 }
 
-void BlockVector::Free(Allocation* hAllocation)
+NodePools* AllocatorPimpl::GetNodePools(UINT creationNodeMask, UINT visibleNodeMask)
 {
-    DeviceMemoryBlock* pBlockToDelete = NULL;
-
-    // Scope for lock.
+    if(creationNodeMask == 1 && visibleNodeMask == 1)
     {
-        MutexLockWrite lock(m_Mutex, m_hAllocator->UseMutex());
-
-        DeviceMemoryBlock* pBlock = hAllocation->GetBlock();
-
-        pBlock->m_pMetadata->Free(hAllocation);
-        D3D12MA_HEAVY_ASSERT(pBlock->Validate());
+        return m_DefaultNodePools;
+    }
 
-        // pBlock became empty after this deallocation.
-        if(pBlock->m_pMetadata->IsEmpty())
-        {
-            // Already has empty Allocation. We don't want to have two, so delete this one.
-            if(m_HasEmptyBlock && m_Blocks.size() > m_MinBlockCount)
-            {
-                pBlockToDelete = pBlock;
-                Remove(pBlock);
-            }
-            // We now have first empty block.
-            else
-            {
-                m_HasEmptyBlock = true;
-            }
-        }
-        // pBlock didn't become empty, but we have another empty block - find and free that one.
-        // (This is optional, heuristics.)
-        else if(m_HasEmptyBlock)
+    {
+        MutexLockRead lock(m_OtherNodePoolsMutex, m_UseMutex);
+        for(size_t i = 0; i < m_OtherNodePools.size(); ++i)
         {
-            DeviceMemoryBlock* pLastBlock = m_Blocks.back();
-            if(pLastBlock->m_pMetadata->IsEmpty() && m_Blocks.size() > m_MinBlockCount)
+            if(m_OtherNodePools[i]->GetCreationNodeMask() == creationNodeMask &&
+                m_OtherNodePools[i]->GetVisibleNodeMask() == visibleNodeMask)
             {
-                pBlockToDelete = pLastBlock;
-                m_Blocks.pop_back();
-                m_HasEmptyBlock = false;
+                return m_OtherNodePools[i];
             }
         }
-
-        IncrementallySortBlocks();
     }
 
-    // Destruction of a free Allocation. Deferred until this point, outside of mutex
-    // lock, for performance reason.
-    if(pBlockToDelete != NULL)
+    MutexLockWrite lock(m_OtherNodePoolsMutex, m_UseMutex);
+    // Another thread may have created them in the meantime.
+    for(size_t i = 0; i < m_OtherNodePools.size(); ++i)
     {
-        pBlockToDelete->Destroy(m_hAllocator);
-        D3D12MA_DELETE(m_hAllocator->GetAllocs(), pBlockToDelete);
+        if(m_OtherNodePools[i]->GetCreationNodeMask() == creationNodeMask &&
+            m_OtherNodePools[i]->GetVisibleNodeMask() == visibleNodeMask)
+        {
+            return m_OtherNodePools[i];
+        }
     }
+    NodePools* const nodePools = D3D12MA_NEW(GetAllocs(), NodePools)(this, creationNodeMask, visibleNodeMask, m_AdaptiveBlockSize);
+    m_OtherNodePools.push_back(nodePools);
+    return nodePools;
 }
 
-UINT64 BlockVector::HeapFlagsToAlignment(D3D12_HEAP_FLAGS flags)
+D3D12_HEAP_PROPERTIES AllocatorPimpl::CalcHeapProperties(D3D12_HEAP_TYPE heapType, UINT creationNodeMask, UINT visibleNodeMask) const
 {
-    /*
-    Documentation of D3D12_HEAP_DESC structure says:
-
-    - D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT   defined as 64KB.
-    - D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT   defined as 4MB. An
-      application must decide whether the heap will contain multi-sample
-      anti-aliasing (MSAA), in which case, the application must choose [this flag].
-
-    https://docs.microsoft.com/en-us/windows/desktop/api/d3d12/ns-d3d12-d3d12_heap_desc
-    */
+    D3D12_HEAP_PROPERTIES heapProps = {};
+    heapProps.Type = heapType;
+    heapProps.CreationNodeMask = creationNodeMask;
+    heapProps.VisibleNodeMask = visibleNodeMask;
+    if(heapType == D3D12_HEAP_TYPE_CUSTOM)
+    {
+        D3D12MA_ASSERT(m_UseUmaCustomHeaps);
+        // Without cache coherency, CPU caching would need explicit flushes, which D3D12 doesn't have.
+        heapProps.CPUPageProperty = m_D3D12Architecture.CacheCoherentUMA ?
+            D3D12_CPU_PAGE_PROPERTY_WRITE_BACK : D3D12_CPU_PAGE_PROPERTY_WRITE_COMBINE;
+        heapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_L0;
+    }
+    return heapProps;
+}
 
-    const D3D12_HEAP_FLAGS denyAllTexturesFlags =
-        D3D12_HEAP_FLAG_DENY_NON_RT_DS_TEXTURES | D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES;
-    const bool canContainAnyTextures =
-        (flags & denyAllTexturesFlags) != denyAllTexturesFlags;
-    return canContainAnyTextures ?
-        D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT : D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+bool AllocatorPimpl::PrefersCommittedAllocation(const D3D12_RESOURCE_DESC& resourceDesc)
+{
+    // Intentional. It may change in the future.
+    return false;
 }
 
-UINT64 BlockVector::CalcMaxBlockSize() const
+#if D3D12MA_USE_SMALL_RESOURCE_PLACEMENT_ALIGNMENT
+/*
+Cheap check whether the device may grant D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT
+to the resource, so it is not asked in vain for every texture. The device decides.
+*/
+static bool MayUseSmallAlignment(const D3D12_RESOURCE_DESC& resourceDesc)
 {
-    UINT64 result = 0;
-    for(size_t i = m_Blocks.size(); i--; )
+    if(resourceDesc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE1D &&
+        resourceDesc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE2D &&
+        resourceDesc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE3D)
     {
-        result = D3D12MA_MAX(result, m_Blocks[i]->m_pMetadata->GetSize());
-        if(result >= m_PreferredBlockSize)
-        {
-            break;
-        }
+        return false;
     }
-    return result;
+    if(resourceDesc.Alignment != 0 ||
+        resourceDesc.SampleDesc.Count > 1 ||
+        (resourceDesc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)) != 0)
+    {
+        return false;
+    }
+    // The whole texture must fit in D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT.
+    // No format takes less than half a byte per texel.
+    const UINT64 texelCount = resourceDesc.Width * resourceDesc.Height * resourceDesc.DepthOrArraySize;
+    return texelCount <= D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT * 2;
 }
+#endif
 
-void BlockVector::Remove(DeviceMemoryBlock* pBlock)
+D3D12_RESOURCE_ALLOCATION_INFO AllocatorPimpl::GetResourceAllocationInfo(D3D12_RESOURCE_DESC& inOutResourceDesc)
 {
-    for(UINT blockIndex = 0; blockIndex < m_Blocks.size(); ++blockIndex)
-    {
-        if(m_Blocks[blockIndex] == pBlock)
+    D3D12MA_TIME_SCOPE(this, TIMED_OPERATION_GET_RESOURCE_ALLOCATION_INFO)
+#if D3D12MA_USE_SMALL_RESOURCE_PLACEMENT_ALIGNMENT
+    if(MayUseSmallAlignment(inOutResourceDesc))
+    {
+        inOutResourceDesc.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+        const D3D12_RESOURCE_ALLOCATION_INFO smallAllocInfo = m_Device->GetResourceAllocationInfo(0, 1, &inOutResourceDesc);
+        // If not granted, the default alignment is returned and the desc must be queried again as given.
+        if(smallAllocInfo.Alignment == D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT)
         {
-            m_Blocks.remove(blockIndex);
-            return;
+            return smallAllocInfo;
         }
+        inOutResourceDesc.Alignment = 0;
     }
-    D3D12MA_ASSERT(0);
+#endif
+    return m_Device->GetResourceAllocationInfo(0, 1, &inOutResourceDesc);
 }
 
-void BlockVector::IncrementallySortBlocks()
+HRESULT AllocatorPimpl::AllocateCommittedMemory(
+    NodePools* nodePools,
+    const ALLOCATION_DESC* pAllocDesc,
+    const D3D12_RESOURCE_DESC* pResourceDesc,
+    const D3D12_RESOURCE_ALLOCATION_INFO& resAllocInfo,
+    D3D12_RESOURCE_STATES InitialResourceState,
+    const D3D12_CLEAR_VALUE *pOptimizedClearValue,
+    Allocation** ppAllocation,
+    REFIID riidResource,
+    void** ppvResource)
 {
-    // Bubble sort only until first swap.
-    for(size_t i = 1; i < m_Blocks.size(); ++i)
+    if((pAllocDesc->Flags & ALLOCATION_FLAG_NEVER_ALLOCATE) != 0)
     {
-        if(m_Blocks[i - 1]->m_pMetadata->GetSumFreeSize() > m_Blocks[i]->m_pMetadata->GetSumFreeSize())
-        {
-            D3D12MA_SWAP(m_Blocks[i - 1], m_Blocks[i]);
-            return;
-        }
+        return E_OUTOFMEMORY;
+    }
+
+    const D3D12_HEAP_PROPERTIES heapProps = CalcHeapProperties(
+        pAllocDesc->HeapType, nodePools->GetCreationNodeMask(), nodePools->GetVisibleNodeMask());
+    HRESULT hr;
+    {
+        D3D12MA_TIME_SCOPE(this, TIMED_OPERATION_CREATE_COMMITTED_RESOURCE)
+        hr = m_Device->CreateCommittedResource(
+            &heapProps, m_ExtraHeapFlags, pResourceDesc, InitialResourceState,
+            pOptimizedClearValue, riidResource, ppvResource);
+    }
+    if(SUCCEEDED(hr))
+    {
+        Allocation* alloc = D3D12MA_NEW(m_AllocationCallbacks, Allocation)();
+        alloc->InitCommitted(this, resAllocInfo.SizeInBytes, pAllocDesc->HeapType, nodePools);
+        alloc->m_Category = pAllocDesc->Category;
+        *ppAllocation = alloc;
+        NotifyAllocationCreated(alloc);
+        nodePools->AddCommittedAllocation(HeapTypeToIndex(pAllocDesc->HeapType), alloc);
     }
+    return hr;
 }
 
-HRESULT BlockVector::AllocateFromBlock(
-    DeviceMemoryBlock* pBlock,
-    UINT64 size,
-    UINT64 alignment,
-    ALLOCATION_FLAGS allocFlags,
-    Allocation** pAllocation)
+void AllocatorPimpl::SetCurrentFrameIndex(UINT frameIndex)
 {
-    AllocationRequest currRequest = {};
-    if(pBlock->m_pMetadata->CreateAllocationRequest(
-        size,
-        alignment,
-        &currRequest))
+    m_CurrentFrameIndex.store(frameIndex);
+}
+
+void AllocatorPimpl::Trim()
+{
+    const UINT currentFrameIndex = GetCurrentFrameIndex();
+    const UINT64 currentTime = GetTimeNanoseconds();
+    UINT trimmedCount = m_DefaultNodePools->Trim(currentFrameIndex, currentTime);
     {
-        // We no longer have an empty Allocation.
-        if(pBlock->m_pMetadata->IsEmpty())
+        MutexLockRead lock(m_OtherNodePoolsMutex, m_UseMutex);
+        for(size_t i = 0; i < m_OtherNodePools.size(); ++i)
         {
-            m_HasEmptyBlock = false;
+            trimmedCount += m_OtherNodePools[i]->Trim(currentFrameIndex, currentTime);
         }
-
-        *pAllocation = D3D12MA_NEW(m_hAllocator->GetAllocs(), Allocation)();
-        pBlock->m_pMetadata->Alloc(currRequest, size, *pAllocation);
-        (*pAllocation)->InitPlaced(
-            m_hAllocator,
-            size,
-            currRequest.offset,
-            alignment,
-            pBlock);
-        D3D12MA_HEAVY_ASSERT(pBlock->Validate());
-        return S_OK;
     }
-    return E_OUTOFMEMORY;
+    m_HeapTrimmedCount += trimmedCount;
+    m_HeapCache.Clear();
 }
 
-HRESULT BlockVector::CreateBlock(UINT64 blockSize, size_t* pNewBlockIndex)
-{
-    ID3D12Heap* heap = NULL;
-    HRESULT hr = CreateD3d12Heap(heap, blockSize);
-    if(FAILED(hr))
-    {
-        return hr;
+void AllocatorPimpl::GetHeapChurnStats(HeapChurnStats& outStats)
+{
+    outStats.HeapCreatedCount = m_HeapCreatedCount.load();
+    outStats.HeapCreatedBytes = m_HeapCreatedBytes.load();
+    outStats.HeapDestroyedCount = m_HeapDestroyedCount.load();
+    outStats.HeapDestroyedBytes = m_HeapDestroyedBytes.load();
+    outStats.HeapTrimmedCount = m_HeapTrimmedCount.load();
+    outStats.HeapReusedCount = m_HeapReusedCount.load();
+    m_HeapCache.GetStats(outStats.CachedHeapCount, outStats.CachedHeapBytes);
+    outStats.EmptyBlockCount = 0;
+    outStats.EmptyBlockBytes = 0;
+    m_DefaultNodePools->AddEmptyBlockStats(outStats.EmptyBlockCount, outStats.EmptyBlockBytes);
+    MutexLockRead lock(m_OtherNodePoolsMutex, m_UseMutex);
+    for(size_t i = 0; i < m_OtherNodePools.size(); ++i)
+    {
+        m_OtherNodePools[i]->AddEmptyBlockStats(outStats.EmptyBlockCount, outStats.EmptyBlockBytes);
     }
+}
 
-    DeviceMemoryBlock* const pBlock = D3D12MA_NEW(m_hAllocator->GetAllocs(), DeviceMemoryBlock)();
-    pBlock->Init(
-        m_hAllocator,
-        this,
-        m_HeapType,
-        heap,
-        blockSize,
-        m_NextBlockId++);
+void AllocatorPimpl::GetSmallAlignmentStats(SmallAlignmentStats& outStats) const
+{
+    outStats.AllocationCount = m_SmallAlignmentCount.load();
+    outStats.AllocationBytes = m_SmallAlignmentBytes.load();
+    outStats.SavedBytes = m_SmallAlignmentSavedBytes.load();
+}
 
-    m_Blocks.push_back(pBlock);
-    if(pNewBlockIndex != NULL)
+void AllocatorPimpl::SetCategoryQuota(UINT category, UINT64 maxBytes)
+{
+    m_CategoryQuotas[category].store(maxBytes);
+
+#if D3D12MA_RECORDING_ENABLED
+    if(m_Recorder != NULL)
     {
-        *pNewBlockIndex = m_Blocks.size() - 1;
+        m_Recorder->RecordSetCategoryQuota(category, maxBytes);
     }
-
-    return hr;
+#endif
 }
 
-HRESULT BlockVector::CreateD3d12Heap(ID3D12Heap*& outHeap, UINT64 size) const
+void AllocatorPimpl::GetCategoryStats(UINT category, CategoryStats& outStats) const
 {
-    D3D12_HEAP_DESC heapDesc = {};
-    heapDesc.SizeInBytes = size;
-    heapDesc.Properties.Type = m_HeapType;
-    heapDesc.Alignment = HeapFlagsToAlignment(m_HeapFlags);
-    heapDesc.Flags = m_HeapFlags;
+    outStats.AllocationCount = m_CategoryAllocationCounts[category].load();
+    outStats.AllocationBytes = m_CategoryAllocationBytes[category].load();
+    outStats.Quota = m_CategoryQuotas[category].load();
+}
 
-    ID3D12Heap* heap = NULL;
-    return m_hAllocator->GetDevice()->CreateHeap(&heapDesc, IID_PPV_ARGS(&outHeap));
+bool AllocatorPimpl::ReserveCategoryBytes(UINT category, UINT64 size)
+{
+    const UINT64 quota = m_CategoryQuotas[category].load();
+    UINT64 bytes = m_CategoryAllocationBytes[category].load();
+    do
+    {
+        if(quota != 0 && bytes + size > quota)
+        {
+            return false;
+        }
+    } while(!m_CategoryAllocationBytes[category].compare_exchange_weak(bytes, bytes + size));
+    return true;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-// Private class AllocatorPimpl implementation
+void AllocatorPimpl::ReleaseCategoryBytes(UINT category, UINT64 size)
+{
+    m_CategoryAllocationBytes[category] -= size;
+}
 
-AllocatorPimpl::AllocatorPimpl(const ALLOCATION_CALLBACKS& allocationCallbacks, const ALLOCATOR_DESC& desc) :
-    m_UseMutex((desc.Flags & ALLOCATOR_FLAG_SINGLETHREADED) == 0),
-    m_Device(desc.pDevice),
-    m_PreferredBlockSize(desc.PreferredBlockSize != 0 ? desc.PreferredBlockSize : D3D12MA_DEFAULT_BLOCK_SIZE),
-    m_AllocationCallbacks(allocationCallbacks)
+#if D3D12MA_LOCK_STATS
+void AllocatorPimpl::GetLockStats(LockStats& outStats) const
 {
-    // desc.pAllocationCallbacks intentionally ignored here, preprocessed by CreateAllocator.
-    ZeroMemory(&m_D3D12Options, sizeof(m_D3D12Options));
+    m_DefaultNodePools->GetLockStats(outStats);
+}
 
-    ZeroMemory(m_pCommittedAllocations, sizeof(m_pCommittedAllocations));
-    ZeroMemory(m_BlockVectors, sizeof(m_BlockVectors));
+void AllocatorPimpl::GetAllLockStats(UINT& inoutCount, LockStats* pLockStats)
+{
+    MutexLockRead lock(m_OtherNodePoolsMutex, m_UseMutex);
+    const UINT nodePoolsCount = 1 + (UINT)m_OtherNodePools.size();
+    if(pLockStats == NULL)
+    {
+        inoutCount = nodePoolsCount;
+        return;
+    }
+    inoutCount = D3D12MA_MIN(inoutCount, nodePoolsCount);
+    for(UINT i = 0; i < inoutCount; ++i)
+    {
+        const NodePools* const nodePools = i == 0 ? m_DefaultNodePools : m_OtherNodePools[i - 1];
+        nodePools->GetLockStats(pLockStats[i]);
+    }
+}
+#endif
 
-    for(UINT heapTypeIndex = 0; heapTypeIndex < HEAP_TYPE_COUNT; ++heapTypeIndex)
+UINT AllocatorPimpl::CalcDefaultPoolCount() const
+{
+    if(SupportsResourceHeapTier2())
+    {
+        return 5;
+    }
+    else
     {
-        m_pCommittedAllocations[heapTypeIndex] = D3D12MA_NEW(GetAllocs(), AllocationVectorType)(GetAllocs());
+        return 13;
     }
 }
 
-HRESULT AllocatorPimpl::Init()
+UINT AllocatorPimpl::CalcDefaultPoolIndex(const ALLOCATION_DESC& allocDesc, const D3D12_RESOURCE_DESC& resourceDesc) const
 {
-    HRESULT hr = m_Device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &m_D3D12Options, sizeof(m_D3D12Options));
-    if(FAILED(hr))
+    if(allocDesc.HeapType == D3D12_HEAP_TYPE_DEFAULT && resourceDesc.SampleDesc.Count > 1)
     {
-        return hr;
+        return CalcDefaultPoolCount() - 1;
     }
 
-    const UINT defaultPoolCount = CalcDefaultPoolCount();
-    for(UINT i = 0; i < defaultPoolCount; ++i)
+    UINT poolIndex = UINT_MAX;
+    switch(allocDesc.HeapType)
     {
-        D3D12_HEAP_TYPE heapType;
-        D3D12_HEAP_FLAGS heapFlags;
-        CalcDefaultPoolParams(heapType, heapFlags, i);
+    case D3D12_HEAP_TYPE_DEFAULT:  poolIndex = 0; break;
+    case D3D12_HEAP_TYPE_UPLOAD:   poolIndex = 1; break;
+    case D3D12_HEAP_TYPE_READBACK: poolIndex = 2; break;
+    case D3D12_HEAP_TYPE_CUSTOM:   poolIndex = 3; break;
+    default: D3D12MA_ASSERT(0);
+    }
 
-        m_BlockVectors[i] = D3D12MA_NEW(GetAllocs(), BlockVector)(
-            this, // hAllocator
-            heapType, // heapType
-            heapFlags, // heapFlags
-            m_PreferredBlockSize,
-            0, // minBlockCount
-            SIZE_MAX, // maxBlockCount
-            false); // explicitBlockSize
-        // No need to call m_pBlockVectors[i]->CreateMinBlocks here, becase minBlockCount is 0.
+    if(!SupportsResourceHeapTier2())
+    {
+        poolIndex *= 3;
+        if(resourceDesc.Dimension != D3D12_RESOURCE_DIMENSION_BUFFER)
+        {
+            ++poolIndex;
+            const bool isRenderTargetOrDepthStencil =
+                (resourceDesc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)) != 0;
+            if(isRenderTargetOrDepthStencil)
+            {
+                ++poolIndex;
+            }
+        }
     }
 
-    return S_OK;
+    return poolIndex;
 }
 
-AllocatorPimpl::~AllocatorPimpl()
+void AllocatorPimpl::CalcDefaultPoolParams(D3D12_HEAP_TYPE& outHeapType, D3D12_HEAP_FLAGS& outHeapFlags, bool& outMsaa, UINT index) const
 {
-    for(UINT i = DEFAULT_POOL_MAX_COUNT; i--; )
+    outHeapType = D3D12_HEAP_TYPE_DEFAULT;
+    outHeapFlags = D3D12_HEAP_FLAG_NONE;
+    outMsaa = index == CalcDefaultPoolCount() - 1;
+
+    if(outMsaa)
     {
-        D3D12MA_DELETE(GetAllocs(), m_BlockVectors[i]);
+        if(!SupportsResourceHeapTier2())
+        {
+            outHeapFlags = D3D12_HEAP_FLAG_DENY_BUFFERS | D3D12_HEAP_FLAG_DENY_NON_RT_DS_TEXTURES;
+        }
+        return;
     }
 
-    for(UINT i = HEAP_TYPE_COUNT; i--; )
+    if(!SupportsResourceHeapTier2())
     {
-        if(m_pCommittedAllocations[i] && !m_pCommittedAllocations[i]->empty())
+        switch(index % 3)
         {
-            D3D12MA_ASSERT(0 && "Unfreed committed allocations found.");
+        case 0:
+            outHeapFlags = D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES | D3D12_HEAP_FLAG_DENY_NON_RT_DS_TEXTURES;
+            break;
+        case 1:
+            outHeapFlags = D3D12_HEAP_FLAG_DENY_BUFFERS | D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES;
+            break;
+        case 2:
+            outHeapFlags = D3D12_HEAP_FLAG_DENY_BUFFERS | D3D12_HEAP_FLAG_DENY_NON_RT_DS_TEXTURES;
+            break;
         }
 
-        D3D12MA_DELETE(GetAllocs(), m_pCommittedAllocations[i]);
+        index /= 3;
     }
-}
 
-HRESULT AllocatorPimpl::CreateResource(
-    const ALLOCATION_DESC* pAllocDesc,
-    const D3D12_RESOURCE_DESC* pResourceDesc,
-    D3D12_RESOURCE_STATES InitialResourceState,
-    const D3D12_CLEAR_VALUE *pOptimizedClearValue,
-    Allocation** ppAllocation,
-    REFIID riidResource,
-    void** ppvResource)
-{
-    if(pAllocDesc->HeapType != D3D12_HEAP_TYPE_DEFAULT &&
-        pAllocDesc->HeapType != D3D12_HEAP_TYPE_UPLOAD &&
-        pAllocDesc->HeapType != D3D12_HEAP_TYPE_READBACK)
+    switch(index)
     {
-        return E_INVALIDARG;
+    case 0:
+        outHeapType = D3D12_HEAP_TYPE_DEFAULT;
+        break;
+    case 1:
+        outHeapType = D3D12_HEAP_TYPE_UPLOAD;
+        break;
+    case 2:
+        outHeapType = D3D12_HEAP_TYPE_READBACK;
+        break;
+    case 3:
+        outHeapType = D3D12_HEAP_TYPE_CUSTOM;
+        break;
+    default:
+        D3D12MA_ASSERT(0);
     }
+}
 
-    ALLOCATION_DESC finalAllocDesc = *pAllocDesc;
-
-    *ppvResource = NULL;
-
-    D3D12_RESOURCE_ALLOCATION_INFO resAllocInfo = m_Device->GetResourceAllocationInfo(0, 1, pResourceDesc);
-    resAllocInfo.Alignment = D3D12MA_MAX<UINT64>(resAllocInfo.Alignment, D3D12MA_DEBUG_ALIGNMENT);
-    D3D12MA_ASSERT(IsPow2(resAllocInfo.Alignment));
-    D3D12MA_ASSERT(resAllocInfo.SizeInBytes > 0);
+void AllocatorPimpl::FreeCommittedMemory(Allocation* allocation)
+{
+    D3D12MA_ASSERT(allocation && allocation->m_Type == Allocation::TYPE_COMMITTED);
+    allocation->m_Committed.nodePools->RemoveCommittedAllocations(
+        HeapTypeToIndex(allocation->m_Committed.heapType), 1, &allocation);
+}
 
-    const UINT defaultPoolIndex = CalcDefaultPoolIndex(*pAllocDesc, *pResourceDesc);
-    BlockVector* blockVector = m_BlockVectors[defaultPoolIndex];
+void AllocatorPimpl::FreePlacedMemory(Allocation* allocation)
+{
+    D3D12MA_ASSERT(allocation && allocation->m_Type == Allocation::TYPE_PLACED);
+    
+    DeviceMemoryBlock* const block = allocation->GetBlock();
+    D3D12MA_ASSERT(block);
+    BlockVector* const blockVector = block->GetBlockVector();
     D3D12MA_ASSERT(blockVector);
+    blockVector->Free(allocation);
+}
 
-    const UINT64 preferredBlockSize = blockVector->GetPreferredBlockSize();
-    bool preferCommittedMemory =
-        D3D12MA_DEBUG_ALWAYS_COMMITTED ||
-        PrefersCommittedAllocation(*pResourceDesc) ||
-        // Heuristics: Allocate committed memory if requested size if greater than half of preferred block size.
-        resAllocInfo.SizeInBytes > preferredBlockSize / 2;
-    if(preferCommittedMemory &&
-        (finalAllocDesc.Flags & ALLOCATION_FLAG_NEVER_ALLOCATE) == 0)
-    {
-        finalAllocDesc.Flags |= ALLOCATION_FLAG_COMMITTED;
-    }
+UINT AllocatorPimpl::GenerateBlockId()
+{
+    UINT id = m_NextBlockId.load();
+    while(!m_NextBlockId.compare_exchange_weak(id, id + 1)) { }
+    return id;
+}
 
-    if((finalAllocDesc.Flags & ALLOCATION_FLAG_COMMITTED) != 0)
+HRESULT AllocatorPimpl::CreateHeap(const D3D12_HEAP_DESC& desc, ID3D12Heap*& outHeap)
+{
+    outHeap = m_HeapCache.Take(desc);
+    if(outHeap != NULL)
     {
-        return AllocateCommittedMemory(
-            &finalAllocDesc,
-            pResourceDesc,
-            resAllocInfo,
-            InitialResourceState,
-            pOptimizedClearValue,
-            ppAllocation,
-            riidResource,
-            ppvResource);
+        ++m_HeapReusedCount;
+        return S_OK;
     }
-    else
-    {
-        HRESULT hr = blockVector->Allocate(
-            resAllocInfo.SizeInBytes,
-            resAllocInfo.Alignment,
-            finalAllocDesc,
-            1,
-            (Allocation**)ppAllocation);
-        if(SUCCEEDED(hr))
-        {
-            hr = m_Device->CreatePlacedResource(
-                (*ppAllocation)->GetBlock()->GetHeap(),
-                (*ppAllocation)->GetOffset(),
-                pResourceDesc,
-                InitialResourceState,
-                pOptimizedClearValue,
-                riidResource,
-                ppvResource);
-            if(SUCCEEDED(hr))
-            {
-                return hr;
-            }
-            else
-            {
-                (*ppAllocation)->Release();
-                return hr;
-            }
-        }
 
-        return AllocateCommittedMemory(
-            &finalAllocDesc,
-            pResourceDesc,
-            resAllocInfo,
-            InitialResourceState,
-            pOptimizedClearValue,
-            ppAllocation,
-            riidResource,
-            ppvResource);
-    }
+    D3D12MA_TIME_SCOPE(this, TIMED_OPERATION_CREATE_HEAP)
+    return m_Device->CreateHeap(&desc, IID_PPV_ARGS(&outHeap));
 }
 
-bool AllocatorPimpl::PrefersCommittedAllocation(const D3D12_RESOURCE_DESC& resourceDesc)
+void AllocatorPimpl::ReleaseHeap(const D3D12_HEAP_DESC& desc, ID3D12Heap* heap)
 {
-    // Intentional. It may change in the future.
-    return false;
+    m_HeapCache.Put(desc, heap);
 }
 
-HRESULT AllocatorPimpl::AllocateCommittedMemory(
-    const ALLOCATION_DESC* pAllocDesc,
-    const D3D12_RESOURCE_DESC* pResourceDesc,
-    const D3D12_RESOURCE_ALLOCATION_INFO& resAllocInfo,
-    D3D12_RESOURCE_STATES InitialResourceState,
-    const D3D12_CLEAR_VALUE *pOptimizedClearValue,
-    Allocation** ppAllocation,
-    REFIID riidResource,
-    void** ppvResource)
+void AllocatorPimpl::NotifyHeapCreated(const DeviceMemoryBlock& block)
 {
-    if((pAllocDesc->Flags & ALLOCATION_FLAG_NEVER_ALLOCATE) != 0)
+    ++m_HeapCreatedCount;
+    m_HeapCreatedBytes += block.m_pMetadata->GetSize();
+    if(m_DeviceMemoryCallbacks.pHeapCreated != NULL)
     {
-        return E_OUTOFMEMORY;
+        (*m_DeviceMemoryCallbacks.pHeapCreated)(block.GetHeapType(), block.m_pMetadata->GetSize(), block.GetId(),
+            m_DeviceMemoryCallbacks.pUserData);
     }
+}
 
-    D3D12_HEAP_PROPERTIES heapProps = {};
-    heapProps.Type = pAllocDesc->HeapType;
-    HRESULT hr = m_Device->CreateCommittedResource(
-        &heapProps, D3D12_HEAP_FLAG_NONE, pResourceDesc, InitialResourceState,
-        pOptimizedClearValue, riidResource, ppvResource);
-    if(SUCCEEDED(hr))
+void AllocatorPimpl::NotifyHeapDestroyed(const DeviceMemoryBlock& block)
+{
+    ++m_HeapDestroyedCount;
+    m_HeapDestroyedBytes += block.m_pMetadata->GetSize();
+    if(m_DeviceMemoryCallbacks.pHeapDestroyed != NULL)
     {
-        Allocation* alloc = D3D12MA_NEW(m_AllocationCallbacks, Allocation)();
-        alloc->InitCommitted(this, resAllocInfo.SizeInBytes, pAllocDesc->HeapType);
-        *ppAllocation = alloc;
+        (*m_DeviceMemoryCallbacks.pHeapDestroyed)(block.GetHeapType(), block.m_pMetadata->GetSize(), block.GetId(),
+            m_DeviceMemoryCallbacks.pUserData);
+    }
+}
+
+void AllocatorPimpl::NotifyAllocationCreated(Allocation* allocation)
+{
+    // Bytes were already added by ReserveCategoryBytes.
+    ++m_CategoryAllocationCounts[allocation->m_Category];
 
-        const UINT heapTypeIndex = HeapTypeToIndex(pAllocDesc->HeapType);
+    if(allocation->m_Type == Allocation::TYPE_PLACED && allocation->m_Placed.smallAlignment)
+    {
+        ++m_SmallAlignmentCount;
+        m_SmallAlignmentBytes += allocation->GetSize();
+        m_SmallAlignmentSavedBytes +=
+            AlignUp<UINT64>(allocation->GetSize(), D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT) - allocation->GetSize();
+    }
 
+    if(allocation->m_Type == Allocation::TYPE_COMMITTED)
+    {
+        if(m_DeviceMemoryCallbacks.pCommittedAllocated != NULL)
         {
-            MutexLockWrite lock(m_CommittedAllocationsMutex[heapTypeIndex], m_UseMutex);
-            AllocationVectorType* const committedAllocations = m_pCommittedAllocations[heapTypeIndex];
-            D3D12MA_ASSERT(committedAllocations);
-            committedAllocations->InsertSorted(alloc, PointerLess());
+            (*m_DeviceMemoryCallbacks.pCommittedAllocated)(allocation->m_Committed.heapType, allocation->GetSize(),
+                COMMITTED_BLOCK_ID, 0, allocation, m_DeviceMemoryCallbacks.pUserData);
         }
     }
-    return hr;
+    else if(m_DeviceMemoryCallbacks.pSuballocated != NULL)
+    {
+        const DeviceMemoryBlock* const block = allocation->GetBlock();
+        (*m_DeviceMemoryCallbacks.pSuballocated)(block->GetHeapType(), allocation->GetSize(),
+            block->GetId(), allocation->GetOffset(), allocation, m_DeviceMemoryCallbacks.pUserData);
+    }
 }
 
-UINT AllocatorPimpl::CalcDefaultPoolCount() const
+void AllocatorPimpl::NotifyAllocationFreed(Allocation* allocation)
 {
-    if(SupportsResourceHeapTier2())
+    --m_CategoryAllocationCounts[allocation->m_Category];
+    ReleaseCategoryBytes(allocation->m_Category, allocation->GetSize());
+
+    if(allocation->m_Type == Allocation::TYPE_PLACED && allocation->m_Placed.smallAlignment)
     {
-        return 3;
+        --m_SmallAlignmentCount;
+        m_SmallAlignmentBytes -= allocation->GetSize();
+        m_SmallAlignmentSavedBytes -=
+            AlignUp<UINT64>(allocation->GetSize(), D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT) - allocation->GetSize();
     }
-    else
+
+    if(allocation->m_Type == Allocation::TYPE_COMMITTED)
     {
-        return 9;
+        if(m_DeviceMemoryCallbacks.pCommittedFreed != NULL)
+        {
+            (*m_DeviceMemoryCallbacks.pCommittedFreed)(allocation->m_Committed.heapType, allocation->GetSize(),
+                COMMITTED_BLOCK_ID, 0, allocation, m_DeviceMemoryCallbacks.pUserData);
+        }
     }
-}
-
-UINT AllocatorPimpl::CalcDefaultPoolIndex(const ALLOCATION_DESC& allocDesc, const D3D12_RESOURCE_DESC& resourceDesc) const
-{
-    UINT poolIndex = UINT_MAX;
-    switch(allocDesc.HeapType)
+    else if(m_DeviceMemoryCallbacks.pSuballocationFreed != NULL)
     {
-    case D3D12_HEAP_TYPE_DEFAULT:  poolIndex = 0; break;
-    case D3D12_HEAP_TYPE_UPLOAD:   poolIndex = 1; break;
-    case D3D12_HEAP_TYPE_READBACK: poolIndex = 2; break;
-    default: D3D12MA_ASSERT(0);
+        const DeviceMemoryBlock* const block = allocation->GetBlock();
+        (*m_DeviceMemoryCallbacks.pSuballocationFreed)(block->GetHeapType(), allocation->GetSize(),
+            block->GetId(), allocation->GetOffset(), allocation, m_DeviceMemoryCallbacks.pUserData);
     }
+}
 
-    if(!SupportsResourceHeapTier2())
+void AllocatorPimpl::FreeAllocations(UINT count, Allocation** ppAllocations)
+{
+#if D3D12MA_RECORDING_ENABLED
+    const UINT64 recordBeginTime = m_Recorder != NULL ? m_Recorder->GetTime() : 0;
+#endif
+
+    Vector<Allocation*> placedAllocations(GetAllocs());
+    Vector<Allocation*> committedAllocations(GetAllocs());
+    for(UINT i = 0; i < count; ++i)
     {
-        poolIndex *= 3;
-        if(resourceDesc.Dimension != D3D12_RESOURCE_DIMENSION_BUFFER)
+        Allocation* const alloc = ppAllocations[i];
+        if(alloc != NULL)
         {
-            ++poolIndex;
-            const bool isRenderTargetOrDepthStencil =
-                (resourceDesc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)) != 0;
-            if(isRenderTargetOrDepthStencil)
+            NotifyAllocationFreed(alloc);
+#if D3D12MA_RECORDING_ENABLED
+            if(m_Recorder != NULL)
             {
-                ++poolIndex;
+                // Recorded as separate releases, before any of the memory can be reused,
+                // like in Allocation::Release.
+                m_Recorder->RecordReleaseAllocation(recordBeginTime, m_Recorder->GetTime(), alloc);
+            }
+#endif
+            if(alloc->m_Type == Allocation::TYPE_PLACED)
+            {
+                placedAllocations.push_back(alloc);
+            }
+            else
+            {
+                D3D12MA_ASSERT(alloc->m_Type == Allocation::TYPE_COMMITTED);
+                committedAllocations.push_back(alloc);
             }
         }
     }
 
-    return poolIndex;
-}
-
-void AllocatorPimpl::CalcDefaultPoolParams(D3D12_HEAP_TYPE& outHeapType, D3D12_HEAP_FLAGS& outHeapFlags, UINT index) const
-{
-    outHeapType = D3D12_HEAP_TYPE_DEFAULT;
-    outHeapFlags = D3D12_HEAP_FLAG_NONE;
-
-    if(!SupportsResourceHeapTier2())
-    {
-        switch(index % 3)
+    // Committed allocations: sorted by node pools and heap type, so each list is locked once.
+    std::sort(
+        committedAllocations.begin(),
+        committedAllocations.end(),
+        [](const Allocation* lhs, const Allocation* rhs)
         {
-        case 0:
-            outHeapFlags = D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES | D3D12_HEAP_FLAG_DENY_NON_RT_DS_TEXTURES;
-            break;
-        case 1:
-            outHeapFlags = D3D12_HEAP_FLAG_DENY_BUFFERS | D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES;
-            break;
-        case 2:
-            outHeapFlags = D3D12_HEAP_FLAG_DENY_BUFFERS | D3D12_HEAP_FLAG_DENY_NON_RT_DS_TEXTURES;
-            break;
+            if(lhs->m_Committed.nodePools != rhs->m_Committed.nodePools)
+            {
+                return lhs->m_Committed.nodePools < rhs->m_Committed.nodePools;
+            }
+            return HeapTypeToIndex(lhs->m_Committed.heapType) < HeapTypeToIndex(rhs->m_Committed.heapType);
+        });
+    size_t committedIndex = 0;
+    while(committedIndex < committedAllocations.size())
+    {
+        const Allocation* const first = committedAllocations[committedIndex];
+        size_t committedEndIndex = committedIndex + 1;
+        while(committedEndIndex < committedAllocations.size() &&
+            committedAllocations[committedEndIndex]->m_Committed.nodePools == first->m_Committed.nodePools &&
+            committedAllocations[committedEndIndex]->m_Committed.heapType == first->m_Committed.heapType)
+        {
+            ++committedEndIndex;
         }
+        first->m_Committed.nodePools->RemoveCommittedAllocations(HeapTypeToIndex(first->m_Committed.heapType),
+            committedEndIndex - committedIndex, committedAllocations.data() + committedIndex);
+        committedIndex = committedEndIndex;
+    }
 
-        index /= 3;
+    // Placed allocations: sorted by block vector, block, and offset, so each
+    // block vector is locked once and each block is traversed once.
+    std::sort(
+        placedAllocations.begin(),
+        placedAllocations.end(),
+        [](const Allocation* lhs, const Allocation* rhs)
+        {
+            const DeviceMemoryBlock* const lhsBlock = lhs->m_Placed.block;
+            const DeviceMemoryBlock* const rhsBlock = rhs->m_Placed.block;
+            if(lhsBlock->GetBlockVector() != rhsBlock->GetBlockVector())
+            {
+                return lhsBlock->GetBlockVector() < rhsBlock->GetBlockVector();
+            }
+            if(lhsBlock != rhsBlock)
+            {
+                return lhsBlock < rhsBlock;
+            }
+            return lhs->m_Placed.offset < rhs->m_Placed.offset;
+        });
+    size_t allocIndex = 0;
+    while(allocIndex < placedAllocations.size())
+    {
+        BlockVector* const blockVector = placedAllocations[allocIndex]->GetBlock()->GetBlockVector();
+        size_t allocEndIndex = allocIndex + 1;
+        while(allocEndIndex < placedAllocations.size() &&
+            placedAllocations[allocEndIndex]->GetBlock()->GetBlockVector() == blockVector)
+        {
+            ++allocEndIndex;
+        }
+        blockVector->Free(allocEndIndex - allocIndex, placedAllocations.data() + allocIndex);
+        allocIndex = allocEndIndex;
     }
 
-    switch(index)
+    for(size_t i = placedAllocations.size(); i--; )
     {
-    case 0:
-        outHeapType = D3D12_HEAP_TYPE_DEFAULT;
-        break;
-    case 1:
-        outHeapType = D3D12_HEAP_TYPE_UPLOAD;
-        break;
-    case 2:
-        outHeapType = D3D12_HEAP_TYPE_READBACK;
-        break;
-    default:
-        D3D12MA_ASSERT(0);
+        placedAllocations[i]->FreeName();
+        D3D12MA_DELETE(GetAllocs(), placedAllocations[i]);
+    }
+    for(size_t i = committedAllocations.size(); i--; )
+    {
+        committedAllocations[i]->FreeName();
+        D3D12MA_DELETE(GetAllocs(), committedAllocations[i]);
     }
 }
 
-void AllocatorPimpl::FreeCommittedMemory(Allocation* allocation)
+
+////////////////////////////////////////////////////////////////////////////////
+// Private class VirtualBlockPimpl definition
+
+class VirtualBlockPimpl
 {
-    D3D12MA_ASSERT(allocation && allocation->m_Type == Allocation::TYPE_COMMITTED);
-    const UINT heapTypeIndex = HeapTypeToIndex(allocation->m_Committed.heapType);
+public:
+    const ALLOCATION_CALLBACKS m_AllocationCallbacks;
+    const UINT64 m_Size;
+    BlockMetadataAlgorithm m_Metadata;
 
-    {
-        MutexLockWrite lock(m_CommittedAllocationsMutex[heapTypeIndex], m_UseMutex);
-        AllocationVectorType* const committedAllocations = m_pCommittedAllocations[heapTypeIndex];
-        D3D12MA_ASSERT(committedAllocations);
-        bool success = committedAllocations->RemoveSorted(allocation, PointerLess());
-        D3D12MA_ASSERT(success);
-    }
-}
+    VirtualBlockPimpl(const ALLOCATION_CALLBACKS& allocationCallbacks, UINT64 size);
+    ~VirtualBlockPimpl();
+};
 
-void AllocatorPimpl::FreePlacedMemory(Allocation* allocation)
+VirtualBlockPimpl::VirtualBlockPimpl(const ALLOCATION_CALLBACKS& allocationCallbacks, UINT64 size) :
+    m_AllocationCallbacks(allocationCallbacks),
+    m_Size(size),
+    m_Metadata(&m_AllocationCallbacks,
+        true) // isVirtual
 {
-    D3D12MA_ASSERT(allocation && allocation->m_Type == Allocation::TYPE_PLACED);
-    
-    DeviceMemoryBlock* const block = allocation->GetBlock();
-    D3D12MA_ASSERT(block);
-    BlockVector* const blockVector = block->GetBlockVector();
-    D3D12MA_ASSERT(blockVector);
-    blockVector->Free(allocation);
+    m_Metadata.Init(m_Size);
 }
 
+VirtualBlockPimpl::~VirtualBlockPimpl()
+{
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 // Public class Allocation implementation
@@ -2947,6 +6613,24 @@ void Allocation::Release()
     }
 
     D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+    // The allocator outlives this object, deleted below.
+    D3D12MA_TIME_SCOPE(m_Allocator, TIMED_OPERATION_RELEASE_ALLOCATION)
+
+#if D3D12MA_RECORDING_ENABLED
+    Recorder* const recorder = m_Allocator->GetRecorder();
+    const UINT64 recordBeginTime = recorder != NULL ? recorder->GetTime() : 0;
+#endif
+
+    m_Allocator->NotifyAllocationFreed(this);
+
+#if D3D12MA_RECORDING_ENABLED
+    if(recorder != NULL)
+    {
+        // Written before the memory and the address of this object can be reused by another
+        // thread, so that its CreateResource is always recorded after this release.
+        recorder->RecordReleaseAllocation(recordBeginTime, recorder->GetTime(), this);
+    }
+#endif
 
     switch(m_Type)
     {
@@ -2991,16 +6675,63 @@ ID3D12Heap* Allocation::GetHeap() const
     }
 }
 
+ID3D12Resource* Allocation::GetResource() const
+{
+    return m_Type == TYPE_PLACED ? m_Placed.block->GetBuffer() : NULL;
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS Allocation::GetGPUVirtualAddress() const
+{
+    ID3D12Resource* const buffer = GetResource();
+    return buffer != NULL ? buffer->GetGPUVirtualAddress() + m_Placed.offset : 0;
+}
+
+void* Allocation::GetMappedData() const
+{
+    if(m_Type == TYPE_PLACED && m_Placed.block->GetMappedData() != NULL)
+    {
+        return (char*)m_Placed.block->GetMappedData() + m_Placed.offset;
+    }
+    return NULL;
+}
+
 void Allocation::SetName(LPCWSTR Name)
 {
+#if D3D12MA_RECORDING_ENABLED
+    Recorder* const recorder = m_Allocator->GetRecorder();
+    const UINT64 recordBeginTime = recorder != NULL ? recorder->GetTime() : 0;
+#endif
+
+    // Acquired before the old one is released, so renaming to the same name keeps it stored.
+    LPCWSTR const newName = Name != NULL ? m_Allocator->GetNameTable().Acquire(Name) : NULL;
+    FreeName();
+    m_Name = newName;
+
+#if D3D12MA_RECORDING_ENABLED
+    if(recorder != NULL)
+    {
+        recorder->RecordSetAllocationName(recordBeginTime, this, Name);
+    }
+#endif
+}
+
+void Allocation::SetNameUtf8(LPCSTR Name)
+{
+#if D3D12MA_RECORDING_ENABLED
+    Recorder* const recorder = m_Allocator->GetRecorder();
+    const UINT64 recordBeginTime = recorder != NULL ? recorder->GetTime() : 0;
+#endif
+
+    LPCWSTR const newName = Name != NULL ? m_Allocator->GetNameTable().Acquire(Name) : NULL;
     FreeName();
+    m_Name = newName;
 
-    if(Name)
+#if D3D12MA_RECORDING_ENABLED
+    if(recorder != NULL)
     {
-        const size_t nameCharCount = wcslen(Name) + 1;
-        m_Name = D3D12MA_NEW_ARRAY(m_Allocator->GetAllocs(), wchar_t, nameCharCount);
-        memcpy(m_Name, Name, nameCharCount * sizeof(wchar_t));
+        recorder->RecordSetAllocationName(recordBeginTime, this, m_Name);
     }
+#endif
 }
 
 Allocation::Allocation()
@@ -3017,13 +6748,17 @@ Allocation::~Allocation()
     // Use Release method instead.
 }
 
-void Allocation::InitCommitted(AllocatorPimpl* allocator, UINT64 size, D3D12_HEAP_TYPE heapType)
+void Allocation::InitCommitted(AllocatorPimpl* allocator, UINT64 size, D3D12_HEAP_TYPE heapType, NodePools* nodePools)
 {
     m_Allocator = allocator;
     m_Type = TYPE_COMMITTED;
     m_Size = size;
+    m_Category = 0;
     m_Name = NULL;
     m_Committed.heapType = heapType;
+    m_Committed.nodePools = nodePools;
+    m_Committed.prev = NULL;
+    m_Committed.next = NULL;
 }
 
 void Allocation::InitPlaced(AllocatorPimpl* allocator, UINT64 size, UINT64 offset, UINT64 alignment, DeviceMemoryBlock* block)
@@ -3031,9 +6766,11 @@ void Allocation::InitPlaced(AllocatorPimpl* allocator, UINT64 size, UINT64 offse
     m_Allocator = allocator;
     m_Type = TYPE_PLACED;
     m_Size = size;
+    m_Category = 0;
     m_Name = NULL;
     m_Placed.offset = offset;
     m_Placed.block = block;
+    m_Placed.smallAlignment = false;
 }
 
 DeviceMemoryBlock* Allocation::GetBlock()
@@ -3046,8 +6783,7 @@ void Allocation::FreeName()
 {
     if(m_Name)
     {
-        const size_t nameCharCount = wcslen(m_Name) + 1;
-        D3D12MA_DELETE_ARRAY(m_Allocator->GetAllocs(), m_Name, nameCharCount);
+        m_Allocator->GetNameTable().Release(m_Name);
         m_Name = NULL;
     }
 }
@@ -3081,6 +6817,16 @@ const D3D12_FEATURE_DATA_D3D12_OPTIONS& Allocator::GetD3D12Options() const
     return m_Pimpl->GetD3D12Options();
 }
 
+BOOL Allocator::IsUMA() const
+{
+    return m_Pimpl->IsUMA();
+}
+
+BOOL Allocator::IsCacheCoherentUMA() const
+{
+    return m_Pimpl->IsCacheCoherentUMA();
+}
+
 HRESULT Allocator::CreateResource(
     const ALLOCATION_DESC* pAllocDesc,
     const D3D12_RESOURCE_DESC* pResourceDesc,
@@ -3095,6 +6841,225 @@ HRESULT Allocator::CreateResource(
     return m_Pimpl->CreateResource(pAllocDesc, pResourceDesc, InitialResourceState, pOptimizedClearValue, ppAllocation, riidResource, ppvResource);
 }
 
+HRESULT Allocator::AllocateBufferRange(
+    const ALLOCATION_DESC* pAllocDesc,
+    UINT64 size,
+    UINT64 alignment,
+    Allocation** ppAllocation)
+{
+    D3D12MA_ASSERT(pAllocDesc && ppAllocation);
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+    return m_Pimpl->AllocateBufferRange(pAllocDesc, size, alignment, ppAllocation);
+}
+
+void Allocator::FreeAllocations(UINT count, Allocation** ppAllocations)
+{
+    D3D12MA_ASSERT(count == 0 || ppAllocations);
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+    m_Pimpl->FreeAllocations(count, ppAllocations);
+}
+
+HRESULT Allocator::GetLatencyStats(TIMED_OPERATION operation, LatencyStats* pStats)
+{
+    D3D12MA_ASSERT(operation < TIMED_OPERATION_COUNT && pStats);
+#if D3D12MA_LATENCY_HISTOGRAMS
+    m_Pimpl->GetLatencyHistograms()->Calculate(operation, *pStats);
+    return S_OK;
+#else
+    (void)operation;
+    (void)pStats;
+    return E_NOTIMPL;
+#endif
+}
+
+void Allocator::SetCurrentFrameIndex(UINT frameIndex)
+{
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+    m_Pimpl->SetCurrentFrameIndex(frameIndex);
+}
+
+void Allocator::Trim()
+{
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+    m_Pimpl->Trim();
+}
+
+void Allocator::GetHeapChurnStats(HeapChurnStats* pStats)
+{
+    D3D12MA_ASSERT(pStats);
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+    m_Pimpl->GetHeapChurnStats(*pStats);
+}
+
+void Allocator::GetSmallAlignmentStats(SmallAlignmentStats* pStats)
+{
+    D3D12MA_ASSERT(pStats);
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+    m_Pimpl->GetSmallAlignmentStats(*pStats);
+}
+
+void Allocator::SetCategoryQuota(UINT category, UINT64 maxBytes)
+{
+    D3D12MA_ASSERT(category < ALLOCATION_CATEGORY_COUNT);
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+    m_Pimpl->SetCategoryQuota(category, maxBytes);
+}
+
+void Allocator::GetCategoryStats(UINT category, CategoryStats* pStats)
+{
+    D3D12MA_ASSERT(category < ALLOCATION_CATEGORY_COUNT && pStats);
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+    m_Pimpl->GetCategoryStats(category, *pStats);
+}
+
+HRESULT Allocator::BuildTraceString(char** ppTraceString)
+{
+    D3D12MA_ASSERT(ppTraceString);
+#if D3D12MA_TRACE_EVENTS
+    *ppTraceString = m_Pimpl->GetTraceEvents()->BuildJson();
+    return S_OK;
+#else
+    *ppTraceString = NULL;
+    return E_NOTIMPL;
+#endif
+}
+
+void Allocator::FreeTraceString(char* pTraceString)
+{
+    if(pTraceString != NULL)
+    {
+        Free(m_Pimpl->GetAllocs(), pTraceString);
+    }
+}
+
+HRESULT Allocator::GetLockStats(LockStats* pLockStats)
+{
+    D3D12MA_ASSERT(pLockStats);
+#if D3D12MA_LOCK_STATS
+    m_Pimpl->GetLockStats(*pLockStats);
+    return S_OK;
+#else
+    (void)pLockStats;
+    return E_NOTIMPL;
+#endif
+}
+
+HRESULT Allocator::GetAllLockStats(UINT* pLockStatsCount, LockStats* pLockStats)
+{
+    D3D12MA_ASSERT(pLockStatsCount);
+#if D3D12MA_LOCK_STATS
+    m_Pimpl->GetAllLockStats(*pLockStatsCount, pLockStats);
+    return S_OK;
+#else
+    (void)pLockStatsCount;
+    (void)pLockStats;
+    return E_NOTIMPL;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public class VirtualBlock implementation
+
+VirtualBlock::VirtualBlock(const ALLOCATION_CALLBACKS& allocationCallbacks, const VIRTUAL_BLOCK_DESC& desc) :
+    m_Pimpl(D3D12MA_NEW(allocationCallbacks, VirtualBlockPimpl)(allocationCallbacks, desc.Size))
+{
+}
+
+VirtualBlock::~VirtualBlock()
+{
+    // THIS IS AN IMPORTANT ASSERT!
+    // Hitting it means you have some memory leak - unreleased allocations in this virtual block.
+    D3D12MA_ASSERT(m_Pimpl->m_Metadata.IsEmpty() && "Some allocations were not freed before destruction of this virtual block!");
+
+    D3D12MA_DELETE(m_Pimpl->m_AllocationCallbacks, m_Pimpl);
+}
+
+void VirtualBlock::Release()
+{
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    // Copy is needed because otherwise we would call destructor and invalidate the structure with callbacks before using it to free memory.
+    const ALLOCATION_CALLBACKS allocationCallbacksCopy = m_Pimpl->m_AllocationCallbacks;
+    D3D12MA_DELETE(allocationCallbacksCopy, this);
+}
+
+BOOL VirtualBlock::IsEmpty() const
+{
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    return m_Pimpl->m_Metadata.IsEmpty() ? TRUE : FALSE;
+}
+
+void VirtualBlock::GetAllocationInfo(UINT64 offset, VIRTUAL_ALLOCATION_INFO* pInfo) const
+{
+    D3D12MA_ASSERT(offset != UINT64_MAX && pInfo);
+
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    m_Pimpl->m_Metadata.GetAllocationInfo(offset, *pInfo);
+}
+
+HRESULT VirtualBlock::Allocate(const VIRTUAL_ALLOCATION_DESC* pDesc, UINT64* pOffset)
+{
+    D3D12MA_ASSERT(pDesc && pOffset && pDesc->Size > 0 && IsPow2(pDesc->Alignment));
+
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    const UINT64 alignment = pDesc->Alignment != 0 ? pDesc->Alignment : 1;
+    AllocationRequest allocRequest = {};
+    if(m_Pimpl->m_Metadata.CreateAllocationRequest(pDesc->Size, alignment, 0, &allocRequest))
+    {
+        m_Pimpl->m_Metadata.Alloc(allocRequest, pDesc->Size, pDesc->pUserData);
+        D3D12MA_HEAVY_ASSERT(m_Pimpl->m_Metadata.Validate());
+        *pOffset = allocRequest.offset;
+        return S_OK;
+    }
+    else
+    {
+        *pOffset = UINT64_MAX;
+        return E_OUTOFMEMORY;
+    }
+}
+
+void VirtualBlock::FreeAllocation(UINT64 offset)
+{
+    D3D12MA_ASSERT(offset != UINT64_MAX);
+
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    m_Pimpl->m_Metadata.FreeAtOffset(offset);
+    D3D12MA_HEAVY_ASSERT(m_Pimpl->m_Metadata.Validate());
+}
+
+void VirtualBlock::Clear()
+{
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    m_Pimpl->m_Metadata.Clear();
+    D3D12MA_HEAVY_ASSERT(m_Pimpl->m_Metadata.Validate());
+}
+
+void VirtualBlock::SetAllocationUserData(UINT64 offset, void* pUserData)
+{
+    D3D12MA_ASSERT(offset != UINT64_MAX);
+
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    m_Pimpl->m_Metadata.SetAllocationUserData(offset, pUserData);
+}
+
+void VirtualBlock::CalculateStats(StatInfo* pInfo) const
+{
+    D3D12MA_ASSERT(pInfo);
+
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    D3D12MA_HEAVY_ASSERT(m_Pimpl->m_Metadata.Validate());
+    InitStatInfo(*pInfo);
+    m_Pimpl->m_Metadata.AddStatInfo(*pInfo);
+    PostprocessStatInfo(*pInfo);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Public global functions
 
@@ -3107,10 +7072,10 @@ HRESULT CreateAllocator(const ALLOCATOR_DESC* pDesc, Allocator** ppAllocator)
     D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
 
     ALLOCATION_CALLBACKS allocationCallbacks;
-    SetupAllocationCallbacks(allocationCallbacks, *pDesc);
+    SetupAllocationCallbacks(allocationCallbacks, pDesc->pAllocationCallbacks);
 
     *ppAllocator = D3D12MA_NEW(allocationCallbacks, Allocator)(allocationCallbacks, *pDesc);
-    HRESULT hr = (*ppAllocator)->m_Pimpl->Init();
+    HRESULT hr = (*ppAllocator)->m_Pimpl->Init(*pDesc);
     if(FAILED(hr))
     {
         D3D12MA_DELETE(allocationCallbacks, *ppAllocator);
@@ -3119,4 +7084,18 @@ HRESULT CreateAllocator(const ALLOCATOR_DESC* pDesc, Allocator** ppAllocator)
     return hr;
 }
 
+HRESULT CreateVirtualBlock(const VIRTUAL_BLOCK_DESC* pDesc, VirtualBlock** ppVirtualBlock)
+{
+    D3D12MA_ASSERT(pDesc && ppVirtualBlock);
+    D3D12MA_ASSERT(pDesc->Size > 0);
+
+    D3D12MA_DEBUG_GLOBAL_MUTEX_LOCK
+
+    ALLOCATION_CALLBACKS allocationCallbacks;
+    SetupAllocationCallbacks(allocationCallbacks, pDesc->pAllocationCallbacks);
+
+    *ppVirtualBlock = D3D12MA_NEW(allocationCallbacks, VirtualBlock)(allocationCallbacks, *pDesc);
+    return S_OK;
+}
+
 } // namespace D3D12MA
@@ -38,8 +38,26 @@ Documentation of all members: D3D12MemAlloc.h
         - [Project setup](@ref quick_start_project_setup)
         - [Creating resources](@ref quick_start_creating_resources)
         - [Mapping memory](@ref quick_start_mapping_memory)
+        - [Suballocating small buffers](@ref quick_start_buffer_ranges)
 - \subpage configuration
   - [Custom CPU memory allocator](@ref custom_memory_allocator)
+  - [Device memory callbacks](@ref device_memory_callbacks)
+  - [Adaptive block size](@ref adaptive_block_size)
+  - [Empty block retention](@ref empty_block_retention)
+  - [Heap recycling](@ref heap_recycling)
+  - [Small resource alignment](@ref small_resource_alignment)
+  - [CPU-accessible memory on UMA](@ref uma_custom_heaps)
+  - [Multiple nodes](@ref multi_node)
+  - [Allocation strategies](@ref allocation_strategies)
+  - [Lifetime hints](@ref lifetime_hints)
+  - [Allocation categories](@ref allocation_categories)
+  - [Single-threaded build](@ref configuration_single_threaded)
+  - [Building without WinAPI](@ref configuration_portability)
+- \subpage virtual_allocator
+- \subpage record_and_replay
+- \subpage lock_statistics
+- \subpage latency_histograms
+- \subpage trace_events
 - \subpage general_considerations
   - [Thread safety](@ref general_considerations_thread_safety)
   - [Future plans](@ref general_considerations_future_plans)
@@ -229,6 +247,34 @@ resource->Unmap(0, NULL);
 \endcode
 
 
+\section quick_start_buffer_ranges Suballocating small buffers
+
+Every resource created with D3D12MA::Allocator::CreateResource is placed at an
+offset aligned to at least 64 KiB, so a small buffer like a 256 B constant buffer
+wastes most of that space. For such buffers, call D3D12MA::Allocator::AllocateBufferRange
+instead. It returns an allocation that is a range of a larger buffer, shared with
+other such allocations and owned by the allocator. No separate `ID3D12Resource`
+is created.
+
+\code
+D3D12MA::ALLOCATION_DESC allocationDesc = {};
+allocationDesc.HeapType = D3D12_HEAP_TYPE_UPLOAD;
+
+D3D12MA::Allocation* allocation;
+HRESULT hr = allocator->AllocateBufferRange(
+    &allocationDesc,
+    sizeof(MyConstantBuffer),
+    D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT,
+    &allocation);
+
+memcpy(allocation->GetMappedData(), &myConstantBufferData, sizeof(MyConstantBuffer));
+cmdList->SetGraphicsRootConstantBufferView(0, allocation->GetGPUVirtualAddress());
+\endcode
+
+Buffers in `UPLOAD` and `READBACK` heaps are persistently mapped, so
+D3D12MA::Allocation::GetMappedData can be used directly.
+
+
 \page configuration Configuration
 
 Please check file `D3D12MemAlloc.cpp` lines between "Configuration Begin" and
@@ -274,6 +320,451 @@ D3D12MA::Allocator* allocator;
 HRESULT hr = D3D12MA::CreateAllocator(&allocatorDesc, &allocator);
 \endcode
 
+\section device_memory_callbacks Device memory callbacks
+
+To feed a memory tracker or a timeline profiler with what the allocator does
+with GPU memory, fill structure D3D12MA::DEVICE_MEMORY_CALLBACKS and pass it as
+optional member D3D12MA::ALLOCATOR_DESC::pDeviceMemoryCallbacks. Pointers left null are not called.
+
+- D3D12MA::DEVICE_MEMORY_CALLBACKS::pHeapCreated and D3D12MA::DEVICE_MEMORY_CALLBACKS::pHeapDestroyed
+  are called when the library creates and releases an `ID3D12Heap` as a new block of memory.
+- D3D12MA::DEVICE_MEMORY_CALLBACKS::pCommittedAllocated and D3D12MA::DEVICE_MEMORY_CALLBACKS::pCommittedFreed
+  are called for resources created as committed, including those that D3D12MA::Allocator::CreateResource
+  creates that way when placing them in a heap was not possible or not preferred.
+- D3D12MA::DEVICE_MEMORY_CALLBACKS::pSuballocated and D3D12MA::DEVICE_MEMORY_CALLBACKS::pSuballocationFreed
+  are called for every allocation made inside a block: placed resources and
+  ranges returned by D3D12MA::Allocator::AllocateBufferRange. They are called often, so leave them null if not needed.
+
+Every callback receives heap type, size in bytes, ID of the block, unique among all blocks of the allocator,
+and your D3D12MA::DEVICE_MEMORY_CALLBACKS::pUserData. The callbacks can be called from any thread
+that calls the library, possibly while internal mutexes are locked, so they must be thread-safe
+and must not call back into the allocator.
+
+\section adaptive_block_size Adaptive block size
+
+By default, every pool allocates blocks of D3D12MA::ALLOCATOR_DESC::PreferredBlockSize
+(256 MiB if not specified), except its first blocks, which can be 1/8, 1/4 and 1/2 of it.
+Resources larger than half of it are created as committed. With one size for all heap types,
+small uploads may leave most of a large `UPLOAD` heap unused, while a workload
+that needs lots of `DEFAULT` memory creates and releases many heaps.
+
+Create the allocator with D3D12MA::ALLOCATOR_FLAG_ADAPTIVE_BLOCK_SIZE to make every pool
+choose sizes from its own workload instead. Each pool keeps a histogram of sizes
+requested from it recently, in which older requests gradually stop counting.
+
+- Size of a new block is the smallest power of two that fits 16 allocations of the
+  90th percentile of the requested sizes, but not less than 4 MiB.
+- When existing blocks of the pool are at least 75% used, the new block is at least
+  half as large as all of them together, so a growing pool needs few heaps.
+- Blocks can be up to 4 times larger than the preferred block size.
+- A resource is created as committed when it is larger than half of the block size
+  chosen by the first rule, so big resources that are requested often are placed in
+  large blocks, while rare ones get their own heap instead of stranding a big block.
+
+
+\section empty_block_retention Empty block retention
+
+When the last allocation in a memory block is freed, the pool keeps the empty block
+for later allocations. By default, it keeps at most one empty block and releases any
+further block that becomes empty immediately. When a workload frees and allocates
+a lot of memory in every frame, this creates and releases the same heaps over and over.
+Whether that happens is visible in D3D12MA::HeapChurnStats returned by D3D12MA::Allocator::GetHeapChurnStats.
+
+To keep more, fill structure D3D12MA::EMPTY_BLOCK_RETENTION and pass it as optional member
+D3D12MA::ALLOCATOR_DESC::pEmptyBlockRetention. Each pool then keeps up to
+D3D12MA::EMPTY_BLOCK_RETENTION::MaxBlockCount empty blocks of total size up to
+D3D12MA::EMPTY_BLOCK_RETENTION::MaxBytes. Empty blocks are released only by
+D3D12MA::Allocator::Trim, when they stayed empty for at least D3D12MA::EMPTY_BLOCK_RETENTION::FrameCount
+frames or D3D12MA::EMPTY_BLOCK_RETENTION::Milliseconds. The library doesn't create any thread for it,
+so call `Trim` periodically, e.g. once per frame:
+
+\code
+D3D12MA::EMPTY_BLOCK_RETENTION emptyBlockRetention = {};
+emptyBlockRetention.MaxBlockCount = 4;
+emptyBlockRetention.MaxBytes = 512ull * 1024 * 1024;
+emptyBlockRetention.FrameCount = 60;
+
+D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+allocatorDesc.pDevice = device;
+allocatorDesc.pEmptyBlockRetention = &emptyBlockRetention;
+HRESULT hr = D3D12MA::CreateAllocator(&allocatorDesc, &allocator);
+
+// Every frame:
+allocator->SetCurrentFrameIndex(frameIndex);
+allocator->Trim();
+\endcode
+
+
+\section heap_recycling Heap recycling
+
+Empty blocks kept by a pool can be reused only by that pool. To let any pool reuse a heap
+released by another, create the allocator with D3D12MA::ALLOCATOR_FLAG_CREATE_NOT_ZEROED_HEAPS
+and set D3D12MA::ALLOCATOR_DESC::HeapCacheMaxBytes to nonzero.
+A recycled heap keeps contents of resources that were placed in it before, so heaps are
+recycled only when the allocator was told zeroed memory is not needed. Without the flag,
+HeapCacheMaxBytes is ignored. Heaps of released blocks are then kept in a cache of the allocator, up to that total size,
+and a pool that needs a new block first takes a heap of the same properties, flags and size
+from the cache, before calling `ID3D12Device::CreateHeap`. When the cache is full,
+the heaps that were put in it earliest are released. D3D12MA::Allocator::Trim releases
+all heaps in the cache. Heaps in the cache still occupy memory.
+They are counted in D3D12MA::HeapChurnStats::CachedHeapCount and D3D12MA::HeapChurnStats::CachedHeapBytes.
+
+By default, the system zeroes memory of every heap it creates. When memory of resources is
+fully initialized before use anyway, e.g. render targets cleared or discarded after placement, create the allocator with
+D3D12MA::ALLOCATOR_FLAG_CREATE_NOT_ZEROED_HEAPS to create heaps with `D3D12_HEAP_FLAG_CREATE_NOT_ZEROED`,
+which makes `CreateHeap` faster. The heap flag is used only when the device supports it, which is checked
+by querying `D3D12_FEATURE_D3D12_OPTIONS7`, and when the library is compiled with headers that declare it.
+Heaps are recycled with this allocator flag even when the device doesn't support the heap flag.
+
+
+\section small_resource_alignment Small resource alignment
+
+Textures are normally placed at 64 KiB alignment and occupy a multiple of 64 KiB,
+even when they are much smaller. Direct3D 12 allows textures that are not render targets
+or depth-stencils, not multisampled and small enough to be placed at
+`D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT` (4 KiB) instead. When `D3D12_RESOURCE_DESC::Alignment`
+is 0, D3D12MA::Allocator::CreateResource asks `ID3D12Device::GetResourceAllocationInfo` for
+this alignment for such textures and, when the device grants it, places the texture with
+`Alignment` set to 4 KiB. Textures with too many texels to possibly fit in 64 KiB are
+not even asked for.
+
+Similarly, multisampled resources, which need 4 MiB alignment, are placed in a default pool
+of their own. Heaps of all other pools are created with 64 KiB alignment, and 4 MiB aligned
+render targets don't leave gaps among smaller resources.
+
+Memory saved with small alignment is returned in D3D12MA::SmallAlignmentStats by
+D3D12MA::Allocator::GetSmallAlignmentStats. Define macro `D3D12MA_USE_SMALL_RESOURCE_PLACEMENT_ALIGNMENT`
+to 0 before including the implementation to disable it.
+
+
+\section uma_custom_heaps CPU-accessible memory on UMA
+
+On integrated GPUs, where `D3D12_FEATURE_DATA_ARCHITECTURE::UMA` is true, `DEFAULT` heap
+is the same system memory that `UPLOAD` heap is, so filling a resource through an
+`UPLOAD` staging copy only costs time and memory. Create the allocator with
+D3D12MA::ALLOCATOR_FLAG_USE_UMA_CUSTOM_HEAPS and, when D3D12MA::Allocator::IsUMA returns true,
+create such resources with D3D12MA::ALLOCATION_FLAG_CPU_ACCESSIBLE in `DEFAULT` heap:
+
+\code
+D3D12MA::ALLOCATION_DESC allocDesc = {};
+allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+allocDesc.Flags = allocator->IsUMA() ? D3D12MA::ALLOCATION_FLAG_CPU_ACCESSIBLE : D3D12MA::ALLOCATION_FLAG_NONE;
+\endcode
+
+They are then placed in heaps of type `D3D12_HEAP_TYPE_CUSTOM` with `D3D12_MEMORY_POOL_L0`,
+allocated from pools of their own, and can be mapped and written directly. CPU pages are
+`D3D12_CPU_PAGE_PROPERTY_WRITE_BACK` when D3D12MA::Allocator::IsCacheCoherentUMA returns true,
+and `D3D12_CPU_PAGE_PROPERTY_WRITE_COMBINE` otherwise, so don't read from them on the CPU
+in that case. Textures must be written with `ID3D12Resource::WriteToSubresource`, unless they
+use `D3D12_TEXTURE_LAYOUT_ROW_MAJOR`. Ranges returned by D3D12MA::Allocator::AllocateBufferRange
+with this flag are persistently mapped, like in `UPLOAD` heap.
+
+On other devices, or without the allocator flag, the allocation flag makes
+D3D12MA::Allocator::CreateResource and D3D12MA::Allocator::AllocateBufferRange fail with `E_NOTIMPL`.
+
+
+\section multi_node Multiple nodes
+
+When the device has more than one node (linked adapters, `ID3D12Device::GetNodeCount` greater than 1),
+set D3D12MA::ALLOCATION_DESC::CreationNodeMask to the node that should hold the memory and
+D3D12MA::ALLOCATION_DESC::VisibleNodeMask to all nodes that should access it:
+
+\code
+D3D12MA::ALLOCATION_DESC allocDesc = {};
+allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+allocDesc.CreationNodeMask = 1 << nodeIndex;
+allocDesc.VisibleNodeMask = 1 << nodeIndex;
+\endcode
+
+They are passed to `D3D12_HEAP_PROPERTIES` of heaps and committed resources. 0 in `CreationNodeMask`
+means node 0, and 0 in `VisibleNodeMask` means the creation node only. Every combination of the two masks has default pools and lists of committed
+allocations of its own, so memory of one node never holds resources of another, and resources
+visible to more nodes don't share heaps with those that are not. Pools of node 0 visible only to node 0
+are created with the allocator, others when first used.
+
+
+\section allocation_strategies Allocation strategies
+
+One of the `ALLOCATION_FLAG_STRATEGY_*` flags in D3D12MA::ALLOCATION_DESC::Flags chooses how a place
+for a placed resource or a buffer range is searched for among existing heaps and within a heap:
+
+- D3D12MA::ALLOCATION_FLAG_STRATEGY_MIN_MEMORY, the default, checks heaps from the most to the least
+  full and takes the smallest free range that fits (best fit). It leaves the fewest bytes unused.
+- D3D12MA::ALLOCATION_FLAG_STRATEGY_MIN_TIME takes the first heap whose largest free range is big enough,
+  and places the allocation in that range without searching others (first fit).
+  Use it on threads that stream resources in, where allocation latency matters more than packing.
+- D3D12MA::ALLOCATION_FLAG_STRATEGY_MIN_FRAGMENTATION checks heaps from the least to the most full
+  and takes the largest free range (worst fit), so what remains of it is still big enough for later
+  allocations. Use it for resources that live long.
+
+Strategies can be mixed freely between allocations of the same heap type.
+Setting more than one of these flags makes allocation fail with `E_INVALIDARG`.
+
+
+\section lifetime_hints Lifetime hints
+
+A heap can be released only when all resources placed in it are released. When resources that stay
+for the whole run share heaps with those released after a level or a frame, few heaps ever become empty.
+If you know how long a resource will live, say so in D3D12MA::ALLOCATION_DESC::Lifetime:
+
+\code
+D3D12MA::ALLOCATION_DESC allocDesc = {};
+allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+allocDesc.Lifetime = D3D12MA::ALLOCATION_LIFETIME_LEVEL;
+\endcode
+
+Placed resources and buffer ranges of different lifetimes are never placed in the same heap, so heaps
+holding level or frame resources become empty, and can be released or reused, once those are gone.
+An empty heap can take allocations of any lifetime. Committed resources are not affected.
+The default, D3D12MA::ALLOCATION_LIFETIME_DEFAULT, is a class of its own shared by all allocations
+without a hint, so using hints for some resources doesn't change where the others are placed.
+
+
+\section allocation_categories Allocation categories
+
+Every allocation is counted in one of D3D12MA::ALLOCATION_CATEGORY_COUNT categories, chosen with
+D3D12MA::ALLOCATION_DESC::Category - for example textures, geometry, render targets, or a subsystem
+that owns them. Category 0 is the default. D3D12MA::Allocator::GetCategoryStats returns the number and
+total size of allocations currently existing in a category. Totals are kept in atomic counters
+updated when an allocation is created and released, so they cost no lock.
+
+D3D12MA::Allocator::SetCategoryQuota limits the total size of a category:
+
+\code
+allocator->SetCategoryQuota(TEXTURE_CATEGORY, 512ull * 1024 * 1024);
+\endcode
+
+D3D12MA::Allocator::CreateResource and D3D12MA::Allocator::AllocateBufferRange then fail with
+`E_OUTOFMEMORY` before doing any work when the new allocation would exceed the quota.
+The size of the new allocation is reserved in the total with an atomic compare-and-swap
+before it is made, and returned if the call fails, so allocations created at the same time
+on multiple threads never exceed the quota together.
+
+
+\section configuration_single_threaded Single-threaded build
+
+D3D12MA::ALLOCATOR_FLAG_SINGLETHREADED skips locking of internal mutexes, but every lock
+still checks the flag at runtime. Tools that never use the library from more than one thread,
+like offline asset processing, can define macro `D3D12MA_SINGLE_THREADED` to 1 when compiling
+"D3D12MemAlloc.cpp". The locks then compile to nothing and every allocator behaves as if it
+was created with D3D12MA::ALLOCATOR_FLAG_SINGLETHREADED, whether the flag is set or not.
+D3D12MA::Allocator::GetLockStats then counts no locks and \ref trace_events contain no waits.
+Such a build must never call the library from more than one thread at the same time. When the
+macro is also defined for "Tests.cpp", multithreaded tests are skipped and benchmarks serialize
+their threads with a global lock.
+
+The allocation algorithm is chosen at compile time in any build, so calls to it made on every
+allocation and free are not virtual and can be inlined by the compiler.
+
+
+\section configuration_portability Building without WinAPI
+
+The library uses WinAPI only where a portable equivalent is not available
+everywhere: `SRWLOCK` for D3D12MA_RW_MUTEX and `_aligned_malloc` for the default
+CPU allocator. When `_WIN32` is not defined, they are replaced with
+`std::shared_mutex` and `aligned_alloc`. All other synchronization uses `std::mutex`
+and `std::atomic`.
+
+Direct3D 12 headers are still needed for type declarations. If you provide them
+yourself, e.g. from the DirectX-Headers project, include them before
+"%D3D12MemAlloc.h" and define macro `D3D12MA_D3D12_HEADERS_ALREADY_INCLUDED`.
+All calls the library makes to the device go through the `ID3D12Device`
+interface passed in D3D12MA::ALLOCATOR_DESC::pDevice, so it can also be an
+implementation of your own, e.g. a software stand-in used for testing or
+benchmarking without a GPU.
+
+
+\page virtual_allocator Virtual allocator
+
+As an extra feature, the core allocation algorithm of the library is exposed through a simple and convenient API of "virtual allocator".
+It doesn't allocate any real GPU memory. It just keeps track of used and free regions of a "virtual block".
+You can use it to allocate your own memory or other objects, even completely unrelated to D3D12,
+e.g. ranges of a descriptor heap or a ring buffer inside your own buffer.
+It doesn't need an `ID3D12Device`.
+
+\code
+D3D12MA::VIRTUAL_BLOCK_DESC blockDesc = {};
+blockDesc.Size = 1048576; // 1 MB
+
+D3D12MA::VirtualBlock* block;
+HRESULT hr = CreateVirtualBlock(&blockDesc, &block);
+
+D3D12MA::VIRTUAL_ALLOCATION_DESC allocDesc = {};
+allocDesc.Size = 4096; // 4 KB
+
+UINT64 allocOffset;
+hr = block->Allocate(&allocDesc, &allocOffset);
+if(SUCCEEDED(hr))
+{
+    // Use the 4 KB of your memory starting at allocOffset.
+}
+else
+{
+    // Allocation failed - no space for it could be found. Handle this error!
+}
+
+block->FreeAllocation(allocOffset);
+block->Release();
+\endcode
+
+The offset returned by D3D12MA::VirtualBlock::Allocate identifies the allocation
+within its block. Call D3D12MA::VirtualBlock::Clear to free all allocations at once,
+and D3D12MA::VirtualBlock::CalculateStats to get statistics.
+The object is not synchronized internally.
+
+
+\page record_and_replay Record and replay
+
+Calls to the library can be recorded to a compact binary file and replayed later.
+It can help to reproduce allocation patterns of an application without sharing
+the application itself, and to compare different allocation algorithms or block
+sizes on such real workloads.
+
+Recording is disabled by default. To enable it, define macro `D3D12MA_RECORDING_ENABLED`
+to 1 when compiling "D3D12MemAlloc.cpp", then fill D3D12MA::ALLOCATOR_DESC::pRecordSettings:
+
+\code
+D3D12MA::RECORD_SETTINGS recordSettings = {};
+recordSettings.pFilePath = "MyTrace.d3d12ma";
+
+D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+allocatorDesc.pDevice = device;
+allocatorDesc.pRecordSettings = &recordSettings;
+\endcode
+
+Recorded are D3D12MA::Allocator::CreateResource, D3D12MA::Allocator::AllocateBufferRange,
+D3D12MA::Allocation::Release (including releases made by D3D12MA::Allocator::FreeAllocations),
+D3D12MA::Allocation::SetName and D3D12MA::Allocator::SetCategoryQuota.
+Each record holds ID of the calling thread, time of the call and its duration, both in nanoseconds since the allocator was created,
+and the identity of the allocation (the address of D3D12MA::Allocation object).
+A release is written before its memory and address can be reused by another thread,
+so its duration doesn't include returning the memory.
+Records of D3D12MA::Allocator::CreateResource also hold heap type, allocation flags,
+lifetime hint, node masks, category, full resource description with its hash,
+size and alignment returned by `ID3D12Device::GetResourceAllocationInfo`, the result
+and the placement chosen: address of the `ID3D12Heap` and offset, or no heap for
+a committed resource. Records of D3D12MA::Allocator::AllocateBufferRange hold the same
+except the resource description.
+
+All numbers are stored little-endian, without padding. The file starts with the
+8 characters `D3D12MAR` followed by UINT32 version (currently 4), UINT32
+`ResourceHeapTier`, UINT32 D3D12MA::ALLOCATOR_DESC::Flags, UINT64 preferred block size
+and UINT32 node count of the device.
+Every record starts with UINT32 type (1 = CreateResource, 2 = Allocation::Release,
+3 = Allocation::SetName, 4 = AllocateBufferRange, 5 = SetCategoryQuota), UINT32 thread ID,
+UINT64 time, UINT64 duration and UINT64 allocation (0 for type 5).
+Types 1 and 4 continue with INT32 result and allocation description as UINT32 heap type,
+UINT32 allocation flags, UINT32 lifetime, UINT32 creation node mask, UINT32 visible node mask
+and UINT32 category. Then, for type 1: UINT64 hash, resource description as UINT32
+`Dimension`, UINT64 `Alignment`, UINT64 `Width`, UINT32 `Height`, UINT16 `DepthOrArraySize`, UINT16 `MipLevels`,
+UINT32 `Format`, UINT32 `SampleDesc.Count`, UINT32 `SampleDesc.Quality`,
+UINT32 `Layout`, UINT32 `Flags`, followed by UINT64 size, UINT64 alignment,
+UINT64 heap and UINT64 offset. For type 4: UINT64 size, UINT64 alignment as passed,
+UINT64 heap and UINT64 offset. For type 3: UINT32 number of characters
+(0xFFFFFFFF for null name), followed by that many UINT16 characters.
+For type 5: UINT32 category and UINT64 quota.
+
+Tool "D3D12MAReplay", built from directory "src/D3D12MAReplay", replays such file.
+It creates a fresh allocator on a software stand-in of `ID3D12Device`, so it doesn't
+need a GPU, and calls the library in the same order, reporting where placement
+of resources differs from the recorded one, time spent in the calls and memory used.
+Calls recorded from multiple threads are replayed on one thread, in the order they were written.
+
+
+\page lock_statistics Lock statistics
+
+To find out how much time threads spend waiting for each other inside the library,
+define macro `D3D12MA_LOCK_STATS` to 1 when compiling "D3D12MemAlloc.cpp".
+Every internal mutex then counts how many times it was locked, how many of these
+locks had to wait because another thread held it, and how long the waiting and holding took.
+Fetch the counters with D3D12MA::Allocator::GetLockStats:
+
+\code
+D3D12MA::LockStats lockStats;
+if(SUCCEEDED(allocator->GetLockStats(&lockStats)))
+{
+    for(UINT i = 0; i < lockStats.DefaultPoolCount; ++i)
+        printf("Heap type %u: %llu contended of %llu, waited %llu ns\n",
+            lockStats.DefaultPools[i].HeapType,
+            lockStats.DefaultPools[i].Lock.ContendedCount,
+            lockStats.DefaultPools[i].Lock.AcquireCount,
+            lockStats.DefaultPools[i].Lock.WaitTimeTotal);
+}
+\endcode
+
+Pools are identified by heap type and heap flags, lists of committed allocations by heap type.
+D3D12MA::Allocator::GetLockStats covers pools of node 0 visible to node 0. With \ref multi_node,
+D3D12MA::Allocator::GetAllLockStats returns them for every combination of node masks used so far.
+Measuring makes every lock slower, so use it only for profiling.
+With the macro left at its default 0, the locks are the same as without this feature
+and D3D12MA::Allocator::GetLockStats returns `E_NOTIMPL`.
+Custom `D3D12MA_MUTEX` must then also provide `bool TryLock()` and custom `D3D12MA_RW_MUTEX`
+`bool TryLockRead()` and `bool TryLockWrite()`. On Windows, the default `D3D12MA_RW_MUTEX`
+requires Windows 7 in this mode.
+
+Nothing is counted when the allocator is created with D3D12MA::ALLOCATOR_FLAG_SINGLETHREADED
+or the library is compiled with `D3D12MA_SINGLE_THREADED` defined to 1, because it doesn't lock at all.
+
+
+\page latency_histograms Latency histograms
+
+To find out how long calls to the library take, and how much of it is spent in the driver,
+define macro `D3D12MA_LATENCY_HISTOGRAMS` to 1 when compiling "D3D12MemAlloc.cpp".
+The allocator then measures every call of the operations listed in D3D12MA::TIMED_OPERATION:
+its own D3D12MA::Allocator::CreateResource and D3D12MA::Allocation::Release, calls to
+`ID3D12Device` that it makes internally, and searches for free space in its blocks. Fetch a summary with D3D12MA::Allocator::GetLatencyStats:
+
+\code
+D3D12MA::LatencyStats createStats, placedStats;
+if(SUCCEEDED(allocator->GetLatencyStats(D3D12MA::TIMED_OPERATION_CREATE_RESOURCE, &createStats)) &&
+    SUCCEEDED(allocator->GetLatencyStats(D3D12MA::TIMED_OPERATION_CREATE_PLACED_RESOURCE, &placedStats)))
+{
+    printf("CreateResource p99 %llu ns, of which CreatePlacedResource p99 %llu ns\n",
+        createStats.TimeP99, placedStats.TimeP99);
+}
+\endcode
+
+Durations are counted in histograms with 8 buckets per power of two, so percentiles are
+accurate to about 12%. Each thread adds to one of several copies of the histograms,
+selected by its ID, so threads rarely write to the same memory. The copies are merged
+when queried. Measuring costs two reads of the clock per operation and the histograms
+take about 200 KB of CPU memory per allocator.
+With the macro left at its default 0, nothing is measured and
+D3D12MA::Allocator::GetLatencyStats returns `E_NOTIMPL`.
+
+
+\page trace_events Trace events
+
+To see on a timeline what the library is doing in every thread, define macro `D3D12MA_TRACE_EVENTS`
+to 1 when compiling "D3D12MemAlloc.cpp". The allocator then records the beginning and duration
+of every operation listed in D3D12MA::TIMED_OPERATION, as well as every wait for an internal mutex
+that was locked by another thread. Fetch them with D3D12MA::Allocator::BuildTraceString
+and save them to a file:
+
+\code
+char* traceString;
+if(SUCCEEDED(allocator->BuildTraceString(&traceString)))
+{
+    FILE* file = fopen("D3D12MA_trace.json", "wb");
+    fwrite(traceString, 1, strlen(traceString), file);
+    fclose(file);
+    allocator->FreeTraceString(traceString);
+}
+\endcode
+
+The string is JSON in the Chrome trace-event format, which can be opened in `chrome://tracing`
+or in Perfetto UI. Every call returns only the events recorded since the previous one.
+
+Each thread records into its own ring buffer of 4096 events, without taking any lock, so
+when the string is built too rarely, the oldest events are lost. Buffers are created for
+up to 64 threads and events from further threads are lost too. The number of lost events
+is returned as `droppedEventCount` in `otherData` of the JSON.
+Recording costs two reads of the clock per operation and about 96 KB of CPU memory per thread
+that uses the allocator. Like with \ref lock_statistics, every lock is first attempted without
+waiting, which requires `TryLock` methods of custom mutexes.
+With the macro left at its default 0, nothing is recorded and
+D3D12MA::Allocator::BuildTraceString returns `E_NOTIMPL`.
+
 
 \page general_considerations General considerations
 
@@ -286,6 +777,8 @@ HRESULT hr = D3D12MA::CreateAllocator(&allocatorDesc, &allocator);
 - When the allocator is created with D3D12MA::ALLOCATOR_FLAG_SINGLETHREADED,
   calls to methods of D3D12MA::Allocator class must be made from a single thread or synchronized by the user.
   Using this flag may improve performance.
+- When the library is compiled with macro `D3D12MA_SINGLE_THREADED` defined to 1, the same applies
+  to all allocators, regardless of the flag. See \ref configuration_single_threaded.
 
 \section general_considerations_future_plans Future plans
 
@@ -306,7 +799,7 @@ Later:
 - Query for memory budget using `IDXGIAdapter3::QueryVideoMemoryInfo` and
   sticking to this budget with allocations
 - Support for resource aliasing (overlap)
-- Support for multi-GPU (multi-adapter)
+- Support for multi-GPU with separate devices (unlinked multi-adapter)
 
 \section general_considerations_features_not_supported Features not supported
 
@@ -314,14 +807,17 @@ Features deliberately excluded from the scope of this library:
 
 - Descriptor allocation. Although also called "heaps", objects that represent
   descriptors are separate part of the D3D12 API from buffers and textures.
-- Support for `D3D12_HEAP_TYPE_CUSTOM`. Only the default heap types are supported:
-  `D3D12_HEAP_TYPE_UPLOAD`, `D3D12_HEAP_TYPE_DEFAULT`, `D3D12_HEAP_TYPE_READBACK`.
+- Support for arbitrary `D3D12_HEAP_TYPE_CUSTOM` heap properties. Only the default heap types are supported:
+  `D3D12_HEAP_TYPE_UPLOAD`, `D3D12_HEAP_TYPE_DEFAULT`, `D3D12_HEAP_TYPE_READBACK`, plus
+  the custom heaps used for \ref uma_custom_heaps.
 - Support for reserved (tiled) resources. We don't recommend using them.
 - Support for `ID3D12Device::Evict` and `MakeResident`. We don't recommend using them.
 
 */
 
-#include <d3d12.h>
+#ifndef D3D12MA_D3D12_HEADERS_ALREADY_INCLUDED
+    #include <d3d12.h>
+#endif
 
 /// \cond INTERNAL
 
@@ -343,7 +839,10 @@ namespace D3D12MA
 /// \cond INTERNAL
 class AllocatorPimpl;
 class DeviceMemoryBlock;
+class NodePools;
+class CommittedAllocationList;
 class BlockVector;
+class VirtualBlockPimpl;
 /// \endcond
 
 /// Pointer to custom callback function that allocates CPU memory.
@@ -366,6 +865,45 @@ struct ALLOCATION_CALLBACKS
     void* pUserData;
 };
 
+class Allocation;
+
+/// Value of `BlockId` passed to ALLOCATION_CALLBACK_FUNC_PTR for committed allocations, which don't belong to any block.
+static const UINT COMMITTED_BLOCK_ID = UINT_MAX;
+
+/**
+\brief Pointer to callback function called when an `ID3D12Heap` block was created or is about to be released.
+
+See \ref device_memory_callbacks.
+*/
+typedef void (*HEAP_CALLBACK_FUNC_PTR)(D3D12_HEAP_TYPE HeapType, UINT64 Size, UINT BlockId, void* pUserData);
+/**
+\brief Pointer to callback function called when an allocation was created or is about to be freed.
+
+`BlockId` and `Offset` tell where the allocation is placed. For committed allocations
+`BlockId` is #COMMITTED_BLOCK_ID and `Offset` is 0. See \ref device_memory_callbacks.
+*/
+typedef void (*ALLOCATION_CALLBACK_FUNC_PTR)(D3D12_HEAP_TYPE HeapType, UINT64 Size, UINT BlockId, UINT64 Offset,
+    Allocation* pAllocation, void* pUserData);
+
+/// Callbacks informing about device memory allocated and freed by the library. See \ref device_memory_callbacks.
+struct DEVICE_MEMORY_CALLBACKS
+{
+    /// Called after a new `ID3D12Heap` block was created. Optional.
+    HEAP_CALLBACK_FUNC_PTR pHeapCreated;
+    /// Called before an `ID3D12Heap` block is released. Optional.
+    HEAP_CALLBACK_FUNC_PTR pHeapDestroyed;
+    /// Called after a committed resource was created. Optional.
+    ALLOCATION_CALLBACK_FUNC_PTR pCommittedAllocated;
+    /// Called before a committed allocation is freed. Optional.
+    ALLOCATION_CALLBACK_FUNC_PTR pCommittedFreed;
+    /// Called after every allocation made inside a block. Optional.
+    ALLOCATION_CALLBACK_FUNC_PTR pSuballocated;
+    /// Called before every allocation inside a block is freed. Optional.
+    ALLOCATION_CALLBACK_FUNC_PTR pSuballocationFreed;
+    /// Custom data that will be passed to all these functions as `pUserData` parameter.
+    void* pUserData;
+};
+
 /// \brief Bit flags to be used with ALLOCATION_DESC::Flags.
 typedef enum ALLOCATION_FLAGS
 {
@@ -389,8 +927,69 @@ typedef enum ALLOCATION_FLAGS
     #ALLOCATION_FLAG_NEVER_ALLOCATE at the same time. It makes no sense.
     */
     ALLOCATION_FLAG_NEVER_ALLOCATE = 0x2,
+
+    /**
+    Place the allocation in CPU-accessible memory local to the GPU, so it can be mapped
+    and written directly, without a staging copy.
+
+    Only allowed with `D3D12_HEAP_TYPE_DEFAULT`, when the allocator was created with
+    #ALLOCATOR_FLAG_USE_UMA_CUSTOM_HEAPS and the device is UMA. Multisampled resources
+    are not allowed. See \ref uma_custom_heaps.
+    */
+    ALLOCATION_FLAG_CPU_ACCESSIBLE = 0x4,
+
+    /**
+    Search for the smallest free range the allocation fits in, in heaps from the most to the least full.
+
+    This is the default strategy. See \ref allocation_strategies.
+    */
+    ALLOCATION_FLAG_STRATEGY_MIN_MEMORY = 0x10000,
+    /**
+    Take the first heap with a large enough free range, without searching for the best one.
+
+    See \ref allocation_strategies.
+    */
+    ALLOCATION_FLAG_STRATEGY_MIN_TIME = 0x20000,
+    /**
+    Take the largest free range, in heaps from the least to the most full.
+
+    See \ref allocation_strategies.
+    */
+    ALLOCATION_FLAG_STRATEGY_MIN_FRAGMENTATION = 0x40000,
+
+    /// Alias to #ALLOCATION_FLAG_STRATEGY_MIN_MEMORY.
+    ALLOCATION_FLAG_STRATEGY_BEST_FIT = ALLOCATION_FLAG_STRATEGY_MIN_MEMORY,
+    /// Alias to #ALLOCATION_FLAG_STRATEGY_MIN_TIME.
+    ALLOCATION_FLAG_STRATEGY_FIRST_FIT = ALLOCATION_FLAG_STRATEGY_MIN_TIME,
+    /// Alias to #ALLOCATION_FLAG_STRATEGY_MIN_FRAGMENTATION.
+    ALLOCATION_FLAG_STRATEGY_WORST_FIT = ALLOCATION_FLAG_STRATEGY_MIN_FRAGMENTATION,
+
+    /// A bit mask to extract only `STRATEGY` bits from entire set of flags.
+    ALLOCATION_FLAG_STRATEGY_MASK =
+        ALLOCATION_FLAG_STRATEGY_MIN_MEMORY |
+        ALLOCATION_FLAG_STRATEGY_MIN_TIME |
+        ALLOCATION_FLAG_STRATEGY_MIN_FRAGMENTATION,
 } ALLOCATION_FLAGS;
 
+/// \brief How long an allocation is expected to live. To be used with ALLOCATION_DESC::Lifetime.
+/** Allocations of different lifetimes are placed in different heaps. See \ref lifetime_hints. */
+typedef enum ALLOCATION_LIFETIME
+{
+    /// Not known. Shares heaps with other allocations without a hint.
+    ALLOCATION_LIFETIME_DEFAULT,
+    /// Lives until the application or the allocator ends.
+    ALLOCATION_LIFETIME_PERMANENT,
+    /// Released together with other resources of a level, scene or similar stage.
+    ALLOCATION_LIFETIME_LEVEL,
+    /// Released after a few frames.
+    ALLOCATION_LIFETIME_FRAME,
+
+    ALLOCATION_LIFETIME_COUNT
+} ALLOCATION_LIFETIME;
+
+/// Number of categories that allocations can be counted in. See \ref allocation_categories.
+static const UINT ALLOCATION_CATEGORY_COUNT = 16;
+
 /// \brief Parameters of created Allocation object. To be used with Allocator::CreateResource.
 struct ALLOCATION_DESC
 {
@@ -399,8 +998,29 @@ struct ALLOCATION_DESC
     /** \brief The type of memory heap where the new allocation should be placed.
 
     It must be one of: `D3D12_HEAP_TYPE_DEFAULT`, `D3D12_HEAP_TYPE_UPLOAD`, `D3D12_HEAP_TYPE_READBACK`.
+    With #ALLOCATION_FLAG_CPU_ACCESSIBLE, `D3D12_HEAP_TYPE_DEFAULT` stands for a `D3D12_HEAP_TYPE_CUSTOM` heap.
     */
     D3D12_HEAP_TYPE HeapType;
+    /** \brief Node where the memory should be created, as a mask with one bit set.
+
+    0 means node 0. See \ref multi_node.
+    */
+    UINT CreationNodeMask;
+    /** \brief Nodes the memory should be visible to. Must include #CreationNodeMask.
+
+    0 means #CreationNodeMask only. See \ref multi_node.
+    */
+    UINT VisibleNodeMask;
+    /** \brief How long the allocation is expected to live.
+
+    Placed resources and buffer ranges of different lifetimes don't share heaps. See \ref lifetime_hints.
+    */
+    ALLOCATION_LIFETIME Lifetime;
+    /** \brief Category the allocation is counted in. Must be less than #ALLOCATION_CATEGORY_COUNT.
+
+    See \ref allocation_categories.
+    */
+    UINT Category;
 };
 
 /** \brief Represents single memory allocation.
@@ -427,6 +1047,9 @@ public:
     /** \brief Returns offset in bytes from the start of memory heap.
 
     If the Allocation represents committed resource with implicit heap, returns 0.
+
+    If the Allocation was created with Allocator::AllocateBufferRange, this is
+    also the offset from the beginning of the buffer returned by GetResource().
     */
     UINT64 GetOffset() const;
 
@@ -442,14 +1065,43 @@ public:
     */
     ID3D12Heap* GetHeap() const;
 
+    /** \brief Returns the buffer that this allocation is a range of.
+
+    Only allocations created with Allocator::AllocateBufferRange have it. The
+    buffer is shared with other allocations and owned by the allocator - don't
+    release it. For allocations created with Allocator::CreateResource, returns NULL.
+    */
+    ID3D12Resource* GetResource() const;
+
+    /** \brief Returns GPU virtual address of the beginning of this allocation inside GetResource().
+
+    If GetResource() is NULL, returns 0.
+    */
+    D3D12_GPU_VIRTUAL_ADDRESS GetGPUVirtualAddress() const;
+
+    /** \brief Returns CPU pointer to the beginning of this allocation inside GetResource().
+
+    Buffers in `D3D12_HEAP_TYPE_UPLOAD` and `D3D12_HEAP_TYPE_READBACK` heaps used
+    by Allocator::AllocateBufferRange are persistently mapped. For other
+    allocations, returns NULL.
+    */
+    void* GetMappedData() const;
+
     /** \brief Associates a name with the allocation object. This name is for use in debug diagnostics and tools.
 
     Internal copy of the string is made, so the memory pointed by the argument can be
-    changed of freed immediately after this call.
+    changed of freed immediately after this call. The allocator stores every distinct name once,
+    so giving many allocations the same name allocates memory only for the first of them.
 
     `Name` can be null.
     */
     void SetName(LPCWSTR Name);
+    /** \brief Associates a name given as UTF-8 with the allocation object.
+
+    The name is converted to a wide string only when the allocator first sees it,
+    and GetName returns the converted string. Otherwise works like SetName.
+    */
+    void SetNameUtf8(LPCSTR Name);
 
     /** \brief Returns the name associated with the allocation object.
 
@@ -459,9 +1111,13 @@ public:
     */
     LPCWSTR GetName() const { return m_Name; }
 
+    /// Returns ALLOCATION_DESC::Category the allocation was created with.
+    UINT GetCategory() const { return m_Category; }
+
 private:
     friend class AllocatorPimpl;
     friend class BlockVector;
+    friend class CommittedAllocationList;
     template<typename T> friend void D3D12MA_DELETE(const ALLOCATION_CALLBACKS&, T*);
 
     AllocatorPimpl* m_Allocator;
@@ -472,25 +1128,33 @@ private:
         TYPE_COUNT
     } m_Type;
     UINT64 m_Size;
-    wchar_t* m_Name;
+    UINT m_Category;
+    // Stored in the name table of the allocator.
+    LPCWSTR m_Name;
 
     union
     {
         struct
         {
             D3D12_HEAP_TYPE heapType;
+            NodePools* nodePools;
+            // Links in CommittedAllocationList.
+            Allocation* prev;
+            Allocation* next;
         } m_Committed;
 
         struct
         {
             UINT64 offset;
             DeviceMemoryBlock* block;
+            // Resource placed with D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT.
+            bool smallAlignment;
         } m_Placed;
     };
 
     Allocation();
     ~Allocation();
-    void InitCommitted(AllocatorPimpl* allocator, UINT64 size, D3D12_HEAP_TYPE heapType);
+    void InitCommitted(AllocatorPimpl* allocator, UINT64 size, D3D12_HEAP_TYPE heapType, NodePools* nodePools);
     void InitPlaced(AllocatorPimpl* allocator, UINT64 size, UINT64 offset, UINT64 alignment, DeviceMemoryBlock* block);
     DeviceMemoryBlock* GetBlock();
     void FreeName();
@@ -512,8 +1176,71 @@ typedef enum ALLOCATOR_FLAGS
     Using this flag may increase performance because internal mutexes are not used.
     */
     ALLOCATOR_FLAG_SINGLETHREADED = 0x1,
+
+    /**
+    Sizes of new memory blocks and the size above which D3D12MA::Allocator::CreateResource
+    creates committed resources are chosen from recently requested sizes, instead of
+    being derived only from ALLOCATOR_DESC::PreferredBlockSize. See \ref adaptive_block_size.
+    */
+    ALLOCATOR_FLAG_ADAPTIVE_BLOCK_SIZE = 0x2,
+
+    /**
+    Memory blocks are created with `D3D12_HEAP_FLAG_CREATE_NOT_ZEROED`, if supported by the device,
+    and so are committed resources. Their initial contents are then undefined. This flag is also
+    required for ALLOCATOR_DESC::HeapCacheMaxBytes to take effect, as recycled heaps are not zeroed.
+    See \ref heap_recycling.
+    */
+    ALLOCATOR_FLAG_CREATE_NOT_ZEROED_HEAPS = 0x4,
+
+    /**
+    On UMA devices, allocations made with #ALLOCATION_FLAG_CPU_ACCESSIBLE are placed in
+    `D3D12_HEAP_TYPE_CUSTOM` heaps in `D3D12_MEMORY_POOL_L0`. See \ref uma_custom_heaps.
+    */
+    ALLOCATOR_FLAG_USE_UMA_CUSTOM_HEAPS = 0x8,
 } ALLOCATOR_FLAGS;
 
+/// \brief Bit flags to be used with RECORD_SETTINGS::Flags.
+typedef enum RECORD_FLAGS
+{
+    /// Zero
+    RECORD_FLAG_NONE = 0,
+
+    /**
+    Flush the file after every recorded call.
+    It makes recording slower, but the file stays complete if the application crashes.
+    */
+    RECORD_FLAG_FLUSH_AFTER_CALL = 0x1,
+} RECORD_FLAGS;
+
+/** \brief Parameters of recording calls to the library. To be used with ALLOCATOR_DESC::pRecordSettings.
+
+See \ref record_and_replay.
+*/
+struct RECORD_SETTINGS
+{
+    /// Flags.
+    RECORD_FLAGS Flags;
+
+    /// Path to the file to be written. Existing file is overwritten.
+    const char* pFilePath;
+};
+
+/// \brief Policy of keeping empty memory blocks for reuse. See \ref empty_block_retention.
+struct EMPTY_BLOCK_RETENTION
+{
+    /// Maximum number of empty blocks kept in each pool. Further blocks are released as soon as they become empty.
+    UINT MaxBlockCount;
+    /// Maximum total size of empty blocks kept in each pool, in bytes. 0 means no limit.
+    UINT64 MaxBytes;
+    /** \brief Number of frames after which Allocator::Trim releases a block that stayed empty.
+
+    Frames are counted with Allocator::SetCurrentFrameIndex. 0 means the number of frames is not considered.
+    */
+    UINT FrameCount;
+    /// Time in milliseconds after which Allocator::Trim releases a block that stayed empty. 0 means time is not considered.
+    UINT Milliseconds;
+};
+
 /// \brief Parameters of created Allocator object. To be used with CreateAllocator().
 struct ALLOCATOR_DESC
 {
@@ -534,6 +1261,179 @@ struct ALLOCATOR_DESC
     Optional, can be null. When specified, will be used for all CPU-side memory allocations.
     */
     const ALLOCATION_CALLBACKS* pAllocationCallbacks;
+
+    /** \brief Parameters for recording calls to the library. Optional.
+
+    Optional, can be null. When specified, the library must be compiled with
+    `D3D12MA_RECORDING_ENABLED` defined to 1, otherwise CreateAllocator() fails with `E_NOTIMPL`.
+    See \ref record_and_replay.
+    */
+    const RECORD_SETTINGS* pRecordSettings;
+
+    /** \brief Callbacks informing about allocation and freeing of device memory. Optional.
+
+    Optional, can be null. See \ref device_memory_callbacks.
+    */
+    const DEVICE_MEMORY_CALLBACKS* pDeviceMemoryCallbacks;
+
+    /** \brief Policy of keeping empty memory blocks for reuse. Optional.
+
+    Optional, can be null, which means at most one empty block is kept in each pool.
+    See \ref empty_block_retention.
+    */
+    const EMPTY_BLOCK_RETENTION* pEmptyBlockRetention;
+
+    /** \brief Maximum total size of heaps of released memory blocks kept for reuse by any pool, in bytes.
+
+    0 means heaps are released together with their blocks. Ignored unless ALLOCATOR_DESC::Flags contains
+    #ALLOCATOR_FLAG_CREATE_NOT_ZEROED_HEAPS, because a recycled heap is not zeroed. See \ref heap_recycling.
+    */
+    UINT64 HeapCacheMaxBytes;
+};
+
+/// \brief Counters of creation and destruction of memory heaps, returned by Allocator::GetHeapChurnStats().
+struct HeapChurnStats
+{
+    /// Number of `ID3D12Heap` objects created as memory blocks since the allocator was created.
+    UINT64 HeapCreatedCount;
+    /// Total size of heaps counted in #HeapCreatedCount, in bytes.
+    UINT64 HeapCreatedBytes;
+    /// Number of memory blocks released since the allocator was created.
+    UINT64 HeapDestroyedCount;
+    /// Total size of heaps counted in #HeapDestroyedCount, in bytes.
+    UINT64 HeapDestroyedBytes;
+    /// Number of memory blocks, included in #HeapDestroyedCount, released by Allocator::Trim().
+    UINT64 HeapTrimmedCount;
+    /// Number of empty blocks currently kept for reuse, in all pools.
+    UINT EmptyBlockCount;
+    /// Total size of blocks counted in #EmptyBlockCount, in bytes.
+    UINT64 EmptyBlockBytes;
+    /// Number of memory blocks, included in #HeapCreatedCount, that took their heap from the heap cache.
+    UINT64 HeapReusedCount;
+    /// Number of heaps currently in the heap cache. See \ref heap_recycling.
+    UINT CachedHeapCount;
+    /// Total size of heaps counted in #CachedHeapCount, in bytes.
+    UINT64 CachedHeapBytes;
+};
+
+/// \brief Statistics of existing resources placed with small alignment, returned by Allocator::GetSmallAlignmentStats().
+struct SmallAlignmentStats
+{
+    /// Number of placed resources with `D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT`. See \ref small_resource_alignment.
+    UINT AllocationCount;
+    /// Total size of resources counted in #AllocationCount, in bytes.
+    UINT64 AllocationBytes;
+    /// Memory that resources counted in #AllocationCount would additionally occupy with the default 64 KiB alignment, in bytes.
+    UINT64 SavedBytes;
+};
+
+/// \brief Totals of allocations in one category. See \ref allocation_categories.
+struct CategoryStats
+{
+    /// Number of allocations currently existing in the category.
+    UINT64 AllocationCount;
+    /** \brief Total size of allocations counted in #AllocationCount, in bytes.
+
+    Also includes sizes reserved by calls that are creating allocations in the category at the moment.
+    */
+    UINT64 AllocationBytes;
+    /// Value set with Allocator::SetCategoryQuota. 0 means no quota.
+    UINT64 Quota;
+};
+
+/// \brief Counters of a single internal mutex. See \ref lock_statistics.
+struct LockStatInfo
+{
+    /// Number of times the mutex was locked.
+    UINT64 AcquireCount;
+    /// Number of times the mutex was held by another thread, so locking had to wait.
+    UINT64 ContendedCount;
+    /// Total time spent waiting to lock the mutex, in nanoseconds.
+    UINT64 WaitTimeTotal;
+    /// Longest single wait to lock the mutex, in nanoseconds.
+    UINT64 WaitTimeMax;
+    /// Total time the mutex was held, in nanoseconds.
+    UINT64 HoldTimeTotal;
+    /// Longest time the mutex was held at once, in nanoseconds.
+    UINT64 HoldTimeMax;
+};
+
+/// \brief Counters of the mutex of a single pool of memory heaps.
+struct PoolLockStats
+{
+    /// Type of heaps in the pool.
+    D3D12_HEAP_TYPE HeapType;
+    /// Flags of heaps in the pool, telling which resources they can hold when only `D3D12_RESOURCE_HEAP_TIER_1` is supported.
+    D3D12_HEAP_FLAGS HeapFlags;
+    /// True for the pool of multisampled resources. Only its heaps have 4 MiB alignment.
+    BOOL Msaa;
+    LockStatInfo Lock;
+};
+
+/// Number of heap types that have pools and lists of committed allocations of their own: `DEFAULT`, `UPLOAD`, `READBACK`, `CUSTOM`.
+static const UINT HEAP_TYPE_COUNT = 4;
+/// Maximum number of default pools of one combination of node masks, reached when only `D3D12_RESOURCE_HEAP_TIER_1` is supported.
+static const UINT DEFAULT_POOL_MAX_COUNT = 13;
+
+/** \brief Counters of internal mutexes of the pools of one combination of node masks.
+
+Returned by Allocator::GetLockStats() and Allocator::GetAllLockStats(). See \ref multi_node.
+*/
+struct LockStats
+{
+    /// Creation node mask of the pools.
+    UINT CreationNodeMask;
+    /// Visible node mask of the pools.
+    UINT VisibleNodeMask;
+    /// Number of valid elements in #DefaultPools.
+    UINT DefaultPoolCount;
+    /// Default pools, used by Allocator::CreateResource.
+    /** Pools of `CUSTOM` heaps are left zeroed when \ref uma_custom_heaps are not used. */
+    PoolLockStats DefaultPools[DEFAULT_POOL_MAX_COUNT];
+    /// Pools used by Allocator::AllocateBufferRange, one per heap type: `DEFAULT`, `UPLOAD`, `READBACK`, `CUSTOM`.
+    PoolLockStats BufferRangePools[HEAP_TYPE_COUNT];
+    /// Lists of committed allocations, one per heap type: `DEFAULT`, `UPLOAD`, `READBACK`, `CUSTOM`.
+    LockStatInfo CommittedAllocations[HEAP_TYPE_COUNT];
+};
+
+/// \brief Operations timed by the allocator. See \ref latency_histograms.
+enum TIMED_OPERATION
+{
+    /// Whole Allocator::CreateResource, including calls to `ID3D12Device` made by it.
+    TIMED_OPERATION_CREATE_RESOURCE,
+    /// Whole Allocation::Release.
+    TIMED_OPERATION_RELEASE_ALLOCATION,
+    /// `ID3D12Device::GetResourceAllocationInfo` called by the library.
+    TIMED_OPERATION_GET_RESOURCE_ALLOCATION_INFO,
+    /// `ID3D12Device::CreateHeap` called by the library to allocate a new block.
+    TIMED_OPERATION_CREATE_HEAP,
+    /// `ID3D12Device::CreatePlacedResource` called by the library.
+    TIMED_OPERATION_CREATE_PLACED_RESOURCE,
+    /// `ID3D12Device::CreateCommittedResource` called by the library.
+    TIMED_OPERATION_CREATE_COMMITTED_RESOURCE,
+    /// Search for a free range in a block of a pool, done while holding the lock of the pool.
+    TIMED_OPERATION_FIND_FREE_RANGE,
+
+    TIMED_OPERATION_COUNT
+};
+
+/// \brief Summary of durations of a single TIMED_OPERATION, returned by Allocator::GetLatencyStats(). All times are in nanoseconds.
+struct LatencyStats
+{
+    /// Number of times the operation was measured.
+    UINT64 Count;
+    /// Sum of all durations.
+    UINT64 TimeTotal;
+    /// Longest duration.
+    UINT64 TimeMax;
+    /// Median.
+    UINT64 TimeP50;
+    /// 90th percentile.
+    UINT64 TimeP90;
+    /// 99th percentile.
+    UINT64 TimeP99;
+    /// 99.9th percentile.
+    UINT64 TimeP999;
 };
 
 /**
@@ -558,6 +1458,11 @@ public:
     /// Returns cached options retrieved from D3D12 device.
     const D3D12_FEATURE_DATA_D3D12_OPTIONS& GetD3D12Options() const;
 
+    /// Returns true if the device reports `D3D12_FEATURE_DATA_ARCHITECTURE::UMA`. See \ref uma_custom_heaps.
+    BOOL IsUMA() const;
+    /// Returns true if the device reports `D3D12_FEATURE_DATA_ARCHITECTURE::CacheCoherentUMA`.
+    BOOL IsCacheCoherentUMA() const;
+
     /** \brief Allocates memory and creates a D3D12 resource (buffer or texture). This is the main allocation function.
 
     The function is similar to `ID3D12Device::CreateCommittedResource`, but it may
@@ -577,6 +1482,110 @@ public:
         REFIID riidResource,
         void** ppvResource);
 
+    /** \brief Allocates a range of a larger buffer, shared with other allocations.
+
+    Use it for small buffers, like constant buffers, instead of CreateResource,
+    which would create separate resource aligned to at least 64 KiB for each of them.
+    The allocator creates one buffer spanning every memory heap it allocates
+    for this purpose and returns ranges of it. Use Allocation::GetResource,
+    Allocation::GetOffset, Allocation::GetGPUVirtualAddress, and
+    Allocation::GetMappedData to access the range.
+
+    `alignment` must be a power of two. Pass 0 to use `D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT` (256 B).
+
+    The buffer is in state `D3D12_RESOURCE_STATE_GENERIC_READ` in `UPLOAD` heap,
+    `D3D12_RESOURCE_STATE_COPY_DEST` in `READBACK` heap, and created in
+    `D3D12_RESOURCE_STATE_COMMON` with `D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS`
+    in `DEFAULT` heap. With #ALLOCATION_FLAG_CPU_ACCESSIBLE, it is created as in `DEFAULT` heap,
+    but also mapped. #ALLOCATION_FLAG_COMMITTED is not allowed.
+
+    Release the allocation with Allocation::Release as usual. No resource is returned.
+    */
+    HRESULT AllocateBufferRange(
+        const ALLOCATION_DESC* pAllocDesc,
+        UINT64 size,
+        UINT64 alignment,
+        Allocation** ppAllocation);
+
+    /** \brief Frees multiple Allocation objects at once.
+
+    Equivalent to calling Allocation::Release on each of them, but faster when
+    many allocations are freed together, e.g. when tearing down a whole level.
+    Allocations are grouped by the memory heap they belong to, so that every
+    internal lock is taken once and every heap is traversed once.
+
+    Elements of `ppAllocations` that are null are ignored.
+    Resources created together with these allocations must be released separately.
+    */
+    void FreeAllocations(UINT count, Allocation** ppAllocations);
+
+    /** \brief Sets index of the current frame, used to find out how long memory blocks stayed empty.
+
+    Call it at the beginning of every frame when using EMPTY_BLOCK_RETENTION::FrameCount.
+    */
+    void SetCurrentFrameIndex(UINT frameIndex);
+
+    /** \brief Releases memory blocks that stayed empty for longer than allowed by ALLOCATOR_DESC::pEmptyBlockRetention.
+
+    When neither EMPTY_BLOCK_RETENTION::FrameCount nor EMPTY_BLOCK_RETENTION::Milliseconds is set,
+    or ALLOCATOR_DESC::pEmptyBlockRetention is null, releases all empty blocks.
+    Also releases all heaps in the heap cache, see \ref heap_recycling.
+    See \ref empty_block_retention.
+    */
+    void Trim();
+
+    /// Retrieves counters of creation and destruction of memory heaps.
+    void GetHeapChurnStats(HeapChurnStats* pStats);
+
+    /// Retrieves statistics of resources placed with small alignment. See \ref small_resource_alignment.
+    void GetSmallAlignmentStats(SmallAlignmentStats* pStats);
+
+    /** \brief Sets maximum total size of allocations in a category, in bytes. 0 means no quota, which is the default.
+
+    Allocations that already exist are not affected, even if they exceed the new quota.
+    See \ref allocation_categories.
+    */
+    void SetCategoryQuota(UINT category, UINT64 maxBytes);
+
+    /// Retrieves totals of allocations in a category. See \ref allocation_categories.
+    void GetCategoryStats(UINT category, CategoryStats* pStats);
+
+    /** \brief Retrieves counters of contention on internal mutexes of pools of node 0 visible to node 0.
+
+    Returns `E_NOTIMPL` when the library was compiled without `D3D12MA_LOCK_STATS` defined to 1.
+    See \ref lock_statistics.
+    */
+    HRESULT GetLockStats(LockStats* pLockStats);
+
+    /** \brief Retrieves counters of contention on internal mutexes of pools of every combination of node masks.
+
+    \param[in,out] pLockStatsCount When `pLockStats` is null, receives the number of combinations of node masks
+        that have pools. Otherwise, holds the number of elements of `pLockStats` and receives the number of them filled.
+    \param pLockStats Null or array of `*pLockStatsCount` elements. The first one is filled with pools of
+        node 0 visible to node 0, like GetLockStats() does, the others in the order the pools were created.
+
+    Returns `E_NOTIMPL` when the library was compiled without `D3D12MA_LOCK_STATS` defined to 1.
+    See \ref lock_statistics.
+    */
+    HRESULT GetAllLockStats(UINT* pLockStatsCount, LockStats* pLockStats);
+
+    /** \brief Retrieves percentiles of durations of given operation since the allocator was created.
+
+    Returns `E_NOTIMPL` when the library was compiled without `D3D12MA_LATENCY_HISTOGRAMS` defined to 1.
+    See \ref latency_histograms.
+    */
+    HRESULT GetLatencyStats(TIMED_OPERATION operation, LatencyStats* pStats);
+
+    /** \brief Returns events recorded since the previous call as a string in Chrome trace-event JSON format.
+
+    Returns `E_NOTIMPL` and null when the library was compiled without `D3D12MA_TRACE_EVENTS` defined to 1.
+    Free the string with FreeTraceString. See \ref trace_events.
+    */
+    HRESULT BuildTraceString(char** ppTraceString);
+
+    /// Frees memory of a string returned from Allocator::BuildTraceString.
+    void FreeTraceString(char* pTraceString);
+
 private:
     friend HRESULT CreateAllocator(const ALLOCATOR_DESC*, Allocator**);
     template<typename T> friend void D3D12MA_DELETE(const ALLOCATION_CALLBACKS&, T*);
@@ -595,6 +1604,137 @@ You normally only need to call it once and keep a single Allocator object for yo
 */
 HRESULT CreateAllocator(const ALLOCATOR_DESC* pDesc, Allocator** ppAllocator);
 
+/// \brief Calculated statistics of memory usage, e.g. in a VirtualBlock.
+struct StatInfo
+{
+    /// Number of memory blocks (heaps) allocated.
+    UINT BlockCount;
+    /// Number of allocations.
+    UINT AllocationCount;
+    /// Number of free ranges of memory between allocations.
+    UINT UnusedRangeCount;
+    /// Total number of bytes occupied by all allocations.
+    UINT64 UsedBytes;
+    /// Total number of bytes occupied by unused ranges.
+    UINT64 UnusedBytes;
+    UINT64 AllocationSizeMin;
+    UINT64 AllocationSizeAvg;
+    UINT64 AllocationSizeMax;
+    UINT64 UnusedRangeSizeMin;
+    UINT64 UnusedRangeSizeAvg;
+    UINT64 UnusedRangeSizeMax;
+};
+
+/// Parameters of created VirtualBlock object to be passed to CreateVirtualBlock().
+struct VIRTUAL_BLOCK_DESC
+{
+    /** \brief Total size of the block.
+
+    Sizes can be expressed in bytes or any units you want as long as you are consistent in using them.
+    For example, if you allocate from some array of structures, 1 can mean single instance of entire structure.
+    */
+    UINT64 Size;
+    /** \brief Custom CPU memory allocation callbacks. Optional.
+
+    Optional, can be null. When specified, will be used for all CPU-side memory allocations.
+    */
+    const ALLOCATION_CALLBACKS* pAllocationCallbacks;
+};
+
+/// Parameters of created virtual allocation to be passed to VirtualBlock::Allocate().
+struct VIRTUAL_ALLOCATION_DESC
+{
+    /** \brief Size of the allocation.
+
+    Cannot be zero.
+    */
+    UINT64 Size;
+    /** \brief Required alignment of the allocation.
+
+    Must be power of two. Special value 0 has the same meaning as 1 - means no special alignment is required, so allocation can start at any offset.
+    */
+    UINT64 Alignment;
+    /** \brief Custom pointer to be associated with the allocation.
+
+    It can be fetched or changed later.
+    */
+    void* pUserData;
+};
+
+/// Parameters of an existing virtual allocation, returned by VirtualBlock::GetAllocationInfo().
+struct VIRTUAL_ALLOCATION_INFO
+{
+    /** \brief Size of the allocation.
+
+    Same value as passed in VIRTUAL_ALLOCATION_DESC::Size.
+    */
+    UINT64 Size;
+    /** \brief Custom pointer associated with the allocation.
+
+    Same value as passed in VIRTUAL_ALLOCATION_DESC::pUserData or VirtualBlock::SetAllocationUserData().
+    */
+    void* pUserData;
+};
+
+/** \brief Represents pure allocation algorithm and a data structure with allocations in some memory block, without actually allocating any GPU memory.
+
+This class allows to use the core algorithm of the library custom allocations e.g. CPU memory or
+sub-allocation regions inside a single GPU buffer or a descriptor heap.
+
+To create this object, fill in D3D12MA::VIRTUAL_BLOCK_DESC and call CreateVirtualBlock().
+To destroy it, call its method VirtualBlock::Release().
+It doesn't need an `ID3D12Device`.
+
+This object is not thread-safe - should not be used from multiple threads simultaneously, must be synchronized externally.
+*/
+class VirtualBlock
+{
+public:
+    /** \brief Destroys this object and frees it from memory.
+
+    You need to free all the allocations within this block or call Clear() before destroying it.
+    */
+    void Release();
+
+    /// Returns true if the block is empty - contains 0 allocations.
+    BOOL IsEmpty() const;
+    /// Returns information about an allocation at given offset - its size and custom pointer.
+    void GetAllocationInfo(UINT64 offset, VIRTUAL_ALLOCATION_INFO* pInfo) const;
+
+    /** \brief Creates new allocation.
+    \param pDesc
+    \param[out] pOffset Offset of the new allocation, which can also be treated as an unique identifier of the allocation within this block. `UINT64_MAX` if allocation failed.
+    \return `S_OK` if allocation succeeded, `E_OUTOFMEMORY` if it failed.
+    */
+    HRESULT Allocate(const VIRTUAL_ALLOCATION_DESC* pDesc, UINT64* pOffset);
+    /// Frees the allocation at given offset.
+    void FreeAllocation(UINT64 offset);
+    /// Frees all the allocations.
+    void Clear();
+    /// Changes custom pointer for an allocation at given offset to a new value.
+    void SetAllocationUserData(UINT64 offset, void* pUserData);
+
+    /// Retrieves statistics from the current state of the block.
+    void CalculateStats(StatInfo* pInfo) const;
+
+private:
+    friend HRESULT CreateVirtualBlock(const VIRTUAL_BLOCK_DESC*, VirtualBlock**);
+    template<typename T> friend void D3D12MA_DELETE(const ALLOCATION_CALLBACKS&, T*);
+
+    VirtualBlockPimpl* m_Pimpl;
+
+    VirtualBlock(const ALLOCATION_CALLBACKS& allocationCallbacks, const VIRTUAL_BLOCK_DESC& desc);
+    ~VirtualBlock();
+
+    D3D12MA_CLASS_NO_COPY(VirtualBlock)
+};
+
+/** \brief Creates new VirtualBlock object and returns it through `ppVirtualBlock`.
+
+Note you don't need to create D3D12MA::Allocator to use virtual blocks.
+*/
+HRESULT CreateVirtualBlock(const VIRTUAL_BLOCK_DESC* pDesc, VirtualBlock** ppVirtualBlock);
+
 } // namespace D3D12MA
 
 /// \cond INTERNAL
@@ -23,6 +23,7 @@
 #include "D3D12MemAlloc.h"
 #include "Common.h"
 #include "Tests.h"
+#include "SoftwareDevice.h"
 #include <atomic>
 
 namespace VS
@@ -1384,6 +1385,71 @@ static void ExecuteTests()
     }
 }
 
+// Runs the tests on a software stand-in device, without creating a window or using the GPU.
+static int ExecuteTestsOnSoftwareDevice()
+{
+    int result = 0;
+    D3D12MA::Allocator* allocator = nullptr;
+    CComPtr<ID3D12Device> device;
+    try
+    {
+        SoftwareDeviceDesc deviceDesc = {};
+        deviceDesc.ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_2;
+        CHECK_HR( CreateSoftwareDevice(deviceDesc, &device) );
+
+        D3D12MA::ALLOCATOR_DESC desc = {};
+        desc.Flags = D3D12MA::ALLOCATOR_FLAG_NONE;
+        desc.pDevice = device;
+
+        D3D12MA::ALLOCATION_CALLBACKS allocationCallbacks = {};
+        if(ENABLE_CPU_ALLOCATION_CALLBACKS)
+        {
+            allocationCallbacks.pAllocate = &CustomAllocate;
+            allocationCallbacks.pFree = &CustomFree;
+            allocationCallbacks.pUserData = CUSTOM_ALLOCATION_USER_DATA;
+            desc.pAllocationCallbacks = &allocationCallbacks;
+        }
+
+        CHECK_HR( D3D12MA::CreateAllocator(&desc, &allocator) );
+
+        TestContext ctx = {};
+        ctx.device = device;
+        ctx.allocator = allocator;
+        ctx.softwareDevice = true;
+        Test(ctx);
+    }
+    catch(const std::exception& ex)
+    {
+        wprintf(L"ERROR: %hs\n", ex.what());
+        result = -1;
+    }
+
+    if(allocator)
+    {
+        allocator->Release();
+    }
+    if(ENABLE_CPU_ALLOCATION_CALLBACKS)
+    {
+        assert(g_CpuAllocationCount.load() == 0);
+    }
+    return result;
+}
+
+// Runs the benchmarks, without creating a window or using the GPU.
+static int ExecuteBenchmarks()
+{
+    try
+    {
+        Benchmark(L"Benchmark");
+    }
+    catch(const std::exception& ex)
+    {
+        wprintf(L"ERROR: %hs\n", ex.what());
+        return -1;
+    }
+    return 0;
+}
+
 static void OnKeyDown(WPARAM key)
 {
     switch (key)
@@ -1438,8 +1504,17 @@ void EndCommandList(ID3D12GraphicsCommandList* cmdList)
     WaitGPUIdle(g_FrameIndex);
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    if(argc > 1 && (strcmp(argv[1], "-s") == 0 || strcmp(argv[1], "--SoftwareDevice") == 0))
+    {
+        return ExecuteTestsOnSoftwareDevice();
+    }
+    if(argc > 1 && (strcmp(argv[1], "-b") == 0 || strcmp(argv[1], "--Benchmark") == 0))
+    {
+        return ExecuteBenchmarks();
+    }
+
     g_Instance = (HINSTANCE)GetModuleHandle(NULL);
 
     CoInitialize(NULL);
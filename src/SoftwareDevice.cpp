@@ -0,0 +1,777 @@
+//
+// Copyright (c) 2019 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "SoftwareDevice.h"
+#include <atomic>
+#include <thread>
+
+static const UINT64 GPU_ADDRESS_BASE = 0x100000000ull;
+
+// Private interface ID that only SoftwareDevice answers in QueryInterface, used to recognize it.
+static const GUID IID_SOFTWARE_DEVICE = { 0x5d1a6c52, 0x8f0e, 0x4b7a, { 0x9c, 0x3d, 0x1e, 0x64, 0xa2, 0x0b, 0x73, 0xf5 } };
+
+// Waits given number of microseconds without giving up the CPU, like a driver call would.
+static void SimulateLatency(UINT microseconds)
+{
+    if(microseconds == 0)
+        return;
+    const time_point endTime = std::chrono::high_resolution_clock::now() +
+        std::chrono::microseconds(microseconds);
+    while(std::chrono::high_resolution_clock::now() < endTime)
+        std::this_thread::yield();
+}
+
+// Approximate size of a texel, good enough to make texture sizes realistic.
+static UINT GetBytesPerPixel(DXGI_FORMAT format)
+{
+    switch(format)
+    {
+    case DXGI_FORMAT_R32G32B32A32_FLOAT:
+        return 16;
+    case DXGI_FORMAT_R16G16B16A16_FLOAT:
+    case DXGI_FORMAT_R32G32_FLOAT:
+        return 8;
+    case DXGI_FORMAT_R8G8_UNORM:
+    case DXGI_FORMAT_R16_FLOAT:
+        return 2;
+    case DXGI_FORMAT_R8_UNORM:
+        return 1;
+    default:
+        return 4;
+    }
+}
+
+static bool IsRenderTargetOrDepthStencil(const D3D12_RESOURCE_DESC& desc)
+{
+    return (desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)) != 0;
+}
+
+// Returns D3D12_RESOURCE_ALLOCATION_INFO::SizeInBytes = UINT64_MAX for an invalid desc, like D3D12 does.
+static D3D12_RESOURCE_ALLOCATION_INFO CalcResourceAllocationInfo(const D3D12_RESOURCE_DESC& desc)
+{
+    D3D12_RESOURCE_ALLOCATION_INFO info = { UINT64_MAX, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT };
+
+    if(desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+    {
+        if(desc.Width == 0 ||
+            (desc.Alignment != 0 && desc.Alignment != D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT))
+        {
+            return info;
+        }
+        info.SizeInBytes = AlignUp<UINT64>(desc.Width, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+        return info;
+    }
+
+    if(desc.Dimension < D3D12_RESOURCE_DIMENSION_TEXTURE1D || desc.Dimension > D3D12_RESOURCE_DIMENSION_TEXTURE3D ||
+        desc.Width == 0 || desc.Height == 0 || desc.DepthOrArraySize == 0)
+    {
+        return info;
+    }
+
+    const bool is3D = desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D;
+    const UINT arraySize = is3D ? 1 : desc.DepthOrArraySize;
+    const UINT sampleCount = std::max(desc.SampleDesc.Count, 1u);
+    const UINT mipLevels = desc.MipLevels ? desc.MipLevels : 1;
+    UINT64 width = desc.Width, height = desc.Height, depth = is3D ? desc.DepthOrArraySize : 1;
+    UINT64 size = 0;
+    for(UINT mip = 0; mip < mipLevels; ++mip)
+    {
+        size += width * height * depth;
+        width = std::max<UINT64>(width / 2, 1);
+        height = std::max<UINT64>(height / 2, 1);
+        depth = std::max<UINT64>(depth / 2, 1);
+    }
+    size *= (UINT64)arraySize * sampleCount * GetBytesPerPixel(desc.Format);
+
+    // Small alignment is granted only when requested and the whole texture fits in one
+    // default-aligned page, otherwise the default alignment is returned.
+    UINT64 alignment, smallAlignment;
+    if(sampleCount > 1)
+    {
+        alignment = D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT;
+        smallAlignment = D3D12_SMALL_MSAA_RESOURCE_PLACEMENT_ALIGNMENT;
+    }
+    else
+    {
+        alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+        smallAlignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+    }
+    if(desc.Alignment == smallAlignment && size <= alignment && !IsRenderTargetOrDepthStencil(desc))
+        alignment = smallAlignment;
+    else if(desc.Alignment != 0 && desc.Alignment != alignment)
+        return info;
+
+    info.SizeInBytes = AlignUp<UINT64>(size, alignment);
+    info.Alignment = alignment;
+    return info;
+}
+
+static bool IsHeapTypeMappable(const D3D12_HEAP_PROPERTIES& props)
+{
+    switch(props.Type)
+    {
+    case D3D12_HEAP_TYPE_UPLOAD:
+    case D3D12_HEAP_TYPE_READBACK:
+        return true;
+    case D3D12_HEAP_TYPE_CUSTOM:
+        return props.CPUPageProperty == D3D12_CPU_PAGE_PROPERTY_WRITE_COMBINE ||
+            props.CPUPageProperty == D3D12_CPU_PAGE_PROPERTY_WRITE_BACK;
+    default:
+        return false;
+    }
+}
+
+class SoftwareDevice;
+
+// Implements IUnknown and ID3D12Object for all objects of the software device.
+template<typename InterfaceT, typename DerivedT>
+class SoftwareObject : public InterfaceT
+{
+public:
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override
+    {
+        if(ppvObject == NULL)
+            return E_POINTER;
+        if(riid == __uuidof(InterfaceT) || riid == __uuidof(IUnknown))
+        {
+            AddRef();
+            *ppvObject = static_cast<InterfaceT*>(this);
+            return S_OK;
+        }
+        *ppvObject = NULL;
+        return E_NOINTERFACE;
+    }
+    ULONG STDMETHODCALLTYPE AddRef() override
+    {
+        return ++m_RefCount;
+    }
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        const ULONG newRefCount = --m_RefCount;
+        if(newRefCount == 0)
+            delete static_cast<DerivedT*>(this);
+        return newRefCount;
+    }
+
+    HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID /*guid*/, UINT* /*pDataSize*/, void* /*pData*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID /*guid*/, UINT /*DataSize*/, const void* /*pData*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID /*guid*/, const IUnknown* /*pData*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetName(LPCWSTR Name) override
+    {
+        m_Name = Name ? Name : L"";
+        return S_OK;
+    }
+
+protected:
+    SoftwareObject() { }
+    virtual ~SoftwareObject() { }
+
+private:
+    std::atomic<ULONG> m_RefCount{1};
+    std::wstring m_Name;
+};
+
+class SoftwareDevice : public SoftwareObject<ID3D12Device, SoftwareDevice>
+{
+public:
+    SoftwareDevice(const SoftwareDeviceDesc& desc) : m_Desc(desc) { }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override
+    {
+        if(ppvObject != NULL && riid == IID_SOFTWARE_DEVICE)
+        {
+            AddRef();
+            *ppvObject = this;
+            return S_OK;
+        }
+        return SoftwareObject::QueryInterface(riid, ppvObject);
+    }
+
+    const SoftwareDeviceDesc& GetDesc() const { return m_Desc; }
+    void GetStats(SoftwareDeviceStats& outStats) const;
+
+    UINT64 AllocateGpuAddressRange(UINT64 size);
+    // Accounts size in bytes against SoftwareDeviceDesc::MemoryBudget. Returns false if it doesn't fit.
+    bool ReserveMemory(UINT64 size);
+    // Checks properties of a heap or a committed resource like D3D12 does.
+    bool ValidateHeapProperties(const D3D12_HEAP_PROPERTIES& props) const;
+    void FreeMemory(UINT64 size) { m_UsedBytes -= size; }
+    void OnResourceDestroyed() { --m_ResourceCount; }
+    void OnHeapDestroyed() { --m_HeapCount; }
+
+    UINT STDMETHODCALLTYPE GetNodeCount() override { return std::max(m_Desc.NodeCount, 1u); }
+    HRESULT STDMETHODCALLTYPE CreateCommandQueue(const D3D12_COMMAND_QUEUE_DESC* /*pDesc*/, REFIID /*riid*/, void** /*ppCommandQueue*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE /*type*/, REFIID /*riid*/, void** /*ppCommandAllocator*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE CreateGraphicsPipelineState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC* /*pDesc*/, REFIID /*riid*/, void** /*ppPipelineState*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE CreateComputePipelineState(const D3D12_COMPUTE_PIPELINE_STATE_DESC* /*pDesc*/, REFIID /*riid*/, void** /*ppPipelineState*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE CreateCommandList(UINT /*nodeMask*/, D3D12_COMMAND_LIST_TYPE /*type*/, ID3D12CommandAllocator* /*pCommandAllocator*/,
+        ID3D12PipelineState* /*pInitialState*/, REFIID /*riid*/, void** /*ppCommandList*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE CheckFeatureSupport(D3D12_FEATURE Feature, void* pFeatureSupportData, UINT FeatureSupportDataSize) override;
+    HRESULT STDMETHODCALLTYPE CreateDescriptorHeap(const D3D12_DESCRIPTOR_HEAP_DESC* /*pDescriptorHeapDesc*/, REFIID /*riid*/, void** /*ppvHeap*/) override { return E_NOTIMPL; }
+    UINT STDMETHODCALLTYPE GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE /*DescriptorHeapType*/) override { return 32; }
+    HRESULT STDMETHODCALLTYPE CreateRootSignature(UINT /*nodeMask*/, const void* /*pBlobWithRootSignature*/, SIZE_T /*blobLengthInBytes*/,
+        REFIID /*riid*/, void** /*ppvRootSignature*/) override { return E_NOTIMPL; }
+    void STDMETHODCALLTYPE CreateConstantBufferView(const D3D12_CONSTANT_BUFFER_VIEW_DESC* /*pDesc*/, D3D12_CPU_DESCRIPTOR_HANDLE /*DestDescriptor*/) override { }
+    void STDMETHODCALLTYPE CreateShaderResourceView(ID3D12Resource* /*pResource*/, const D3D12_SHADER_RESOURCE_VIEW_DESC* /*pDesc*/,
+        D3D12_CPU_DESCRIPTOR_HANDLE /*DestDescriptor*/) override { }
+    void STDMETHODCALLTYPE CreateUnorderedAccessView(ID3D12Resource* /*pResource*/, ID3D12Resource* /*pCounterResource*/,
+        const D3D12_UNORDERED_ACCESS_VIEW_DESC* /*pDesc*/, D3D12_CPU_DESCRIPTOR_HANDLE /*DestDescriptor*/) override { }
+    void STDMETHODCALLTYPE CreateRenderTargetView(ID3D12Resource* /*pResource*/, const D3D12_RENDER_TARGET_VIEW_DESC* /*pDesc*/,
+        D3D12_CPU_DESCRIPTOR_HANDLE /*DestDescriptor*/) override { }
+    void STDMETHODCALLTYPE CreateDepthStencilView(ID3D12Resource* /*pResource*/, const D3D12_DEPTH_STENCIL_VIEW_DESC* /*pDesc*/,
+        D3D12_CPU_DESCRIPTOR_HANDLE /*DestDescriptor*/) override { }
+    void STDMETHODCALLTYPE CreateSampler(const D3D12_SAMPLER_DESC* /*pDesc*/, D3D12_CPU_DESCRIPTOR_HANDLE /*DestDescriptor*/) override { }
+    void STDMETHODCALLTYPE CopyDescriptors(UINT /*NumDestDescriptorRanges*/, const D3D12_CPU_DESCRIPTOR_HANDLE* /*pDestDescriptorRangeStarts*/,
+        const UINT* /*pDestDescriptorRangeSizes*/, UINT /*NumSrcDescriptorRanges*/, const D3D12_CPU_DESCRIPTOR_HANDLE* /*pSrcDescriptorRangeStarts*/,
+        const UINT* /*pSrcDescriptorRangeSizes*/, D3D12_DESCRIPTOR_HEAP_TYPE /*DescriptorHeapsType*/) override { }
+    void STDMETHODCALLTYPE CopyDescriptorsSimple(UINT /*NumDescriptors*/, D3D12_CPU_DESCRIPTOR_HANDLE /*DestDescriptorRangeStart*/,
+        D3D12_CPU_DESCRIPTOR_HANDLE /*SrcDescriptorRangeStart*/, D3D12_DESCRIPTOR_HEAP_TYPE /*DescriptorHeapsType*/) override { }
+    D3D12_RESOURCE_ALLOCATION_INFO STDMETHODCALLTYPE GetResourceAllocationInfo(UINT visibleMask, UINT numResourceDescs,
+        const D3D12_RESOURCE_DESC* pResourceDescs) override;
+    D3D12_HEAP_PROPERTIES STDMETHODCALLTYPE GetCustomHeapProperties(UINT nodeMask, D3D12_HEAP_TYPE heapType) override;
+    HRESULT STDMETHODCALLTYPE CreateCommittedResource(const D3D12_HEAP_PROPERTIES* pHeapProperties, D3D12_HEAP_FLAGS HeapFlags,
+        const D3D12_RESOURCE_DESC* pDesc, D3D12_RESOURCE_STATES InitialResourceState, const D3D12_CLEAR_VALUE* pOptimizedClearValue,
+        REFIID riidResource, void** ppvResource) override;
+    HRESULT STDMETHODCALLTYPE CreateHeap(const D3D12_HEAP_DESC* pDesc, REFIID riid, void** ppvHeap) override;
+    HRESULT STDMETHODCALLTYPE CreatePlacedResource(ID3D12Heap* pHeap, UINT64 HeapOffset, const D3D12_RESOURCE_DESC* pDesc,
+        D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* pOptimizedClearValue, REFIID riid, void** ppvResource) override;
+    HRESULT STDMETHODCALLTYPE CreateReservedResource(const D3D12_RESOURCE_DESC* /*pDesc*/, D3D12_RESOURCE_STATES /*InitialState*/,
+        const D3D12_CLEAR_VALUE* /*pOptimizedClearValue*/, REFIID /*riid*/, void** /*ppvResource*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE CreateSharedHandle(ID3D12DeviceChild* /*pObject*/, const SECURITY_ATTRIBUTES* /*pAttributes*/, DWORD /*Access*/,
+        LPCWSTR /*Name*/, HANDLE* /*pHandle*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE OpenSharedHandle(HANDLE /*NTHandle*/, REFIID /*riid*/, void** /*ppvObj*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE OpenSharedHandleByName(LPCWSTR /*Name*/, DWORD /*Access*/, HANDLE* /*pNTHandle*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE MakeResident(UINT /*NumObjects*/, ID3D12Pageable* const* /*ppObjects*/) override { return S_OK; }
+    HRESULT STDMETHODCALLTYPE Evict(UINT /*NumObjects*/, ID3D12Pageable* const* /*ppObjects*/) override { return S_OK; }
+    HRESULT STDMETHODCALLTYPE CreateFence(UINT64 /*InitialValue*/, D3D12_FENCE_FLAGS /*Flags*/, REFIID /*riid*/, void** /*ppFence*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetDeviceRemovedReason() override { return S_OK; }
+    void STDMETHODCALLTYPE GetCopyableFootprints(const D3D12_RESOURCE_DESC* /*pResourceDesc*/, UINT /*FirstSubresource*/, UINT /*NumSubresources*/,
+        UINT64 /*BaseOffset*/, D3D12_PLACED_SUBRESOURCE_FOOTPRINT* /*pLayouts*/, UINT* /*pNumRows*/, UINT64* /*pRowSizeInBytes*/, UINT64* pTotalBytes) override
+    {
+        if(pTotalBytes)
+            *pTotalBytes = UINT64_MAX;
+    }
+    HRESULT STDMETHODCALLTYPE CreateQueryHeap(const D3D12_QUERY_HEAP_DESC* /*pDesc*/, REFIID /*riid*/, void** /*ppvHeap*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE SetStablePowerState(BOOL /*Enable*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE CreateCommandSignature(const D3D12_COMMAND_SIGNATURE_DESC* /*pDesc*/, ID3D12RootSignature* /*pRootSignature*/,
+        REFIID /*riid*/, void** /*ppvCommandSignature*/) override { return E_NOTIMPL; }
+    void STDMETHODCALLTYPE GetResourceTiling(ID3D12Resource* /*pTiledResource*/, UINT* /*pNumTilesForEntireResource*/,
+        D3D12_PACKED_MIP_INFO* /*pPackedMipDesc*/, D3D12_TILE_SHAPE* /*pStandardTileShapeForNonPackedMips*/, UINT* /*pNumSubresourceTilings*/,
+        UINT /*FirstSubresourceTilingToGet*/, D3D12_SUBRESOURCE_TILING* /*pSubresourceTilingsForNonPackedMips*/) override { }
+    LUID STDMETHODCALLTYPE GetAdapterLuid() override
+    {
+        LUID luid = {};
+        return luid;
+    }
+
+private:
+    const SoftwareDeviceDesc m_Desc;
+
+    std::atomic<UINT64> m_NextGpuAddress{GPU_ADDRESS_BASE};
+    std::atomic<UINT64> m_UsedBytes{0};
+    std::atomic<UINT64> m_MaxUsedBytes{0};
+    std::atomic<UINT64> m_HeapCount{0};
+    std::atomic<UINT64> m_ResourceCount{0};
+
+    std::atomic<UINT64> m_CheckFeatureSupportCount{0};
+    std::atomic<UINT64> m_GetResourceAllocationInfoCount{0};
+    std::atomic<UINT64> m_CreateHeapCount{0};
+    std::atomic<UINT64> m_CreatePlacedResourceCount{0};
+    std::atomic<UINT64> m_CreateCommittedResourceCount{0};
+    std::atomic<UINT64> m_CreateNotZeroedHeapCount{0};
+    std::atomic<UINT64> m_OutOfMemoryCount{0};
+};
+
+// Common part of heaps and resources: they keep the device alive and report their own destruction.
+template<typename InterfaceT, typename DerivedT>
+class SoftwareDeviceChild : public SoftwareObject<InterfaceT, DerivedT>
+{
+public:
+    HRESULT STDMETHODCALLTYPE GetDevice(REFIID riid, void** ppvDevice) override
+    {
+        return m_Device->QueryInterface(riid, ppvDevice);
+    }
+
+protected:
+    SoftwareDevice* const m_Device;
+
+    SoftwareDeviceChild(SoftwareDevice* device) : m_Device(device) { m_Device->AddRef(); }
+    ~SoftwareDeviceChild()
+    {
+        SimulateLatency(m_Device->GetDesc().ReleaseLatency);
+        m_Device->Release();
+    }
+};
+
+class SoftwareHeap : public SoftwareDeviceChild<ID3D12Heap, SoftwareHeap>
+{
+public:
+    SoftwareHeap(SoftwareDevice* device, const D3D12_HEAP_DESC& desc, UINT64 gpuAddress);
+    ~SoftwareHeap();
+
+    UINT64 GetGpuAddress() const { return m_GpuAddress; }
+    char* GetMappedData() const { return m_MappedData; }
+
+    D3D12_HEAP_DESC STDMETHODCALLTYPE GetDesc() override { return m_Desc; }
+
+private:
+    const D3D12_HEAP_DESC m_Desc;
+    const UINT64 m_GpuAddress;
+    char* m_MappedData = NULL;
+};
+
+class SoftwareResource : public SoftwareDeviceChild<ID3D12Resource, SoftwareResource>
+{
+public:
+    // Placed resource, when heap is not null. Committed resource otherwise.
+    SoftwareResource(SoftwareDevice* device, const D3D12_RESOURCE_DESC& desc, SoftwareHeap* heap, UINT64 heapOffset,
+        const D3D12_HEAP_PROPERTIES& committedHeapProperties, D3D12_HEAP_FLAGS committedHeapFlags, UINT64 committedSize);
+    ~SoftwareResource();
+
+    HRESULT STDMETHODCALLTYPE Map(UINT Subresource, const D3D12_RANGE* pReadRange, void** ppData) override;
+    void STDMETHODCALLTYPE Unmap(UINT /*Subresource*/, const D3D12_RANGE* /*pWrittenRange*/) override { }
+    D3D12_RESOURCE_DESC STDMETHODCALLTYPE GetDesc() override { return m_Desc; }
+    D3D12_GPU_VIRTUAL_ADDRESS STDMETHODCALLTYPE GetGPUVirtualAddress() override;
+    HRESULT STDMETHODCALLTYPE WriteToSubresource(UINT /*DstSubresource*/, const D3D12_BOX* /*pDstBox*/, const void* /*pSrcData*/,
+        UINT /*SrcRowPitch*/, UINT /*SrcDepthPitch*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE ReadFromSubresource(void* /*pDstData*/, UINT /*DstRowPitch*/, UINT /*DstDepthPitch*/, UINT /*SrcSubresource*/,
+        const D3D12_BOX* /*pSrcBox*/) override { return E_NOTIMPL; }
+    HRESULT STDMETHODCALLTYPE GetHeapProperties(D3D12_HEAP_PROPERTIES* pHeapProperties, D3D12_HEAP_FLAGS* pHeapFlags) override;
+
+private:
+    const D3D12_RESOURCE_DESC m_Desc;
+    // Null for committed resources, which own their memory instead.
+    SoftwareHeap* const m_Heap;
+    const UINT64 m_HeapOffset;
+    D3D12_HEAP_PROPERTIES m_CommittedHeapProperties;
+    D3D12_HEAP_FLAGS m_CommittedHeapFlags;
+    UINT64 m_CommittedSize;
+    UINT64 m_CommittedGpuAddress = 0;
+    char* m_CommittedMappedData = NULL;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// class SoftwareHeap
+
+SoftwareHeap::SoftwareHeap(SoftwareDevice* device, const D3D12_HEAP_DESC& desc, UINT64 gpuAddress) :
+    SoftwareDeviceChild(device),
+    m_Desc(desc),
+    m_GpuAddress(gpuAddress)
+{
+    if(IsHeapTypeMappable(desc.Properties))
+        m_MappedData = (char*)calloc(1, (size_t)desc.SizeInBytes);
+}
+
+SoftwareHeap::~SoftwareHeap()
+{
+    free(m_MappedData);
+    m_Device->FreeMemory(m_Desc.SizeInBytes);
+    m_Device->OnHeapDestroyed();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class SoftwareResource
+
+SoftwareResource::SoftwareResource(SoftwareDevice* device, const D3D12_RESOURCE_DESC& desc, SoftwareHeap* heap, UINT64 heapOffset,
+    const D3D12_HEAP_PROPERTIES& committedHeapProperties, D3D12_HEAP_FLAGS committedHeapFlags, UINT64 committedSize) :
+    SoftwareDeviceChild(device),
+    m_Desc(desc),
+    m_Heap(heap),
+    m_HeapOffset(heapOffset),
+    m_CommittedHeapProperties(committedHeapProperties),
+    m_CommittedHeapFlags(committedHeapFlags),
+    m_CommittedSize(committedSize)
+{
+    if(m_Heap)
+    {
+        // Like in D3D12, a placed resource keeps its heap alive.
+        m_Heap->AddRef();
+    }
+    else
+    {
+        m_CommittedGpuAddress = m_Device->AllocateGpuAddressRange(committedSize);
+        if(IsHeapTypeMappable(committedHeapProperties))
+            m_CommittedMappedData = (char*)calloc(1, (size_t)committedSize);
+    }
+}
+
+SoftwareResource::~SoftwareResource()
+{
+    if(m_Heap)
+    {
+        m_Heap->Release();
+    }
+    else
+    {
+        free(m_CommittedMappedData);
+        m_Device->FreeMemory(m_CommittedSize);
+    }
+    m_Device->OnResourceDestroyed();
+}
+
+HRESULT STDMETHODCALLTYPE SoftwareResource::Map(UINT Subresource, const D3D12_RANGE* pReadRange, void** ppData)
+{
+    (void)pReadRange;
+    char* const data = m_Heap ?
+        (m_Heap->GetMappedData() ? m_Heap->GetMappedData() + m_HeapOffset : NULL) :
+        m_CommittedMappedData;
+    if(data == NULL || Subresource != 0)
+        return E_INVALIDARG;
+    if(ppData)
+        *ppData = data;
+    return S_OK;
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS STDMETHODCALLTYPE SoftwareResource::GetGPUVirtualAddress()
+{
+    // Only buffers have a GPU virtual address.
+    if(m_Desc.Dimension != D3D12_RESOURCE_DIMENSION_BUFFER)
+        return 0;
+    return m_Heap ? m_Heap->GetGpuAddress() + m_HeapOffset : m_CommittedGpuAddress;
+}
+
+HRESULT STDMETHODCALLTYPE SoftwareResource::GetHeapProperties(D3D12_HEAP_PROPERTIES* pHeapProperties, D3D12_HEAP_FLAGS* pHeapFlags)
+{
+    if(m_Heap)
+    {
+        const D3D12_HEAP_DESC heapDesc = m_Heap->GetDesc();
+        if(pHeapProperties)
+            *pHeapProperties = heapDesc.Properties;
+        if(pHeapFlags)
+            *pHeapFlags = heapDesc.Flags;
+    }
+    else
+    {
+        if(pHeapProperties)
+            *pHeapProperties = m_CommittedHeapProperties;
+        if(pHeapFlags)
+            *pHeapFlags = m_CommittedHeapFlags;
+    }
+    return S_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class SoftwareDevice
+
+void SoftwareDevice::GetStats(SoftwareDeviceStats& outStats) const
+{
+    outStats.CheckFeatureSupportCount = m_CheckFeatureSupportCount;
+    outStats.GetResourceAllocationInfoCount = m_GetResourceAllocationInfoCount;
+    outStats.CreateHeapCount = m_CreateHeapCount;
+    outStats.CreatePlacedResourceCount = m_CreatePlacedResourceCount;
+    outStats.CreateCommittedResourceCount = m_CreateCommittedResourceCount;
+    outStats.CreateNotZeroedHeapCount = m_CreateNotZeroedHeapCount;
+    outStats.OutOfMemoryCount = m_OutOfMemoryCount;
+    outStats.HeapCount = m_HeapCount;
+    outStats.ResourceCount = m_ResourceCount;
+    outStats.UsedBytes = m_UsedBytes;
+    outStats.MaxUsedBytes = m_MaxUsedBytes;
+}
+
+UINT64 SoftwareDevice::AllocateGpuAddressRange(UINT64 size)
+{
+    // Leave a gap between ranges so that addresses of different heaps never touch.
+    return m_NextGpuAddress.fetch_add(
+        AlignUp<UINT64>(size, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT) + D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+}
+
+bool SoftwareDevice::ReserveMemory(UINT64 size)
+{
+    UINT64 usedBytes = m_UsedBytes.load();
+    do
+    {
+        if(m_Desc.MemoryBudget != 0 && usedBytes + size > m_Desc.MemoryBudget)
+        {
+            ++m_OutOfMemoryCount;
+            return false;
+        }
+    } while(!m_UsedBytes.compare_exchange_weak(usedBytes, usedBytes + size));
+
+    const UINT64 newUsedBytes = usedBytes + size;
+    UINT64 maxUsedBytes = m_MaxUsedBytes.load();
+    while(newUsedBytes > maxUsedBytes && !m_MaxUsedBytes.compare_exchange_weak(maxUsedBytes, newUsedBytes))
+    {
+    }
+    return true;
+}
+
+HRESULT STDMETHODCALLTYPE SoftwareDevice::CheckFeatureSupport(D3D12_FEATURE Feature, void* pFeatureSupportData, UINT FeatureSupportDataSize)
+{
+    ++m_CheckFeatureSupportCount;
+    switch(Feature)
+    {
+    case D3D12_FEATURE_D3D12_OPTIONS:
+    {
+        if(pFeatureSupportData == NULL || FeatureSupportDataSize != sizeof(D3D12_FEATURE_DATA_D3D12_OPTIONS))
+            return E_INVALIDARG;
+        D3D12_FEATURE_DATA_D3D12_OPTIONS* options = (D3D12_FEATURE_DATA_D3D12_OPTIONS*)pFeatureSupportData;
+        ZeroMemory(options, sizeof(*options));
+        options->ResourceHeapTier = m_Desc.ResourceHeapTier;
+        return S_OK;
+    }
+    case D3D12_FEATURE_ARCHITECTURE:
+    {
+        if(pFeatureSupportData == NULL || FeatureSupportDataSize != sizeof(D3D12_FEATURE_DATA_ARCHITECTURE))
+            return E_INVALIDARG;
+        D3D12_FEATURE_DATA_ARCHITECTURE* architecture = (D3D12_FEATURE_DATA_ARCHITECTURE*)pFeatureSupportData;
+        const UINT nodeIndex = architecture->NodeIndex;
+        if(nodeIndex != 0)
+            return E_INVALIDARG;
+        ZeroMemory(architecture, sizeof(*architecture));
+        architecture->UMA = m_Desc.UMA;
+        architecture->CacheCoherentUMA = m_Desc.UMA && m_Desc.CacheCoherentUMA;
+        return S_OK;
+    }
+#ifdef __ID3D12Device8_INTERFACE_DEFINED__
+    case D3D12_FEATURE_D3D12_OPTIONS7:
+    {
+        // Reported to tell that D3D12_HEAP_FLAG_CREATE_NOT_ZEROED is supported. Nothing else is.
+        if(pFeatureSupportData == NULL || FeatureSupportDataSize != sizeof(D3D12_FEATURE_DATA_D3D12_OPTIONS7))
+            return E_INVALIDARG;
+        ZeroMemory(pFeatureSupportData, FeatureSupportDataSize);
+        return S_OK;
+    }
+#endif
+    default:
+        return E_INVALIDARG;
+    }
+}
+
+D3D12_RESOURCE_ALLOCATION_INFO STDMETHODCALLTYPE SoftwareDevice::GetResourceAllocationInfo(UINT visibleMask, UINT numResourceDescs,
+    const D3D12_RESOURCE_DESC* pResourceDescs)
+{
+    (void)visibleMask;
+    ++m_GetResourceAllocationInfoCount;
+    SimulateLatency(m_Desc.GetResourceAllocationInfoLatency);
+
+    // Multiple resources are laid out one after another, each aligned as it requires.
+    D3D12_RESOURCE_ALLOCATION_INFO result = { 0, D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT };
+    for(UINT i = 0; i < numResourceDescs; ++i)
+    {
+        const D3D12_RESOURCE_ALLOCATION_INFO info = CalcResourceAllocationInfo(pResourceDescs[i]);
+        if(info.SizeInBytes == UINT64_MAX)
+            return info;
+        result.SizeInBytes = AlignUp(result.SizeInBytes, info.Alignment) + info.SizeInBytes;
+        result.Alignment = std::max(result.Alignment, info.Alignment);
+    }
+    return result;
+}
+
+D3D12_HEAP_PROPERTIES STDMETHODCALLTYPE SoftwareDevice::GetCustomHeapProperties(UINT nodeMask, D3D12_HEAP_TYPE heapType)
+{
+    (void)nodeMask;
+    D3D12_HEAP_PROPERTIES props = {};
+    props.Type = D3D12_HEAP_TYPE_CUSTOM;
+    props.CreationNodeMask = 1;
+    props.VisibleNodeMask = 1;
+    switch(heapType)
+    {
+    case D3D12_HEAP_TYPE_UPLOAD:
+        props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_WRITE_COMBINE;
+        props.MemoryPoolPreference = D3D12_MEMORY_POOL_L0;
+        break;
+    case D3D12_HEAP_TYPE_READBACK:
+        props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_WRITE_BACK;
+        props.MemoryPoolPreference = D3D12_MEMORY_POOL_L0;
+        break;
+    default:
+        props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_NOT_AVAILABLE;
+        props.MemoryPoolPreference = m_Desc.UMA ? D3D12_MEMORY_POOL_L0 : D3D12_MEMORY_POOL_L1;
+        break;
+    }
+    return props;
+}
+
+bool SoftwareDevice::ValidateHeapProperties(const D3D12_HEAP_PROPERTIES& props) const
+{
+    // 0 means node 0 in both masks. The creation node must be one of the visible ones.
+    const UINT nodeCount = std::max(m_Desc.NodeCount, 1u);
+    const UINT allNodesMask = nodeCount < 32 ? (1u << nodeCount) - 1 : UINT_MAX;
+    const UINT creationNodeMask = props.CreationNodeMask != 0 ? props.CreationNodeMask : 1;
+    const UINT visibleNodeMask = props.VisibleNodeMask != 0 ? props.VisibleNodeMask : 1;
+    if((creationNodeMask & (creationNodeMask - 1)) != 0 ||
+        (creationNodeMask & ~allNodesMask) != 0 ||
+        (visibleNodeMask & ~allNodesMask) != 0 ||
+        (visibleNodeMask & creationNodeMask) == 0)
+    {
+        return false;
+    }
+
+    switch(props.Type)
+    {
+    case D3D12_HEAP_TYPE_DEFAULT:
+    case D3D12_HEAP_TYPE_UPLOAD:
+    case D3D12_HEAP_TYPE_READBACK:
+        return props.CPUPageProperty == D3D12_CPU_PAGE_PROPERTY_UNKNOWN &&
+            props.MemoryPoolPreference == D3D12_MEMORY_POOL_UNKNOWN;
+    case D3D12_HEAP_TYPE_CUSTOM:
+        if(props.CPUPageProperty == D3D12_CPU_PAGE_PROPERTY_UNKNOWN ||
+            props.MemoryPoolPreference == D3D12_MEMORY_POOL_UNKNOWN)
+            return false;
+        // L1 exists only on NUMA and is never accessible by the CPU.
+        if(props.MemoryPoolPreference == D3D12_MEMORY_POOL_L1)
+            return !m_Desc.UMA && props.CPUPageProperty == D3D12_CPU_PAGE_PROPERTY_NOT_AVAILABLE;
+        return true;
+    default:
+        return false;
+    }
+}
+
+HRESULT STDMETHODCALLTYPE SoftwareDevice::CreateCommittedResource(const D3D12_HEAP_PROPERTIES* pHeapProperties, D3D12_HEAP_FLAGS HeapFlags,
+    const D3D12_RESOURCE_DESC* pDesc, D3D12_RESOURCE_STATES InitialResourceState, const D3D12_CLEAR_VALUE* pOptimizedClearValue,
+    REFIID riidResource, void** ppvResource)
+{
+    (void)InitialResourceState;
+    (void)pOptimizedClearValue;
+    ++m_CreateCommittedResourceCount;
+    SimulateLatency(m_Desc.CreateCommittedResourceLatency);
+
+    if(pHeapProperties == NULL || pDesc == NULL || !ValidateHeapProperties(*pHeapProperties))
+        return E_INVALIDARG;
+    const D3D12_RESOURCE_ALLOCATION_INFO allocInfo = CalcResourceAllocationInfo(*pDesc);
+    if(allocInfo.SizeInBytes == UINT64_MAX)
+        return E_INVALIDARG;
+    // Like D3D12, a null output pointer only validates the parameters.
+    if(ppvResource == NULL)
+        return S_FALSE;
+
+    if(!ReserveMemory(allocInfo.SizeInBytes))
+        return E_OUTOFMEMORY;
+    ++m_ResourceCount;
+    SoftwareResource* resource = new SoftwareResource(
+        this, *pDesc, NULL, 0, *pHeapProperties, HeapFlags, allocInfo.SizeInBytes);
+    const HRESULT hr = resource->QueryInterface(riidResource, ppvResource);
+    resource->Release();
+    return hr;
+}
+
+HRESULT STDMETHODCALLTYPE SoftwareDevice::CreateHeap(const D3D12_HEAP_DESC* pDesc, REFIID riid, void** ppvHeap)
+{
+    ++m_CreateHeapCount;
+    SimulateLatency(m_Desc.CreateHeapLatency);
+
+    if(pDesc == NULL || pDesc->SizeInBytes == 0 || !ValidateHeapProperties(pDesc->Properties))
+        return E_INVALIDARG;
+    if(pDesc->Alignment != 0 &&
+        pDesc->Alignment != D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT &&
+        pDesc->Alignment != D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT)
+    {
+        return E_INVALIDARG;
+    }
+    if(m_Desc.ResourceHeapTier == D3D12_RESOURCE_HEAP_TIER_1)
+    {
+        // Tier 1 heaps can hold only one category of resources.
+        const D3D12_HEAP_FLAGS denyFlags = pDesc->Flags &
+            (D3D12_HEAP_FLAG_DENY_BUFFERS | D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES | D3D12_HEAP_FLAG_DENY_NON_RT_DS_TEXTURES);
+        if(denyFlags != D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS &&
+            denyFlags != D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES &&
+            denyFlags != D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES)
+        {
+            return E_INVALIDARG;
+        }
+    }
+    if(ppvHeap == NULL)
+        return S_FALSE;
+
+    if(!ReserveMemory(pDesc->SizeInBytes))
+        return E_OUTOFMEMORY;
+    ++m_HeapCount;
+#ifdef __ID3D12Device8_INTERFACE_DEFINED__
+    if((pDesc->Flags & D3D12_HEAP_FLAG_CREATE_NOT_ZEROED) != 0)
+        ++m_CreateNotZeroedHeapCount;
+#endif
+    SoftwareHeap* heap = new SoftwareHeap(this, *pDesc, AllocateGpuAddressRange(pDesc->SizeInBytes));
+    const HRESULT hr = heap->QueryInterface(riid, ppvHeap);
+    heap->Release();
+    return hr;
+}
+
+HRESULT STDMETHODCALLTYPE SoftwareDevice::CreatePlacedResource(ID3D12Heap* pHeap, UINT64 HeapOffset, const D3D12_RESOURCE_DESC* pDesc,
+    D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* pOptimizedClearValue, REFIID riid, void** ppvResource)
+{
+    (void)InitialState;
+    (void)pOptimizedClearValue;
+    ++m_CreatePlacedResourceCount;
+    SimulateLatency(m_Desc.CreatePlacedResourceLatency);
+
+    if(pHeap == NULL || pDesc == NULL)
+        return E_INVALIDARG;
+    SoftwareHeap* const heap = static_cast<SoftwareHeap*>(pHeap);
+    const D3D12_HEAP_DESC heapDesc = heap->GetDesc();
+
+    const D3D12_RESOURCE_ALLOCATION_INFO allocInfo = CalcResourceAllocationInfo(*pDesc);
+    if(allocInfo.SizeInBytes == UINT64_MAX ||
+        HeapOffset % allocInfo.Alignment != 0 ||
+        HeapOffset + allocInfo.SizeInBytes > heapDesc.SizeInBytes)
+    {
+        return E_INVALIDARG;
+    }
+    // Only heaps created with MSAA alignment can hold multisampled resources.
+    if(pDesc->SampleDesc.Count > 1 && heapDesc.Alignment != D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT)
+        return E_INVALIDARG;
+
+    D3D12_HEAP_FLAGS requiredAllowance;
+    if(pDesc->Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+        requiredAllowance = D3D12_HEAP_FLAG_DENY_BUFFERS;
+    else if(IsRenderTargetOrDepthStencil(*pDesc))
+        requiredAllowance = D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES;
+    else
+        requiredAllowance = D3D12_HEAP_FLAG_DENY_NON_RT_DS_TEXTURES;
+    if((heapDesc.Flags & requiredAllowance) != 0)
+        return E_INVALIDARG;
+
+    if(ppvResource == NULL)
+        return S_FALSE;
+
+    ++m_ResourceCount;
+    D3D12_HEAP_PROPERTIES noHeapProperties = {};
+    SoftwareResource* resource = new SoftwareResource(
+        this, *pDesc, heap, HeapOffset, noHeapProperties, D3D12_HEAP_FLAG_NONE, 0);
+    const HRESULT hr = resource->QueryInterface(riid, ppvResource);
+    resource->Release();
+    return hr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public functions
+
+HRESULT CreateSoftwareDevice(const SoftwareDeviceDesc& desc, ID3D12Device** ppDevice)
+{
+    if(ppDevice == NULL ||
+        (desc.ResourceHeapTier != D3D12_RESOURCE_HEAP_TIER_1 && desc.ResourceHeapTier != D3D12_RESOURCE_HEAP_TIER_2))
+    {
+        return E_INVALIDARG;
+    }
+    *ppDevice = new SoftwareDevice(desc);
+    return S_OK;
+}
+
+bool GetSoftwareDeviceStats(ID3D12Device* device, SoftwareDeviceStats& outStats)
+{
+    SoftwareDevice* softwareDevice = NULL;
+    if(device == NULL || FAILED(device->QueryInterface(IID_SOFTWARE_DEVICE, (void**)&softwareDevice)))
+        return false;
+    softwareDevice->GetStats(outStats);
+    softwareDevice->Release();
+    return true;
+}
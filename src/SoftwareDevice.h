@@ -0,0 +1,97 @@
+//
+// Copyright (c) 2019 Advanced Micro Devices, Inc. All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "Common.h"
+
+/*
+Software stand-in for ID3D12Device.
+
+It implements the subset of ID3D12Device that D3D12MA calls - CheckFeatureSupport,
+GetResourceAllocationInfo, CreateHeap, CreatePlacedResource, CreateCommittedResource -
+without talking to any GPU. Heaps and resources are bookkeeping objects. Heaps and
+committed resources in UPLOAD and READBACK heaps, and in CUSTOM heaps with CPU access,
+are backed by system memory, so they can be mapped. Every other method of the device does nothing and returns E_NOTIMPL
+where it can return an error.
+
+It is meant for running the allocator's tests and benchmarks on a machine without a
+GPU, and for deterministic out-of-memory testing.
+*/
+
+struct SoftwareDeviceDesc
+{
+    /// Value reported as D3D12_FEATURE_DATA_D3D12_OPTIONS::ResourceHeapTier.
+    /** When D3D12_RESOURCE_HEAP_TIER_1, CreateHeap also requires the heap to be
+    restricted to a single resource category, like a real tier 1 device does. */
+    D3D12_RESOURCE_HEAP_TIER ResourceHeapTier;
+    /// Values reported in D3D12_FEATURE_DATA_ARCHITECTURE.
+    /** On UMA, custom heaps must use D3D12_MEMORY_POOL_L0, like on a real UMA device. */
+    BOOL UMA;
+    BOOL CacheCoherentUMA;
+    /// Value returned by ID3D12Device::GetNodeCount. 0 means 1.
+    /** Node masks of heaps and committed resources are checked against it. */
+    UINT NodeCount;
+    /// Maximum total size of heaps and committed resources existing at the same time, in bytes.
+    /** A call that would exceed it fails with E_OUTOFMEMORY. 0 means unlimited. */
+    UINT64 MemoryBudget;
+    /// Time that CreateHeap takes, in microseconds.
+    UINT CreateHeapLatency;
+    /// Time that CreatePlacedResource takes, in microseconds.
+    UINT CreatePlacedResourceLatency;
+    /// Time that CreateCommittedResource takes, in microseconds.
+    UINT CreateCommittedResourceLatency;
+    /// Time that GetResourceAllocationInfo takes, in microseconds.
+    UINT GetResourceAllocationInfoLatency;
+    /// Time that destroying a heap or a resource takes, in microseconds.
+    UINT ReleaseLatency;
+};
+
+/// Numbers of calls made to a software device and memory it currently holds.
+struct SoftwareDeviceStats
+{
+    UINT64 CheckFeatureSupportCount;
+    UINT64 GetResourceAllocationInfoCount;
+    UINT64 CreateHeapCount;
+    UINT64 CreatePlacedResourceCount;
+    UINT64 CreateCommittedResourceCount;
+    /// Number of heaps created with D3D12_HEAP_FLAG_CREATE_NOT_ZEROED.
+    UINT64 CreateNotZeroedHeapCount;
+    /// Number of calls that failed with E_OUTOFMEMORY because of SoftwareDeviceDesc::MemoryBudget.
+    UINT64 OutOfMemoryCount;
+    /// Number of heaps currently existing.
+    UINT64 HeapCount;
+    /// Number of placed and committed resources currently existing.
+    UINT64 ResourceCount;
+    /// Total size of heaps and committed resources currently existing, in bytes.
+    UINT64 UsedBytes;
+    /// Maximum value UsedBytes reached since the device was created.
+    UINT64 MaxUsedBytes;
+};
+
+/// Creates a software device. Release it with ID3D12Device::Release.
+HRESULT CreateSoftwareDevice(const SoftwareDeviceDesc& desc, ID3D12Device** ppDevice);
+
+/// Fetches counters of a device created with CreateSoftwareDevice.
+/** Returns false and leaves outStats untouched if `device` is not a software device. */
+bool GetSoftwareDeviceStats(ID3D12Device* device, SoftwareDeviceStats& outStats);
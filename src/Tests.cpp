@@ -22,7 +22,16 @@
 
 #include "Tests.h"
 #include "Common.h"
+#include "SoftwareDevice.h"
+#include "D3D12MAReplay/Replayer.h"
 #include <thread>
+#include <random>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <malloc.h> // for _aligned_malloc, _aligned_free
+
+static const UINT64 MEGABYTE = 1024 * 1024;
 
 extern ID3D12GraphicsCommandList* BeginCommandList();
 extern void EndCommandList(ID3D12GraphicsCommandList* cmdList);
@@ -522,13 +531,2956 @@ static void TestMultithreading(const TestContext& ctx)
     }
 }
 
-static void TestGroupBasics(const TestContext& ctx)
+static void TestBufferRanges(const TestContext& ctx)
 {
-    TestCommittedResources(ctx);
-    TestPlacedResources(ctx);
-    TestMapping(ctx);
-    TestTransfer(ctx);
-    TestMultithreading(ctx);
+    wprintf(L"Test buffer ranges\n");
+
+    const UINT count = 100;
+    const UINT64 size = 200;
+    const UINT64 alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+
+    D3D12MA::ALLOCATION_DESC allocDesc = {};
+    allocDesc.HeapType = D3D12_HEAP_TYPE_UPLOAD;
+
+    std::vector<AllocationUniquePtr> allocations(count);
+    for(UINT i = 0; i < count; ++i)
+    {
+        D3D12MA::Allocation* alloc = nullptr;
+        CHECK_HR( ctx.allocator->AllocateBufferRange(&allocDesc, size, alignment, &alloc) );
+        allocations[i].reset(alloc);
+
+        CHECK_BOOL( alloc->GetResource() != NULL );
+        CHECK_BOOL( alloc->GetHeap() != NULL );
+        CHECK_BOOL( alloc->GetSize() == size );
+        CHECK_BOOL( alloc->GetOffset() % alignment == 0 );
+        CHECK_BOOL( alloc->GetGPUVirtualAddress() ==
+            alloc->GetResource()->GetGPUVirtualAddress() + alloc->GetOffset() );
+        CHECK_BOOL( alloc->GetMappedData() != NULL );
+
+        FillData(alloc->GetMappedData(), size, i);
+    }
+
+    // All of them should fit in one buffer, without overlapping.
+    for(UINT i = 1; i < count; ++i)
+    {
+        CHECK_BOOL( allocations[i]->GetResource() == allocations[0]->GetResource() );
+    }
+    for(UINT i = 0; i < count; ++i)
+    {
+        for(UINT j = i + 1; j < count; ++j)
+        {
+            CHECK_BOOL(allocations[i]->GetOffset() + allocations[i]->GetSize() <= allocations[j]->GetOffset() ||
+                allocations[j]->GetOffset() + allocations[j]->GetSize() <= allocations[i]->GetOffset());
+        }
+    }
+    for(UINT i = 0; i < count; ++i)
+    {
+        CHECK_BOOL( ValidateData(allocations[i]->GetMappedData(), size, i) );
+    }
+
+    // Ordinary resources don't have buffer, GPU address, and mapped pointer.
+    ResourceWithAllocation res;
+    D3D12_RESOURCE_DESC resourceDesc;
+    FillResourceDescForBuffer(resourceDesc, size);
+    D3D12MA::Allocation* alloc = nullptr;
+    CHECK_HR( ctx.allocator->CreateResource(
+        &allocDesc,
+        &resourceDesc,
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        NULL,
+        &alloc,
+        IID_PPV_ARGS(&res.resource)) );
+    res.allocation.reset(alloc);
+    CHECK_BOOL( alloc->GetResource() == NULL && alloc->GetGPUVirtualAddress() == 0 && alloc->GetMappedData() == NULL );
+
+    // Ranges in DEFAULT heap are not mapped.
+    allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+    CHECK_HR( ctx.allocator->AllocateBufferRange(&allocDesc, size, 0, &alloc) );
+    AllocationUniquePtr defaultAlloc(alloc);
+    CHECK_BOOL( alloc->GetResource() != NULL && alloc->GetMappedData() == NULL );
+    CHECK_BOOL( alloc->GetOffset() % D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT == 0 );
+
+    // Committed flag is not allowed.
+    allocDesc.Flags = D3D12MA::ALLOCATION_FLAG_COMMITTED;
+    CHECK_BOOL( FAILED(ctx.allocator->AllocateBufferRange(&allocDesc, size, 0, &alloc)) );
+}
+
+static void TestFreeAllocations(const TestContext& ctx)
+{
+    wprintf(L"Test free allocations\n");
+
+    const UINT count = 64;
+    const UINT64 bufSizeMin = 1024ull;
+    const UINT64 bufSizeMax = 256ull * 1024;
+
+    RandomNumberGenerator rand(123);
+
+    ResourceWithAllocation resources[count];
+    D3D12MA::Allocation* allocations[count + 1] = {};
+
+    for(UINT i = 0; i < count; ++i)
+    {
+        D3D12MA::ALLOCATION_DESC allocDesc = {};
+        allocDesc.HeapType = (i % 3) == 0 ? D3D12_HEAP_TYPE_UPLOAD : D3D12_HEAP_TYPE_DEFAULT;
+        // Mix in some committed allocations.
+        if((i % 5) == 0)
+        {
+            allocDesc.Flags = D3D12MA::ALLOCATION_FLAG_COMMITTED;
+        }
+
+        D3D12_RESOURCE_DESC resourceDesc;
+        FillResourceDescForBuffer(resourceDesc, rand.Generate() % (bufSizeMax - bufSizeMin) + bufSizeMin);
+
+        D3D12MA::Allocation* alloc = nullptr;
+        CHECK_HR( ctx.allocator->CreateResource(
+            &allocDesc,
+            &resourceDesc,
+            allocDesc.HeapType == D3D12_HEAP_TYPE_UPLOAD ? D3D12_RESOURCE_STATE_GENERIC_READ : D3D12_RESOURCE_STATE_COPY_DEST,
+            NULL,
+            &alloc,
+            IID_PPV_ARGS(&resources[i].resource)) );
+        resources[i].allocation.reset(alloc);
+        resources[i].allocation->SetName(L"FreeAllocations");
+    }
+
+    // Free every other allocation in random order, with a null entry in the middle.
+    UINT freeCount = 0;
+    for(UINT i = 0; i < count; i += 2)
+    {
+        allocations[freeCount++] = resources[i].allocation.release();
+    }
+    allocations[freeCount++] = nullptr;
+    for(UINT i = freeCount; i-- > 1; )
+    {
+        std::swap(allocations[i], allocations[rand.Generate() % (i + 1)]);
+    }
+    ctx.allocator->FreeAllocations(freeCount, allocations);
+    for(UINT i = 0; i < count; i += 2)
+    {
+        resources[i].resource.Release();
+    }
+
+    // Remaining allocations must still be usable, then free them all at once.
+    freeCount = 0;
+    for(UINT i = 1; i < count; i += 2)
+    {
+        CHECK_BOOL( wcscmp(resources[i].allocation->GetName(), L"FreeAllocations") == 0 );
+        allocations[freeCount++] = resources[i].allocation.release();
+    }
+    ctx.allocator->FreeAllocations(freeCount, allocations);
+
+    // Freeing at once must leave memory the same as the equivalent single frees: freed neighbours
+    // merge into one free range and an empty heap beyond the last one in use is released.
+    UINT64 liveHeapCounts[2] = {};
+    for(UINT batch = 0; batch < 2; ++batch)
+    {
+        SoftwareDeviceDesc deviceDesc = {};
+        deviceDesc.ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_2;
+        CComPtr<ID3D12Device> device;
+        CHECK_HR( CreateSoftwareDevice(deviceDesc, &device) );
+
+        D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+        allocatorDesc.pDevice = device;
+        allocatorDesc.PreferredBlockSize = 16 * MEGABYTE;
+        D3D12MA::Allocator* allocator = nullptr;
+        CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+        {
+            D3D12MA::ALLOCATION_DESC allocDesc = {};
+            allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+            D3D12_RESOURCE_DESC resourceDesc;
+            FillResourceDescForBuffer(resourceDesc, 64 * 1024);
+
+            // Fill the first heap until a buffer goes to a second one.
+            std::vector<ResourceWithAllocation> firstHeapResources;
+            ResourceWithAllocation secondHeapResource;
+            while(secondHeapResource.allocation == nullptr)
+            {
+                ResourceWithAllocation res;
+                D3D12MA::Allocation* alloc = nullptr;
+                CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                    &alloc, IID_PPV_ARGS(&res.resource)) );
+                res.allocation.reset(alloc);
+                CHECK_BOOL( alloc->GetHeap() != NULL );
+                if(!firstHeapResources.empty() && alloc->GetHeap() != firstHeapResources[0].allocation->GetHeap())
+                    secondHeapResource = std::move(res);
+                else
+                    firstHeapResources.push_back(std::move(res));
+            }
+            CHECK_BOOL( firstHeapResources.size() >= 5 );
+            for(size_t i = 1; i < 5; ++i)
+                CHECK_BOOL( firstHeapResources[i].allocation->GetOffset() > firstHeapResources[i - 1].allocation->GetOffset() );
+            const UINT64 mergedOffset = firstHeapResources[1].allocation->GetOffset();
+
+            // Three neighbours from the first heap and the only allocation in the second one.
+            // Single frees empty the second heap first, so it is released by the next free.
+            D3D12MA::Allocation* allocationsToFree[] = {
+                secondHeapResource.allocation.release(),
+                firstHeapResources[1].allocation.release(),
+                firstHeapResources[2].allocation.release(),
+                firstHeapResources[3].allocation.release() };
+            const UINT allocationsToFreeCount = (UINT)(sizeof(allocationsToFree) / sizeof(allocationsToFree[0]));
+            secondHeapResource.resource.Release();
+            for(size_t i = 1; i < 4; ++i)
+                firstHeapResources[i].resource.Release();
+            if(batch)
+            {
+                // Reversed, so the second heap becomes empty last.
+                std::reverse(allocationsToFree, allocationsToFree + allocationsToFreeCount);
+                allocator->FreeAllocations(allocationsToFreeCount, allocationsToFree);
+            }
+            else
+            {
+                for(UINT i = 0; i < allocationsToFreeCount; ++i)
+                    allocationsToFree[i]->Release();
+            }
+
+            D3D12MA::HeapChurnStats churnStats;
+            allocator->GetHeapChurnStats(&churnStats);
+            liveHeapCounts[batch] = churnStats.HeapCreatedCount - churnStats.HeapDestroyedCount;
+            CHECK_BOOL( liveHeapCounts[batch] == 1 && churnStats.EmptyBlockCount == 0 );
+
+            // Buffer as big as the three freed ones fits in their place only if they were merged.
+            FillResourceDescForBuffer(resourceDesc, 3 * 64 * 1024);
+            ResourceWithAllocation merged;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&merged.resource)) );
+            merged.allocation.reset(alloc);
+            CHECK_BOOL( alloc->GetHeap() == firstHeapResources[0].allocation->GetHeap() );
+            CHECK_BOOL( alloc->GetOffset() == mergedOffset );
+            D3D12MA::HeapChurnStats churnStatsAfter;
+            allocator->GetHeapChurnStats(&churnStatsAfter);
+            CHECK_BOOL( churnStatsAfter.HeapCreatedCount == churnStats.HeapCreatedCount );
+        }
+        allocator->Release();
+    }
+    CHECK_BOOL( liveHeapCounts[1] == liveHeapCounts[0] );
+}
+
+static void TestVirtualBlocks(const TestContext& ctx)
+{
+    wprintf(L"Test virtual blocks\n");
+
+    using namespace D3D12MA;
+
+    const UINT64 blockSize = 16 * MEGABYTE;
+    const UINT64 alignment = 256;
+
+    // # Create block 16 MB
+
+    VIRTUAL_BLOCK_DESC blockDesc = {};
+    blockDesc.Size = blockSize;
+    VirtualBlock* block;
+    CHECK_HR( CreateVirtualBlock(&blockDesc, &block) );
+    CHECK_BOOL( block );
+
+    // # Allocate 8 MB
+
+    VIRTUAL_ALLOCATION_DESC allocDesc = {};
+    allocDesc.Alignment = alignment;
+    allocDesc.pUserData = (void*)(uintptr_t)1;
+    allocDesc.Size = 8 * MEGABYTE;
+    UINT64 alloc0Offset;
+    CHECK_HR( block->Allocate(&allocDesc, &alloc0Offset) );
+    CHECK_BOOL( alloc0Offset < blockSize );
+
+    // # Validate the allocation
+
+    VIRTUAL_ALLOCATION_INFO allocInfo = {};
+    block->GetAllocationInfo(alloc0Offset, &allocInfo);
+    CHECK_BOOL( allocInfo.Size == allocDesc.Size );
+    CHECK_BOOL( allocInfo.pUserData == allocDesc.pUserData );
+
+    // # Check SetUserData
+
+    block->SetAllocationUserData(alloc0Offset, (void*)(uintptr_t)2);
+    block->GetAllocationInfo(alloc0Offset, &allocInfo);
+    CHECK_BOOL( allocInfo.pUserData == (void*)(uintptr_t)2 );
+
+    // # Allocate 4 MB
+
+    allocDesc.Size = 4 * MEGABYTE;
+    allocDesc.Alignment = alignment;
+    UINT64 alloc1Offset;
+    CHECK_HR( block->Allocate(&allocDesc, &alloc1Offset) );
+    CHECK_BOOL( alloc1Offset < blockSize );
+    CHECK_BOOL( alloc1Offset + 4 * MEGABYTE <= alloc0Offset || alloc0Offset + 8 * MEGABYTE <= alloc1Offset ); // Check if they don't overlap.
+
+    // # Allocate another 8 MB - it should fail
+
+    allocDesc.Size = 8 * MEGABYTE;
+    allocDesc.Alignment = alignment;
+    UINT64 alloc2Offset;
+    CHECK_BOOL( FAILED(block->Allocate(&allocDesc, &alloc2Offset)) );
+    CHECK_BOOL( alloc2Offset == UINT64_MAX );
+
+    // # Free the 4 MB block. Now allocation of 8 MB should succeed.
+
+    block->FreeAllocation(alloc1Offset);
+    CHECK_HR( block->Allocate(&allocDesc, &alloc2Offset) );
+    CHECK_BOOL( alloc2Offset < blockSize );
+    CHECK_BOOL( alloc2Offset + 4 * MEGABYTE <= alloc0Offset || alloc0Offset + 8 * MEGABYTE <= alloc2Offset ); // Check if they don't overlap.
+
+    // # Calculate statistics
+
+    StatInfo statInfo = {};
+    block->CalculateStats(&statInfo);
+    CHECK_BOOL(statInfo.AllocationCount == 2);
+    CHECK_BOOL(statInfo.BlockCount == 1);
+    CHECK_BOOL(statInfo.UsedBytes == blockSize);
+    CHECK_BOOL(statInfo.UnusedBytes + statInfo.UsedBytes == blockSize);
+
+    // # Free alloc0, leave alloc2 unfreed.
+
+    block->FreeAllocation(alloc0Offset);
+
+    // # Test alignment
+
+    {
+        constexpr size_t allocCount = 10;
+        UINT64 allocOffset[allocCount] = {};
+        for(size_t i = 0; i < allocCount; ++i)
+        {
+            const bool alignment0 = i == allocCount - 1;
+            allocDesc.Size = i * 3 + 15;
+            allocDesc.Alignment = alignment0 ? 0 : 8;
+            CHECK_HR(block->Allocate(&allocDesc, &allocOffset[i]));
+            if(!alignment0)
+            {
+                CHECK_BOOL(allocOffset[i] % allocDesc.Alignment == 0);
+            }
+        }
+
+        for(size_t i = allocCount; i--; )
+        {
+            block->FreeAllocation(allocOffset[i]);
+        }
+    }
+
+    // # Final cleanup
+
+    block->FreeAllocation(alloc2Offset);
+    CHECK_BOOL( block->IsEmpty() );
+
+    // # Clear frees everything at once
+
+    allocDesc.Size = MEGABYTE;
+    allocDesc.Alignment = 0;
+    for(UINT i = 0; i < 16; ++i)
+    {
+        UINT64 offset;
+        CHECK_HR( block->Allocate(&allocDesc, &offset) );
+    }
+    CHECK_BOOL( FAILED(block->Allocate(&allocDesc, &alloc0Offset)) );
+    block->Clear();
+    CHECK_BOOL( block->IsEmpty() );
+    block->CalculateStats(&statInfo);
+    CHECK_BOOL( statInfo.AllocationCount == 0 && statInfo.UnusedBytes == blockSize );
+
+    block->Release();
+}
+
+static void TestVirtualBlockSmallUnits(const TestContext& ctx)
+{
+    wprintf(L"Test virtual blocks with small units\n");
+
+    using namespace D3D12MA;
+
+    // Blocks counting e.g. descriptors: every single unit must be usable.
+    const UINT64 blockSizes[] = { 8, 64 };
+    for(size_t sizeIndex = 0; sizeIndex < sizeof(blockSizes) / sizeof(blockSizes[0]); ++sizeIndex)
+    {
+        const UINT64 blockSize = blockSizes[sizeIndex];
+
+        VIRTUAL_BLOCK_DESC blockDesc = {};
+        blockDesc.Size = blockSize;
+        VirtualBlock* block;
+        CHECK_HR( CreateVirtualBlock(&blockDesc, &block) );
+
+        VIRTUAL_ALLOCATION_DESC allocDesc = {};
+        allocDesc.Size = 1;
+        std::vector<UINT64> offsets((size_t)blockSize);
+        for(size_t i = 0; i < offsets.size(); ++i)
+        {
+            CHECK_HR( block->Allocate(&allocDesc, &offsets[i]) );
+        }
+        UINT64 offset;
+        CHECK_BOOL( FAILED(block->Allocate(&allocDesc, &offset)) );
+
+        // Free every other unit, leaving holes of 1 unit, then fill them again.
+        std::sort(offsets.begin(), offsets.end());
+        for(size_t i = 0; i < offsets.size(); i += 2)
+        {
+            block->FreeAllocation(offsets[i]);
+        }
+        for(size_t i = 0; i < offsets.size(); i += 2)
+        {
+            CHECK_HR( block->Allocate(&allocDesc, &offsets[i]) );
+            CHECK_BOOL( offsets[i] % 2 == 0 );
+        }
+        CHECK_BOOL( FAILED(block->Allocate(&allocDesc, &offset)) );
+
+        StatInfo statInfo = {};
+        block->CalculateStats(&statInfo);
+        CHECK_BOOL( statInfo.AllocationCount == blockSize && statInfo.UnusedBytes == 0 );
+
+        block->Clear();
+        block->Release();
+    }
+}
+
+static void TestSoftwareDevice(const TestContext& ctx)
+{
+    wprintf(L"Test software device\n");
+
+    const UINT64 budget = 64 * MEGABYTE;
+
+    SoftwareDeviceDesc deviceDesc = {};
+    deviceDesc.ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_1;
+    deviceDesc.MemoryBudget = budget;
+    CComPtr<ID3D12Device> device;
+    CHECK_HR( CreateSoftwareDevice(deviceDesc, &device) );
+
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.pDevice = device;
+    allocatorDesc.PreferredBlockSize = 16 * MEGABYTE;
+    D3D12MA::Allocator* allocator = nullptr;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+    CHECK_BOOL( allocator->GetD3D12Options().ResourceHeapTier == D3D12_RESOURCE_HEAP_TIER_1 );
+
+    // Tier 1 device rejects heaps that mix categories, so this works only if
+    // the allocator keeps buffers and textures in separate heaps.
+    {
+        D3D12MA::ALLOCATION_DESC allocDesc = {};
+        allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+
+        D3D12_RESOURCE_DESC bufDesc;
+        FillResourceDescForBuffer(bufDesc, 64 * 1024);
+        ResourceWithAllocation buf;
+        D3D12MA::Allocation* alloc = nullptr;
+        CHECK_HR( allocator->CreateResource(&allocDesc, &bufDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+            &alloc, IID_PPV_ARGS(&buf.resource)) );
+        buf.allocation.reset(alloc);
+        CHECK_BOOL( buf.allocation->GetHeap() != NULL );
+        CHECK_BOOL( buf.resource->GetGPUVirtualAddress() != 0 );
+
+        D3D12_RESOURCE_DESC texDesc = {};
+        texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+        texDesc.Width = 256;
+        texDesc.Height = 256;
+        texDesc.DepthOrArraySize = 1;
+        texDesc.MipLevels = 1;
+        texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        texDesc.SampleDesc.Count = 1;
+        ResourceWithAllocation tex;
+        CHECK_HR( allocator->CreateResource(&allocDesc, &texDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+            &alloc, IID_PPV_ARGS(&tex.resource)) );
+        tex.allocation.reset(alloc);
+        CHECK_BOOL( tex.allocation->GetHeap() != NULL && tex.allocation->GetHeap() != buf.allocation->GetHeap() );
+    }
+
+    // Upload buffers are backed by system memory and can be mapped.
+    {
+        D3D12MA::ALLOCATION_DESC allocDesc = {};
+        allocDesc.HeapType = D3D12_HEAP_TYPE_UPLOAD;
+        D3D12_RESOURCE_DESC bufDesc;
+        FillResourceDescForBuffer(bufDesc, MEGABYTE);
+        ResourceWithAllocation buf;
+        D3D12MA::Allocation* alloc = nullptr;
+        CHECK_HR( allocator->CreateResource(&allocDesc, &bufDesc, D3D12_RESOURCE_STATE_GENERIC_READ, NULL,
+            &alloc, IID_PPV_ARGS(&buf.resource)) );
+        buf.allocation.reset(alloc);
+        void* mappedPtr = NULL;
+        CHECK_HR( buf.resource->Map(0, NULL, &mappedPtr) );
+        FillData(mappedPtr, MEGABYTE, 123);
+        CHECK_BOOL( ValidateData(mappedPtr, MEGABYTE, 123) );
+        buf.resource->Unmap(0, NULL);
+    }
+
+    // Allocate until the device runs out of its budget.
+    {
+        D3D12MA::ALLOCATION_DESC allocDesc = {};
+        allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+        D3D12_RESOURCE_DESC bufDesc;
+        FillResourceDescForBuffer(bufDesc, MEGABYTE);
+
+        std::vector<ResourceWithAllocation> resources;
+        HRESULT hr = S_OK;
+        while(resources.size() < budget / MEGABYTE * 2)
+        {
+            ResourceWithAllocation res;
+            D3D12MA::Allocation* alloc = nullptr;
+            hr = allocator->CreateResource(&allocDesc, &bufDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource));
+            if(FAILED(hr))
+                break;
+            res.allocation.reset(alloc);
+            resources.push_back(std::move(res));
+        }
+        CHECK_BOOL( hr == E_OUTOFMEMORY );
+        CHECK_BOOL( !resources.empty() && resources.size() <= budget / MEGABYTE );
+
+        SoftwareDeviceStats stats;
+        CHECK_BOOL( GetSoftwareDeviceStats(device, stats) );
+        CHECK_BOOL( stats.OutOfMemoryCount > 0 );
+        CHECK_BOOL( stats.UsedBytes <= budget && stats.MaxUsedBytes <= budget );
+        CHECK_BOOL( stats.ResourceCount == resources.size() );
+        CHECK_BOOL( stats.CreateHeapCount >= 2 && stats.CheckFeatureSupportCount > 0 );
+    }
+
+    allocator->Release();
+
+    // Everything the allocator created must be gone now.
+    SoftwareDeviceStats stats;
+    CHECK_BOOL( GetSoftwareDeviceStats(device, stats) );
+    CHECK_BOOL( stats.HeapCount == 0 && stats.ResourceCount == 0 && stats.UsedBytes == 0 );
+
+    CHECK_BOOL( !GetSoftwareDeviceStats(NULL, stats) );
+}
+
+static void TestLockStats(const TestContext& ctx)
+{
+    wprintf(L"Test lock statistics\n");
+
+    D3D12MA::LockStats statsBeg;
+    const HRESULT hr = ctx.allocator->GetLockStats(&statsBeg);
+    if(hr == E_NOTIMPL)
+    {
+        wprintf(L"    Skipped, D3D12MA_LOCK_STATS is not enabled.\n");
+        return;
+    }
+    CHECK_HR(hr);
+
+    // One placed and one committed buffer in DEFAULT heap.
+    {
+        D3D12MA::ALLOCATION_DESC allocDesc = {};
+        allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+        D3D12_RESOURCE_DESC resourceDesc;
+        FillResourceDescForBuffer(resourceDesc, MEGABYTE);
+
+        ResourceWithAllocation placed, committed;
+        D3D12MA::Allocation* alloc = nullptr;
+        CHECK_HR( ctx.allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+            &alloc, IID_PPV_ARGS(&placed.resource)) );
+        placed.allocation.reset(alloc);
+        allocDesc.Flags = D3D12MA::ALLOCATION_FLAG_COMMITTED;
+        CHECK_HR( ctx.allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+            &alloc, IID_PPV_ARGS(&committed.resource)) );
+        committed.allocation.reset(alloc);
+    }
+
+    D3D12MA::LockStats statsEnd;
+    CHECK_HR( ctx.allocator->GetLockStats(&statsEnd) );
+    CHECK_BOOL( statsEnd.DefaultPoolCount == statsBeg.DefaultPoolCount &&
+        (statsEnd.DefaultPoolCount == 5 || statsEnd.DefaultPoolCount == 13) );
+
+    // Placed buffer locks the pool of DEFAULT heap to allocate and free, committed one locks the list of committed allocations.
+    UINT64 defaultPoolAcquireCount = 0;
+    for(UINT i = 0; i < statsEnd.DefaultPoolCount; ++i)
+    {
+        const D3D12MA::LockStatInfo& lock = statsEnd.DefaultPools[i].Lock;
+        CHECK_BOOL( lock.ContendedCount <= lock.AcquireCount );
+        CHECK_BOOL( lock.WaitTimeMax <= lock.WaitTimeTotal && lock.HoldTimeMax <= lock.HoldTimeTotal );
+        if(statsEnd.DefaultPools[i].HeapType == D3D12_HEAP_TYPE_DEFAULT)
+            defaultPoolAcquireCount += lock.AcquireCount - statsBeg.DefaultPools[i].Lock.AcquireCount;
+    }
+    CHECK_BOOL( defaultPoolAcquireCount >= 2 );
+    CHECK_BOOL( statsEnd.CommittedAllocations[0].AcquireCount >= statsBeg.CommittedAllocations[0].AcquireCount + 2 );
+    CHECK_BOOL( statsEnd.BufferRangePools[0].HeapType == D3D12_HEAP_TYPE_DEFAULT &&
+        statsEnd.BufferRangePools[2].HeapType == D3D12_HEAP_TYPE_READBACK );
+    CHECK_BOOL( statsEnd.CreationNodeMask == 1 && statsEnd.VisibleNodeMask == 1 );
+
+    // Pools of other node masks are reported by GetAllLockStats, after those of node 0.
+    SoftwareDeviceDesc deviceDesc = {};
+    deviceDesc.ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_2;
+    deviceDesc.NodeCount = 2;
+    CComPtr<ID3D12Device> device;
+    CHECK_HR( CreateSoftwareDevice(deviceDesc, &device) );
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.pDevice = device;
+    D3D12MA::Allocator* allocator = nullptr;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+    {
+        UINT lockStatsCount = 0;
+        CHECK_HR( allocator->GetAllLockStats(&lockStatsCount, NULL) );
+        CHECK_BOOL( lockStatsCount == 1 );
+
+        D3D12MA::ALLOCATION_DESC allocDesc = {};
+        allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+        allocDesc.CreationNodeMask = 2;
+        D3D12_RESOURCE_DESC resourceDesc;
+        FillResourceDescForBuffer(resourceDesc, MEGABYTE);
+        ResourceWithAllocation placed;
+        D3D12MA::Allocation* alloc = nullptr;
+        CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+            &alloc, IID_PPV_ARGS(&placed.resource)) );
+        placed.allocation.reset(alloc);
+
+        D3D12MA::LockStats allStats[3];
+        lockStatsCount = 3;
+        CHECK_HR( allocator->GetAllLockStats(&lockStatsCount, allStats) );
+        CHECK_BOOL( lockStatsCount == 2 );
+        CHECK_BOOL( allStats[0].CreationNodeMask == 1 && allStats[0].VisibleNodeMask == 1 );
+        CHECK_BOOL( allStats[1].CreationNodeMask == 2 && allStats[1].VisibleNodeMask == 2 );
+        UINT64 node1AcquireCount = 0;
+        for(UINT i = 0; i < allStats[1].DefaultPoolCount; ++i)
+        {
+            if(allStats[1].DefaultPools[i].HeapType == D3D12_HEAP_TYPE_DEFAULT)
+                node1AcquireCount += allStats[1].DefaultPools[i].Lock.AcquireCount;
+        }
+        CHECK_BOOL( node1AcquireCount >= 1 );
+    }
+    allocator->Release();
+}
+
+static void TestLatencyStats(const TestContext& ctx)
+{
+    wprintf(L"Test latency statistics\n");
+
+    D3D12MA::LatencyStats statsBeg[D3D12MA::TIMED_OPERATION_COUNT];
+    const HRESULT hr = ctx.allocator->GetLatencyStats(D3D12MA::TIMED_OPERATION_CREATE_RESOURCE, &statsBeg[0]);
+    if(hr == E_NOTIMPL)
+    {
+        wprintf(L"    Skipped, D3D12MA_LATENCY_HISTOGRAMS is not enabled.\n");
+        return;
+    }
+    CHECK_HR(hr);
+    for(UINT op = 0; op < D3D12MA::TIMED_OPERATION_COUNT; ++op)
+        CHECK_HR( ctx.allocator->GetLatencyStats((D3D12MA::TIMED_OPERATION)op, &statsBeg[op]) );
+
+    // Placed and committed buffers, created and released.
+    const UINT bufCount = 16;
+    {
+        D3D12MA::ALLOCATION_DESC allocDesc = {};
+        allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+        D3D12_RESOURCE_DESC resourceDesc;
+        FillResourceDescForBuffer(resourceDesc, MEGABYTE);
+
+        std::vector<ResourceWithAllocation> resources;
+        for(UINT i = 0; i < bufCount; ++i)
+        {
+            allocDesc.Flags = i % 2 ? D3D12MA::ALLOCATION_FLAG_COMMITTED : D3D12MA::ALLOCATION_FLAG_NONE;
+            ResourceWithAllocation res;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( ctx.allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) );
+            res.allocation.reset(alloc);
+            resources.push_back(std::move(res));
+        }
+    }
+
+    D3D12MA::LatencyStats statsEnd[D3D12MA::TIMED_OPERATION_COUNT];
+    for(UINT op = 0; op < D3D12MA::TIMED_OPERATION_COUNT; ++op)
+    {
+        const D3D12MA::LatencyStats& stats = statsEnd[op];
+        CHECK_HR( ctx.allocator->GetLatencyStats((D3D12MA::TIMED_OPERATION)op, &statsEnd[op]) );
+        CHECK_BOOL( stats.Count >= statsBeg[op].Count && stats.TimeTotal >= statsBeg[op].TimeTotal );
+        CHECK_BOOL( stats.TimeP50 <= stats.TimeP90 && stats.TimeP90 <= stats.TimeP99 &&
+            stats.TimeP99 <= stats.TimeP999 && stats.TimeP999 <= stats.TimeMax );
+        CHECK_BOOL( stats.TimeMax <= stats.TimeTotal );
+    }
+    CHECK_BOOL( statsEnd[D3D12MA::TIMED_OPERATION_CREATE_RESOURCE].Count == statsBeg[D3D12MA::TIMED_OPERATION_CREATE_RESOURCE].Count + bufCount );
+    CHECK_BOOL( statsEnd[D3D12MA::TIMED_OPERATION_RELEASE_ALLOCATION].Count == statsBeg[D3D12MA::TIMED_OPERATION_RELEASE_ALLOCATION].Count + bufCount );
+    CHECK_BOOL( statsEnd[D3D12MA::TIMED_OPERATION_GET_RESOURCE_ALLOCATION_INFO].Count >= statsBeg[D3D12MA::TIMED_OPERATION_GET_RESOURCE_ALLOCATION_INFO].Count + bufCount );
+    CHECK_BOOL( statsEnd[D3D12MA::TIMED_OPERATION_CREATE_PLACED_RESOURCE].Count >= statsBeg[D3D12MA::TIMED_OPERATION_CREATE_PLACED_RESOURCE].Count + bufCount / 2 );
+    CHECK_BOOL( statsEnd[D3D12MA::TIMED_OPERATION_CREATE_COMMITTED_RESOURCE].Count >= statsBeg[D3D12MA::TIMED_OPERATION_CREATE_COMMITTED_RESOURCE].Count + bufCount / 2 );
+    CHECK_BOOL( statsEnd[D3D12MA::TIMED_OPERATION_FIND_FREE_RANGE].Count >= statsBeg[D3D12MA::TIMED_OPERATION_FIND_FREE_RANGE].Count + bufCount / 2 );
+    // Time of the whole CreateResource includes the calls to the device.
+    CHECK_BOOL( statsEnd[D3D12MA::TIMED_OPERATION_CREATE_RESOURCE].TimeTotal - statsBeg[D3D12MA::TIMED_OPERATION_CREATE_RESOURCE].TimeTotal >=
+        statsEnd[D3D12MA::TIMED_OPERATION_CREATE_COMMITTED_RESOURCE].TimeTotal - statsBeg[D3D12MA::TIMED_OPERATION_CREATE_COMMITTED_RESOURCE].TimeTotal );
+}
+
+static size_t CountSubstrings(const char* str, const char* substr)
+{
+    size_t count = 0;
+    for(const char* p = strstr(str, substr); p != nullptr; p = strstr(p + 1, substr))
+        ++count;
+    return count;
+}
+
+static void TestTraceEvents(const TestContext& ctx)
+{
+    wprintf(L"Test trace events\n");
+
+    // Also removes events recorded by previous tests.
+    char* traceString = nullptr;
+    const HRESULT hr = ctx.allocator->BuildTraceString(&traceString);
+    if(hr == E_NOTIMPL)
+    {
+        wprintf(L"    Skipped, D3D12MA_TRACE_EVENTS is not enabled.\n");
+        return;
+    }
+    CHECK_HR(hr);
+    ctx.allocator->FreeTraceString(traceString);
+
+    // Several threads creating and releasing buffers. The library compiled with
+    // D3D12MA_SINGLE_THREADED doesn't lock, so only one thread is used then.
+#if D3D12MA_SINGLE_THREADED
+    const UINT threadCount = 1;
+#else
+    const UINT threadCount = 4;
+#endif
+    const UINT bufCountPerThread = 32;
+    std::vector<std::thread> threads;
+    for(UINT threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+    {
+        threads.push_back(std::thread([&ctx]() {
+            D3D12MA::ALLOCATION_DESC allocDesc = {};
+            allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+            D3D12_RESOURCE_DESC resourceDesc;
+            FillResourceDescForBuffer(resourceDesc, 64 * 1024);
+
+            std::vector<ResourceWithAllocation> resources;
+            for(UINT i = 0; i < bufCountPerThread; ++i)
+            {
+                ResourceWithAllocation res;
+                D3D12MA::Allocation* alloc = nullptr;
+                CHECK_HR( ctx.allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                    &alloc, IID_PPV_ARGS(&res.resource)) );
+                res.allocation.reset(alloc);
+                resources.push_back(std::move(res));
+            }
+        }));
+    }
+    for(auto& thread : threads)
+        thread.join();
+
+    CHECK_HR( ctx.allocator->BuildTraceString(&traceString) );
+    CHECK_BOOL( strncmp(traceString, "{\"traceEvents\":[", 16) == 0 );
+    CHECK_BOOL( strstr(traceString, "\"droppedEventCount\":\"0\"") != nullptr );
+    CHECK_BOOL( CountSubstrings(traceString, "\"Allocator::CreateResource\"") == threadCount * bufCountPerThread );
+    CHECK_BOOL( CountSubstrings(traceString, "\"Allocation::Release\"") == threadCount * bufCountPerThread );
+    CHECK_BOOL( CountSubstrings(traceString, "\"Find free range\"") >= threadCount * bufCountPerThread );
+    CHECK_BOOL( CountSubstrings(traceString, "\"ph\":\"X\"") == CountSubstrings(traceString, "\"name\":") );
+    ctx.allocator->FreeTraceString(traceString);
+
+    // Events were removed by the previous call.
+    CHECK_HR( ctx.allocator->BuildTraceString(&traceString) );
+    CHECK_BOOL( strstr(traceString, "\"Allocator::CreateResource\"") == nullptr );
+    ctx.allocator->FreeTraceString(traceString);
+
+    // More short-lived threads than the library has buffers for. Each thread gives its
+    // buffer up when it exits, so no event is dropped. They run one after another, so
+    // this works with D3D12MA_SINGLE_THREADED too. Threads are joined only at the end,
+    // so the system doesn't give their IDs to the next ones.
+    struct ThreadExitCounter
+    {
+        std::atomic<UINT>* counter = nullptr;
+        // Destroyed after objects of the library that are local to this thread, as it is created before them.
+        ~ThreadExitCounter() { if(counter != nullptr) ++*counter; }
+    };
+    const UINT shortLivedThreadCount = 100;
+    std::atomic<UINT> exitedThreadCount{0};
+    threads.clear();
+    for(UINT threadIndex = 0; threadIndex < shortLivedThreadCount; ++threadIndex)
+    {
+        threads.push_back(std::thread([&ctx, &exitedThreadCount]() {
+            static thread_local ThreadExitCounter exitCounter;
+            exitCounter.counter = &exitedThreadCount;
+
+            D3D12MA::ALLOCATION_DESC allocDesc = {};
+            allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+            D3D12_RESOURCE_DESC resourceDesc;
+            FillResourceDescForBuffer(resourceDesc, 64 * 1024);
+
+            ResourceWithAllocation res;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( ctx.allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) );
+            res.allocation.reset(alloc);
+        }));
+        while(exitedThreadCount.load() <= threadIndex)
+            std::this_thread::yield();
+    }
+    for(auto& thread : threads)
+        thread.join();
+
+    CHECK_HR( ctx.allocator->BuildTraceString(&traceString) );
+    CHECK_BOOL( strstr(traceString, "\"droppedEventCount\":\"0\"") != nullptr );
+    CHECK_BOOL( CountSubstrings(traceString, "\"Allocator::CreateResource\"") == shortLivedThreadCount );
+    CHECK_BOOL( CountSubstrings(traceString, "\"Allocation::Release\"") == shortLivedThreadCount );
+    ctx.allocator->FreeTraceString(traceString);
+}
+
+// Device memory tracked through D3D12MA::DEVICE_MEMORY_CALLBACKS.
+struct DeviceMemoryTracker
+{
+    std::mutex mutex;
+    std::map<UINT, UINT64> heapSizes; // Key is block ID.
+    UINT64 heapCreatedCount = 0;
+    UINT64 committedBytes = 0;
+    size_t committedCount = 0;
+    UINT64 suballocatedBytes = 0;
+    size_t suballocationCount = 0;
+};
+
+static void OnHeapCreated(D3D12_HEAP_TYPE heapType, UINT64 size, UINT blockId, void* pUserData)
+{
+    DeviceMemoryTracker* const tracker = (DeviceMemoryTracker*)pUserData;
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    CHECK_BOOL( blockId != D3D12MA::COMMITTED_BLOCK_ID && size > 0 );
+    CHECK_BOOL( tracker->heapSizes.emplace(blockId, size).second );
+    ++tracker->heapCreatedCount;
+}
+
+static void OnHeapDestroyed(D3D12_HEAP_TYPE heapType, UINT64 size, UINT blockId, void* pUserData)
+{
+    DeviceMemoryTracker* const tracker = (DeviceMemoryTracker*)pUserData;
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    auto it = tracker->heapSizes.find(blockId);
+    CHECK_BOOL( it != tracker->heapSizes.end() && it->second == size );
+    tracker->heapSizes.erase(it);
+}
+
+static void OnCommittedAllocated(D3D12_HEAP_TYPE heapType, UINT64 size, UINT blockId, UINT64 offset,
+    D3D12MA::Allocation* pAllocation, void* pUserData)
+{
+    DeviceMemoryTracker* const tracker = (DeviceMemoryTracker*)pUserData;
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    CHECK_BOOL( blockId == D3D12MA::COMMITTED_BLOCK_ID && offset == 0 && pAllocation->GetHeap() == NULL );
+    tracker->committedBytes += size;
+    ++tracker->committedCount;
+}
+
+static void OnCommittedFreed(D3D12_HEAP_TYPE heapType, UINT64 size, UINT blockId, UINT64 offset,
+    D3D12MA::Allocation* pAllocation, void* pUserData)
+{
+    DeviceMemoryTracker* const tracker = (DeviceMemoryTracker*)pUserData;
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    CHECK_BOOL( tracker->committedCount > 0 && tracker->committedBytes >= size );
+    tracker->committedBytes -= size;
+    --tracker->committedCount;
+}
+
+static void OnSuballocated(D3D12_HEAP_TYPE heapType, UINT64 size, UINT blockId, UINT64 offset,
+    D3D12MA::Allocation* pAllocation, void* pUserData)
+{
+    DeviceMemoryTracker* const tracker = (DeviceMemoryTracker*)pUserData;
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    auto it = tracker->heapSizes.find(blockId);
+    CHECK_BOOL( it != tracker->heapSizes.end() && offset + size <= it->second );
+    CHECK_BOOL( pAllocation->GetOffset() == offset && pAllocation->GetSize() == size );
+    tracker->suballocatedBytes += size;
+    ++tracker->suballocationCount;
+}
+
+static void OnSuballocationFreed(D3D12_HEAP_TYPE heapType, UINT64 size, UINT blockId, UINT64 offset,
+    D3D12MA::Allocation* pAllocation, void* pUserData)
+{
+    DeviceMemoryTracker* const tracker = (DeviceMemoryTracker*)pUserData;
+    std::lock_guard<std::mutex> lock(tracker->mutex);
+    CHECK_BOOL( tracker->heapSizes.find(blockId) != tracker->heapSizes.end() );
+    CHECK_BOOL( tracker->suballocationCount > 0 && tracker->suballocatedBytes >= size );
+    tracker->suballocatedBytes -= size;
+    --tracker->suballocationCount;
+}
+
+static void TestDeviceMemoryCallbacks(const TestContext& ctx)
+{
+    wprintf(L"Test device memory callbacks\n");
+
+    DeviceMemoryTracker tracker;
+    D3D12MA::DEVICE_MEMORY_CALLBACKS deviceMemoryCallbacks = {};
+    deviceMemoryCallbacks.pHeapCreated = &OnHeapCreated;
+    deviceMemoryCallbacks.pHeapDestroyed = &OnHeapDestroyed;
+    deviceMemoryCallbacks.pCommittedAllocated = &OnCommittedAllocated;
+    deviceMemoryCallbacks.pCommittedFreed = &OnCommittedFreed;
+    deviceMemoryCallbacks.pSuballocated = &OnSuballocated;
+    deviceMemoryCallbacks.pSuballocationFreed = &OnSuballocationFreed;
+    deviceMemoryCallbacks.pUserData = &tracker;
+
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.pDevice = ctx.device;
+    allocatorDesc.PreferredBlockSize = 16 * MEGABYTE;
+    allocatorDesc.pDeviceMemoryCallbacks = &deviceMemoryCallbacks;
+    D3D12MA::Allocator* allocator = nullptr;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+
+    {
+        std::vector<ResourceWithAllocation> resources;
+        UINT64 placedBytes = 0;
+        size_t committedCount = 0;
+        for(UINT i = 0; i < 32; ++i)
+        {
+            D3D12MA::ALLOCATION_DESC allocDesc = {};
+            allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+            // Large buffers are created as committed by the allocator itself, others are placed.
+            const UINT64 size = i % 8 == 7 ? 12 * MEGABYTE : MEGABYTE;
+            D3D12_RESOURCE_DESC resourceDesc;
+            FillResourceDescForBuffer(resourceDesc, size);
+            ResourceWithAllocation res;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) );
+            res.allocation.reset(alloc);
+            if(alloc->GetHeap() != NULL)
+                placedBytes += alloc->GetSize();
+            else
+                ++committedCount;
+            resources.push_back(std::move(res));
+        }
+
+        D3D12MA::ALLOCATION_DESC allocDesc = {};
+        allocDesc.HeapType = D3D12_HEAP_TYPE_UPLOAD;
+        D3D12MA::Allocation* rangeAlloc = nullptr;
+        CHECK_HR( allocator->AllocateBufferRange(&allocDesc, 256, 0, &rangeAlloc) );
+
+        CHECK_BOOL( committedCount == 4 && tracker.committedCount == committedCount );
+        CHECK_BOOL( tracker.suballocationCount == resources.size() - committedCount + 1 );
+        CHECK_BOOL( tracker.suballocatedBytes == placedBytes + rangeAlloc->GetSize() );
+        CHECK_BOOL( tracker.heapSizes.size() >= 3 && tracker.heapCreatedCount == tracker.heapSizes.size() );
+
+        // Free half one by one and the rest at once.
+        resources.resize(resources.size() / 2);
+        std::vector<D3D12MA::Allocation*> allocations;
+        for(size_t i = 0; i < resources.size(); ++i)
+            allocations.push_back(resources[i].allocation.release());
+        allocations.push_back(rangeAlloc);
+        resources.clear();
+        allocator->FreeAllocations((UINT)allocations.size(), allocations.data());
+    }
+
+    CHECK_BOOL( tracker.committedCount == 0 && tracker.committedBytes == 0 );
+    CHECK_BOOL( tracker.suballocationCount == 0 && tracker.suballocatedBytes == 0 );
+
+    allocator->Release();
+    CHECK_BOOL( tracker.heapSizes.empty() );
+}
+
+static void TestAdaptiveBlockSize(const TestContext& ctx)
+{
+    wprintf(L"Test adaptive block size\n");
+
+    DeviceMemoryTracker tracker;
+    D3D12MA::DEVICE_MEMORY_CALLBACKS deviceMemoryCallbacks = {};
+    deviceMemoryCallbacks.pHeapCreated = &OnHeapCreated;
+    deviceMemoryCallbacks.pHeapDestroyed = &OnHeapDestroyed;
+    deviceMemoryCallbacks.pUserData = &tracker;
+
+    const UINT64 preferredBlockSize = 16 * MEGABYTE;
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.pDevice = ctx.device;
+    allocatorDesc.Flags = D3D12MA::ALLOCATOR_FLAG_ADAPTIVE_BLOCK_SIZE;
+    allocatorDesc.PreferredBlockSize = preferredBlockSize;
+    allocatorDesc.pDeviceMemoryCallbacks = &deviceMemoryCallbacks;
+    D3D12MA::Allocator* allocator = nullptr;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+
+    D3D12MA::ALLOCATION_DESC allocDesc = {};
+    allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+
+    // Many small buffers: blocks are smaller than preferred and not much larger than needed.
+    {
+        const UINT bufCount = 256;
+        D3D12_RESOURCE_DESC resourceDesc;
+        FillResourceDescForBuffer(resourceDesc, 64 * 1024);
+        std::vector<ResourceWithAllocation> resources;
+        for(UINT i = 0; i < bufCount; ++i)
+        {
+            ResourceWithAllocation res;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) );
+            res.allocation.reset(alloc);
+            CHECK_BOOL( alloc->GetHeap() != NULL );
+            resources.push_back(std::move(res));
+        }
+
+        UINT64 heapSizeTotal = 0;
+        for(const auto& heap : tracker.heapSizes)
+        {
+            CHECK_BOOL( heap.second < preferredBlockSize );
+            heapSizeTotal += heap.second;
+        }
+        // With D3D12MA_DEBUG_MARGIN, every buffer also takes the margin, aligned up to 64 KiB.
+#ifdef D3D12MA_DEBUG_MARGIN
+        const UINT64 debugMargin = D3D12MA_DEBUG_MARGIN;
+#else
+        const UINT64 debugMargin = 0;
+#endif
+        const UINT64 bufSizeWithMargin = AlignUp<UINT64>(64 * 1024 + debugMargin, 64 * 1024);
+        CHECK_BOOL( heapSizeTotal <= 2 * bufCount * bufSizeWithMargin );
+    }
+
+    // Large buffers requested often: they stop being committed and go to blocks larger than preferred.
+    {
+        D3D12_RESOURCE_DESC resourceDesc;
+        FillResourceDescForBuffer(resourceDesc, 12 * MEGABYTE);
+        // Only few are alive at a time.
+        std::vector<ResourceWithAllocation> resources(4);
+        bool lastPlaced = true;
+        for(UINT i = 0; i < 128; ++i)
+        {
+            ResourceWithAllocation& res = resources[i % resources.size()];
+            res.resource.Release();
+            res.allocation.reset();
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) );
+            res.allocation.reset(alloc);
+            // At first, they are larger than half of preferred block size.
+            if(i == 0)
+                CHECK_BOOL( alloc->GetHeap() == NULL );
+            if(i >= 96)
+                lastPlaced = lastPlaced && alloc->GetHeap() != NULL;
+        }
+        CHECK_BOOL( lastPlaced );
+
+        bool largeBlockFound = false;
+        for(const auto& heap : tracker.heapSizes)
+            largeBlockFound = largeBlockFound || heap.second > preferredBlockSize;
+        CHECK_BOOL( largeBlockFound );
+    }
+
+    allocator->Release();
+    CHECK_BOOL( tracker.heapSizes.empty() );
+}
+
+static void TestEmptyBlockRetention(const TestContext& ctx)
+{
+    wprintf(L"Test empty block retention\n");
+
+    D3D12MA::EMPTY_BLOCK_RETENTION emptyBlockRetention = {};
+    emptyBlockRetention.MaxBlockCount = 2;
+    emptyBlockRetention.FrameCount = 2;
+
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.pDevice = ctx.device;
+    allocatorDesc.PreferredBlockSize = 16 * MEGABYTE;
+    allocatorDesc.pEmptyBlockRetention = &emptyBlockRetention;
+    D3D12MA::Allocator* allocator = nullptr;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+
+    D3D12MA::HeapChurnStats stats;
+    allocator->GetHeapChurnStats(&stats);
+    CHECK_BOOL( stats.HeapCreatedCount == 0 && stats.EmptyBlockCount == 0 );
+
+    // Buffers that need several blocks in the same pool.
+    {
+        D3D12MA::ALLOCATION_DESC allocDesc = {};
+        allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+        D3D12_RESOURCE_DESC resourceDesc;
+        FillResourceDescForBuffer(resourceDesc, MEGABYTE);
+        std::vector<ResourceWithAllocation> resources;
+        for(UINT i = 0; i < 64; ++i)
+        {
+            ResourceWithAllocation res;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) );
+            res.allocation.reset(alloc);
+            resources.push_back(std::move(res));
+        }
+        allocator->GetHeapChurnStats(&stats);
+        CHECK_BOOL( stats.HeapCreatedCount > 2 && stats.HeapDestroyedCount == 0 );
+    }
+
+    // Two of the blocks stay empty, the others are released immediately.
+    const UINT64 createdCount = stats.HeapCreatedCount;
+    allocator->GetHeapChurnStats(&stats);
+    CHECK_BOOL( stats.EmptyBlockCount == 2 && stats.EmptyBlockBytes > 0 );
+    CHECK_BOOL( stats.HeapDestroyedCount == createdCount - 2 && stats.HeapTrimmedCount == 0 );
+
+    // Not empty for long enough yet.
+    allocator->SetCurrentFrameIndex(1);
+    allocator->Trim();
+    allocator->GetHeapChurnStats(&stats);
+    CHECK_BOOL( stats.EmptyBlockCount == 2 && stats.HeapTrimmedCount == 0 );
+
+    allocator->SetCurrentFrameIndex(2);
+    allocator->Trim();
+    allocator->GetHeapChurnStats(&stats);
+    CHECK_BOOL( stats.EmptyBlockCount == 0 && stats.EmptyBlockBytes == 0 && stats.HeapTrimmedCount == 2 );
+    CHECK_BOOL( stats.HeapDestroyedCount == stats.HeapCreatedCount && stats.HeapDestroyedBytes == stats.HeapCreatedBytes );
+
+    allocator->Release();
+}
+
+static void TestHeapRecycling(const TestContext& ctx)
+{
+    wprintf(L"Test heap recycling\n");
+
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.Flags = D3D12MA::ALLOCATOR_FLAG_CREATE_NOT_ZEROED_HEAPS;
+    allocatorDesc.pDevice = ctx.device;
+    allocatorDesc.PreferredBlockSize = 16 * MEGABYTE;
+    allocatorDesc.HeapCacheMaxBytes = 64 * MEGABYTE;
+    D3D12MA::Allocator* allocator = nullptr;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+
+    SoftwareDeviceStats deviceStatsBegin = {};
+    const bool softwareDevice = GetSoftwareDeviceStats(ctx.device, deviceStatsBegin);
+
+    D3D12MA::ALLOCATION_DESC allocDesc = {};
+    allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+    D3D12_RESOURCE_DESC resourceDesc;
+    FillResourceDescForBuffer(resourceDesc, MEGABYTE);
+
+    D3D12MA::HeapChurnStats stats;
+    for(UINT round = 0; round < 2; ++round)
+    {
+        // Buffers that need several blocks. All but one of them are destroyed when the buffers are released.
+        std::vector<ResourceWithAllocation> resources;
+        for(UINT i = 0; i < 40; ++i)
+        {
+            ResourceWithAllocation res;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) );
+            res.allocation.reset(alloc);
+            resources.push_back(std::move(res));
+        }
+        resources.clear();
+
+        allocator->GetHeapChurnStats(&stats);
+        CHECK_BOOL( stats.HeapDestroyedCount > 0 );
+        if(round == 0)
+        {
+            CHECK_BOOL( stats.HeapReusedCount == 0 );
+            // Heaps of all destroyed blocks fit in the cache.
+            CHECK_BOOL( stats.CachedHeapCount == stats.HeapDestroyedCount && stats.CachedHeapBytes == stats.HeapDestroyedBytes );
+        }
+        else
+        {
+            CHECK_BOOL( stats.HeapReusedCount > 0 );
+            CHECK_BOOL( stats.CachedHeapCount > 0 && stats.CachedHeapBytes <= allocatorDesc.HeapCacheMaxBytes );
+        }
+    }
+
+    if(softwareDevice)
+    {
+        // Reused heaps were not created again.
+        SoftwareDeviceStats deviceStats;
+        CHECK_BOOL( GetSoftwareDeviceStats(ctx.device, deviceStats) );
+        const UINT64 createHeapCount = deviceStats.CreateHeapCount - deviceStatsBegin.CreateHeapCount;
+        CHECK_BOOL( createHeapCount == stats.HeapCreatedCount - stats.HeapReusedCount );
+        // Not zeroed either for all heaps or, when not supported, for none.
+        const UINT64 notZeroedCount = deviceStats.CreateNotZeroedHeapCount - deviceStatsBegin.CreateNotZeroedHeapCount;
+        CHECK_BOOL( notZeroedCount == 0 || notZeroedCount == createHeapCount );
+    }
+
+    allocator->Trim();
+    allocator->GetHeapChurnStats(&stats);
+    CHECK_BOOL( stats.CachedHeapCount == 0 && stats.CachedHeapBytes == 0 && stats.EmptyBlockCount == 0 );
+
+    allocator->Release();
+
+    // Without ALLOCATOR_FLAG_CREATE_NOT_ZEROED_HEAPS, new blocks must get zeroed memory,
+    // so no heap is recycled.
+    allocatorDesc.Flags = D3D12MA::ALLOCATOR_FLAG_NONE;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+    for(UINT round = 0; round < 2; ++round)
+    {
+        std::vector<ResourceWithAllocation> resources;
+        for(UINT i = 0; i < 40; ++i)
+        {
+            ResourceWithAllocation res;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) );
+            res.allocation.reset(alloc);
+            resources.push_back(std::move(res));
+        }
+        resources.clear();
+
+        allocator->GetHeapChurnStats(&stats);
+        CHECK_BOOL( stats.HeapDestroyedCount > 0 );
+        CHECK_BOOL( stats.HeapReusedCount == 0 );
+        CHECK_BOOL( stats.CachedHeapCount == 0 && stats.CachedHeapBytes == 0 );
+    }
+    allocator->Release();
+}
+
+static void TestSmallAlignment(const TestContext& ctx)
+{
+    wprintf(L"Test small resource alignment\n");
+
+    D3D12MA::SmallAlignmentStats stats;
+    ctx.allocator->GetSmallAlignmentStats(&stats);
+    const D3D12MA::SmallAlignmentStats statsBegin = stats;
+
+    D3D12MA::ALLOCATION_DESC allocDesc = {};
+    allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+
+    D3D12_RESOURCE_DESC resourceDesc = {};
+    resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    resourceDesc.Width = 32;
+    resourceDesc.Height = 32;
+    resourceDesc.DepthOrArraySize = 1;
+    resourceDesc.MipLevels = 1;
+    resourceDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    resourceDesc.SampleDesc.Count = 1;
+    resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+
+    // 4 KiB textures, eligible for small alignment.
+    const UINT smallTextureCount = 64;
+    std::vector<ResourceWithAllocation> resources;
+    for(UINT i = 0; i < smallTextureCount; ++i)
+    {
+        ResourceWithAllocation res;
+        D3D12MA::Allocation* alloc = nullptr;
+        CHECK_HR( ctx.allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COPY_DEST, NULL,
+            &alloc, IID_PPV_ARGS(&res.resource)) );
+        res.allocation.reset(alloc);
+        CHECK_BOOL( res.allocation->GetOffset() % D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT == 0 );
+        resources.push_back(std::move(res));
+    }
+
+    ctx.allocator->GetSmallAlignmentStats(&stats);
+    const UINT smallCount = stats.AllocationCount - statsBegin.AllocationCount;
+    // The device decides. If it granted small alignment, it did so for all of them.
+    CHECK_BOOL( smallCount == 0 || smallCount == smallTextureCount );
+    if(ctx.softwareDevice && smallCount > 0)
+    {
+        CHECK_BOOL( stats.AllocationBytes - statsBegin.AllocationBytes == smallTextureCount * 4096ull );
+        CHECK_BOOL( stats.SavedBytes - statsBegin.SavedBytes ==
+            smallTextureCount * (D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 4096ull) );
+    }
+
+    // Not eligible: too large, render target.
+    {
+        D3D12_RESOURCE_DESC largeDesc = resourceDesc;
+        largeDesc.Width = 1024;
+        largeDesc.Height = 1024;
+        D3D12_RESOURCE_DESC renderTargetDesc = resourceDesc;
+        renderTargetDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+        const D3D12_RESOURCE_DESC* const descs[] = { &largeDesc, &renderTargetDesc };
+        for(size_t i = 0; i < sizeof(descs) / sizeof(descs[0]); ++i)
+        {
+            ResourceWithAllocation res;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( ctx.allocator->CreateResource(&allocDesc, descs[i], D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) );
+            res.allocation.reset(alloc);
+            CHECK_BOOL( res.allocation->GetOffset() % D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT == 0 );
+            resources.push_back(std::move(res));
+        }
+        D3D12MA::SmallAlignmentStats statsAfter;
+        ctx.allocator->GetSmallAlignmentStats(&statsAfter);
+        CHECK_BOOL( statsAfter.AllocationCount == stats.AllocationCount );
+    }
+
+    resources.clear();
+    ctx.allocator->GetSmallAlignmentStats(&stats);
+    CHECK_BOOL( stats.AllocationCount == statsBegin.AllocationCount && stats.SavedBytes == statsBegin.SavedBytes );
+}
+
+static void FillResourceDescForRenderTarget(D3D12_RESOURCE_DESC& outResourceDesc, UINT size, UINT sampleCount)
+{
+    outResourceDesc = {};
+    outResourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    outResourceDesc.Width = size;
+    outResourceDesc.Height = size;
+    outResourceDesc.DepthOrArraySize = 1;
+    outResourceDesc.MipLevels = 1;
+    outResourceDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    outResourceDesc.SampleDesc.Count = sampleCount;
+    outResourceDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+    outResourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+}
+
+static void TestMsaaPools(const TestContext& ctx)
+{
+    wprintf(L"Test MSAA pools\n");
+
+    D3D12MA::ALLOCATION_DESC allocDesc = {};
+    allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+
+    // Interleaved, so they would share heaps if they were in the same pool.
+    std::vector<ResourceWithAllocation> msaaResources, resources;
+    for(UINT i = 0; i < 8; ++i)
+    {
+        for(UINT sampleCount = 1; sampleCount <= 4; sampleCount *= 4)
+        {
+            D3D12_RESOURCE_DESC resourceDesc;
+            FillResourceDescForRenderTarget(resourceDesc, 256, sampleCount);
+            ResourceWithAllocation res;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( ctx.allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_RENDER_TARGET, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) );
+            res.allocation.reset(alloc);
+            CHECK_BOOL( res.allocation->GetHeap() != NULL );
+            if(sampleCount > 1)
+            {
+                CHECK_BOOL( res.allocation->GetOffset() % D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT == 0 );
+                msaaResources.push_back(std::move(res));
+            }
+            else
+                resources.push_back(std::move(res));
+        }
+    }
+
+    for(size_t i = 0; i < msaaResources.size(); ++i)
+    {
+        for(size_t j = 0; j < resources.size(); ++j)
+            CHECK_BOOL( msaaResources[i].allocation->GetHeap() != resources[j].allocation->GetHeap() );
+    }
+}
+
+static void TestUmaCustomHeaps(const TestContext& ctx)
+{
+    wprintf(L"Test UMA custom heaps\n");
+
+    D3D12_RESOURCE_DESC resourceDesc;
+    FillResourceDescForBuffer(resourceDesc, 65536);
+    D3D12MA::ALLOCATION_DESC allocDesc = {};
+    allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+    allocDesc.Flags = D3D12MA::ALLOCATION_FLAG_CPU_ACCESSIBLE;
+
+    // Without ALLOCATOR_FLAG_USE_UMA_CUSTOM_HEAPS, not even a UMA device supports the flag.
+    {
+        D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+        allocatorDesc.pDevice = ctx.device;
+        D3D12MA::Allocator* allocator = nullptr;
+        CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+        ResourceWithAllocation res;
+        D3D12MA::Allocation* alloc = nullptr;
+        CHECK_BOOL( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+            &alloc, IID_PPV_ARGS(&res.resource)) == E_NOTIMPL );
+        allocator->Release();
+    }
+
+    for(BOOL cacheCoherent = FALSE; cacheCoherent <= TRUE; ++cacheCoherent)
+    {
+        SoftwareDeviceDesc deviceDesc = {};
+        deviceDesc.ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_1;
+        deviceDesc.UMA = TRUE;
+        deviceDesc.CacheCoherentUMA = cacheCoherent;
+        CComPtr<ID3D12Device> device;
+        CHECK_HR( CreateSoftwareDevice(deviceDesc, &device) );
+
+        D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+        allocatorDesc.pDevice = device;
+        allocatorDesc.Flags = D3D12MA::ALLOCATOR_FLAG_USE_UMA_CUSTOM_HEAPS;
+        D3D12MA::Allocator* allocator = nullptr;
+        CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+        CHECK_BOOL( allocator->IsUMA() && allocator->IsCacheCoherentUMA() == cacheCoherent );
+        {
+            const D3D12_CPU_PAGE_PROPERTY expectedPageProperty = cacheCoherent ?
+                D3D12_CPU_PAGE_PROPERTY_WRITE_BACK : D3D12_CPU_PAGE_PROPERTY_WRITE_COMBINE;
+
+            // Placed and committed, written directly.
+            ResourceWithAllocation resources[2];
+            for(UINT i = 0; i < 2; ++i)
+            {
+                D3D12MA::ALLOCATION_DESC resourceAllocDesc = allocDesc;
+                if(i == 1)
+                    resourceAllocDesc.Flags |= D3D12MA::ALLOCATION_FLAG_COMMITTED;
+                D3D12MA::Allocation* alloc = nullptr;
+                CHECK_HR( allocator->CreateResource(&resourceAllocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                    &alloc, IID_PPV_ARGS(&resources[i].resource)) );
+                resources[i].allocation.reset(alloc);
+                CHECK_BOOL( (resources[i].allocation->GetHeap() != NULL) == (i == 0) );
+
+                D3D12_HEAP_PROPERTIES heapProps = {};
+                CHECK_HR( resources[i].resource->GetHeapProperties(&heapProps, NULL) );
+                CHECK_BOOL( heapProps.Type == D3D12_HEAP_TYPE_CUSTOM &&
+                    heapProps.CPUPageProperty == expectedPageProperty &&
+                    heapProps.MemoryPoolPreference == D3D12_MEMORY_POOL_L0 );
+
+                void* mappedPtr = NULL;
+                CHECK_HR( resources[i].resource->Map(0, NULL, &mappedPtr) );
+                FillData(mappedPtr, resourceDesc.Width, i);
+                resources[i].resource->Unmap(0, NULL);
+            }
+
+            // Buffer range is mapped.
+            D3D12MA::Allocation* range = nullptr;
+            CHECK_HR( allocator->AllocateBufferRange(&allocDesc, 256, 0, &range) );
+            CHECK_BOOL( range->GetMappedData() != NULL );
+            FillData(range->GetMappedData(), 256, 2);
+            range->Release();
+
+            // Multisampled resources and other heap types are not allowed.
+            D3D12_RESOURCE_DESC msaaDesc;
+            FillResourceDescForRenderTarget(msaaDesc, 256, 4);
+            ResourceWithAllocation res;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_BOOL( allocator->CreateResource(&allocDesc, &msaaDesc, D3D12_RESOURCE_STATE_RENDER_TARGET, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) == E_INVALIDARG );
+            D3D12MA::ALLOCATION_DESC uploadAllocDesc = allocDesc;
+            uploadAllocDesc.HeapType = D3D12_HEAP_TYPE_UPLOAD;
+            CHECK_BOOL( allocator->CreateResource(&uploadAllocDesc, &resourceDesc, D3D12_RESOURCE_STATE_GENERIC_READ, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) == E_INVALIDARG );
+        }
+        allocator->Release();
+    }
+}
+
+static void TestNodeMasks(const TestContext& ctx)
+{
+    wprintf(L"Test node masks\n");
+
+    SoftwareDeviceDesc deviceDesc = {};
+    deviceDesc.ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_2;
+    deviceDesc.NodeCount = 2;
+    CComPtr<ID3D12Device> device;
+    CHECK_HR( CreateSoftwareDevice(deviceDesc, &device) );
+
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.pDevice = device;
+    D3D12MA::Allocator* allocator = nullptr;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+    {
+        D3D12_RESOURCE_DESC resourceDesc;
+        FillResourceDescForBuffer(resourceDesc, 65536);
+
+        // Creation and visible node masks, with 0 meaning the defaults.
+        const UINT nodeMasks[][2] = { { 0, 0 }, { 1, 1 }, { 2, 0 }, { 2, 2 }, { 1, 3 }, { 2, 3 } };
+        const size_t nodeMaskCount = sizeof(nodeMasks) / sizeof(nodeMasks[0]);
+        std::vector<ResourceWithAllocation> resources;
+        std::vector<D3D12MA::Allocation*> committedAllocations;
+        for(size_t i = 0; i < nodeMaskCount; ++i)
+        {
+            D3D12MA::ALLOCATION_DESC allocDesc = {};
+            allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+            allocDesc.CreationNodeMask = nodeMasks[i][0];
+            allocDesc.VisibleNodeMask = nodeMasks[i][1];
+            const UINT expectedCreationNodeMask = nodeMasks[i][0] != 0 ? nodeMasks[i][0] : 1;
+            const UINT expectedVisibleNodeMask = nodeMasks[i][1] != 0 ? nodeMasks[i][1] : expectedCreationNodeMask;
+
+            ResourceWithAllocation res;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) );
+            res.allocation.reset(alloc);
+            D3D12_HEAP_PROPERTIES heapProps = {};
+            CHECK_HR( res.resource->GetHeapProperties(&heapProps, NULL) );
+            CHECK_BOOL( heapProps.CreationNodeMask == expectedCreationNodeMask &&
+                heapProps.VisibleNodeMask == expectedVisibleNodeMask );
+            resources.push_back(std::move(res));
+
+            allocDesc.Flags = D3D12MA::ALLOCATION_FLAG_COMMITTED;
+            CComPtr<ID3D12Resource> committedResource;
+            CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&committedResource)) );
+            CHECK_HR( committedResource->GetHeapProperties(&heapProps, NULL) );
+            CHECK_BOOL( heapProps.CreationNodeMask == expectedCreationNodeMask &&
+                heapProps.VisibleNodeMask == expectedVisibleNodeMask );
+            committedAllocations.push_back(alloc);
+        }
+
+        // Only the first two and the next two have the same node masks, so only they share heaps.
+        for(size_t i = 0; i < nodeMaskCount; ++i)
+        {
+            for(size_t j = i + 1; j < nodeMaskCount; ++j)
+            {
+                const bool sameNodeMasks = (i == 0 && j == 1) || (i == 2 && j == 3);
+                CHECK_BOOL( (resources[i].allocation->GetHeap() == resources[j].allocation->GetHeap()) == sameNodeMasks );
+            }
+        }
+
+        // Committed allocations of all nodes released together.
+        allocator->FreeAllocations((UINT)committedAllocations.size(), committedAllocations.data());
+
+        // Invalid: two creation nodes, a node that doesn't exist, a creation node that isn't visible.
+        const UINT invalidNodeMasks[][2] = { { 3, 3 }, { 4, 4 }, { 1, 2 } };
+        for(size_t i = 0; i < sizeof(invalidNodeMasks) / sizeof(invalidNodeMasks[0]); ++i)
+        {
+            D3D12MA::ALLOCATION_DESC allocDesc = {};
+            allocDesc.HeapType = D3D12_HEAP_TYPE_UPLOAD;
+            allocDesc.CreationNodeMask = invalidNodeMasks[i][0];
+            allocDesc.VisibleNodeMask = invalidNodeMasks[i][1];
+            ResourceWithAllocation res;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_BOOL( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_GENERIC_READ, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) == E_INVALIDARG );
+            CHECK_BOOL( allocator->AllocateBufferRange(&allocDesc, 256, 0, &alloc) == E_INVALIDARG );
+        }
+
+        // Buffer ranges of node 1.
+        D3D12MA::ALLOCATION_DESC allocDesc = {};
+        allocDesc.HeapType = D3D12_HEAP_TYPE_UPLOAD;
+        allocDesc.CreationNodeMask = 2;
+        D3D12MA::Allocation* range = nullptr;
+        CHECK_HR( allocator->AllocateBufferRange(&allocDesc, 256, 0, &range) );
+        D3D12_HEAP_PROPERTIES heapProps = {};
+        CHECK_HR( range->GetResource()->GetHeapProperties(&heapProps, NULL) );
+        CHECK_BOOL( heapProps.Type == D3D12_HEAP_TYPE_UPLOAD && heapProps.CreationNodeMask == 2 );
+        range->Release();
+    }
+    allocator->Release();
+}
+
+static void TestAllocationStrategies(const TestContext& ctx)
+{
+    wprintf(L"Test allocation strategies\n");
+
+    // Offsets checked below assume buffers placed right next to each other.
+#if !(defined(D3D12MA_DEBUG_MARGIN) && D3D12MA_DEBUG_MARGIN > 0)
+    SoftwareDeviceDesc deviceDesc = {};
+    deviceDesc.ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_2;
+    CComPtr<ID3D12Device> device;
+    CHECK_HR( CreateSoftwareDevice(deviceDesc, &device) );
+
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.pDevice = device;
+    allocatorDesc.PreferredBlockSize = 16 * 65536;
+    D3D12MA::Allocator* allocator = nullptr;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+    {
+        D3D12MA::ALLOCATION_DESC allocDesc = {};
+        allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+        D3D12_RESOURCE_DESC resourceDesc;
+
+        // Two full heaps, each with a buffer of 5 * 64 KiB followed by 11 buffers of 64 KiB.
+        // The big one first makes the heaps full-size.
+        std::vector<ResourceWithAllocation> resources(24);
+        for(size_t i = 0; i < resources.size(); ++i)
+        {
+            FillResourceDescForBuffer(resourceDesc, i % 12 == 0 ? 5 * 65536 : 65536);
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&resources[i].resource)) );
+            resources[i].allocation.reset(alloc);
+        }
+        ID3D12Heap* const heap0 = resources[0].allocation->GetHeap();
+        ID3D12Heap* const heap1 = resources[12].allocation->GetHeap();
+        CHECK_BOOL( heap0 != heap1 && resources[11].allocation->GetHeap() == heap0 );
+        const UINT64 offset2 = resources[2].allocation->GetOffset();
+        const UINT64 offset5 = resources[5].allocation->GetOffset();
+        CHECK_BOOL( resources[6].allocation->GetOffset() == offset5 + 65536 &&
+            resources[12].allocation->GetOffset() == 0 );
+
+        // Heap 0: free ranges of 64 KiB and 128 KiB. Heap 1: free range of 320 KiB.
+        resources[2] = ResourceWithAllocation();
+        resources[5] = ResourceWithAllocation();
+        resources[6] = ResourceWithAllocation();
+        resources[12] = ResourceWithAllocation();
+
+        struct StrategyCase
+        {
+            D3D12MA::ALLOCATION_FLAGS flags;
+            UINT64 size;
+            ID3D12Heap* expectedHeap;
+            UINT64 expectedOffset;
+        };
+        const StrategyCase cases[] = {
+            // Best fit: the smallest free range in the most full heap.
+            { D3D12MA::ALLOCATION_FLAG_NONE, 65536, heap0, offset2 },
+            { D3D12MA::ALLOCATION_FLAG_STRATEGY_MIN_MEMORY, 65536, heap0, offset2 },
+            // First fit: the first heap with a large enough free range, its largest one.
+            { D3D12MA::ALLOCATION_FLAG_STRATEGY_MIN_TIME, 65536, heap0, offset5 },
+            { D3D12MA::ALLOCATION_FLAG_STRATEGY_MIN_TIME, 4 * 65536, heap1, 0 },
+            // Worst fit: the largest free range in the least full heap.
+            { D3D12MA::ALLOCATION_FLAG_STRATEGY_MIN_FRAGMENTATION, 65536, heap1, 0 },
+        };
+        for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+        {
+            allocDesc.Flags = cases[i].flags;
+            FillResourceDescForBuffer(resourceDesc, cases[i].size);
+            ResourceWithAllocation res;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) );
+            res.allocation.reset(alloc);
+            CHECK_BOOL( alloc->GetHeap() == cases[i].expectedHeap && alloc->GetOffset() == cases[i].expectedOffset );
+        }
+
+        // More than one strategy.
+        allocDesc.Flags = (D3D12MA::ALLOCATION_FLAGS)(D3D12MA::ALLOCATION_FLAG_STRATEGY_MIN_TIME |
+            D3D12MA::ALLOCATION_FLAG_STRATEGY_MIN_FRAGMENTATION);
+        FillResourceDescForBuffer(resourceDesc, 65536);
+        ResourceWithAllocation res;
+        D3D12MA::Allocation* alloc = nullptr;
+        CHECK_BOOL( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+            &alloc, IID_PPV_ARGS(&res.resource)) == E_INVALIDARG );
+        CHECK_BOOL( allocator->AllocateBufferRange(&allocDesc, 256, 0, &alloc) == E_INVALIDARG );
+
+        // Buffer ranges take the strategy too.
+        for(UINT i = 0; i < 3; ++i)
+        {
+            allocDesc.Flags = (D3D12MA::ALLOCATION_FLAGS)(D3D12MA::ALLOCATION_FLAG_STRATEGY_MIN_MEMORY << i);
+            CHECK_HR( allocator->AllocateBufferRange(&allocDesc, 256, 0, &alloc) );
+            alloc->Release();
+        }
+    }
+    allocator->Release();
+#else
+    wprintf(L"    Skipped, D3D12MA_DEBUG_MARGIN is not 0.\n");
+#endif
+}
+
+static void TestLifetimeHints(const TestContext& ctx)
+{
+    wprintf(L"Test lifetime hints\n");
+
+    SoftwareDeviceDesc deviceDesc = {};
+    deviceDesc.ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_2;
+    CComPtr<ID3D12Device> device;
+    CHECK_HR( CreateSoftwareDevice(deviceDesc, &device) );
+
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.pDevice = device;
+    D3D12MA::Allocator* allocator = nullptr;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+    {
+        D3D12_RESOURCE_DESC resourceDesc;
+        FillResourceDescForBuffer(resourceDesc, 65536);
+
+        const D3D12MA::ALLOCATION_LIFETIME lifetimes[] = {
+            D3D12MA::ALLOCATION_LIFETIME_PERMANENT,
+            D3D12MA::ALLOCATION_LIFETIME_LEVEL,
+            D3D12MA::ALLOCATION_LIFETIME_LEVEL,
+            D3D12MA::ALLOCATION_LIFETIME_DEFAULT,
+        };
+        const size_t lifetimeCount = sizeof(lifetimes) / sizeof(lifetimes[0]);
+        std::vector<ResourceWithAllocation> resources(lifetimeCount);
+        for(size_t i = 0; i < lifetimeCount; ++i)
+        {
+            D3D12MA::ALLOCATION_DESC allocDesc = {};
+            allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+            allocDesc.Lifetime = lifetimes[i];
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&resources[i].resource)) );
+            resources[i].allocation.reset(alloc);
+        }
+
+        // Only allocations of the same lifetime share a heap.
+        for(size_t i = 0; i < lifetimeCount; ++i)
+        {
+            for(size_t j = i + 1; j < lifetimeCount; ++j)
+            {
+                CHECK_BOOL( (resources[i].allocation->GetHeap() == resources[j].allocation->GetHeap()) ==
+                    (lifetimes[i] == lifetimes[j]) );
+            }
+        }
+
+        // Heap of the level becomes empty and takes allocations of another lifetime.
+        ID3D12Heap* const levelHeap = resources[1].allocation->GetHeap();
+        resources[1] = ResourceWithAllocation();
+        resources[2] = ResourceWithAllocation();
+        D3D12MA::ALLOCATION_DESC allocDesc = {};
+        allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+        allocDesc.Lifetime = D3D12MA::ALLOCATION_LIFETIME_FRAME;
+        ResourceWithAllocation frameRes;
+        D3D12MA::Allocation* alloc = nullptr;
+        CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+            &alloc, IID_PPV_ARGS(&frameRes.resource)) );
+        frameRes.allocation.reset(alloc);
+        CHECK_BOOL( alloc->GetHeap() == levelHeap );
+
+        // Buffer ranges.
+        allocDesc.HeapType = D3D12_HEAP_TYPE_UPLOAD;
+        D3D12MA::Allocation* permanentRange = nullptr;
+        allocDesc.Lifetime = D3D12MA::ALLOCATION_LIFETIME_PERMANENT;
+        CHECK_HR( allocator->AllocateBufferRange(&allocDesc, 256, 0, &permanentRange) );
+        D3D12MA::Allocation* frameRange = nullptr;
+        allocDesc.Lifetime = D3D12MA::ALLOCATION_LIFETIME_FRAME;
+        CHECK_HR( allocator->AllocateBufferRange(&allocDesc, 256, 0, &frameRange) );
+        CHECK_BOOL( permanentRange->GetResource() != frameRange->GetResource() );
+        frameRange->Release();
+        permanentRange->Release();
+
+        // Invalid lifetime.
+        allocDesc.Lifetime = D3D12MA::ALLOCATION_LIFETIME_COUNT;
+        ResourceWithAllocation res;
+        CHECK_BOOL( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_GENERIC_READ, NULL,
+            &alloc, IID_PPV_ARGS(&res.resource)) == E_INVALIDARG );
+        CHECK_BOOL( allocator->AllocateBufferRange(&allocDesc, 256, 0, &alloc) == E_INVALIDARG );
+    }
+    allocator->Release();
+}
+
+static void TestAllocationCategories(const TestContext& ctx)
+{
+    wprintf(L"Test allocation categories\n");
+
+    SoftwareDeviceDesc deviceDesc = {};
+    deviceDesc.ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_2;
+    CComPtr<ID3D12Device> device;
+    CHECK_HR( CreateSoftwareDevice(deviceDesc, &device) );
+
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.pDevice = device;
+    D3D12MA::Allocator* allocator = nullptr;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+    {
+        const UINT category = 3;
+        D3D12_RESOURCE_DESC resourceDesc;
+        FillResourceDescForBuffer(resourceDesc, 65536);
+
+        // Placed, committed, and buffer range.
+        std::vector<ResourceWithAllocation> resources(2);
+        for(size_t i = 0; i < resources.size(); ++i)
+        {
+            D3D12MA::ALLOCATION_DESC allocDesc = {};
+            allocDesc.Flags = i == 0 ? D3D12MA::ALLOCATION_FLAG_NONE : D3D12MA::ALLOCATION_FLAG_COMMITTED;
+            allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+            allocDesc.Category = category;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&resources[i].resource)) );
+            resources[i].allocation.reset(alloc);
+            CHECK_BOOL( alloc->GetCategory() == category );
+        }
+        D3D12MA::ALLOCATION_DESC allocDesc = {};
+        allocDesc.HeapType = D3D12_HEAP_TYPE_UPLOAD;
+        allocDesc.Category = category;
+        D3D12MA::Allocation* range = nullptr;
+        CHECK_HR( allocator->AllocateBufferRange(&allocDesc, 256, 0, &range) );
+        CHECK_BOOL( range->GetCategory() == category );
+
+        D3D12MA::CategoryStats stats = {};
+        allocator->GetCategoryStats(category, &stats);
+        const UINT64 expectedBytes = 2 * 65536 + 256;
+        CHECK_BOOL( stats.AllocationCount == 3 && stats.AllocationBytes == expectedBytes && stats.Quota == 0 );
+        allocator->GetCategoryStats(0, &stats);
+        CHECK_BOOL( stats.AllocationCount == 0 && stats.AllocationBytes == 0 );
+
+        // Quota with room for one more buffer.
+        allocator->SetCategoryQuota(category, expectedBytes + 65536);
+        allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+        ResourceWithAllocation res;
+        D3D12MA::Allocation* alloc = nullptr;
+        CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+            &alloc, IID_PPV_ARGS(&res.resource)) );
+        res.allocation.reset(alloc);
+        resources.push_back(std::move(res));
+
+        SoftwareDeviceStats deviceStatsBefore, deviceStatsAfter;
+        CHECK_BOOL( GetSoftwareDeviceStats(device, deviceStatsBefore) );
+        CHECK_BOOL( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+            &alloc, IID_PPV_ARGS(&res.resource)) == E_OUTOFMEMORY );
+        CHECK_BOOL( allocator->AllocateBufferRange(&allocDesc, 256, 0, &alloc) == E_OUTOFMEMORY );
+        // Failed before calling the device.
+        CHECK_BOOL( GetSoftwareDeviceStats(device, deviceStatsAfter) );
+        CHECK_BOOL( deviceStatsAfter.GetResourceAllocationInfoCount == deviceStatsBefore.GetResourceAllocationInfoCount + 1 &&
+            deviceStatsAfter.CreatePlacedResourceCount == deviceStatsBefore.CreatePlacedResourceCount &&
+            deviceStatsAfter.CreateCommittedResourceCount == deviceStatsBefore.CreateCommittedResourceCount );
+        allocator->GetCategoryStats(category, &stats);
+        CHECK_BOOL( stats.AllocationCount == 4 && stats.AllocationBytes == expectedBytes + 65536 &&
+            stats.Quota == expectedBytes + 65536 );
+
+        // Other categories are not limited.
+        allocDesc.Category = category + 1;
+        CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+            &alloc, IID_PPV_ARGS(&res.resource)) );
+        res.allocation.reset(alloc);
+        resources.push_back(std::move(res));
+
+        range->Release();
+        resources.clear();
+        for(UINT i = 0; i < D3D12MA::ALLOCATION_CATEGORY_COUNT; ++i)
+        {
+            allocator->GetCategoryStats(i, &stats);
+            CHECK_BOOL( stats.AllocationCount == 0 && stats.AllocationBytes == 0 );
+        }
+
+        // Invalid category.
+        allocDesc.Category = D3D12MA::ALLOCATION_CATEGORY_COUNT;
+        CHECK_BOOL( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+            &alloc, IID_PPV_ARGS(&res.resource)) == E_INVALIDARG );
+        CHECK_BOOL( allocator->AllocateBufferRange(&allocDesc, 256, 0, &alloc) == E_INVALIDARG );
+    }
+    allocator->Release();
+}
+
+static void TestCategoryQuotaMultithreading(const TestContext& ctx)
+{
+    wprintf(L"Test category quota multithreading\n");
+
+    // Budget of the device smaller than all threads could use, so some creations also fail
+    // after the quota was reserved.
+    SoftwareDeviceDesc deviceDesc = {};
+    deviceDesc.ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_2;
+    deviceDesc.MemoryBudget = 64ull * 1024 * 1024;
+    CComPtr<ID3D12Device> device;
+    CHECK_HR( CreateSoftwareDevice(deviceDesc, &device) );
+
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.pDevice = device;
+    allocatorDesc.PreferredBlockSize = 4ull * 1024 * 1024;
+    D3D12MA::Allocator* allocator = nullptr;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+    {
+        const UINT category = 1;
+        const UINT64 quota = 8ull * 1024 * 1024;
+        allocator->SetCategoryQuota(category, quota);
+
+        const UINT threadCount = 8;
+        const UINT operationCountPerThread = 2000;
+        std::atomic<bool> finished{false};
+        std::atomic<UINT> overQuotaCount{0};
+        std::atomic<UINT> failedCount{0};
+
+        auto checkTotal = [&]()
+        {
+            D3D12MA::CategoryStats stats;
+            allocator->GetCategoryStats(category, &stats);
+            if(stats.AllocationBytes > quota)
+                ++overQuotaCount;
+        };
+
+        std::thread observer([&]()
+        {
+            while(!finished.load())
+                checkTotal();
+        });
+
+        std::vector<std::thread> threads;
+        for(UINT threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+        {
+            threads.emplace_back([&, threadIndex]()
+            {
+                RandomNumberGenerator rand(threadIndex + 1);
+                std::vector<ResourceWithAllocation> resources;
+                for(UINT operationIndex = 0; operationIndex < operationCountPerThread; ++operationIndex)
+                {
+                    if(!resources.empty() && rand.Generate() % 3 == 0)
+                    {
+                        const size_t index = rand.Generate() % resources.size();
+                        resources[index] = std::move(resources.back());
+                        resources.pop_back();
+                        continue;
+                    }
+
+                    D3D12MA::ALLOCATION_DESC allocDesc = {};
+                    allocDesc.Category = category;
+                    ResourceWithAllocation res;
+                    D3D12MA::Allocation* alloc = nullptr;
+                    HRESULT hr;
+                    if(rand.Generate() % 4 == 0)
+                    {
+                        allocDesc.HeapType = D3D12_HEAP_TYPE_UPLOAD;
+                        hr = allocator->AllocateBufferRange(&allocDesc, rand.Generate() % 65536 + 1, 0, &alloc);
+                    }
+                    else
+                    {
+                        allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+                        if(rand.Generate() % 8 == 0)
+                            allocDesc.Flags = D3D12MA::ALLOCATION_FLAG_COMMITTED;
+                        D3D12_RESOURCE_DESC resourceDesc;
+                        FillResourceDescForBuffer(resourceDesc, (rand.Generate() % 16 + 1) * 65536);
+                        hr = allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                            &alloc, IID_PPV_ARGS(&res.resource));
+                    }
+                    if(SUCCEEDED(hr))
+                    {
+                        res.allocation.reset(alloc);
+                        resources.push_back(std::move(res));
+                        checkTotal();
+                    }
+                    else
+                        ++failedCount;
+                }
+            });
+        }
+        for(UINT threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+            threads[threadIndex].join();
+        finished.store(true);
+        observer.join();
+
+        CHECK_BOOL( overQuotaCount.load() == 0 );
+        // The quota was actually reached.
+        CHECK_BOOL( failedCount.load() > 0 );
+        // Reservations of failed calls were returned.
+        D3D12MA::CategoryStats stats;
+        allocator->GetCategoryStats(category, &stats);
+        CHECK_BOOL( stats.AllocationCount == 0 && stats.AllocationBytes == 0 );
+    }
+    allocator->Release();
+}
+
+static void TestAllocationNames(const TestContext& ctx)
+{
+    wprintf(L"Test allocation names\n");
+
+    D3D12MA::ALLOCATION_DESC allocDesc = {};
+    allocDesc.HeapType = D3D12_HEAP_TYPE_UPLOAD;
+    const UINT count = 300;
+    std::vector<D3D12MA::Allocation*> allocations(count);
+    for(UINT i = 0; i < count; ++i)
+    {
+        CHECK_HR( ctx.allocator->AllocateBufferRange(&allocDesc, 256, 0, &allocations[i]) );
+    }
+
+    // Same name is stored once, whether given as a wide or a narrow string.
+    allocations[0]->SetName(L"GBuffer");
+    allocations[1]->SetName(L"GBuffer");
+    allocations[2]->SetNameUtf8("GBuffer");
+    allocations[3]->SetNameUtf8("GBuffer");
+    CHECK_BOOL( wcscmp(allocations[0]->GetName(), L"GBuffer") == 0 );
+    CHECK_BOOL( allocations[1]->GetName() == allocations[0]->GetName() );
+    CHECK_BOOL( wcscmp(allocations[2]->GetName(), L"GBuffer") == 0 );
+    CHECK_BOOL( allocations[3]->GetName() == allocations[2]->GetName() );
+
+    // Name stays valid while any allocation has it. Renaming to the same name keeps it.
+    LPCWSTR const name = allocations[1]->GetName();
+    allocations[0]->SetName(NULL);
+    CHECK_BOOL( allocations[0]->GetName() == NULL );
+    allocations[1]->SetName(L"GBuffer");
+    CHECK_BOOL( allocations[1]->GetName() == name && wcscmp(name, L"GBuffer") == 0 );
+
+    // UTF-8, including a character outside of the basic plane and an invalid byte.
+    allocations[4]->SetNameUtf8("Caf\xC3\xA9 \xF0\x9F\x98\x80\xFF");
+    const wchar_t* expected = sizeof(wchar_t) == 2 ?
+        L"Caf\u00E9 \xD83D\xDE00\uFFFD" : L"Caf\u00E9 \U0001F600\uFFFD";
+    CHECK_BOOL( wcscmp(allocations[4]->GetName(), expected) == 0 );
+
+    // Many distinct names.
+    for(UINT i = 5; i < count; ++i)
+    {
+        wchar_t distinctName[32];
+        swprintf(distinctName, sizeof(distinctName) / sizeof(distinctName[0]), L"ShadowCascade%u", i % 100);
+        allocations[i]->SetName(distinctName);
+    }
+    for(UINT i = 5; i < count; ++i)
+    {
+        wchar_t distinctName[32];
+        swprintf(distinctName, sizeof(distinctName) / sizeof(distinctName[0]), L"ShadowCascade%u", i % 100);
+        CHECK_BOOL( wcscmp(allocations[i]->GetName(), distinctName) == 0 );
+        if(i >= 105)
+        {
+            CHECK_BOOL( allocations[i]->GetName() == allocations[i - 100]->GetName() );
+        }
+    }
+
+    ctx.allocator->FreeAllocations(count / 2, allocations.data());
+    for(UINT i = count / 2; i < count; ++i)
+    {
+        allocations[i]->Release();
+    }
+}
+
+#if D3D12MA_RECORDING_ENABLED
+static void TestRecordAndReplay(const TestContext& ctx)
+{
+    wprintf(L"Test record and replay\n");
+
+    char tempPath[MAX_PATH];
+    const DWORD tempPathLength = GetTempPathA(MAX_PATH, tempPath);
+    CHECK_BOOL( tempPathLength > 0 && tempPathLength < MAX_PATH );
+    const std::string filePath = std::string(tempPath) + "D3D12MA_TestRecordAndReplay.d3d12ma";
+
+    SoftwareDeviceDesc deviceDesc = {};
+    deviceDesc.ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_2;
+    CComPtr<ID3D12Device> device;
+    CHECK_HR( CreateSoftwareDevice(deviceDesc, &device) );
+
+    D3D12MA::RECORD_SETTINGS recordSettings = {};
+    recordSettings.pFilePath = filePath.c_str();
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.pDevice = device;
+    allocatorDesc.PreferredBlockSize = 4 * MEGABYTE;
+    allocatorDesc.pRecordSettings = &recordSettings;
+    D3D12MA::Allocator* allocator = nullptr;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+
+    // A short sequence of every recorded call: placed and committed buffers, a texture, names,
+    // buffer ranges, a category quota that makes some of them fail, single and batch frees.
+    {
+        RandomNumberGenerator rand(1357);
+        std::vector<ResourceWithAllocation> resources;
+        D3D12MA::ALLOCATION_DESC allocDesc = {};
+        allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+        for(UINT i = 0; i < 32; ++i)
+        {
+            allocDesc.Flags = (i % 8) == 7 ? D3D12MA::ALLOCATION_FLAG_COMMITTED : D3D12MA::ALLOCATION_FLAG_NONE;
+            D3D12_RESOURCE_DESC resourceDesc;
+            FillResourceDescForBuffer(resourceDesc, (rand.Generate() % 16 + 1) * 64 * 1024);
+            ResourceWithAllocation res;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) );
+            res.allocation.reset(alloc);
+            if(i % 4 == 0)
+                alloc->SetName(L"Recorded");
+            resources.push_back(std::move(res));
+            if(i % 3 == 2)
+                resources.erase(resources.begin() + rand.Generate() % resources.size());
+        }
+
+        allocDesc.Flags = D3D12MA::ALLOCATION_FLAG_NONE;
+        D3D12_RESOURCE_DESC texDesc = {};
+        texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+        texDesc.Width = 256;
+        texDesc.Height = 256;
+        texDesc.DepthOrArraySize = 1;
+        texDesc.MipLevels = 1;
+        texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        texDesc.SampleDesc.Count = 1;
+        ResourceWithAllocation tex;
+        D3D12MA::Allocation* alloc = nullptr;
+        CHECK_HR( allocator->CreateResource(&allocDesc, &texDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+            &alloc, IID_PPV_ARGS(&tex.resource)) );
+        tex.allocation.reset(alloc);
+
+        allocator->SetCategoryQuota(1, 64 * 1024);
+        allocDesc.HeapType = D3D12_HEAP_TYPE_UPLOAD;
+        allocDesc.Category = 1;
+        std::vector<D3D12MA::Allocation*> ranges;
+        for(UINT i = 0; i < 8; ++i)
+        {
+            if(SUCCEEDED(allocator->AllocateBufferRange(&allocDesc, 16 * 1024, 256, &alloc)))
+                ranges.push_back(alloc);
+        }
+        CHECK_BOOL( ranges.size() == 4 );
+        allocator->FreeAllocations((UINT)ranges.size(), ranges.data());
+    }
+    allocator->Release();
+
+    ReplayConfig replayConfig;
+    replayConfig.filePath = filePath.c_str();
+    {
+        Replayer replayer(replayConfig);
+        CHECK_BOOL( replayer.Run() == 0 );
+        CHECK_BOOL( replayer.GetCreateResultMismatchCount() == 0 );
+        CHECK_BOOL( replayer.GetPlacementMismatchCount() == 0 );
+    }
+    DeleteFileA(filePath.c_str());
+}
+#endif
+
+static void TestGroupVirtual(const TestContext& ctx)
+{
+    TestVirtualBlocks(ctx);
+    TestVirtualBlockSmallUnits(ctx);
+}
+
+static void TestGroupBasics(const TestContext& ctx)
+{
+    TestCommittedResources(ctx);
+    TestPlacedResources(ctx);
+    TestMapping(ctx);
+    if(!ctx.softwareDevice)
+        TestTransfer(ctx);
+#if !D3D12MA_SINGLE_THREADED
+    TestMultithreading(ctx);
+#endif
+    TestBufferRanges(ctx);
+    TestFreeAllocations(ctx);
+    TestLockStats(ctx);
+    TestLatencyStats(ctx);
+    TestTraceEvents(ctx);
+    TestDeviceMemoryCallbacks(ctx);
+    TestAdaptiveBlockSize(ctx);
+    TestEmptyBlockRetention(ctx);
+    TestHeapRecycling(ctx);
+    TestSmallAlignment(ctx);
+    TestMsaaPools(ctx);
+    TestUmaCustomHeaps(ctx);
+    TestNodeMasks(ctx);
+    TestAllocationStrategies(ctx);
+    TestLifetimeHints(ctx);
+    TestAllocationCategories(ctx);
+#if !D3D12MA_SINGLE_THREADED
+    TestCategoryQuotaMultithreading(ctx);
+#endif
+    TestAllocationNames(ctx);
+#if D3D12MA_RECORDING_ENABLED
+    TestRecordAndReplay(ctx);
+#endif
+    TestSoftwareDevice(ctx);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+
+// Written in every row of the results, to tell apart results of different versions of the code.
+static const char* const CODE_DESCRIPTION = "D3D12MA 1.0.0";
+
+// Appends rows to a CSV file. Writes the header row only if the file was empty.
+// Every benchmark has its own file, named resultsFilePrefix + benchmarkName + ".csv".
+class BenchmarkResultsFile
+{
+public:
+    BenchmarkResultsFile(const wchar_t* resultsFilePrefix, const wchar_t* benchmarkName, const char* headerRow);
+    ~BenchmarkResultsFile() { if(m_File) fclose(m_File); }
+    void WriteRow(const char* format, ...);
+
+private:
+    FILE* m_File = nullptr;
+};
+
+BenchmarkResultsFile::BenchmarkResultsFile(const wchar_t* resultsFilePrefix, const wchar_t* benchmarkName, const char* headerRow)
+{
+    const std::wstring filePath = std::wstring(resultsFilePrefix) + benchmarkName + L".csv";
+    _wfopen_s(&m_File, filePath.c_str(), L"a");
+    CHECK_BOOL(m_File);
+    fseek(m_File, 0, SEEK_END);
+    if(ftell(m_File) == 0)
+        fprintf(m_File, "Code,%s\n", headerRow);
+}
+
+void BenchmarkResultsFile::WriteRow(const char* format, ...)
+{
+    fprintf(m_File, "%s,", CODE_DESCRIPTION);
+    va_list argList;
+    va_start(argList, format);
+    vfprintf(m_File, format, argList);
+    va_end(argList);
+    fprintf(m_File, "\n");
+    fflush(m_File);
+}
+
+// Percentile of values sorted ascending, e.g. p = 0.99.
+static UINT64 GetPercentile(const std::vector<UINT64>& sortedValues, double p)
+{
+    if(sortedValues.empty())
+        return 0;
+    const size_t index = std::min<size_t>((size_t)(p * sortedValues.size()), sortedValues.size() - 1);
+    return sortedValues[index];
+}
+
+// CPU allocation callbacks that count bytes currently allocated.
+struct CpuAllocationCounter
+{
+    std::atomic<size_t> currentBytes{0};
+    std::atomic<size_t> currentCount{0};
+};
+
+static void* CountingAllocate(size_t Size, size_t Alignment, void* pUserData)
+{
+    // Size and offset of the original pointer are kept before the returned pointer.
+    const size_t alignment = std::max(Alignment, alignof(size_t));
+    const size_t headerSize = AlignUp(2 * sizeof(size_t), alignment);
+    char* const memory = (char*)_aligned_malloc(Size + headerSize, alignment);
+    if(!memory)
+        return nullptr;
+    char* const result = memory + headerSize;
+    ((size_t*)result)[-1] = Size;
+    ((size_t*)result)[-2] = headerSize;
+    CpuAllocationCounter* const counter = (CpuAllocationCounter*)pUserData;
+    counter->currentBytes += Size;
+    ++counter->currentCount;
+    return result;
+}
+
+static void CountingFree(void* pMemory, void* pUserData)
+{
+    if(!pMemory)
+        return;
+    const size_t size = ((size_t*)pMemory)[-1];
+    const size_t headerSize = ((size_t*)pMemory)[-2];
+    CpuAllocationCounter* const counter = (CpuAllocationCounter*)pUserData;
+    counter->currentBytes -= size;
+    --counter->currentCount;
+    _aligned_free((char*)pMemory - headerSize);
+}
+
+enum class SIZE_DISTRIBUTION { UNIFORM, LOG_NORMAL, BIMODAL, COUNT };
+static const char* const SIZE_DISTRIBUTION_NAMES[] = { "Uniform", "LogNormal", "Bimodal" };
+enum class FREE_ORDER { RANDOM, FIFO, LIFO, COUNT };
+static const char* const FREE_ORDER_NAMES[] = { "Random", "FIFO", "LIFO" };
+enum class ALIGNMENT_MIX { SMALL, SMALL_AND_MSAA, COUNT };
+static const char* const ALIGNMENT_MIX_NAMES[] = { "64K", "64K+4M" };
+
+// Sizes of resources, which are always multiples of 64 KiB.
+class AllocationSizeGenerator
+{
+public:
+    AllocationSizeGenerator(SIZE_DISTRIBUTION distribution, ALIGNMENT_MIX alignmentMix, UINT seed) :
+        m_Distribution(distribution), m_AlignmentMix(alignmentMix), m_Engine(seed) { }
+    void Generate(UINT64& outSize, UINT64& outAlignment);
+
+private:
+    static const UINT64 PAGE = 64 * 1024;
+    const SIZE_DISTRIBUTION m_Distribution;
+    const ALIGNMENT_MIX m_AlignmentMix;
+    std::mt19937 m_Engine;
+};
+
+void AllocationSizeGenerator::Generate(UINT64& outSize, UINT64& outAlignment)
+{
+    UINT64 pageCount = 1;
+    switch(m_Distribution)
+    {
+    case SIZE_DISTRIBUTION::UNIFORM:
+        // 64 KiB .. 4 MiB
+        pageCount = std::uniform_int_distribution<UINT64>(1, 64)(m_Engine);
+        break;
+    case SIZE_DISTRIBUTION::LOG_NORMAL:
+    {
+        // Median 256 KiB, most between 64 KiB and 2 MiB, with a long tail up to 32 MiB.
+        const double bytes = std::lognormal_distribution<double>(log(256.0 * 1024.0), 1.0)(m_Engine);
+        pageCount = std::min<UINT64>(std::max<UINT64>((UINT64)ceil(bytes / PAGE), 1), 512);
+        break;
+    }
+    case SIZE_DISTRIBUTION::BIMODAL:
+        // 80% small buffers and textures of 64..256 KiB, 20% large render targets of 4..16 MiB.
+        if(std::uniform_int_distribution<UINT>(0, 99)(m_Engine) < 80)
+            pageCount = std::uniform_int_distribution<UINT64>(1, 4)(m_Engine);
+        else
+            pageCount = std::uniform_int_distribution<UINT64>(64, 256)(m_Engine);
+        break;
+    default:
+        assert(0);
+    }
+    outSize = pageCount * PAGE;
+
+    outAlignment = PAGE;
+    // Every 10th resource is MSAA, requiring 4 MiB alignment.
+    if(m_AlignmentMix == ALIGNMENT_MIX::SMALL_AND_MSAA && std::uniform_int_distribution<UINT>(0, 9)(m_Engine) == 0)
+        outAlignment = 4 * MEGABYTE;
+}
+
+/*
+Drives the metadata of a single block through a VirtualBlock: fills it to about half,
+then frees and allocates alternately in given order. Every call is timed.
+*/
+static void BenchmarkMetadataCase(
+    BenchmarkResultsFile& resultsFile,
+    SIZE_DISTRIBUTION distribution,
+    FREE_ORDER freeOrder,
+    ALIGNMENT_MIX alignmentMix)
+{
+    const UINT64 blockSize = 256 * MEGABYTE;
+    const size_t operationCount = 100000;
+
+    CpuAllocationCounter cpuCounter;
+    D3D12MA::ALLOCATION_CALLBACKS allocationCallbacks = {};
+    allocationCallbacks.pAllocate = &CountingAllocate;
+    allocationCallbacks.pFree = &CountingFree;
+    allocationCallbacks.pUserData = &cpuCounter;
+
+    D3D12MA::VIRTUAL_BLOCK_DESC blockDesc = {};
+    blockDesc.Size = blockSize;
+    blockDesc.pAllocationCallbacks = &allocationCallbacks;
+    D3D12MA::VirtualBlock* block;
+    CHECK_HR( D3D12MA::CreateVirtualBlock(&blockDesc, &block) );
+
+    AllocationSizeGenerator sizeGenerator(distribution, alignmentMix, 13579);
+    std::mt19937 freeOrderEngine(24680);
+    // Offsets of live allocations, oldest first.
+    std::vector<UINT64> liveOffsets;
+    liveOffsets.reserve(16 * 1024);
+    std::vector<UINT64> latencies;
+    latencies.reserve(operationCount);
+    UINT64 liveBytes = 0;
+    size_t failedAllocationCount = 0;
+    size_t maxCpuBytes = 0, maxAllocationCount = 0;
+
+    auto allocate = [&]() -> bool
+    {
+        D3D12MA::VIRTUAL_ALLOCATION_DESC allocDesc = {};
+        sizeGenerator.Generate(allocDesc.Size, allocDesc.Alignment);
+        allocDesc.pUserData = (void*)(uintptr_t)allocDesc.Size;
+        UINT64 offset;
+        const time_point timeBeg = std::chrono::high_resolution_clock::now();
+        const HRESULT hr = block->Allocate(&allocDesc, &offset);
+        latencies.push_back((UINT64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::high_resolution_clock::now() - timeBeg).count());
+        if(FAILED(hr))
+        {
+            ++failedAllocationCount;
+            return false;
+        }
+        liveOffsets.push_back(offset);
+        liveBytes += allocDesc.Size;
+        return true;
+    };
+    auto freeAlloc = [&]()
+    {
+        size_t index = 0;
+        switch(freeOrder)
+        {
+        case FREE_ORDER::RANDOM:
+            index = std::uniform_int_distribution<size_t>(0, liveOffsets.size() - 1)(freeOrderEngine);
+            break;
+        case FREE_ORDER::FIFO:
+            index = 0;
+            break;
+        case FREE_ORDER::LIFO:
+            index = liveOffsets.size() - 1;
+            break;
+        default:
+            assert(0);
+        }
+        const UINT64 offset = liveOffsets[index];
+        D3D12MA::VIRTUAL_ALLOCATION_INFO allocInfo;
+        block->GetAllocationInfo(offset, &allocInfo);
+        const time_point timeBeg = std::chrono::high_resolution_clock::now();
+        block->FreeAllocation(offset);
+        latencies.push_back((UINT64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::high_resolution_clock::now() - timeBeg).count());
+        liveBytes -= allocInfo.Size;
+        liveOffsets.erase(liveOffsets.begin() + index);
+    };
+
+    const time_point timeBeg = std::chrono::high_resolution_clock::now();
+    while(latencies.size() < operationCount)
+    {
+        // Keep the block about half full, so both allocations and frees happen all the time.
+        if(liveBytes < blockSize / 2 || liveOffsets.empty())
+        {
+            if(!allocate() && !liveOffsets.empty())
+                freeAlloc();
+        }
+        else
+            freeAlloc();
+
+        maxCpuBytes = std::max<size_t>(maxCpuBytes, cpuCounter.currentBytes);
+        maxAllocationCount = std::max(maxAllocationCount, liveOffsets.size());
+    }
+    const duration totalDuration = std::chrono::high_resolution_clock::now() - timeBeg;
+
+    // Fragmentation of free space: 0 when it's all one range, close to 1 when it's scattered in tiny ranges.
+    D3D12MA::StatInfo stats;
+    block->CalculateStats(&stats);
+    const double fragmentation = stats.UnusedBytes > 0 ?
+        1.0 - (double)stats.UnusedRangeSizeMax / (double)stats.UnusedBytes : 0.0;
+
+    block->Clear();
+    block->Release();
+    CHECK_BOOL(cpuCounter.currentBytes == 0 && cpuCounter.currentCount == 0);
+
+    std::sort(latencies.begin(), latencies.end());
+    const double seconds = std::chrono::duration<double>(totalDuration).count();
+    const double opsPerSecond = seconds > 0.0 ? (double)latencies.size() / seconds : 0.0;
+    // Peak CPU memory of the block, including the memory it preallocates, per peak number of allocations.
+    const double metadataBytesPerAllocation = maxAllocationCount > 0 ?
+        (double)maxCpuBytes / (double)maxAllocationCount : 0.0;
+    const UINT64 p50 = GetPercentile(latencies, 0.5);
+    const UINT64 p99 = GetPercentile(latencies, 0.99);
+    const UINT64 p999 = GetPercentile(latencies, 0.999);
+
+    wprintf(L"    %-9hs %-6hs %-6hs: %.0f ops/s, p50 %llu ns, p99 %llu ns, p999 %llu ns, %.1f B/alloc, fragmentation %.3f, %zu failed\n",
+        SIZE_DISTRIBUTION_NAMES[(size_t)distribution], FREE_ORDER_NAMES[(size_t)freeOrder], ALIGNMENT_MIX_NAMES[(size_t)alignmentMix],
+        opsPerSecond, p50, p99, p999, metadataBytesPerAllocation, fragmentation, failedAllocationCount);
+    resultsFile.WriteRow("%s,%s,%s,%zu,%zu,%.0f,%llu,%llu,%llu,%.1f,%.4f",
+        SIZE_DISTRIBUTION_NAMES[(size_t)distribution], FREE_ORDER_NAMES[(size_t)freeOrder], ALIGNMENT_MIX_NAMES[(size_t)alignmentMix],
+        latencies.size(), failedAllocationCount, opsPerSecond, p50, p99, p999, metadataBytesPerAllocation, fragmentation);
+}
+
+static void BenchmarkMetadata(const wchar_t* resultsFilePrefix)
+{
+    wprintf(L"Benchmark metadata\n");
+
+    BenchmarkResultsFile resultsFile(resultsFilePrefix, L"Metadata",
+        "SizeDistribution,FreeOrder,Alignment,Operations,FailedAllocations,"
+        "OpsPerSecond,LatencyP50Ns,LatencyP99Ns,LatencyP999Ns,MetadataBytesPerAllocation,Fragmentation");
+
+    for(size_t distribution = 0; distribution < (size_t)SIZE_DISTRIBUTION::COUNT; ++distribution)
+    {
+        for(size_t freeOrder = 0; freeOrder < (size_t)FREE_ORDER::COUNT; ++freeOrder)
+        {
+            for(size_t alignmentMix = 0; alignmentMix < (size_t)ALIGNMENT_MIX::COUNT; ++alignmentMix)
+            {
+                BenchmarkMetadataCase(resultsFile, (SIZE_DISTRIBUTION)distribution, (FREE_ORDER)freeOrder,
+                    (ALIGNMENT_MIX)alignmentMix);
+            }
+        }
+    }
+}
+
+enum class LOCKING { INTERNAL, GLOBAL_LOCK, COUNT };
+static const char* const LOCKING_NAMES[] = { "Internal", "GlobalLock" };
+enum class DEVICE_LATENCY { NONE, DRIVER, COUNT };
+static const char* const DEVICE_LATENCY_NAMES[] = { "None", "Driver" };
+
+/*
+Creates and releases resources through the Allocator from threadCount threads at once.
+With LOCKING::GLOBAL_LOCK, the allocator is created with ALLOCATOR_FLAG_SINGLETHREADED and every
+call to it is guarded by a single mutex, like an application would do without relying on the
+synchronization inside the library.
+*/
+static void BenchmarkScalingCase(
+    BenchmarkResultsFile& resultsFile,
+    LOCKING locking,
+    DEVICE_LATENCY deviceLatency,
+    UINT threadCount)
+{
+    const UINT operationCountPerThread = 2000;
+    const size_t maxResourceCountPerThread = 128;
+
+    SoftwareDeviceDesc deviceDesc = {};
+    deviceDesc.ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_2;
+    if(deviceLatency == DEVICE_LATENCY::DRIVER)
+    {
+        // Rough order of magnitude of real drivers: creating a heap or a committed resource is a kernel call.
+        deviceDesc.CreateHeapLatency = 200;
+        deviceDesc.CreateCommittedResourceLatency = 100;
+        deviceDesc.CreatePlacedResourceLatency = 10;
+        deviceDesc.GetResourceAllocationInfoLatency = 1;
+        deviceDesc.ReleaseLatency = 20;
+    }
+    CComPtr<ID3D12Device> device;
+    CHECK_HR( CreateSoftwareDevice(deviceDesc, &device) );
+
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.pDevice = device;
+    allocatorDesc.Flags = locking == LOCKING::GLOBAL_LOCK ?
+        D3D12MA::ALLOCATOR_FLAG_SINGLETHREADED : D3D12MA::ALLOCATOR_FLAG_NONE;
+    D3D12MA::Allocator* allocator;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+
+    std::mutex globalMutex;
+    std::atomic<UINT> readyThreadCount{0};
+    std::atomic<bool> start{false};
+    std::vector<std::vector<UINT64>> threadLatencies(threadCount);
+
+    auto threadFunc = [&](UINT threadIndex)
+    {
+        RandomNumberGenerator rand(threadIndex + 1);
+        std::vector<UINT64>& latencies = threadLatencies[threadIndex];
+        latencies.reserve(operationCountPerThread);
+        std::vector<ResourceWithAllocation> resources;
+        resources.reserve(maxResourceCountPerThread);
+
+        ++readyThreadCount;
+        while(!start.load())
+            std::this_thread::yield();
+
+        for(UINT operationIndex = 0; operationIndex < operationCountPerThread; ++operationIndex)
+        {
+            const bool release = resources.size() == maxResourceCountPerThread ||
+                (!resources.empty() && rand.Generate() % 2 == 0);
+            if(release)
+            {
+                const size_t index = rand.Generate() % resources.size();
+                D3D12MA::Allocation* const alloc = resources[index].allocation.release();
+                resources[index].resource.Release();
+
+                const time_point timeBeg = std::chrono::high_resolution_clock::now();
+                if(locking == LOCKING::GLOBAL_LOCK)
+                {
+                    std::lock_guard<std::mutex> lock(globalMutex);
+                    alloc->Release();
+                }
+                else
+                    alloc->Release();
+                latencies.push_back((UINT64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::high_resolution_clock::now() - timeBeg).count());
+
+                resources[index] = std::move(resources.back());
+                resources.pop_back();
+            }
+            else
+            {
+                D3D12MA::ALLOCATION_DESC allocDesc = {};
+                allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+                D3D12_RESOURCE_DESC resourceDesc;
+                const UINT kind = rand.Generate() % 100;
+                if(kind < 70)
+                {
+                    // Buffer 4 KiB .. 1 MiB.
+                    FillResourceDescForBuffer(resourceDesc, AlignUp<UINT64>(rand.Generate() % (1024 * 1024) + 1, 4096));
+                }
+                else if(kind < 95)
+                {
+                    // Texture 256x256 .. 1024x1024.
+                    const UINT size = 256u << (rand.Generate() % 3);
+                    resourceDesc = {};
+                    resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+                    resourceDesc.Width = size;
+                    resourceDesc.Height = size;
+                    resourceDesc.DepthOrArraySize = 1;
+                    resourceDesc.MipLevels = 1;
+                    resourceDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+                    resourceDesc.SampleDesc.Count = 1;
+                    resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+                }
+                else
+                {
+                    // Large buffer in its own committed resource.
+                    FillResourceDescForBuffer(resourceDesc, 32 * MEGABYTE);
+                    allocDesc.Flags = D3D12MA::ALLOCATION_FLAG_COMMITTED;
+                }
+
+                ResourceWithAllocation res;
+                D3D12MA::Allocation* alloc = nullptr;
+                HRESULT hr;
+                const time_point timeBeg = std::chrono::high_resolution_clock::now();
+                if(locking == LOCKING::GLOBAL_LOCK)
+                {
+                    std::lock_guard<std::mutex> lock(globalMutex);
+                    hr = allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                        &alloc, IID_PPV_ARGS(&res.resource));
+                }
+                else
+                {
+                    hr = allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                        &alloc, IID_PPV_ARGS(&res.resource));
+                }
+                latencies.push_back((UINT64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::high_resolution_clock::now() - timeBeg).count());
+                CHECK_HR(hr);
+                res.allocation.reset(alloc);
+                resources.push_back(std::move(res));
+            }
+        }
+
+        // Release remaining resources, not measured.
+        if(locking == LOCKING::GLOBAL_LOCK)
+        {
+            std::lock_guard<std::mutex> lock(globalMutex);
+            resources.clear();
+        }
+        else
+            resources.clear();
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount);
+    for(UINT threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+        threads.push_back(std::thread(threadFunc, threadIndex));
+    while(readyThreadCount.load() < threadCount)
+        std::this_thread::yield();
+
+    const time_point timeBeg = std::chrono::high_resolution_clock::now();
+    start = true;
+    for(UINT threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+        threads[threadIndex].join();
+    const duration totalDuration = std::chrono::high_resolution_clock::now() - timeBeg;
+
+    // Time spent waiting on internal mutexes, available only when the library is compiled with D3D12MA_LOCK_STATS.
+    D3D12MA::LockStats lockStats;
+    const bool lockStatsAvailable = SUCCEEDED(allocator->GetLockStats(&lockStats));
+    UINT64 poolWaitTime = 0, committedWaitTime = 0;
+    if(lockStatsAvailable)
+    {
+        for(UINT i = 0; i < lockStats.DefaultPoolCount; ++i)
+            poolWaitTime += lockStats.DefaultPools[i].Lock.WaitTimeTotal;
+        for(size_t i = 0; i < sizeof(lockStats.CommittedAllocations) / sizeof(lockStats.CommittedAllocations[0]); ++i)
+            committedWaitTime += lockStats.CommittedAllocations[i].WaitTimeTotal;
+    }
+
+    allocator->Release();
+
+    std::vector<UINT64> latencies;
+    latencies.reserve((size_t)operationCountPerThread * threadCount);
+    for(UINT threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+        latencies.insert(latencies.end(), threadLatencies[threadIndex].begin(), threadLatencies[threadIndex].end());
+    std::sort(latencies.begin(), latencies.end());
+
+    const double seconds = std::chrono::duration<double>(totalDuration).count();
+    const double opsPerSecond = seconds > 0.0 ? (double)latencies.size() / seconds : 0.0;
+    const UINT64 p50 = GetPercentile(latencies, 0.5);
+    const UINT64 p99 = GetPercentile(latencies, 0.99);
+    const UINT64 p999 = GetPercentile(latencies, 0.999);
+
+    wprintf(L"    %-10hs latency %-6hs %2u threads: %.0f ops/s, p50 %llu ns, p99 %llu ns, p999 %llu ns",
+        LOCKING_NAMES[(size_t)locking], DEVICE_LATENCY_NAMES[(size_t)deviceLatency], threadCount,
+        opsPerSecond, p50, p99, p999);
+    if(lockStatsAvailable)
+        wprintf(L", waited on pools %llu ns, on committed %llu ns", poolWaitTime, committedWaitTime);
+    wprintf(L"\n");
+
+    // Wait times are left empty when not available.
+    char waitTimes[64] = ",";
+    if(lockStatsAvailable)
+        snprintf(waitTimes, sizeof(waitTimes), "%llu,%llu", poolWaitTime, committedWaitTime);
+    resultsFile.WriteRow("%s,%s,%u,%zu,%.0f,%llu,%llu,%llu,%s",
+        LOCKING_NAMES[(size_t)locking], DEVICE_LATENCY_NAMES[(size_t)deviceLatency], threadCount,
+        latencies.size(), opsPerSecond, p50, p99, p999, waitTimes);
+}
+
+static void BenchmarkScaling(const wchar_t* resultsFilePrefix)
+{
+    wprintf(L"Benchmark scaling\n");
+
+    BenchmarkResultsFile resultsFile(resultsFilePrefix, L"Scaling",
+        "Locking,DeviceLatency,Threads,Operations,OpsPerSecond,LatencyP50Ns,LatencyP99Ns,LatencyP999Ns,"
+        "PoolWaitNs,CommittedWaitNs");
+
+    const UINT maxThreadCount = std::min(std::max(std::thread::hardware_concurrency(), 1u), 32u);
+    for(size_t deviceLatency = 0; deviceLatency < (size_t)DEVICE_LATENCY::COUNT; ++deviceLatency)
+    {
+        for(size_t locking = 0; locking < (size_t)LOCKING::COUNT; ++locking)
+        {
+#if D3D12MA_SINGLE_THREADED
+            // Internal locks are compiled out, so threads must be serialized by the global lock.
+            if((LOCKING)locking == LOCKING::INTERNAL)
+                continue;
+#endif
+            for(UINT threadCount = 1; ; threadCount = std::min(threadCount * 2, maxThreadCount))
+            {
+                BenchmarkScalingCase(resultsFile, (LOCKING)locking, (DEVICE_LATENCY)deviceLatency, threadCount);
+                if(threadCount == maxThreadCount)
+                    break;
+            }
+        }
+    }
+}
+
+/*
+Creates a random mix of buffers, render targets and multisampled render targets in
+DEFAULT heap, then keeps replacing random ones, and measures how much more memory the
+software device holds in heaps than the resources occupy.
+*/
+static void BenchmarkFragmentationCase(BenchmarkResultsFile& resultsFile, D3D12_RESOURCE_HEAP_TIER resourceHeapTier)
+{
+    const size_t resourceCount = 1024;
+    const UINT operationCount = 20000;
+
+    SoftwareDeviceDesc deviceDesc = {};
+    deviceDesc.ResourceHeapTier = resourceHeapTier;
+    CComPtr<ID3D12Device> device;
+    CHECK_HR( CreateSoftwareDevice(deviceDesc, &device) );
+
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.pDevice = device;
+    D3D12MA::Allocator* allocator;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+
+    RandomNumberGenerator rand(1);
+    std::vector<ResourceWithAllocation> resources;
+    resources.reserve(resourceCount);
+    UINT64 resourceBytes = 0, maxResourceBytes = 0, heapBytesSum = 0, resourceBytesSum = 0;
+    for(UINT operationIndex = 0; operationIndex < resourceCount + operationCount; ++operationIndex)
+    {
+        // After the resources are created, release a random one before creating each next one.
+        if(resources.size() == resourceCount)
+        {
+            const size_t index = rand.Generate() % resources.size();
+            resourceBytes -= resources[index].allocation->GetSize();
+            resources[index] = std::move(resources.back());
+            resources.pop_back();
+        }
+        {
+            D3D12MA::ALLOCATION_DESC allocDesc = {};
+            allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+            D3D12_RESOURCE_DESC resourceDesc;
+            const UINT kind = rand.Generate() % 100;
+            if(kind < 40)
+            {
+                // Buffer 4 KiB .. 1 MiB.
+                FillResourceDescForBuffer(resourceDesc, AlignUp<UINT64>(rand.Generate() % (1024 * 1024) + 1, 4096));
+            }
+            else if(kind < 80)
+            {
+                // Render target 128x128 .. 1024x1024.
+                FillResourceDescForRenderTarget(resourceDesc, 128u << (rand.Generate() % 4), 1);
+            }
+            else
+            {
+                // Multisampled render target 128x128 .. 1024x1024, 4 samples.
+                FillResourceDescForRenderTarget(resourceDesc, 128u << (rand.Generate() % 4), 4);
+            }
+
+            ResourceWithAllocation res;
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&res.resource)) );
+            res.allocation.reset(alloc);
+            resourceBytes += alloc->GetSize();
+            maxResourceBytes = std::max(maxResourceBytes, resourceBytes);
+            resources.push_back(std::move(res));
+        }
+
+        // Steady state only.
+        if(operationIndex >= resourceCount)
+        {
+            SoftwareDeviceStats deviceStats;
+            CHECK_BOOL( GetSoftwareDeviceStats(device, deviceStats) );
+            heapBytesSum += deviceStats.UsedBytes;
+            resourceBytesSum += resourceBytes;
+        }
+    }
+
+    SoftwareDeviceStats deviceStats;
+    CHECK_BOOL( GetSoftwareDeviceStats(device, deviceStats) );
+    resources.clear();
+    allocator->Release();
+
+    // Bytes held by the device per byte of live resources, averaged over the run and at the peaks.
+    const double averageOverhead = resourceBytesSum > 0 ? (double)heapBytesSum / (double)resourceBytesSum : 0.0;
+    const double peakOverhead = maxResourceBytes > 0 ? (double)deviceStats.MaxUsedBytes / (double)maxResourceBytes : 0.0;
+
+    const char* const tierName = resourceHeapTier == D3D12_RESOURCE_HEAP_TIER_1 ? "Tier1" : "Tier2";
+    wprintf(L"    %hs: peak resources %llu MiB, peak heaps %llu MiB, overhead average %.3f, peak %.3f\n",
+        tierName, maxResourceBytes / MEGABYTE, deviceStats.MaxUsedBytes / MEGABYTE, averageOverhead, peakOverhead);
+    resultsFile.WriteRow("%s,%u,%llu,%llu,%.4f,%.4f",
+        tierName, operationCount, maxResourceBytes, deviceStats.MaxUsedBytes, averageOverhead, peakOverhead);
+}
+
+static void BenchmarkFragmentation(const wchar_t* resultsFilePrefix)
+{
+    wprintf(L"Benchmark fragmentation\n");
+
+    BenchmarkResultsFile resultsFile(resultsFilePrefix, L"Fragmentation",
+        "ResourceHeapTier,Operations,PeakResourceBytes,PeakHeapBytes,AverageOverhead,PeakOverhead");
+
+    BenchmarkFragmentationCase(resultsFile, D3D12_RESOURCE_HEAP_TIER_2);
+    BenchmarkFragmentationCase(resultsFile, D3D12_RESOURCE_HEAP_TIER_1);
+}
+
+static void CreateRandomResource(D3D12MA::Allocator* allocator, RandomNumberGenerator& rand,
+    D3D12MA::ALLOCATION_LIFETIME lifetime, ResourceWithAllocation& outRes)
+{
+    D3D12MA::ALLOCATION_DESC allocDesc = {};
+    allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+    allocDesc.Lifetime = lifetime;
+    D3D12_RESOURCE_DESC resourceDesc;
+    if(rand.Generate() % 2)
+    {
+        // Buffer 4 KiB .. 1 MiB.
+        FillResourceDescForBuffer(resourceDesc, AlignUp<UINT64>(rand.Generate() % (1024 * 1024) + 1, 4096));
+    }
+    else
+    {
+        // Render target 128x128 .. 1024x1024.
+        FillResourceDescForRenderTarget(resourceDesc, 128u << (rand.Generate() % 4), 1);
+    }
+    D3D12MA::Allocation* alloc = nullptr;
+    CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+        &alloc, IID_PPV_ARGS(&outRes.resource)) );
+    outRes.allocation.reset(alloc);
+}
+
+/*
+Plays levels: each one loads level resources with some permanent ones among them, then
+runs frames creating resources released a few frames later, then releases all but the
+permanent ones. Measures how many heaps the unload of a level releases, and how much more
+memory than the permanent resources occupy stays in heaps after it - with and without
+lifetime hints.
+*/
+static void BenchmarkLifetimesCase(BenchmarkResultsFile& resultsFile, bool useLifetimeHints)
+{
+    const UINT levelCount = 8;
+    const UINT levelResourceCount = 512;
+    // Every this many resources created while loading a level is permanent.
+    const UINT permanentResourceInterval = 16;
+    const UINT frameCount = 200;
+    const UINT resourcesPerFrame = 8;
+    const UINT frameResourceLatency = 3;
+
+    SoftwareDeviceDesc deviceDesc = {};
+    deviceDesc.ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_2;
+    CComPtr<ID3D12Device> device;
+    CHECK_HR( CreateSoftwareDevice(deviceDesc, &device) );
+
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.pDevice = device;
+    D3D12MA::Allocator* allocator;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+
+    const D3D12MA::ALLOCATION_LIFETIME permanentLifetime =
+        useLifetimeHints ? D3D12MA::ALLOCATION_LIFETIME_PERMANENT : D3D12MA::ALLOCATION_LIFETIME_DEFAULT;
+    const D3D12MA::ALLOCATION_LIFETIME levelLifetime =
+        useLifetimeHints ? D3D12MA::ALLOCATION_LIFETIME_LEVEL : D3D12MA::ALLOCATION_LIFETIME_DEFAULT;
+    const D3D12MA::ALLOCATION_LIFETIME frameLifetime =
+        useLifetimeHints ? D3D12MA::ALLOCATION_LIFETIME_FRAME : D3D12MA::ALLOCATION_LIFETIME_DEFAULT;
+
+    RandomNumberGenerator rand(1);
+    std::vector<ResourceWithAllocation> permanentResources;
+    UINT64 permanentBytes = 0, heapCountBeforeUnloadSum = 0, releasedHeapCountSum = 0;
+    UINT64 heapBytesAfterUnloadSum = 0, permanentBytesAfterUnloadSum = 0;
+    for(UINT levelIndex = 0; levelIndex < levelCount; ++levelIndex)
+    {
+        std::vector<ResourceWithAllocation> levelResources(levelResourceCount);
+        for(UINT i = 0; i < levelResourceCount; ++i)
+        {
+            if(i % permanentResourceInterval == 0)
+            {
+                ResourceWithAllocation res;
+                CreateRandomResource(allocator, rand, permanentLifetime, res);
+                permanentBytes += res.allocation->GetSize();
+                permanentResources.push_back(std::move(res));
+            }
+            CreateRandomResource(allocator, rand, levelLifetime, levelResources[i]);
+        }
+
+        std::vector<ResourceWithAllocation> frameResources(frameResourceLatency * resourcesPerFrame);
+        for(UINT frameIndex = 0; frameIndex < frameCount; ++frameIndex)
+        {
+            for(UINT i = 0; i < resourcesPerFrame; ++i)
+            {
+                ResourceWithAllocation& res = frameResources[(frameIndex % frameResourceLatency) * resourcesPerFrame + i];
+                res = ResourceWithAllocation();
+                CreateRandomResource(allocator, rand, frameLifetime, res);
+            }
+        }
+
+        SoftwareDeviceStats deviceStats;
+        CHECK_BOOL( GetSoftwareDeviceStats(device, deviceStats) );
+        const UINT64 heapCountBeforeUnload = deviceStats.HeapCount;
+
+        frameResources.clear();
+        levelResources.clear();
+
+        CHECK_BOOL( GetSoftwareDeviceStats(device, deviceStats) );
+        heapCountBeforeUnloadSum += heapCountBeforeUnload;
+        releasedHeapCountSum += heapCountBeforeUnload - deviceStats.HeapCount;
+        heapBytesAfterUnloadSum += deviceStats.UsedBytes;
+        permanentBytesAfterUnloadSum += permanentBytes;
+    }
+
+    permanentResources.clear();
+    allocator->Release();
+
+    // Fraction of heaps released by unloading a level, and bytes held by the device after it
+    // per byte of permanent resources.
+    const double heapReleaseRate = heapCountBeforeUnloadSum > 0 ?
+        (double)releasedHeapCountSum / (double)heapCountBeforeUnloadSum : 0.0;
+    const double overheadAfterUnload = permanentBytesAfterUnloadSum > 0 ?
+        (double)heapBytesAfterUnloadSum / (double)permanentBytesAfterUnloadSum : 0.0;
+
+    const char* const hintsName = useLifetimeHints ? "Hints" : "NoHints";
+    wprintf(L"    %hs: heaps released on unload %.1f%%, overhead after unload %.3f\n",
+        hintsName, heapReleaseRate * 100.0, overheadAfterUnload);
+    resultsFile.WriteRow("%s,%u,%llu,%llu,%.4f,%.4f",
+        hintsName, levelCount, heapCountBeforeUnloadSum, releasedHeapCountSum, heapReleaseRate, overheadAfterUnload);
+}
+
+static void BenchmarkLifetimes(const wchar_t* resultsFilePrefix)
+{
+    wprintf(L"Benchmark lifetimes\n");
+
+    BenchmarkResultsFile resultsFile(resultsFilePrefix, L"Lifetimes",
+        "LifetimeHints,Levels,HeapsBeforeUnload,ReleasedHeaps,HeapReleaseRate,OverheadAfterUnload");
+
+    BenchmarkLifetimesCase(resultsFile, false);
+    BenchmarkLifetimesCase(resultsFile, true);
+}
+
+/*
+Creates many small committed resources, then releases them in random order. Measures average
+time of a single CreateResource and Release, which includes registering the allocation in and
+removing it from the list of committed allocations of the allocator.
+*/
+static void BenchmarkCommittedAllocationsCase(BenchmarkResultsFile& resultsFile, UINT allocationCount)
+{
+    SoftwareDeviceDesc deviceDesc = {};
+    deviceDesc.ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_2;
+    CComPtr<ID3D12Device> device;
+    CHECK_HR( CreateSoftwareDevice(deviceDesc, &device) );
+
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.pDevice = device;
+    D3D12MA::Allocator* allocator;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+
+    D3D12MA::ALLOCATION_DESC allocDesc = {};
+    allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+    allocDesc.Flags = D3D12MA::ALLOCATION_FLAG_COMMITTED;
+    D3D12_RESOURCE_DESC resourceDesc;
+    FillResourceDescForBuffer(resourceDesc, 65536);
+
+    std::vector<ResourceWithAllocation> resources(allocationCount);
+    const time_point createBeg = std::chrono::high_resolution_clock::now();
+    for(UINT i = 0; i < allocationCount; ++i)
+    {
+        D3D12MA::Allocation* alloc = nullptr;
+        CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+            &alloc, IID_PPV_ARGS(&resources[i].resource)) );
+        resources[i].allocation.reset(alloc);
+    }
+    const duration createDuration = std::chrono::high_resolution_clock::now() - createBeg;
+
+    RandomNumberGenerator rand(1);
+    for(UINT i = allocationCount; i > 1; --i)
+        std::swap(resources[i - 1], resources[rand.Generate() % i]);
+
+    const time_point releaseBeg = std::chrono::high_resolution_clock::now();
+    for(UINT i = 0; i < allocationCount; ++i)
+        resources[i] = ResourceWithAllocation();
+    const duration releaseDuration = std::chrono::high_resolution_clock::now() - releaseBeg;
+
+    resources.clear();
+    allocator->Release();
+
+    const double createNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(createDuration).count() / allocationCount;
+    const double releaseNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(releaseDuration).count() / allocationCount;
+
+    wprintf(L"    Allocations=%u: create %.1f ns, release %.1f ns\n", allocationCount, createNs, releaseNs);
+    resultsFile.WriteRow("%u,%.1f,%.1f", allocationCount, createNs, releaseNs);
+}
+
+static void BenchmarkCommittedAllocations(const wchar_t* resultsFilePrefix)
+{
+    wprintf(L"Benchmark committed allocations\n");
+
+    BenchmarkResultsFile resultsFile(resultsFilePrefix, L"CommittedAllocations",
+        "Allocations,CreateNanoseconds,ReleaseNanoseconds");
+
+    BenchmarkCommittedAllocationsCase(resultsFile, 1000);
+    BenchmarkCommittedAllocationsCase(resultsFile, 10000);
+    BenchmarkCommittedAllocationsCase(resultsFile, 100000);
+}
+
+/*
+Fills one heap with small placed buffers and releases every other one, leaving freeRangeCount
+free ranges in the block. Then repeatedly creates batchSize buffers, which take some of those
+ranges, and frees them at once with Allocator::FreeAllocations. Measures average time of
+FreeAllocations per allocation, which should depend on the batch, not on the number of free ranges.
+*/
+static void BenchmarkFreeAllocationsCase(BenchmarkResultsFile& resultsFile, UINT freeRangeCount, UINT batchSize)
+{
+    const UINT64 bufSize = 64 * 1024;
+    const UINT batchCount = 1000;
+
+    SoftwareDeviceDesc deviceDesc = {};
+    deviceDesc.ResourceHeapTier = D3D12_RESOURCE_HEAP_TIER_2;
+    CComPtr<ID3D12Device> device;
+    CHECK_HR( CreateSoftwareDevice(deviceDesc, &device) );
+
+    D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
+    allocatorDesc.pDevice = device;
+    allocatorDesc.PreferredBlockSize = 2 * freeRangeCount * bufSize;
+    D3D12MA::Allocator* allocator;
+    CHECK_HR( D3D12MA::CreateAllocator(&allocatorDesc, &allocator) );
+
+    D3D12MA::ALLOCATION_DESC allocDesc = {};
+    allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+    D3D12_RESOURCE_DESC resourceDesc;
+    FillResourceDescForBuffer(resourceDesc, bufSize);
+
+    std::vector<ResourceWithAllocation> resources(2 * freeRangeCount);
+    for(size_t i = 0; i < resources.size(); ++i)
+    {
+        D3D12MA::Allocation* alloc = nullptr;
+        CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+            &alloc, IID_PPV_ARGS(&resources[i].resource)) );
+        resources[i].allocation.reset(alloc);
+    }
+    for(size_t i = 1; i < resources.size(); i += 2)
+        resources[i] = ResourceWithAllocation();
+
+    std::vector<ResourceWithAllocation> batch(batchSize);
+    std::vector<D3D12MA::Allocation*> allocations(batchSize);
+    duration freeDuration = duration::zero();
+    for(UINT batchIndex = 0; batchIndex < batchCount; ++batchIndex)
+    {
+        for(UINT i = 0; i < batchSize; ++i)
+        {
+            D3D12MA::Allocation* alloc = nullptr;
+            CHECK_HR( allocator->CreateResource(&allocDesc, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL,
+                &alloc, IID_PPV_ARGS(&batch[i].resource)) );
+            batch[i].resource.Release();
+            allocations[i] = alloc;
+        }
+        const time_point freeBeg = std::chrono::high_resolution_clock::now();
+        allocator->FreeAllocations(batchSize, allocations.data());
+        freeDuration += std::chrono::high_resolution_clock::now() - freeBeg;
+    }
+
+    resources.clear();
+    allocator->Release();
+
+    const double freeNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(freeDuration).count() /
+        ((double)batchCount * batchSize);
+
+    wprintf(L"    FreeRanges=%u BatchSize=%u: free %.1f ns\n", freeRangeCount, batchSize, freeNs);
+    resultsFile.WriteRow("%u,%u,%.1f", freeRangeCount, batchSize, freeNs);
+}
+
+static void BenchmarkFreeAllocations(const wchar_t* resultsFilePrefix)
+{
+    wprintf(L"Benchmark free allocations\n");
+
+    BenchmarkResultsFile resultsFile(resultsFilePrefix, L"FreeAllocations",
+        "FreeRanges,BatchSize,FreeNanosecondsPerAllocation");
+
+    BenchmarkFreeAllocationsCase(resultsFile, 256, 16);
+    BenchmarkFreeAllocationsCase(resultsFile, 4096, 1);
+    BenchmarkFreeAllocationsCase(resultsFile, 4096, 16);
+}
+
+void Benchmark(const wchar_t* resultsFilePrefix)
+{
+    wprintf(L"BENCHMARKS BEGIN\n");
+
+    BenchmarkMetadata(resultsFilePrefix);
+    BenchmarkScaling(resultsFilePrefix);
+    BenchmarkFragmentation(resultsFilePrefix);
+    BenchmarkLifetimes(resultsFilePrefix);
+    BenchmarkCommittedAllocations(resultsFilePrefix);
+    BenchmarkFreeAllocations(resultsFilePrefix);
+
+    wprintf(L"BENCHMARKS END\n");
 }
 
 void Test(const TestContext& ctx)
@@ -542,6 +3494,7 @@ void Test(const TestContext& ctx)
         return;
     }
 
+    TestGroupVirtual(ctx);
     TestGroupBasics(ctx);
 
     wprintf(L"TESTS END\n");
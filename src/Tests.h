@@ -28,6 +28,12 @@ struct TestContext
 {
     ID3D12Device* device;
     D3D12MA::Allocator* allocator;
+    // True when device is a stand-in created with CreateSoftwareDevice.
+    // Tests that need to execute command lists are skipped then.
+    bool softwareDevice;
 };
 
 void Test(const TestContext& ctx);
+// Runs benchmarks. They don't need a GPU. Results are also appended to CSV files,
+// one per benchmark, with names starting with resultsFilePrefix.
+void Benchmark(const wchar_t* resultsFilePrefix);